@@ -0,0 +1,63 @@
+
+// Block compression quality and speed: encodes every texture of a scene directory in each BCn
+// format, decodes it again and reports the PSNR over the channels the format keeps, the encode
+// rate with rows of blocks split across threads, and the size against RGBA8. BC7 keeps the
+// textures' sRGB encoding, the others treat texels as linear like normal and metal-rough maps.
+//
+//     bench-bc [texture directory, default media/sponza]
+
+#include "bench.h"
+
+#include <cstdio>
+#include <util/bc.h>
+
+using namespace Util;
+
+int main(int argc, char** argv) {
+
+    std::string dir = argc > 1 ? argv[1] : "media/sponza";
+    std::vector<Image> textures;
+    for(const std::string& file : Bench::images_in(dir)) {
+        if(std::optional<Image> img = Image::load(file)) textures.push_back(std::move(*img));
+    }
+    if(textures.empty()) {
+        std::printf("no textures in %s\n", dir.c_str());
+        return 0;
+    }
+    std::printf("%zu textures in %s\n%-5s %10s %10s %10s %10s\n", textures.size(), dir.c_str(),
+                "", "mean dB", "min dB", "Mtexel/s", "MB");
+
+    for(BC_Format format : {BC_Format::bc1, BC_Format::bc4, BC_Format::bc5, BC_Format::bc7}) {
+
+        unsigned int channels = format == BC_Format::bc1   ? 3
+                                : format == BC_Format::bc4 ? 1
+                                : format == BC_Format::bc5 ? 2
+                                                           : 4;
+        double sum_db = 0.0, min_db = 1e30, ms = 0.0, texels = 0.0, bytes = 0.0;
+
+        for(const Image& t : textures) {
+            Image_Const_View src = t.view();
+            if(format != BC_Format::bc7) src.format = Image_Format::rgba8;
+
+            BC_Level level;
+            ms += Bench::time_ms([&] { level = bc_compress(src, format); }, 1);
+            bool srgb = src.format == Image_Format::rgba8_srgb;
+            Image decoded = bc_decompress(level.view(), format, srgb);
+
+            // Identical blocks give an infinite PSNR; count them as 60 dB
+            double db = std::min(psnr(src, decoded.view(), channels), 60.0);
+            sum_db += db;
+            min_db = std::min(min_db, db);
+            texels += (double)src.w * src.h;
+            bytes += (double)level.blocks.size();
+        }
+
+        std::printf("%-5s %10.2f %10.2f %10.1f %10.1f\n", format_name(format),
+                    sum_db / textures.size(), min_db, texels / ms * 1e-3, bytes / (1 << 20));
+    }
+
+    double raw = 0.0;
+    for(const Image& t : textures) raw += (double)t.bytes();
+    std::printf("RGBA8 %43.1f\n", raw / (1 << 20));
+    return 0;
+}
@@ -0,0 +1,47 @@
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Timing for the CPU benchmarks
+
+namespace Bench {
+
+/// Milliseconds f takes, best of runs
+template<typename F> double time_ms(F&& f, int runs = 5) {
+    double best = 1e30;
+    for(int i = 0; i < runs; i++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        f();
+        auto end = std::chrono::high_resolution_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+inline volatile double sink = 0.0;
+
+/// Keeps the compiler from dropping work whose result is unused
+inline void keep(double value) {
+    sink = value;
+}
+
+/// Image files directly in dir, sorted by name; empty if dir does not exist
+inline std::vector<std::string> images_in(const std::string& dir) {
+    std::vector<std::string> ret;
+    std::error_code err;
+    for(const auto& entry : std::filesystem::directory_iterator(dir, err)) {
+        std::string ext = entry.path().extension().string();
+        if(ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".tga") {
+            ret.push_back(entry.path().string());
+        }
+    }
+    std::sort(ret.begin(), ret.end());
+    return ret;
+}
+
+} // namespace Bench
@@ -0,0 +1,82 @@
+
+// Milliseconds per SVGF filter of a 1920x1080 frame at 1 to 8 a-trous passes: the scalar
+// reference on one thread against the SSE path split by rows across all threads. The frame is
+// tests/denoise's floor and wall, with the sky showing above the wall, at one noisy sample per
+// pixel so the filter takes the spatial variance estimate.
+//
+//     bench-denoise
+
+#include "bench.h"
+
+#include <cstdio>
+#include <lib/pack.h>
+#include <lib/rng.h>
+#include <util/denoise.h>
+#include <util/parallel.h>
+#include <vector>
+
+int main() {
+
+    const unsigned int w = 1920, h = 1080;
+    size_t n = (size_t)w * h;
+
+    Mat4 iV = Mat4::look_at(Vec3{0.0f, 1.5f, 4.0f}, Vec3{0.0f, 1.0f, 0.0f}).inverse();
+    Mat4 iP = Mat4::project(60.0f, (float)w / h, 0.1f).inverse();
+    Mat4 rays = Pack::ray_matrix(iV, iP);
+    Vec3 o = iV[3].xyz();
+
+    std::vector<float> color(n * 4, 1.0f), moments(n * 4, 0.0f);
+    std::vector<uint32_t> depth(n, 0), norm(n, 0), alb(n, 0);
+    RNG rng(1);
+    for(unsigned int y = 0; y < h; y++) {
+        for(unsigned int x = 0; x < w; x++) {
+            size_t i = (size_t)y * w + x;
+            Vec2 jitter{rng.unit(), rng.unit()};
+            Vec3 d = Pack::gbuf_ray(rays, x, y, jitter, w, h);
+            float v = 2.0f * rng.unit();
+            // Nearest of the floor y = 0 and the wall z = -2, which ends at y = 3
+            const float miss = 1e30f;
+            float t_floor = d.y < 0.0f ? -o.y / d.y : miss;
+            float t_wall = d.z < 0.0f ? (-2.0f - o.z) / d.z : miss;
+            if(o.y + t_wall * d.y > 3.0f) t_wall = miss;
+            float t = std::min(t_floor, t_wall);
+            if(t < miss) {
+                Vec3 p = o + t * d;
+                bool check = ((int)std::floor(p.x * 2.0f) + (int)std::floor(p.z * 2.0f)) & 1;
+                Vec3 a = t == t_floor ? Vec3{check ? 0.8f : 0.2f} : Vec3{0.7f, 0.4f, 0.3f};
+                depth[i] = Pack::pack_depth(t, jitter);
+                norm[i] = Pack::pack_normal(t == t_floor ? Vec3{0.0f, 1.0f, 0.0f}
+                                                         : Vec3{0.0f, 0.0f, 1.0f});
+                alb[i] = Pack::pack_albedo(a);
+                for(int c = 0; c < 3; c++) color[4 * i + c] = a[c] * v;
+            }
+            moments[4 * i + 0] = v;
+            moments[4 * i + 1] = v * v;
+            moments[4 * i + 2] = 1.0f;
+        }
+    }
+
+    Util::SVGF_Input in;
+    in.w = w;
+    in.h = h;
+    in.color = color.data();
+    in.moments = moments.data();
+    in.depth = depth.data();
+    in.norm = norm.data();
+    in.alb = alb.data();
+    in.rays = rays;
+
+    std::vector<float> out(n * 4);
+    std::printf("%ux%u, %u threads\n", w, h, Util::n_threads());
+    std::printf("%6s %14s %10s\n", "passes", "reference ms", "svgf ms");
+    for(int passes : {1, 2, 5, 8}) {
+        Util::SVGF_Params params;
+        params.iterations = passes;
+        double ref = Bench::time_ms([&] { Util::svgf_reference(in, params, out.data()); }, 1);
+        Bench::keep(out[n * 2]);
+        double simd = Bench::time_ms([&] { Util::svgf(in, params, out.data()); });
+        Bench::keep(out[n * 2]);
+        std::printf("%6d %14.1f %10.1f\n", passes, ref, simd);
+    }
+    return 0;
+}
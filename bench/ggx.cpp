@@ -0,0 +1,107 @@
+
+// Variance per sample of the GGX directional albedo estimate eval / pdf, for visible-normal
+// sampling (GGX_sample) against classic NDF sampling and uniform hemisphere sampling, over a
+// grid of roughness and view angles. Also times GGX_sample + GGX_pdf + GGX_eval.
+//
+//     bench-ggx
+
+#include "bench.h"
+
+#include <cstdio>
+#include <lib/ggx.h>
+#include <lib/rng.h>
+
+namespace {
+
+/// Half vectors drawn from D(h) cos(h); the sampler GGX_sample replaced
+bool ndf_sample(Vec2 Xi, float roughness, const GGX_Shade& sh, Vec3& wi, float& pdf) {
+    float a2 = roughness * roughness;
+    float phi = 2.0f * PI_F * Xi.x;
+    float c = std::sqrt((1.0f - Xi.y) / (1.0f + (a2 - 1.0f) * Xi.y));
+    float s = std::sqrt(1.0f - c * c);
+    Vec3 H = sh.T * (std::cos(phi) * s) + sh.B * (std::sin(phi) * s) + sh.N * c;
+    wi = GGX_reflect(sh.wo, H);
+    float iDh = std::max(dot(wi, H), 0.0f);
+    pdf = iDh > 0.0f ? GGX_D(c, a2) * c / (4.0f * iDh) : 0.0f;
+    return dot(wi, sh.N) > 0.0f;
+}
+
+struct Moments {
+    double mean = 0.0, variance = 0.0;
+};
+
+template<typename Sample> Moments estimate(Sample&& sample, int n) {
+    RNG rng(3);
+    double sum = 0.0, sq = 0.0;
+    for(int i = 0; i < n; i++) {
+        double f = sample(Vec2{rng.unit(), rng.unit()});
+        sum += f;
+        sq += f * f;
+    }
+    Moments m;
+    m.mean = sum / n;
+    m.variance = sq / n - m.mean * m.mean;
+    return m;
+}
+
+} // namespace
+
+int main() {
+
+    const int n = 400000;
+    std::printf("%5s %5s %7s | %9s %9s %9s\n", "rough", "cos", "albedo", "vndf var", "ndf var",
+                "unif var");
+
+    for(float roughness : {0.05f, 0.1f, 0.3f, 0.5f, 0.8f}) {
+        for(float cos_theta : {0.95f, 0.7f, 0.4f, 0.1f}) {
+
+            float sin_theta = std::sqrt(1.0f - cos_theta * cos_theta);
+            GGX_Shade sh{-Vec3{sin_theta, 0.0f, cos_theta}, Vec3{1.0f, 0.0f, 0.0f},
+                         Vec3{0.0f, 1.0f, 0.0f}, Vec3{0.0f, 0.0f, 1.0f}};
+            Vec3 white{1.0f};
+
+            Moments vndf = estimate(
+                [&](Vec2 u) {
+                    Vec3 wi;
+                    if(!GGX_sample(u, roughness, sh, wi)) return 0.0;
+                    float pdf = GGX_pdf(roughness, sh, wi);
+                    return pdf > 0.0f ? (double)GGX_eval(white, roughness, sh, wi).x / pdf : 0.0;
+                },
+                n);
+            Moments ndf = estimate(
+                [&](Vec2 u) {
+                    Vec3 wi;
+                    float pdf;
+                    if(!ndf_sample(u, roughness, sh, wi, pdf) || pdf <= 0.0f) return 0.0;
+                    return (double)GGX_eval(white, roughness, sh, wi).x / pdf;
+                },
+                n);
+            Moments uniform = estimate(
+                [&](Vec2 u) {
+                    float s = std::sqrt(1.0f - u.x * u.x), phi = 2.0f * PI_F * u.y;
+                    Vec3 wi{s * std::cos(phi), s * std::sin(phi), u.x};
+                    return (double)GGX_eval(white, roughness, sh, wi).x * 2.0 * PI_F;
+                },
+                n);
+
+            std::printf("%5.2f %5.2f %7.4f | %9.2e %9.2e %9.2e\n", roughness, cos_theta,
+                        vndf.mean, vndf.variance, ndf.variance, uniform.variance);
+        }
+    }
+
+    GGX_Shade sh{-Vec3{0.6f, 0.0f, 0.8f}, Vec3{1.0f, 0.0f, 0.0f}, Vec3{0.0f, 1.0f, 0.0f},
+                 Vec3{0.0f, 0.0f, 1.0f}};
+    const int samples = 1 << 20;
+    double ms = Bench::time_ms([&] {
+        RNG rng(1);
+        double sum = 0.0;
+        for(int i = 0; i < samples; i++) {
+            Vec3 wi;
+            if(!GGX_sample(Vec2{rng.unit(), rng.unit()}, 0.3f, sh, wi)) continue;
+            sum += GGX_eval(Vec3{1.0f}, 0.3f, sh, wi).x / GGX_pdf(0.3f, sh, wi);
+        }
+        Bench::keep(sum);
+    });
+    std::printf("sample + pdf + eval: %.1f ns\n", ms * 1e6 / samples);
+    return 0;
+}
@@ -0,0 +1,71 @@
+
+// Mip chain generation throughput: a full chain for a 2048^2 texture in each format and filter,
+// with the rows of each level split across threads, then every texture of a scene directory at
+// once, one texture per thread. Rates count the base level's texels.
+//
+//     bench-mipmap [texture directory, default media/sponza]
+
+#include "bench.h"
+
+#include <cstdio>
+#include <lib/rng.h>
+#include <util/mipmap.h>
+
+using namespace Util;
+
+namespace {
+
+Image noise(unsigned int size, Image_Format format) {
+    Image img(size, size, format);
+    RNG rng(1);
+    if(format == Image_Format::rgba8_srgb) {
+        for(size_t i = 0; i < img.bytes(); i++) {
+            img.data()[i] = (unsigned char)(rng.unit() * 256.0f);
+        }
+    } else {
+        Image src(size, size, Image_Format::rgba32f);
+        float* f = reinterpret_cast<float*>(src.data());
+        for(size_t i = 0; i < (size_t)size * size * 4; i++) f[i] = rng.unit() * 4.0f;
+        img = src.convert(format);
+    }
+    return img;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+
+    const unsigned int size = 2048;
+    std::printf("%-10s %-7s %9s %12s\n", "format", "filter", "ms", "Mtexel/s");
+    for(Image_Format format : {Image_Format::rgba8_srgb, Image_Format::rgba16f}) {
+        Image img = noise(size, format);
+        for(Mip_Filter filter : {Mip_Filter::box, Mip_Filter::kaiser}) {
+            double ms = Bench::time_ms(
+                [&] { Bench::keep((double)build_mips(img.view(), filter).size()); });
+            std::printf("%-10s %-7s %9.1f %12.1f\n", format_name(format),
+                        filter == Mip_Filter::box ? "box" : "kaiser", ms,
+                        (double)size * size / ms * 1e-3);
+        }
+    }
+
+    std::string dir = argc > 1 ? argv[1] : "media/sponza";
+    std::vector<Image> textures;
+    size_t texels = 0;
+    for(const std::string& file : Bench::images_in(dir)) {
+        if(std::optional<Image> img = Image::load(file)) {
+            texels += (size_t)img->w() * img->h();
+            textures.push_back(std::move(*img));
+        }
+    }
+    if(textures.empty()) {
+        std::printf("no textures in %s\n", dir.c_str());
+        return 0;
+    }
+
+    std::vector<Image_Const_View> views;
+    for(const Image& t : textures) views.push_back(t.view());
+    double ms = Bench::time_ms([&] { Bench::keep((double)build_mips(views).size()); }, 3);
+    std::printf("%zu textures in %s, %.1f Mtexel: %.1f ms, %.1f Mtexel/s\n", textures.size(),
+                dir.c_str(), texels * 1e-6, ms, texels / ms * 1e-3);
+    return 0;
+}
@@ -0,0 +1,67 @@
+
+// Radiance cache throughput: inserts and then looks up 16M random points in a 10 m box from all
+// threads at once, with the default table and cell sizes. Also reports how full the table got
+// and the lookup hit rate.
+//
+//     bench-radiance_cache
+
+#include "bench.h"
+
+#include <atomic>
+#include <cstdio>
+#include <lib/rng.h>
+#include <util/parallel.h>
+#include <util/radiance_cache.h>
+
+using namespace Util;
+
+namespace {
+
+const size_t POINTS = size_t(1) << 24, BATCHES = 256;
+
+Vec3 point(RNG& rng) {
+    return Vec3{rng.unit(), rng.unit(), rng.unit()} * 10.0f;
+}
+
+} // namespace
+
+int main() {
+
+    Radiance_Cache cache;
+    const Vec3 up{0.0f, 1.0f, 0.0f}, camera{5.0f};
+
+    double insert_ms = Bench::time_ms(
+        [&] {
+            cache.clear();
+            parallel_for(0, BATCHES, [&](size_t b) {
+                RNG rng((uint32_t)b);
+                for(size_t i = 0; i < POINTS / BATCHES; i++) {
+                    Vec3 x = point(rng);
+                    cache.insert(x, up, (x - camera).norm(), Vec3{1.0f});
+                }
+            });
+        },
+        3);
+
+    std::atomic<size_t> hits{0};
+    double lookup_ms = Bench::time_ms(
+        [&] {
+            hits = 0;
+            parallel_for(0, BATCHES, [&](size_t b) {
+                RNG rng((uint32_t)(b + BATCHES));
+                size_t h = 0;
+                for(size_t i = 0; i < POINTS / BATCHES; i++) {
+                    Vec3 x = point(rng), v;
+                    h += cache.lookup(x, up, (x - camera).norm(), v);
+                }
+                hits += h;
+            });
+        },
+        3);
+
+    std::printf("%u threads: insert %.1f M/s, lookup %.1f M/s\n", n_threads(),
+                POINTS / insert_ms * 1e-3, POINTS / lookup_ms * 1e-3);
+    std::printf("occupied %zu of %zu, dropped %zu, hit rate %.3f\n", cache.occupied(),
+                cache.capacity(), cache.dropped(), (double)hits / POINTS);
+    return 0;
+}
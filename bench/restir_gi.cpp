@@ -0,0 +1,76 @@
+
+// Equal-time error of ReSTIR GI against plain path tracing, on the CPU reference integrator's
+// box at 64x64. Both estimate the indirect light at the primary hits; each gets the frames that
+// fit in a time budget, measured from a short run, and reports its RMSE relative to a 2048 frame
+// path traced reference. The last rows compare single frames as seen in real time, after 16
+// frames of temporal history.
+//
+//     bench-restir_gi
+
+#include "bench.h"
+
+#include <cstdio>
+#include <util/restir_gi.h>
+
+using namespace Util;
+
+namespace {
+
+GI_Params indirect(bool restir, int frames) {
+    GI_Params params;
+    params.w = 64;
+    params.h = 64;
+    params.frames = frames;
+    params.restir = restir;
+    params.direct = false;
+    return params;
+}
+
+std::vector<Vec3> render(const GI_Params& params) {
+    std::vector<Vec3> out;
+    gi_render(GI_Scene::box(), params, out);
+    return out;
+}
+
+double rel_rmse(const std::vector<Vec3>& img, const std::vector<Vec3>& ref) {
+    double se = 0.0, ref_sq = 0.0;
+    for(size_t i = 0; i < img.size(); i++) {
+        for(int c = 0; c < 3; c++) {
+            se += (img[i][c] - ref[i][c]) * (img[i][c] - ref[i][c]);
+            ref_sq += ref[i][c] * ref[i][c];
+        }
+    }
+    return std::sqrt(se / ref_sq);
+}
+
+} // namespace
+
+int main() {
+
+    std::vector<Vec3> ref = render(indirect(false, 2048));
+
+    const char* names[2] = {"path tracing", "ReSTIR GI"};
+    double frame_ms[2];
+    for(int r = 0; r < 2; r++) {
+        frame_ms[r] = Bench::time_ms([&] { render(indirect(r == 1, 16)); }, 3) / 16.0;
+    }
+    std::printf("%-14s %8.2f ms per frame\n%-14s %8.2f ms per frame\n\n", names[0], frame_ms[0],
+                names[1], frame_ms[1]);
+
+    std::printf("%-10s %-14s %8s %10s\n", "budget", "", "frames", "rel. RMSE");
+    for(double budget : {50.0, 200.0, 800.0, 3200.0}) {
+        for(int r = 0; r < 2; r++) {
+            int frames = std::max((int)(budget / frame_ms[r]), 1);
+            double error = rel_rmse(render(indirect(r == 1, frames)), ref);
+            std::printf("%7.0f ms %-14s %8d %10.4f\n", budget, names[r], frames, error);
+        }
+    }
+
+    std::printf("\n%-25s %10s\n", "single frame", "rel. RMSE");
+    for(int r = 0; r < 2; r++) {
+        GI_Params params = indirect(r == 1, 16);
+        params.accumulate = false;
+        std::printf("%-25s %10.4f\n", names[r], rel_rmse(render(params), ref));
+    }
+    return 0;
+}
@@ -0,0 +1,80 @@
+
+// Convergence of Owen-scrambled Sobol against the Hammersley set and independent random points:
+// RMS error over 64 randomizations of two integrals on [0,1)^2, a smooth Gaussian and a
+// discontinuous disk, at power-of-two sample counts. Hammersley is randomized by a random toroidal
+// shift per trial, and unlike Sobol it needs n up front. Also times point generation.
+//
+//     bench-sobol
+
+#include "bench.h"
+
+#include <cmath>
+#include <cstdio>
+#include <lib/rng.h>
+#include <lib/sobol.h>
+
+namespace {
+
+double gaussian(Vec2 p) {
+    double x = p.x - 0.5, y = p.y - 0.5;
+    return std::exp(-8.0 * (x * x + y * y));
+}
+double disk(Vec2 p) {
+    double x = p.x - 0.5, y = p.y - 0.5;
+    return x * x + y * y < 0.16 ? 1.0 : 0.0;
+}
+
+template<typename F, typename Point>
+double rms_error(F&& f, double exact, uint32_t n, Point&& point) {
+    const uint32_t trials = 64;
+    double sq = 0.0;
+    for(uint32_t t = 0; t < trials; t++) {
+        double sum = 0.0;
+        for(uint32_t i = 0; i < n; i++) sum += f(point(i, t));
+        double err = sum / n - exact;
+        sq += err * err;
+    }
+    return std::sqrt(sq / trials);
+}
+
+template<typename F> void convergence(const char* name, F&& f, double exact) {
+
+    std::printf("%s\n%8s %12s %12s %12s %8s\n", name, "n", "sobol", "hammersley", "random",
+                "ratio");
+    for(uint32_t n = 16; n <= 16384; n *= 4) {
+        double s = rms_error(f, exact, n, [](uint32_t i, uint32_t t) {
+            return Sobol::sample_2d(i, 0, Sobol::hash(t + 1));
+        });
+        double h = rms_error(f, exact, n, [n](uint32_t i, uint32_t t) {
+            RNG rng(t + 1, 0, 0, 0);
+            float dx = rng.unit(), dy = rng.unit();
+            float x = (float)i / n + dx, y = Sobol::to_float(Sobol::reverse_bits(i)) + dy;
+            return Vec2{x - std::floor(x), y - std::floor(y)};
+        });
+        double r = rms_error(f, exact, n, [n](uint32_t i, uint32_t t) {
+            RNG rng(t * n + i + 1, 0, 0, 0);
+            return Vec2{rng.unit(), rng.unit()};
+        });
+        std::printf("%8u %12.3e %12.3e %12.3e %8.1f\n", n, s, h, r, r / s);
+    }
+}
+
+} // namespace
+
+int main() {
+
+    // Exact values: the Gaussian's integral is separable, the disk's is its area
+    const double pi = 3.14159265358979323846;
+    double g = std::sqrt(pi / 8.0) * std::erf(std::sqrt(8.0) * 0.5);
+    convergence("gaussian", gaussian, g * g);
+    convergence("disk", disk, pi * 0.16);
+
+    const uint32_t n = 1 << 20;
+    double ms = Bench::time_ms([] {
+        double sum = 0.0;
+        for(uint32_t i = 0; i < n; i++) sum += Sobol::sample_2d(i, 3, 42).x;
+        Bench::keep(sum);
+    });
+    std::printf("sample_2d: %.1f ns per point\n", ms * 1e6 / n);
+    return 0;
+}
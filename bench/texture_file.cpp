@@ -0,0 +1,153 @@
+
+// Texture load time: decoding a scene's PNG and JPEG textures with stb, on one thread and on
+// all of them, against mapping and parsing the same textures as BC7 mip chains in KTX2 and DDS
+// containers, and then copying their blocks out as a staging upload would. The containers are
+// written to a temporary directory first; encoding goes through the texture cache, so it is
+// only slow on the first run.
+//
+//     bench-texture_file [texture directory, default media/sponza]
+
+#include "bench.h"
+
+#include <cstdio>
+#include <cstring>
+#include <util/parallel.h>
+#include <util/texture_file.h>
+
+using namespace Util;
+
+namespace {
+
+void put32(std::vector<unsigned char>& v, size_t at, uint32_t x) {
+    std::memcpy(&v[at], &x, 4);
+}
+void put64(std::vector<unsigned char>& v, size_t at, uint64_t x) {
+    std::memcpy(&v[at], &x, 8);
+}
+
+/// DDS with a DX10 header, levels base first
+std::vector<unsigned char> dds(const BC_Texture& t) {
+    // DXGI_FORMAT_BC7_UNORM(_SRGB)
+    std::vector<unsigned char> v(148);
+    std::memcpy(&v[0], "DDS ", 4);
+    put32(v, 4, 124);
+    put32(v, 12, t.levels[0].h);
+    put32(v, 16, t.levels[0].w);
+    put32(v, 28, (uint32_t)t.levels.size());
+    put32(v, 76, 32);
+    put32(v, 80, 4);
+    std::memcpy(&v[84], "DX10", 4);
+    put32(v, 128, t.srgb ? 99 : 98);
+    put32(v, 132, 3);
+    put32(v, 140, 1);
+    for(const BC_Level& l : t.levels) v.insert(v.end(), l.blocks.begin(), l.blocks.end());
+    return v;
+}
+
+/// KTX2 without supercompression; the level index lists the base first, the data stores the
+/// smallest level first
+std::vector<unsigned char> ktx2(const BC_Texture& t) {
+    const unsigned char id[12] = {0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n'};
+    size_t n = t.levels.size();
+    std::vector<unsigned char> v(80 + n * 24);
+    std::memcpy(&v[0], id, 12);
+    // VK_FORMAT_BC7_UNORM(_SRGB)_BLOCK
+    put32(v, 12, t.srgb ? 146 : 145);
+    put32(v, 16, 1);
+    put32(v, 20, t.levels[0].w);
+    put32(v, 24, t.levels[0].h);
+    put32(v, 36, 1);
+    put32(v, 40, (uint32_t)n);
+    for(size_t l = n; l-- > 0;) {
+        while(v.size() % 16) v.push_back(0);
+        size_t size = t.levels[l].blocks.size();
+        put64(v, 80 + l * 24, v.size());
+        put64(v, 88 + l * 24, size);
+        put64(v, 96 + l * 24, size);
+        v.insert(v.end(), t.levels[l].blocks.begin(), t.levels[l].blocks.end());
+    }
+    return v;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+
+    std::string dir = argc > 1 ? argv[1] : "media/sponza";
+    std::string out = (std::filesystem::temp_directory_path() / "gpurt-bench-textures").string();
+    std::filesystem::create_directories(out);
+
+    std::vector<std::string> sources, containers[2];
+    size_t source_bytes = 0, block_bytes = 0;
+    for(const std::string& file : Bench::images_in(dir)) {
+        std::optional<Image> img = Image::load(file);
+        if(!img) continue;
+        BC_Texture t = bc_texture(img->view(), BC_Format::bc7, "texture_cache");
+        std::string base = out + "/" + std::to_string(sources.size());
+        std::vector<unsigned char> d = dds(t), k = ktx2(t);
+        if(!File::write(base + ".dds", d.data(), d.size()) ||
+           !File::write(base + ".ktx2", k.data(), k.size())) {
+            std::printf("cannot write to %s\n", out.c_str());
+            return 1;
+        }
+        sources.push_back(file);
+        containers[0].push_back(base + ".ktx2");
+        containers[1].push_back(base + ".dds");
+        source_bytes += std::filesystem::file_size(file);
+        block_bytes += t.bytes();
+    }
+    if(sources.empty()) {
+        std::printf("no textures in %s\n", dir.c_str());
+        return 0;
+    }
+    size_t n = sources.size();
+    std::printf("%zu textures in %s: %.1f MB of images, %.1f MB of BC7 mip chains\n", n,
+                dir.c_str(), source_bytes / 1048576.0, block_bytes / 1048576.0);
+
+    double stb_1 = Bench::time_ms(
+        [&] {
+            for(const std::string& s : sources) {
+                Image img;
+                img.reload(s);
+                Bench::keep((double)img.bytes());
+            }
+        },
+        3);
+    double stb_n = Bench::time_ms(
+        [&] {
+            std::vector<Image> imgs(n);
+            parallel_for(0, n, [&](size_t i) { imgs[i].reload(sources[i]); });
+            Bench::keep((double)imgs.back().bytes());
+        },
+        3);
+    std::string threads = "stb, " + std::to_string(n_threads()) + " threads";
+    std::printf("%-19s %10.1f ms\n%-19s %10.1f ms\n", "stb, 1 thread", stb_1, threads.c_str(),
+                stb_n);
+
+    const char* names[2] = {"KTX2", "DDS"};
+    for(int c = 0; c < 2; c++) {
+        std::vector<BC_File> files(n);
+        size_t failed = 0;
+        double parse = Bench::time_ms(
+            [&] {
+                failed = 0;
+                for(size_t i = 0; i < n; i++) failed += !load_bc_file(containers[c][i], files[i]);
+            },
+            3);
+        // Touches every block, as copying into a staging buffer does
+        std::vector<unsigned char> staging(block_bytes);
+        double copy = Bench::time_ms([&] {
+            size_t at = 0;
+            for(const BC_File& f : files) {
+                for(const BC_Level_View& l : f.levels) {
+                    std::memcpy(staging.data() + at, l.blocks, l.size);
+                    at += l.size;
+                }
+            }
+            Bench::keep(staging[at / 2]);
+        });
+        std::printf("%-4s map and parse %10.2f ms, %.1f ms with the copy%s\n", names[c], parse,
+                    parse + copy, failed ? " (some failed to load)" : "");
+    }
+    return 0;
+}
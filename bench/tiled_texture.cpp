@@ -0,0 +1,157 @@
+
+// Tiled against row-major texel layout: eight-wide trilinear lookups into the mip chains of a
+// scene's textures, once with each Tiled_Texture layout and once through the scalar
+// Texture_Sampler over plain row-major images. Access patterns range from fully incoherent, like
+// secondary bounces, to neighbouring pixels of a scanline or a column, to lookups clustered in a
+// window that moves every few thousand lookups. Rates are in millions of lookups per second.
+//
+//     bench-tiled_texture [texture directory, default media/sponza]
+
+#include "bench.h"
+
+#include <cstdio>
+#include <lib/rng.h>
+#include <util/mipmap.h>
+#include <util/texture_sampler.h>
+#include <util/tiled_texture.h>
+
+using namespace Util;
+
+namespace {
+
+const size_t LOOKUPS = 1 << 22;
+
+/// Eight lookups into one texture
+struct Query {
+    size_t texture;
+    Lookup8 in;
+};
+
+enum class Pattern { incoherent, incoherent_lods, scanline, column, window_64, window_256 };
+
+const char* pattern_name(Pattern p) {
+    switch(p) {
+    case Pattern::incoherent: return "incoherent lod 0";
+    case Pattern::incoherent_lods: return "incoherent lod 0-4";
+    case Pattern::scanline: return "scanline";
+    case Pattern::column: return "column";
+    case Pattern::window_64: return "window 64 texels";
+    case Pattern::window_256: return "window 256 texels";
+    }
+    return "";
+}
+
+std::vector<Query> queries(Pattern pattern, size_t textures) {
+
+    std::vector<Query> qs(LOOKUPS / 8);
+    RNG rng(7);
+    for(size_t q = 0; q < qs.size(); q++) {
+        Lookup8& in = qs[q].in;
+        qs[q].texture = (size_t)(rng.unit() * textures) % textures;
+
+        // Windows move every 4096 lookups
+        RNG window((uint32_t)(q / 512) + 1);
+        Vec2 corner{window.unit(), window.unit()};
+        size_t window_texture = (size_t)(window.unit() * textures) % textures;
+
+        for(int i = 0; i < 8; i++) {
+            // Position along a 1024 pixel scanline or column, one texel apart at lod 0
+            size_t p = q * 8 + i;
+            float along = (p % 1024) / 1024.0f, across = ((p / 1024) % 1024) / 1024.0f;
+            in.lod[i] = 0.0f;
+            switch(pattern) {
+            case Pattern::incoherent:
+            case Pattern::incoherent_lods:
+                in.u[i] = rng.unit();
+                in.v[i] = rng.unit();
+                if(pattern == Pattern::incoherent_lods) in.lod[i] = rng.unit() * 4.0f;
+                break;
+            case Pattern::scanline:
+            case Pattern::column:
+                in.u[i] = pattern == Pattern::scanline ? along : across;
+                in.v[i] = pattern == Pattern::scanline ? across : along;
+                qs[q].texture = (p >> 20) % textures;
+                break;
+            case Pattern::window_64:
+            case Pattern::window_256: {
+                float size = (pattern == Pattern::window_64 ? 64.0f : 256.0f) / 1024.0f;
+                in.u[i] = corner.x + rng.unit() * size;
+                in.v[i] = corner.y + rng.unit() * size;
+                qs[q].texture = window_texture;
+            } break;
+            }
+        }
+    }
+    return qs;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+
+    std::string dir = argc > 1 ? argv[1] : "media/sponza";
+    std::vector<Image> bases;
+    for(const std::string& file : Bench::images_in(dir)) {
+        if(std::optional<Image> img = Image::load(file)) bases.push_back(std::move(*img));
+    }
+    if(bases.empty()) {
+        std::printf("no textures in %s\n", dir.c_str());
+        return 0;
+    }
+
+    std::vector<std::vector<Image>> mips = build_mips([&] {
+        std::vector<Image_Const_View> views;
+        for(const Image& b : bases) views.push_back(b.view());
+        return views;
+    }());
+
+    std::vector<Texture_Sampler> naive;
+    std::vector<Tiled_Texture> row_major, tiled;
+    size_t bytes = 0;
+    for(size_t i = 0; i < bases.size(); i++) {
+        std::vector<Image_Const_View> levels = {bases[i].view()};
+        for(const Image& m : mips[i]) levels.push_back(m.view());
+        naive.emplace_back(levels);
+        row_major.emplace_back(levels, Texel_Layout::row_major);
+        tiled.emplace_back(levels, Texel_Layout::tiled);
+        bytes += tiled.back().bytes();
+    }
+    std::printf("%zu textures in %s, %zu MB per layout\n", bases.size(), dir.c_str(), bytes >> 20);
+    std::printf("%-20s %12s %12s %12s\n", "", "scalar", "row-major", "tiled");
+
+    for(Pattern pattern : {Pattern::incoherent, Pattern::incoherent_lods, Pattern::scanline,
+                           Pattern::column, Pattern::window_64, Pattern::window_256}) {
+
+        std::vector<Query> qs = queries(pattern, bases.size());
+        double scalar_ms = Bench::time_ms(
+            [&] {
+                float sum = 0.0f;
+                for(const Query& q : qs) {
+                    for(int i = 0; i < 8; i++) {
+                        Vec2 uv{q.in.u[i], q.in.v[i]};
+                        sum += naive[q.texture].sample(uv, q.in.lod[i]).x;
+                    }
+                }
+                Bench::keep(sum);
+            },
+            3);
+        auto wide = [&](const std::vector<Tiled_Texture>& textures) {
+            return Bench::time_ms(
+                [&] {
+                    float sum = 0.0f;
+                    Texel8 out;
+                    for(const Query& q : qs) {
+                        textures[q.texture].sample8(q.in, out);
+                        sum += out.r[3];
+                    }
+                    Bench::keep(sum);
+                },
+                3);
+        };
+        double row_ms = wide(row_major), tiled_ms = wide(tiled);
+
+        std::printf("%-20s %12.1f %12.1f %12.1f\n", pattern_name(pattern),
+                    LOOKUPS / scalar_ms * 1e-3, LOOKUPS / row_ms * 1e-3, LOOKUPS / tiled_ms * 1e-3);
+    }
+    return 0;
+}
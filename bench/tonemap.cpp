@@ -0,0 +1,51 @@
+
+// Milliseconds to tonemap one 3840x2160 RGBA32F frame to RGBA8, per curve: the scalar
+// reference on one thread against the SSE path split by rows across all threads.
+//
+//     bench-tonemap
+
+#include "bench.h"
+
+#include <cstdio>
+#include <lib/rng.h>
+#include <util/parallel.h>
+#include <util/tonemap.h>
+#include <vector>
+
+using namespace Util;
+
+int main() {
+    const unsigned int w = 3840, h = 2160;
+    size_t n = (size_t)w * h;
+
+    // HDR values spread over roughly [0, 16), the range a path traced frame spans
+    std::vector<float> in(n * 4);
+    RNG rng(0, 0, 0, 0);
+    for(size_t i = 0; i < n * 4; i++) {
+        float u = rng.unit();
+        in[i] = i % 4 == 3 ? 1.0f : u * u * 16.0f;
+    }
+    std::vector<unsigned char> out(n * 4);
+
+    std::printf("%ux%u, %u threads\n", w, h, n_threads());
+    std::printf("%-12s %14s %10s\n", "curve", "reference ms", "run ms");
+
+    const struct {
+        const char* name;
+        Tonemap_Curve curve;
+    } curves[] = {{"uncharted2", Tonemap_Curve::uncharted2},
+                  {"exponential", Tonemap_Curve::exponential},
+                  {"none", Tonemap_Curve::none}};
+
+    for(auto& c : curves) {
+        Tonemap_Params p;
+        p.curve = c.curve;
+        Tonemapper tonemap(p);
+        double ref = Bench::time_ms([&] { tonemap.reference(in.data(), out.data(), n); }, 3);
+        Bench::keep(out[n * 2]);
+        double run = Bench::time_ms([&] { tonemap.run(in.data(), out.data(), w, h); });
+        Bench::keep(out[n * 2]);
+        std::printf("%-12s %14.2f %10.2f\n", c.name, ref, run);
+    }
+    return 0;
+}
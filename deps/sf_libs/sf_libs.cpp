@@ -10,5 +10,6 @@
 #define STB_IMAGE_IMPLEMENTATION
 
 #define TINYGLTF_NOEXCEPTION
+#define TINYGLTF_NO_EXTERNAL_IMAGE
 #define TINYGLTF_IMPLEMENTATION
 #include "tiny_gltf.h"
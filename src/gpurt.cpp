@@ -3,10 +3,9 @@
 
 #include <algorithm>
 #include <chrono>
+#include <cstdio>
 #include <imgui/imgui.h>
 #include <nfd/nfd.h>
-#include <sf_libs/stb_image_write.h>
-#include <util/image.h>
 
 GPURT::GPURT(Window& window, std::string scene_file) : window(window), cam(window.drawable()) {
 
@@ -35,6 +34,7 @@ void GPURT::render() {
     Frame& f = frames[vk.frame()];
 
     VkCommandBuffer cmds = vk.begin();
+    finish_capture();
 
     if(use_rt) {
         build_accel();
@@ -43,16 +43,28 @@ void GPURT::render() {
         rt_pipe.use_accel(TLAS);
         rt_pipe.update_uniforms(cam);
         rt_pipe.trace(cam, cmds, {rt_target->w, rt_target->h});
-
-        rt_target->transition(cmds, VK_IMAGE_LAYOUT_GENERAL,
-                              VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-        effect_pass->begin(cmds, f.ef_fb, {});
-        effect_pipe.tonemap(cmds, rt_target_view);
-        effect_pass->end(cmds);
-
-        rt_target->transition(cmds, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                              VK_IMAGE_LAYOUT_GENERAL);
+        if(save_requested) capture_rt(cmds);
+
+        auto present = [&](VK::Image& image, VK::ImageView& view) {
+            image.transition(cmds, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+            effect_pass->begin(cmds, f.ef_fb, {});
+            effect_pipe.tonemap(cmds, view);
+            effect_pass->end(cmds);
+
+            image.transition(cmds, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+        };
+
+        if(use_denoiser) {
+            unsigned int g = rt_pipe.gbuf();
+            denoise_pipe.denoise(cmds, rt_target_view, rt_pipe.moments_image_view[g],
+                                 rt_pipe.pos_image_view[g], rt_pipe.norm_image_view[g],
+                                 rt_pipe.alb_image_view[g], rt_pipe.gbuf_rays(),
+                                 rt_pipe.history());
+            present(denoise_pipe.output_image(), denoise_pipe.output());
+        } else {
+            present(rt_target, rt_target_view);
+        }
 
     } else {
         VkClearValue col, depth;
@@ -188,7 +200,8 @@ void GPURT::build_images() {
 
     rt_target->recreate(
         ext.width, ext.height, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        VMA_MEMORY_USAGE_GPU_ONLY);
     rt_target->transition(VK_IMAGE_LAYOUT_GENERAL);
     rt_target_view->recreate(rt_target, VK_IMAGE_ASPECT_COLOR_BIT);
 }
@@ -201,6 +214,7 @@ void GPURT::build_pipe() {
     // VkExtent2D ext = {3840, 2160};
 
     effect_pipe.recreate(effect_pass, ext);
+    denoise_pipe.recreate(ext);
     mesh_pipe.recreate(mesh_pass, ext);
     rt_pipe.recreate(scene);
 
@@ -255,10 +269,123 @@ void GPURT::load_scene() {
     build_accel();
 }
 
+void GPURT::load_env() {
+
+    char* path = nullptr;
+    NFD_OpenDialog(image_file_types, nullptr, &path);
+    if(!path) return;
+
+    bool loaded = scene.load_env(std::string(path));
+    free(path);
+    if(!loaded) return;
+
+    if(rt_pipe.env_scale == 0.0f) rt_pipe.env_scale = 1.0f;
+    rt_pipe.recreate(scene);
+}
+
 void GPURT::save_rt() {
-    auto& buf = frames[VK::vk().frame()].color;
-    Util::Image img = buf->read();
-    stbi_write_png("out.png", buf->w, buf->h, 4, img.data(), buf->w * 4);
+    save_requested = true;
+}
+
+void GPURT::capture_rt(VkCommandBuffer& cmds) {
+
+    Capture& c = frames[VK::vk().frame()].capture;
+    save_requested = false;
+
+    // This frame's fence was waited on, so the buffers are free to resize
+    if(c.w != rt_target->w || c.h != rt_target->h) {
+        size_t n = (size_t)rt_target->w * rt_target->h;
+        c.color->recreate(n * 4 * sizeof(float), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                          VMA_MEMORY_USAGE_GPU_TO_CPU);
+        c.depth->recreate(n * sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                          VMA_MEMORY_USAGE_GPU_TO_CPU);
+        c.normal->recreate(n * sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                           VMA_MEMORY_USAGE_GPU_TO_CPU);
+        c.albedo->recreate(n * sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                           VMA_MEMORY_USAGE_GPU_TO_CPU);
+        c.w = rt_target->w;
+        c.h = rt_target->h;
+    }
+
+    c.settings = output;
+    c.settings.tonemap.curve = (Util::Tonemap_Curve)effect_pipe.tonemap_type;
+    c.settings.tonemap.exposure = effect_pipe.exposure;
+    c.settings.tonemap.gamma = effect_pipe.gamma;
+    c.path = output.path(n_saved++);
+    c.aovs = output.aovs && output.format != Util::Output_Format::png;
+
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(cmds,
+                         VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR |
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    // rt_target and the G-buffer just traced are both in GENERAL
+    c.color->from_image(cmds, rt_target);
+    if(c.aovs) {
+        unsigned int g = rt_pipe.gbuf();
+        c.depth->from_image(cmds, rt_pipe.pos_image[g]);
+        c.normal->from_image(cmds, rt_pipe.norm_image[g]);
+        c.albedo->from_image(cmds, rt_pipe.alb_image[g]);
+    }
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(cmds, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1,
+                         &barrier, 0, nullptr, 0, nullptr);
+
+    c.pending = true;
+}
+
+void GPURT::finish_capture() {
+
+    // Called after begin_frame() waited on this frame's fence, so the copies have landed
+    Capture& c = frames[VK::vk().frame()].capture;
+    if(!c.pending) return;
+    c.pending = false;
+
+    size_t n = (size_t)c.w * c.h;
+    Util::Output_Frame out = writer.acquire(c.w, c.h, c.aovs);
+    c.color->read(out.color.data(), n * 4 * sizeof(float));
+    if(c.aovs) {
+        c.depth->read(out.depth.data(), n * sizeof(uint32_t));
+        c.normal->read(out.normal.data(), n * sizeof(uint32_t));
+        c.albedo->read(out.albedo.data(), n * sizeof(uint32_t));
+    }
+    out.path = c.path;
+    out.settings = c.settings;
+    writer.submit(std::move(out));
+}
+
+bool GPURT::render_reference(const std::string& name, Util::Trace_Params params) {
+
+    Vec2 dim = window.drawable();
+    params.w = (unsigned int)dim.x;
+    params.h = (unsigned int)dim.y;
+
+    Util::Tracer_Scene tracer(scene);
+    std::vector<Vec3> image;
+    auto start = std::chrono::steady_clock::now();
+    int iterations = Util::path_trace(tracer, cam, params, image);
+    std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+    info("Traced %ux%u at %d spp in %d iterations, %.1fs", params.w, params.h, params.spp,
+         iterations, time.count());
+
+    Util::Output_Frame out = writer.acquire(params.w, params.h, false);
+    for(size_t i = 0; i < image.size(); i++) {
+        out.color[4 * i + 0] = image[i].x;
+        out.color[4 * i + 1] = image[i].y;
+        out.color[4 * i + 2] = image[i].z;
+        out.color[4 * i + 3] = 1.0f;
+    }
+    out.settings = output;
+    out.settings.name = name;
+    out.settings.aovs = false;
+    out.path = out.settings.path(0);
+    return Util::Image_Writer::write(out);
 }
 
 void GPURT::UIsidebar() {
@@ -276,6 +403,8 @@ void GPURT::UIsidebar() {
 
     ImGui::Text("Edit Scene");
     if(ImGui::Button("Open Scene")) load_scene();
+    ImGui::SameLine();
+    if(ImGui::Button("Open Env Map")) load_env();
     ImGui::Separator();
 
     bool change = false;
@@ -289,6 +418,35 @@ void GPURT::UIsidebar() {
     }
     change = change || ImGui::Checkbox("Normal Maps", &rt_pipe.use_normal_map);
     change = change || ImGui::Checkbox("Metalness", &rt_pipe.use_metalness);
+    change = change || ImGui::Checkbox("Ray Cone LOD", &rt_pipe.use_ray_cones);
+
+    ImGui::DragInt("Texture MB", &rt_pipe.texture_budget, 8.0f, 0, 65536);
+    if(ImGui::IsItemDeactivatedAfterEdit()) build_rt();
+    ImGui::Text("Textures: %zu / %zu MB", rt_pipe.texture_bytes >> 20,
+                rt_pipe.texture_full_bytes >> 20);
+
+    VK::Uploader::Stats uploads = VK::vk().uploads().stats();
+    ImGui::Text("Uploads: %s queue", uploads.dedicated ? "transfer" : "graphics");
+    if(uploads.staged) {
+        char progress[64];
+        std::snprintf(progress, sizeof(progress), "%zu / %zu MB", uploads.copied >> 20,
+                      uploads.staged >> 20);
+        ImGui::ProgressBar((float)uploads.copied / uploads.staged, ImVec2(-1.0f, 0.0f), progress);
+    }
+
+    if(ImGui::Checkbox("Virtual Textures", &rt_pipe.use_virtual_textures)) build_rt();
+    if(rt_pipe.use_virtual_textures) {
+        // Atlases are limited to 16384 texels a side, 120x120 slots
+        ImGui::DragInt("VT Pages", &rt_pipe.vt_pages, 16.0f, 64, 14400);
+        if(ImGui::IsItemDeactivatedAfterEdit()) build_rt();
+        ImGui::SliderInt("VT Uploads", &rt_pipe.vt_uploads, 1, 256);
+        if(ImGui::IsItemDeactivatedAfterEdit()) build_rt();
+        if(const auto* stats = rt_pipe.vt_stats()) {
+            ImGui::Text("Pages: %zu resident, %zu missing, %zu pending", stats->resident,
+                        stats->missing, stats->pending);
+            ImGui::Text("Uploaded %zu, evicted %zu", stats->uploaded, stats->evicted);
+        }
+    }
 
     ImGui::Separator();
 
@@ -297,20 +455,33 @@ void GPURT::UIsidebar() {
     change = change || ImGui::SliderInt("Depth", &rt_pipe.max_depth, 1, 32);
     change = change || ImGui::Checkbox("Roulette", &rt_pipe.use_rr);
     change = change || ImGui::Checkbox("QMC", &rt_pipe.use_qmc);
+    ImGui::SameLine();
+    change = change || ImGui::Checkbox("Blue Noise", &rt_pipe.use_blue_noise);
+    ImGui::Checkbox("Reproject", &rt_pipe.use_reproject);
+    if(rt_pipe.use_reproject) {
+        ImGui::SliderInt("History", &rt_pipe.max_history, 1, 256);
+    }
 
-    const char* integrators[] = {"Direct", "Material", "MIS", "ReSTIR Direct", "ReSTIR"};
+    const char* integrators[] = {"Direct", "Material", "MIS", "ReSTIR Direct", "ReSTIR", "ReSTIR GI"};
     const char* brdfs[] = {"BlinnPhong", "GGX"};
     const char* debug_views[] = {"None", "Pos", "Norm", "Albedo"};
-    change = change || ImGui::Combo("Integrator", &rt_pipe.integrator, integrators, 5);
+    change = change || ImGui::Combo("Integrator", &rt_pipe.integrator, integrators, 6);
     change = change || ImGui::Combo("BRDF", &rt_pipe.brdf, brdfs, 2);
     change = change || ImGui::Combo("Debug", &rt_pipe.debug_view, debug_views, 4);
 
-    if(rt_pipe.integrator == 3 || rt_pipe.integrator == 4) {
+    if(rt_pipe.integrator >= 3) {
         change = change || ImGui::SliderInt("Res", &rt_pipe.res_samples, 1, 32);
         change = change || ImGui::Checkbox("Temporal Reuse", &rt_pipe.use_temporal);
         if(rt_pipe.use_temporal) {
             change = change || ImGui::SliderInt("Temporal", &rt_pipe.temporal_scale, 1, 32);
         }
+        const char* biases[] = {"Biased", "1/Z", "1/Z + Visibility"};
+        change = change || ImGui::Checkbox("Spatial Reuse", &rt_pipe.use_spatial);
+        if(rt_pipe.use_spatial) {
+            change = change || ImGui::SliderInt("Neighbors", &rt_pipe.spatial_samples, 1, 16);
+            change = change || ImGui::SliderFloat("Radius", &rt_pipe.spatial_radius, 1.0f, 64.0f);
+            change = change || ImGui::Combo("Bias", &rt_pipe.spatial_bias, biases, 3);
+        }
     }
 
     if(change) rt_pipe.reset_frame();
@@ -321,9 +492,28 @@ void GPURT::UIsidebar() {
     ImGui::DragFloat("Gamma", &effect_pipe.gamma, 0.01f, 0.01f, 5.0f);
     ImGui::SliderInt("Tonemap", &effect_pipe.tonemap_type, 0, 2);
 
-    if(ImGui::Button("Save")) {
+    ImGui::Checkbox("Denoise", &use_denoiser);
+    if(use_denoiser) {
+        ImGui::SliderInt("Filter Iters", &denoise_pipe.iterations, 1, 8);
+        ImGui::DragFloat("Phi Color", &denoise_pipe.phi_color, 0.1f, 0.01f, 64.0f);
+        ImGui::DragFloat("Phi Normal", &denoise_pipe.phi_normal, 1.0f, 1.0f, 512.0f);
+        ImGui::DragFloat("Phi Pos", &denoise_pipe.phi_pos, 0.01f, 0.001f, 16.0f);
+    }
+
+    const char* formats[] = {"EXR (half)", "EXR (float)", "PNG"};
+    ImGui::Combo("Format", (int*)&output.format, formats, 3);
+    char name[256];
+    std::snprintf(name, sizeof(name), "%s", output.name.c_str());
+    if(ImGui::InputText("File", name, sizeof(name))) output.name = name;
+    if(output.format != Util::Output_Format::png) ImGui::Checkbox("AOVs", &output.aovs);
+
+    if(use_rt && ImGui::Button("Save")) {
         save_rt();
     }
+    if(size_t n = writer.pending()) {
+        ImGui::SameLine();
+        ImGui::Text("Writing %zu", n);
+    }
     ImGui::Separator();
 
     if(!scene.empty()) {
@@ -6,8 +6,11 @@
 
 #include <lib/mathlib.h>
 #include <scene/scene.h>
+#include <util/image_writer.h>
+#include <util/path_tracer.h>
 
 #include <vk/rt.h>
+#include <vk/denoise.h>
 #include <vk/effect.h>
 #include <vk/mesh.h>
 
@@ -18,6 +21,10 @@ public:
 
     void loop();
 
+    /// Renders the loaded scene from its camera at the window's size with the CPU path tracer,
+    /// and writes it like a saved frame to name plus the output format's extension
+    bool render_reference(const std::string& name, Util::Trace_Params params);
+
 private:
     void event(SDL_Event e);
     void render();
@@ -25,6 +32,7 @@ private:
 
     void UIsidebar();
     void load_scene();
+    void load_env();
     void edit_material(Material& opt);
 
     void build_images();
@@ -34,6 +42,8 @@ private:
     void build_pass();
     void build_rt();
     void save_rt();
+    void capture_rt(VkCommandBuffer& cmds);
+    void finish_capture();
 
     static inline const char* scene_file_types = "dae,obj,fbx,glb,gltf,3ds,blend,stl,ply";
     static inline const char* image_file_types = "exr,hdr,hdri,jpg,jpeg,png,tga,bmp,psd,gif";
@@ -54,20 +64,39 @@ private:
     VK::Drop<VK::Image> rt_target;
     VK::Drop<VK::ImageView> rt_target_view;
 
+    /// Readback of rt_target and the G-buffer, copied by a frame's commands and handed to the
+    /// writer once that frame's fence has been waited on
+    struct Capture {
+        VK::Drop<VK::Buffer> color, depth, normal, albedo;
+        unsigned int w = 0, h = 0;
+        bool pending = false;
+        bool aovs = false;
+        std::string path;
+        Util::Output_Settings settings;
+    };
+
     struct Frame {
         VK::Drop<VK::Image> color, depth;
         VK::Drop<VK::ImageView> color_view, depth_view;
         VK::Drop<VK::Framebuffer> m_fb, ef_fb;
+        Capture capture;
     };
 
     bool use_rt = true;
+    bool use_denoiser = false;
     bool rebuild_tlas = true;
     bool rebuild_blas = true;
+    bool save_requested = false;
+    unsigned int n_saved = 0;
 
     std::array<Frame, VK::Manager::MAX_IN_FLIGHT> frames;
     VK::Drop<VK::Pass> mesh_pass, effect_pass;
 
     VK::MeshPipe mesh_pipe;
     VK::EffectPipe effect_pipe;
+    VK::DenoisePipe denoise_pipe;
     VK::RTPipe rt_pipe;
+
+    Util::Output_Settings output;
+    Util::Image_Writer writer;
 };
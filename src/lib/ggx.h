@@ -0,0 +1,89 @@
+
+#pragma once
+
+#include <cmath>
+
+#include "mathlib.h"
+
+// GGX microfacet BRDF; mirrors the GGX section of src/shaders/rt/rtcommon.glsl.
+// As in the shader, wo points towards the surface and eval includes the cosine term.
+
+struct GGX_Shade {
+    Vec3 wo, T, B, N;
+};
+
+inline Vec3 GGX_reflect(Vec3 i, Vec3 n) {
+    return i - 2.0f * dot(n, i) * n;
+}
+
+inline Vec3 GGX_F(Vec3 r0, float iDn) {
+    float cos5 = std::pow(1.0f - iDn, 5.0f);
+    return r0 + (1.0f - r0) * cos5;
+}
+
+inline float GGX_G(float oDn, float iDn, float a2) {
+    float sqr0 = std::sqrt(a2 + (1.0f - a2) * iDn * iDn);
+    float sqr1 = std::sqrt(a2 + (1.0f - a2) * oDn * oDn);
+    return 2.0f * oDn * iDn / (oDn * sqr0 + iDn * sqr1);
+}
+
+inline float GGX_D(float nDh, float a2) {
+    float b = nDh * nDh * (a2 - 1.0f) + 1.0f;
+    return a2 / (PI_F * b * b);
+}
+
+inline float GGX_pdf(float roughness, const GGX_Shade& shade, Vec3 wi) {
+
+    float oDn = dot(-shade.wo, shade.N);
+    float iDn = dot(wi, shade.N);
+    if(oDn <= 0.0f || iDn <= 0.0f) return 0.0f;
+
+    Vec3 H = (wi - shade.wo).unit();
+
+    float nDh = std::max(dot(H, shade.N), 0.0f);
+    float a2 = roughness * roughness;
+
+    // Visible normals: D_wo(H) / (4 oDh) = G1(wo) D(H) / (4 oDn)
+    return GGX_D(nDh, a2) / (2.0f * (oDn + std::sqrt(a2 + (1.0f - a2) * oDn * oDn)));
+}
+
+inline Vec3 GGX_eval(Vec3 albedo, float roughness, const GGX_Shade& shade, Vec3 wi) {
+
+    float oDn = dot(-shade.wo, shade.N);
+    float iDn = dot(wi, shade.N);
+    if(oDn <= 0.0f || iDn <= 0.0f) return Vec3{};
+
+    Vec3 H = (wi - shade.wo).unit();
+
+    float nDh = std::max(dot(H, shade.N), 0.0f);
+    float a2 = roughness * roughness;
+
+    return GGX_F(albedo, iDn) * GGX_D(nDh, a2) * GGX_G(oDn, iDn, a2) / (4.0f * oDn);
+}
+
+/// Samples the distribution of visible normals (Heitz 2018)
+inline bool GGX_sample(Vec2 Xi, float roughness, const GGX_Shade& shade, Vec3& wi) {
+
+    float alpha = roughness;
+    Vec3 wo = -shade.wo;
+    Vec3 Ve{dot(wo, shade.T), dot(wo, shade.B), dot(wo, shade.N)};
+
+    Vec3 Vh = Vec3{alpha * Ve.x, alpha * Ve.y, Ve.z}.unit();
+    float lensq = Vh.x * Vh.x + Vh.y * Vh.y;
+    Vec3 T1 = lensq > 0.0f ? Vec3{-Vh.y, Vh.x, 0.0f} * (1.0f / std::sqrt(lensq)) : Vec3{1.0f, 0.0f, 0.0f};
+    Vec3 T2 = cross(Vh, T1);
+
+    float r = std::sqrt(Xi.x);
+    float phi = 2.0f * PI_F * Xi.y;
+    float t1 = r * std::cos(phi);
+    float t2 = r * std::sin(phi);
+    float s = 0.5f * (1.0f + Vh.z);
+    t2 = (1.0f - s) * std::sqrt(1.0f - t1 * t1) + s * t2;
+
+    Vec3 Nh = t1 * T1 + t2 * T2 + std::sqrt(std::max(0.0f, 1.0f - t1 * t1 - t2 * t2)) * Vh;
+    Vec3 Ne = Vec3{alpha * Nh.x, alpha * Nh.y, std::max(0.0f, Nh.z)}.unit();
+
+    Vec3 H = shade.T * Ne.x + shade.B * Ne.y + shade.N * Ne.z;
+    wi = GGX_reflect(shade.wo, H);
+    return dot(wi, shade.N) > 0.0f;
+}
@@ -0,0 +1,223 @@
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "mathlib.h"
+
+// Compact G-buffer and reservoir encodings. Mirrors src/shaders/rt/pack.glsl operation for
+// operation: halves, depth and albedo only use integer ops, correctly rounded add/mul and floor,
+// so both sides agree bit for bit and pack(unpack(x)) == x. Normals go through a division and a
+// normalize, so a GPU may land one code away, as can re-encoding a decoded normal.
+
+namespace Pack {
+
+inline uint32_t float_bits(float f) {
+    uint32_t u;
+    std::memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+inline float bits_float(uint32_t u) {
+    float f;
+    std::memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+/// IEEE half with round to nearest even; out of range values (and infinities) saturate to 65504
+inline uint32_t f32_to_f16(float f) {
+    uint32_t x = float_bits(f);
+    uint32_t sign = (x >> 16) & 0x8000u;
+    uint32_t a = x & 0x7fffffffu;
+
+    if(a >= 0x477ff000u) return sign | 0x7bffu;
+
+    // Subnormal half: units of 2^-24, anything at or below 2^-25 rounds to zero
+    if(a < 0x38800000u) {
+        if(a <= 0x33000000u) return sign;
+        uint32_t m = (a & 0x7fffffu) | 0x800000u;
+        uint32_t shift = 126u - (a >> 23);
+        uint32_t h = m >> shift;
+        uint32_t rem = m & ((1u << shift) - 1u), half = 1u << (shift - 1u);
+        if(rem > half || (rem == half && (h & 1u))) h++;
+        return sign | h;
+    }
+
+    uint32_t h = (a - 0x38000000u) >> 13;
+    uint32_t rem = a & 0x1fffu;
+    if(rem > 0x1000u || (rem == 0x1000u && (h & 1u))) h++;
+    return sign | h;
+}
+
+/// Exact, like unpackHalf2x16
+inline float f16_to_f32(uint32_t h) {
+    uint32_t sign = (h & 0x8000u) << 16;
+    uint32_t e = (h >> 10) & 0x1fu, m = h & 0x3ffu;
+    if(e == 0) {
+        float v = std::ldexp(static_cast<float>(m), -24);
+        return sign ? -v : v;
+    }
+    if(e == 31) return bits_float(sign | 0x7f800000u | (m << 13));
+    return bits_float(sign | ((e + 112u) << 23) | (m << 13));
+}
+
+inline uint32_t pack_half2(Vec2 v) {
+    return f32_to_f16(v.x) | (f32_to_f16(v.y) << 16);
+}
+
+inline Vec2 unpack_half2(uint32_t p) {
+    return Vec2{f16_to_f32(p & 0xffffu), f16_to_f32(p >> 16)};
+}
+
+inline float sign_not_zero(float f) {
+    return f >= 0.0f ? 1.0f : -1.0f;
+}
+
+inline uint32_t quantize_snorm16(float f) {
+    return static_cast<uint32_t>(std::floor((f * 0.5f + 0.5f) * 65534.0f + 0.5f)) + 1u;
+}
+
+/// Octahedral unit vector, 16 bits per axis mapped to [1, 65535]; 0 encodes "no geometry"
+inline uint32_t pack_normal(Vec3 n) {
+    float s = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if(s == 0.0f) return 0;
+    float x = n.x / s, y = n.y / s;
+    if(n.z < 0.0f) {
+        float ox = (1.0f - std::abs(y)) * sign_not_zero(x);
+        float oy = (1.0f - std::abs(x)) * sign_not_zero(y);
+        x = ox;
+        y = oy;
+    }
+    return quantize_snorm16(x) | (quantize_snorm16(y) << 16);
+}
+
+inline Vec3 unpack_normal(uint32_t p) {
+    if(p == 0) return Vec3{};
+    float x = static_cast<float>((p & 0xffffu) - 1u) * (2.0f / 65534.0f) - 1.0f;
+    float y = static_cast<float>((p >> 16) - 1u) * (2.0f / 65534.0f) - 1.0f;
+    float z = 1.0f - std::abs(x) - std::abs(y);
+    float t = std::max(-z, 0.0f);
+    x += x >= 0.0f ? -t : t;
+    y += y >= 0.0f ? -t : t;
+    return Vec3{x, y, z}.unit();
+}
+
+/// Hit distance as the top 24 bits of its float (16 bit mantissa, rounded), plus the sample's
+/// sub-pixel jitter at 4 bits per axis. 0 means the ray missed.
+inline uint32_t pack_depth(float t, Vec2 jitter) {
+    if(!(t > 0.0f)) return 0;
+    uint32_t d = std::max((float_bits(t) + 0x40u) >> 7, 1u);
+    uint32_t jx = std::min(static_cast<uint32_t>(std::max(jitter.x, 0.0f) * 16.0f), 15u);
+    uint32_t jy = std::min(static_cast<uint32_t>(std::max(jitter.y, 0.0f) * 16.0f), 15u);
+    return (d << 8) | (jy << 4) | jx;
+}
+
+inline float unpack_depth(uint32_t p, Vec2& jitter) {
+    jitter = Vec2{static_cast<float>(p & 15u) + 0.5f, static_cast<float>((p >> 4) & 15u) + 0.5f} *
+             (1.0f / 16.0f);
+    return bits_float((p >> 8) << 7);
+}
+
+inline uint32_t quantize_unorm8(float f) {
+    return static_cast<uint32_t>(std::floor(std::clamp(f, 0.0f, 1.0f) * 255.0f + 0.5f));
+}
+
+/// 8 bits per channel; alpha is set to mark geometry
+inline uint32_t pack_albedo(Vec3 a) {
+    return quantize_unorm8(a.x) | (quantize_unorm8(a.y) << 8) | (quantize_unorm8(a.z) << 16) |
+           (255u << 24);
+}
+
+inline Vec3 unpack_albedo(uint32_t p) {
+    return Vec3{static_cast<float>(p & 255u), static_cast<float>((p >> 8) & 255u),
+                static_cast<float>((p >> 16) & 255u)} *
+           (1.0f / 255.0f);
+}
+
+/// Maps NDC (x, y, 0, 1) to an unnormalized world-space view ray: the rotation of iV times iP
+inline Mat4 ray_matrix(const Mat4& iV, const Mat4& iP) {
+    Mat4 r = iV;
+    r[3] = Vec4{0.0f, 0.0f, 0.0f, 1.0f};
+    return r * iP;
+}
+
+/// World-space view ray through the sample at jitter within pixel (x, y) of a w*h G-buffer;
+/// rays is ray_matrix(iV, iP)
+inline Vec3 gbuf_ray(const Mat4& rays, unsigned int x, unsigned int y, Vec2 jitter,
+                     unsigned int w, unsigned int h) {
+    Vec2 ndc = Vec2{(static_cast<float>(x) + jitter.x) / static_cast<float>(w),
+                    (static_cast<float>(y) + jitter.y) / static_cast<float>(h)} *
+                   2.0f -
+               Vec2{1.0f};
+    Vec4 d = rays * Vec4{ndc.x, ndc.y, 0.0f, 1.0f};
+    return d.xyz().unit();
+}
+
+/// World position of a packed depth sample at pixel (x, y) of a w*h G-buffer
+inline Vec3 unpack_position(uint32_t depth, unsigned int x, unsigned int y, unsigned int w,
+                            unsigned int h, const Mat4& iV, const Mat4& iP) {
+    Vec2 jitter;
+    float t = unpack_depth(depth, jitter);
+    return iV[3].xyz() + t * gbuf_ray(ray_matrix(iV, iP), x, y, jitter, w, h);
+}
+
+/// Light reservoir as the shaders use it (Reservoir in restir.glsl)
+struct Light_Reservoir {
+    Vec3 pos, normal, emissive;
+    float w_sum = 0.0f;
+    float w = 0.0f;
+    uint32_t n_seen = 0;
+};
+
+/// Its storage form (PackedReservoir in pack.glsl): octahedral light normal, half emission and a
+/// 16 bit sample count, half the size of the std430 struct.
+struct Packed_Reservoir {
+    Vec3 pos;
+    uint32_t normal;
+    uint32_t emissive_rg;
+    uint32_t emissive_b_n;
+    float w_sum;
+    float w;
+};
+static_assert(sizeof(Packed_Reservoir) == 32);
+
+/// Storage form of a ReSTIR GI reservoir (PackedGIReservoir in restir_gi.glsl): visible and
+/// sample points with octahedral normals, half radiance and a 16 bit sample count.
+struct Packed_GI_Reservoir {
+    Vec3 xv;
+    uint32_t nv;
+    Vec3 xs;
+    uint32_t ns;
+    uint32_t Lo_rg;
+    uint32_t Lo_b_n;
+    float w_sum;
+    float w;
+};
+static_assert(sizeof(Packed_GI_Reservoir) == 48);
+
+inline Packed_Reservoir pack_reservoir(const Light_Reservoir& r) {
+    Packed_Reservoir p;
+    p.pos = r.pos;
+    p.normal = pack_normal(r.normal);
+    p.emissive_rg = pack_half2(Vec2{r.emissive.x, r.emissive.y});
+    p.emissive_b_n = f32_to_f16(r.emissive.z) | (std::min(r.n_seen, 65535u) << 16);
+    p.w_sum = r.w_sum;
+    p.w = r.w;
+    return p;
+}
+
+inline Light_Reservoir unpack_reservoir(const Packed_Reservoir& p) {
+    Light_Reservoir r;
+    Vec2 rg = unpack_half2(p.emissive_rg);
+    r.pos = p.pos;
+    r.normal = unpack_normal(p.normal);
+    r.emissive = Vec3{rg.x, rg.y, f16_to_f32(p.emissive_b_n & 0xffffu)};
+    r.w_sum = p.w_sum;
+    r.w = p.w;
+    r.n_seen = p.emissive_b_n >> 16;
+    return r;
+}
+
+} // namespace Pack
@@ -0,0 +1,101 @@
+
+#pragma once
+
+#include "rng.h"
+#include <cstddef>
+#include <vector>
+
+// Weighted reservoir sampling for ReSTIR (Bitterli et al. 2020); mirrors src/shaders/rt/restir.glsl
+// and the spatial pass in restir_spatial.rgen, with T standing in for the light sample.
+
+template<typename T> struct Reservoir {
+
+    /// Streaming RIS: offers candidate x with resampling weight w (target / source pdf)
+    bool update(const T& x, float w, RNG& rng) {
+        M += 1.0f;
+        w_sum += w;
+        if(w > 0.0f && rng.unit() * w_sum < w) {
+            y = x;
+            return true;
+        }
+        return false;
+    }
+
+    /// Merges r, whose sample has resampling weight w at the destination (res_combine)
+    bool merge(const Reservoir& r, float w, RNG& rng) {
+        M += r.M;
+        w_sum += w;
+        if(w > 0.0f && rng.unit() * w_sum < w) {
+            y = r.y;
+            return true;
+        }
+        return false;
+    }
+
+    /// Sets W for target p_hat after M candidates from the source pdf (update_weight)
+    void finalize(float p_hat) {
+        W = p_hat > 0.0f && M > 0.0f ? w_sum / (p_hat * M) : 0.0f;
+    }
+
+    T y{};
+    float w_sum = 0.0f;
+    /// Unbiased contribution weight: f(y) * W estimates the integral of f
+    float W = 0.0f;
+    float M = 0.0f;
+};
+
+/// Normalization for spatial reuse. none divides by every merged candidate, which is biased
+/// wherever a neighbour's target is zero but the destination's is not; z only counts neighbours
+/// whose target is non-zero for the chosen sample (the 1/Z weights, add visibility to the
+/// targets for the shadow-ray variant); mis uses the generalized balance heuristic.
+enum class Reservoir_Bias { none, z, mis };
+
+/// Spatial reuse into rs[0]. target(i, y) evaluates pixel i's target function; all reservoirs must
+/// already be finalized for their own targets. Returns the combined reservoir with W for rs[0].
+template<typename T, typename Target>
+Reservoir<T> combine(const std::vector<Reservoir<T>>& rs, Target&& target, Reservoir_Bias bias,
+                     RNG& rng) {
+
+    Reservoir<T> out;
+
+    for(size_t i = 0; i < rs.size(); i++) {
+
+        const Reservoir<T>& r = rs[i];
+        if(r.M == 0.0f) continue;
+
+        float w = target(0, r.y) * r.W;
+
+        if(bias == Reservoir_Bias::mis) {
+            float num = 0.0f, den = 0.0f;
+            for(size_t j = 0; j < rs.size(); j++) {
+                float p = rs[j].M * target(j, r.y);
+                if(j == i) num = p;
+                den += p;
+            }
+            w *= den > 0.0f ? num / den : 0.0f;
+        } else {
+            w *= r.M;
+        }
+
+        out.merge(r, w, rng);
+    }
+
+    float p_hat = target(0, out.y);
+    if(p_hat <= 0.0f || out.M == 0.0f) {
+        out.W = 0.0f;
+        return out;
+    }
+
+    switch(bias) {
+    case Reservoir_Bias::none: out.W = out.w_sum / (p_hat * out.M); break;
+    case Reservoir_Bias::z: {
+        float Z = 0.0f;
+        for(size_t j = 0; j < rs.size(); j++) {
+            if(target(j, out.y) > 0.0f) Z += rs[j].M;
+        }
+        out.W = Z > 0.0f ? out.w_sum / (p_hat * Z) : 0.0f;
+    } break;
+    case Reservoir_Bias::mis: out.W = out.w_sum / p_hat; break;
+    }
+    return out;
+}
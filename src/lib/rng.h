@@ -0,0 +1,47 @@
+
+#pragma once
+
+#include <cstdint>
+
+// Counter-based PCG (RXS-M-XS 32) RNG; mirrors the RNG section of src/shaders/rt/rtcommon.glsl.
+// Streams are keyed on (pixel, frame, sample, bounce), so a render is reproducible bit for bit.
+
+struct RNG {
+
+    /// Stateless PCG permutation, also used to derive stream keys
+    static uint32_t pcg_hash(uint32_t v) {
+        uint32_t state = v * 747796405u + 2891336453u;
+        uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+        return (word >> 22u) ^ word;
+    }
+
+    static uint32_t key(uint32_t pixel, uint32_t frame, uint32_t sample, uint32_t bounce) {
+        return pcg_hash(pixel ^ pcg_hash(frame ^ pcg_hash(sample ^ pcg_hash(bounce))));
+    }
+
+    RNG() = default;
+    explicit RNG(uint32_t seed) : state(seed) {
+    }
+    RNG(uint32_t pixel, uint32_t frame, uint32_t sample, uint32_t bounce)
+        : state(key(pixel, frame, sample, bounce)) {
+    }
+
+    uint32_t next() {
+        uint32_t old = state;
+        state = state * 747796405u + 2891336453u;
+        uint32_t word = ((old >> ((old >> 28u) + 4u)) ^ old) * 277803737u;
+        return (word >> 22u) ^ word;
+    }
+
+    /// [0,1) with 24 bits of precision, exactly representable in a float
+    float unit() {
+        return (float)(next() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    /// [a,b)
+    uint32_t range(uint32_t a, uint32_t b) {
+        return next() % (b - a) + a;
+    }
+
+    uint32_t state = 0;
+};
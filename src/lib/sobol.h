@@ -0,0 +1,93 @@
+
+#pragma once
+
+#include <cstdint>
+
+#include "vec2.h"
+
+// Progressive, padded, Owen-scrambled Sobol (Burley 2020, "Practical Hash-based Owen Scrambling").
+// Mirrors src/shaders/rt/sobol.glsl operation for operation, so CPU and GPU draw identical points.
+
+namespace Sobol {
+
+/// Joe-Kuo direction numbers for the first two dimensions; 2D padding needs nothing more
+inline constexpr uint32_t directions[2][32] = {
+    {0x80000000u, 0x40000000u, 0x20000000u, 0x10000000u, 0x08000000u, 0x04000000u, 0x02000000u,
+     0x01000000u, 0x00800000u, 0x00400000u, 0x00200000u, 0x00100000u, 0x00080000u, 0x00040000u,
+     0x00020000u, 0x00010000u, 0x00008000u, 0x00004000u, 0x00002000u, 0x00001000u, 0x00000800u,
+     0x00000400u, 0x00000200u, 0x00000100u, 0x00000080u, 0x00000040u, 0x00000020u, 0x00000010u,
+     0x00000008u, 0x00000004u, 0x00000002u, 0x00000001u},
+    {0x80000000u, 0xc0000000u, 0xa0000000u, 0xf0000000u, 0x88000000u, 0xcc000000u, 0xaa000000u,
+     0xff000000u, 0x80800000u, 0xc0c00000u, 0xa0a00000u, 0xf0f00000u, 0x88880000u, 0xcccc0000u,
+     0xaaaa0000u, 0xffff0000u, 0x80008000u, 0xc000c000u, 0xa000a000u, 0xf000f000u, 0x88008800u,
+     0xcc00cc00u, 0xaa00aa00u, 0xff00ff00u, 0x80808080u, 0xc0c0c0c0u, 0xa0a0a0a0u, 0xf0f0f0f0u,
+     0x88888888u, 0xccccccccu, 0xaaaaaaaau, 0xffffffffu}};
+
+inline uint32_t sobol(uint32_t index, uint32_t dim) {
+    uint32_t x = 0;
+    for(uint32_t bit = 0; index; index >>= 1, bit++) {
+        if(index & 1) x ^= directions[dim][bit];
+    }
+    return x;
+}
+
+inline uint32_t reverse_bits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+    return x;
+}
+
+/// Integer hash (lowbias32)
+inline uint32_t hash(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+inline uint32_t hash_combine(uint32_t seed, uint32_t v) {
+    return seed ^ (v + (seed << 6) + (seed >> 2));
+}
+
+inline uint32_t laine_karras_permutation(uint32_t x, uint32_t seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+/// Owen scramble: every bit is flipped based on a hash of the bits above it
+inline uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+    x = reverse_bits(x);
+    x = laine_karras_permutation(x, seed);
+    return reverse_bits(x);
+}
+
+/// Top 24 bits to [0,1), exactly representable in a float
+inline float to_float(uint32_t x) {
+    return (float)(x >> 8) * (1.0f / 16777216.0f);
+}
+
+/// Sample 'index' of the scrambled 2D sequence for dimension pair 'dim'. The index is shuffled
+/// per pair so pairs stay decorrelated, and the sequence is progressive: any prefix is well stratified.
+inline Vec2 sample_2d(uint32_t index, uint32_t dim, uint32_t seed) {
+    uint32_t s = hash_combine(seed, hash(dim));
+    uint32_t i = nested_uniform_scramble(index, s);
+    uint32_t x = nested_uniform_scramble(sobol(i, 0), hash_combine(s, 0));
+    uint32_t y = nested_uniform_scramble(sobol(i, 1), hash_combine(s, 1));
+    return Vec2{to_float(x), to_float(y)};
+}
+
+/// Per-pixel seed; the same seed across frames continues the sequence
+inline uint32_t pixel_seed(uint32_t x, uint32_t y, uint32_t width) {
+    return hash(y * width + x);
+}
+
+} // namespace Sobol
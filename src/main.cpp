@@ -5,14 +5,27 @@
 
 int main(int argc, char** argv) {
 
-    std::string scene_file;
+    std::string scene_file, reference;
+    Util::Trace_Params trace;
+    bool no_guiding = false;
     CLI::App args{"GPURT"};
     args.add_option("-s,--scene", scene_file, "Scene file to load");
+    args.add_option("-r,--reference", reference,
+                    "Render the scene with the CPU path tracer to this file name and exit");
+    args.add_option("--spp", trace.spp, "Samples per pixel for --reference");
+    args.add_option("--max-depth", trace.max_depth, "Path length for --reference");
+    args.add_flag("--no-guiding", no_guiding, "Trace --reference without SD-tree path guiding");
 
     CLI11_PARSE(args, argc, argv);
 
     Window window;
     GPURT gpurt(window, scene_file);
+
+    if(!reference.empty()) {
+        trace.guiding = !no_guiding;
+        return gpurt.render_reference(reference, trace) ? 0 : 1;
+    }
+
     gpurt.loop();
     return 0;
 }
@@ -0,0 +1,96 @@
+
+#include "env_map.h"
+
+#include <cstring>
+#include <util/image.h>
+#include <util/parallel.h>
+
+bool Env_Map::load(std::string file) {
+
+    clear();
+
+    auto image = Util::Image::load(file);
+    if(!image.has_value()) {
+        warn("Failed to load env map %s", file.c_str());
+        return false;
+    }
+    // LDR files are decoded with the exact sRGB curve rather than stb_image's 2.2 gamma
+    Util::Image rgba = image->format() == Util::Image_Format::rgba32f
+                           ? std::move(image.value())
+                           : image->convert(Util::Image_Format::rgba32f);
+
+    _w = rgba.w();
+    _h = rgba.h();
+    _data.resize((size_t)_w * _h * 4);
+    std::memcpy(_data.data(), rgba.data(), _data.size() * sizeof(float));
+
+    build_dist();
+    info("Loaded %ux%u env map %s", _w, _h, file.c_str());
+    return true;
+}
+
+void Env_Map::clear() {
+    _w = _h = 0;
+    _data.clear();
+    _dist = {};
+}
+
+void Env_Map::build_dist() {
+
+    // Weight by sin(theta) so the distribution matches solid angle, not texel area
+    std::vector<float> f((size_t)_w * _h);
+    Util::parallel_for(0, _h, [&, this](size_t y) {
+        float sin_t = std::sin(PI_F * (y + 0.5f) / _h);
+        for(unsigned int x = 0; x < _w; x++) {
+            const float* t = &_data[(y * _w + x) * 4];
+            Vec3 c{std::max(t[0], 0.0f), std::max(t[1], 0.0f), std::max(t[2], 0.0f)};
+            f[y * _w + x] = (0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z) * sin_t;
+        }
+    });
+
+    _dist.build(f, _w, _h);
+}
+
+Vec2 Env_Map::dir_to_uv(Vec3 dir) {
+    float phi = std::atan2(dir.z, dir.x);
+    if(phi < 0.0f) phi += 2.0f * PI_F;
+    float theta = std::acos(clamp(dir.y, -1.0f, 1.0f));
+    return Vec2{phi / (2.0f * PI_F), theta / PI_F};
+}
+
+Vec3 Env_Map::uv_to_dir(Vec2 uv) {
+    float phi = uv.x * 2.0f * PI_F;
+    float theta = uv.y * PI_F;
+    float sin_t = std::sin(theta);
+    return Vec3{sin_t * std::cos(phi), std::cos(theta), sin_t * std::sin(phi)};
+}
+
+Vec3 Env_Map::radiance(Vec3 dir) const {
+    if(empty()) return Vec3{};
+    Vec2 uv = dir_to_uv(dir);
+    unsigned int x = clamp((unsigned int)(uv.x * _w), 0u, _w - 1);
+    unsigned int y = clamp((unsigned int)(uv.y * _h), 0u, _h - 1);
+    const float* t = &_data[(y * _w + x) * 4];
+    return Vec3{t[0], t[1], t[2]};
+}
+
+Vec3 Env_Map::sample(Vec2 u, float& pdf) const {
+
+    float pdf_uv;
+    Vec2 uv = _dist.sample(u, pdf_uv);
+    float sin_t = std::sin(uv.y * PI_F);
+
+    pdf = sin_t == 0.0f ? 0.0f : pdf_uv / (2.0f * PI_F * PI_F * sin_t);
+    return uv_to_dir(uv);
+}
+
+float Env_Map::pdf(Vec3 dir) const {
+
+    if(empty()) return 0.0f;
+
+    Vec2 uv = dir_to_uv(dir);
+    float sin_t = std::sin(uv.y * PI_F);
+    if(sin_t == 0.0f) return 0.0f;
+
+    return _dist.pdf(uv) / (2.0f * PI_F * PI_F * sin_t);
+}
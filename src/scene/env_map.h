@@ -0,0 +1,56 @@
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <lib/mathlib.h>
+#include <util/distribution.h>
+
+/// Equirectangular HDR environment (+Y up), importance sampled by luminance
+class Env_Map {
+public:
+    Env_Map() = default;
+    Env_Map(const Env_Map& src) = delete;
+    Env_Map(Env_Map&& src) = default;
+    ~Env_Map() = default;
+
+    Env_Map& operator=(const Env_Map& src) = delete;
+    Env_Map& operator=(Env_Map&& src) = default;
+
+    /// Loads anything Util::Image can, as RGBA32F
+    bool load(std::string file);
+    void clear();
+
+    bool empty() const {
+        return _data.empty();
+    }
+    unsigned int w() const {
+        return _w;
+    }
+    unsigned int h() const {
+        return _h;
+    }
+
+    /// RGBA32F texels, row-major
+    const std::vector<float>& data() const {
+        return _data;
+    }
+    const Util::Distribution_2D& dist() const {
+        return _dist;
+    }
+
+    Vec3 radiance(Vec3 dir) const;
+    Vec3 sample(Vec2 u, float& pdf) const;
+    float pdf(Vec3 dir) const;
+
+    static Vec2 dir_to_uv(Vec3 dir);
+    static Vec3 uv_to_dir(Vec2 uv);
+
+private:
+    void build_dist();
+
+    unsigned int _w = 0, _h = 0;
+    std::vector<float> _data;
+    Util::Distribution_2D _dist;
+};
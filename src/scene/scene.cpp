@@ -1,6 +1,11 @@
 
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <sstream>
 #include "scene.h"
+#include <util/parallel.h>
+#include <util/texture_budget.h>
 
 #define TINYGLTF_NOEXCEPTION
 #include <sf_libs/tiny_gltf.h>
@@ -33,6 +38,7 @@ size_t Scene::size() const {
 void Scene::clear() {
 	objs.clear();
 	textures.clear();
+	bc_textures.clear();
 }
 
 bool Scene::empty() {
@@ -314,6 +320,72 @@ void Scene::parse_mesh(tinygltf::Model& model, tinygltf::Mesh& gltfMesh, Pose po
 	}
 }
 
+namespace {
+
+// Images are read and decoded after parsing, several at once. The loader only keeps the bytes
+// of embedded images; external ones are left to Scene::load by TINYGLTF_NO_EXTERNAL_IMAGE.
+bool keep_image_bytes(tinygltf::Image* image, const int, std::string*, std::string*, int, int,
+					  const unsigned char* bytes, int size, void*) {
+	image->image.assign(bytes, bytes + size);
+	image->as_is = true;
+	return true;
+}
+
+std::string decode_uri(const std::string& uri) {
+	std::string ret;
+	for(size_t i = 0; i < uri.size(); i++) {
+		if(uri[i] == '%' && i + 2 < uri.size() && std::isxdigit((unsigned char)uri[i + 1]) &&
+		   std::isxdigit((unsigned char)uri[i + 2])) {
+			ret += (char)std::stoi(uri.substr(i + 1, 2), nullptr, 16);
+			i += 2;
+		} else {
+			ret += uri[i];
+		}
+	}
+	return ret;
+}
+
+bool is_bc_path(const std::string& path) {
+	std::string ext = path.substr(path.find_last_of('.') + 1);
+	for(char& c : ext) c = (char)std::tolower((unsigned char)c);
+	return ext == "dds" || ext == "ktx2";
+}
+
+// KHR_texture_basisu and MSFT_texture_dds name a compressed image to use instead of source
+int texture_source(const tinygltf::Texture& texture) {
+	for(const char* name : {"KHR_texture_basisu", "MSFT_texture_dds"}) {
+		auto ext = texture.extensions.find(name);
+		if(ext != texture.extensions.end() && ext->second.Has("source"))
+			return ext->second.Get("source").GetNumberAsInt();
+	}
+	return texture.source;
+}
+
+// Float texels are kept as half floats, which hold any radiance a texture needs in half the
+// memory. Values past the half range would become infinities, so they are clamped first.
+Util::Image pack_half(Util::Image& image) {
+	const float HALF_MAX = 65504.0f;
+	float* texels = reinterpret_cast<float*>(image.data());
+	for(size_t i = 0, n = image.bytes() / sizeof(float); i < n; i++) {
+		float t = texels[i];
+		texels[i] = t == t ? std::clamp(t, -HALF_MAX, HALF_MAX) : 0.0f;
+	}
+	return image.convert(Util::Image_Format::rgba16f);
+}
+
+bool same_blocks(const Util::BC_File& a, const Util::BC_File& b) {
+	if(a.format != b.format || a.srgb != b.srgb || a.levels.size() != b.levels.size())
+		return false;
+	for(size_t l = 0; l < a.levels.size(); l++) {
+		const auto &la = a.levels[l], &lb = b.levels[l];
+		if(la.w != lb.w || la.h != lb.h || std::memcmp(la.blocks, lb.blocks, la.size))
+			return false;
+	}
+	return true;
+}
+
+} // namespace
+
 std::string Scene::load(std::string file, Camera& cam) {
 
 	clear();
@@ -322,6 +394,7 @@ std::string Scene::load(std::string file, Camera& cam) {
 
 	Model model;
 	TinyGLTF loader;
+	loader.SetImageLoader(keep_image_bytes, nullptr);
 	std::string err;
 	std::string warn;
 
@@ -370,26 +443,118 @@ std::string Scene::load(std::string file, Camera& cam) {
 		}
 	}
 
-	// Iterate through all texture declaration in glTF file
-	for(const auto &gltfTexture : model.textures) {
-		if(gltfTexture.source >= model.images.size()) continue;
+	// Referenced images are loaded once each, in parallel. DDS and KTX2 files are only mapped and
+	// keep their blocks; anything else is decoded, EXR and HDR files to half floats.
+	std::string dir = file.substr(0, file.find_last_of("/\\") + 1);
+	std::vector<int> sources;
+	std::vector<int> tex_source(model.textures.size(), -1);
+	std::vector<char> wanted(model.images.size(), 0);
+	for(size_t t = 0; t < model.textures.size(); t++) {
+		int source = texture_source(model.textures[t]);
+		if(source < 0 || source >= (int)model.images.size()) continue;
+		tex_source[t] = source;
+		if(!wanted[source]) sources.push_back(source);
+		wanted[source] = 1;
+	}
+
+	std::vector<Util::Image> decoded(model.images.size());
+	std::vector<Util::BC_File> compressed(model.images.size());
+	std::vector<char> loaded(model.images.size(), 0);
+	Util::parallel_for(0, sources.size(), [&](size_t i) {
+		int source = sources[i];
+		auto& image = model.images[source];
+		std::string name = image.uri.empty() ? image.name : dir + decode_uri(image.uri);
+		bool ok = false;
+		if(!image.as_is) {
+			if(is_bc_path(name)) ok = Util::load_bc_file(name, compressed[source]);
+			else ok = decoded[source].reload(name);
+		} else if(Util::is_bc_container(image.image.data(), image.image.size())) {
+			ok = Util::load_bc_file(std::move(image.image), name, compressed[source]);
+		} else {
+			ok = decoded[source].reload(image.image.data(), image.image.size(), name);
+			image.image = {};
+		}
+		if(ok && decoded[source].format() == Util::Image_Format::rgba32f)
+			decoded[source] = pack_half(decoded[source]);
+		if(!ok) warn("Failed to load texture image %s", name.c_str());
+		loaded[source] = ok;
+	});
+
+	// glTF textures that share an image, or images with identical texels, are stored once
+	std::vector<int> tex_idx(model.textures.size(), -1), image_idx(model.images.size(), -1);
+	size_t referenced_bytes = 0;
+
+	for(size_t t = 0; t < model.textures.size(); t++) {
+		int source = tex_source[t];
+		if(source < 0 || !loaded[source]) continue;
+
+		bool bc = !compressed[source].levels.empty();
+		referenced_bytes += bc ? compressed[source].bytes() : decoded[source].bytes();
+
+		if(image_idx[source] < 0) {
+			image_idx[source] = (int)textures.size();
+			textures.push_back(std::move(decoded[source]));
+			bc_textures.push_back(std::move(compressed[source]));
+		}
+		tex_idx[t] = image_idx[source];
+	}
 
-		Util::Image tex;
-		const auto &image = model.images[gltfTexture.source];
-		assert(image.component == 4);
+	std::vector<Util::Image_Const_View> views;
+	for(const auto& tex : textures) views.push_back(tex.view());
+	std::vector<unsigned int> first = Util::find_duplicates(views);
+
+	// Compressed textures all have empty images, so they are compared by their blocks instead
+	for(unsigned int i = 0; i < textures.size(); i++) {
+		if(bc_textures[i].levels.empty()) continue;
+		first[i] = i;
+		for(unsigned int j = 0; j < i; j++) {
+			if(first[j] == j && same_blocks(bc_textures[i], bc_textures[j])) {
+				first[i] = j;
+				break;
+			}
+		}
+	}
 
-		const auto size =
-			image.component * image.width * image.height * sizeof(unsigned char);
-		std::vector<unsigned char> data(size);
-		std::memcpy(data.data(), image.image.data(), size);
+	std::vector<int> kept(textures.size(), -1);
+	std::vector<Util::Image> unique;
+	std::vector<Util::BC_File> unique_bc;
+	for(size_t i = 0; i < textures.size(); i++) {
+		if(first[i] != i) continue;
+		kept[i] = (int)unique.size();
+		unique.push_back(std::move(textures[i]));
+		unique_bc.push_back(std::move(bc_textures[i]));
+	}
+	textures = std::move(unique);
+	bc_textures = std::move(unique_bc);
 
-		tex.reload(image.width, image.height, std::move(data));
-		textures.push_back(std::move(tex));
+	for(int& idx : tex_idx) {
+		if(idx >= 0) idx = kept[first[idx]];
+	}
+	auto remap = [&](int& tex) {
+		tex = tex >= 0 && tex < (int)tex_idx.size() ? tex_idx[tex] : -1;
+	};
+	for_objs([&](Object& obj) {
+		remap(obj.material.albedo_tex);
+		remap(obj.material.emissive_tex);
+		remap(obj.material.metal_rough_tex);
+		remap(obj.material.normal_tex);
+	});
+
+	size_t stored_bytes = 0;
+	for(size_t i = 0; i < textures.size(); i++)
+		stored_bytes += textures[i].bytes() + bc_textures[i].bytes();
+	if(stored_bytes < referenced_bytes) {
+		info("Stored %zu unique of %zu textures, saving %zu MB", textures.size(),
+		     model.textures.size(), (referenced_bytes - stored_bytes) >> 20);
 	}
 
 	return err;
 }
 
+bool Scene::load_env(std::string file) {
+	return env.load(file);
+}
+
 unsigned int Scene::n_textures() const {
 	return (unsigned int)textures.size();
 }
@@ -4,10 +4,12 @@
 #include <string>
 #include <unordered_map>
 
+#include "env_map.h"
 #include "object.h"
 #include <lib/mathlib.h>
 #include <util/camera.h>
 #include <util/image.h>
+#include <util/texture_file.h>
 #include <sf_libs/tiny_gltf.h>
 
 class Scene {
@@ -38,6 +40,16 @@ public:
     const std::vector<Util::Image>& images() const {
         return textures;
     };
+    /// Parallel to images(): textures loaded from DDS or KTX2 files keep their blocks here and
+    /// have an empty image
+    const std::vector<Util::BC_File>& bc_images() const {
+        return bc_textures;
+    }
+
+    bool load_env(std::string file);
+    const Env_Map& env_map() const {
+        return env;
+    }
 
     float scale = 1.0f;
     
@@ -45,5 +57,7 @@ private:
     void parse_mesh(tinygltf::Model& model, tinygltf::Mesh& gltfMesh, Pose pose);
     std::unordered_map<unsigned int, Object> objs;
     std::vector<Util::Image> textures;
+    std::vector<Util::BC_File> bc_textures;
+    Env_Map env;
     unsigned int next_id, first_id;
 };
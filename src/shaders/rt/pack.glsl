@@ -0,0 +1,90 @@
+
+// Compact G-buffer and reservoir encodings; keep in sync with src/lib/pack.h.
+
+// IEEE half with round to nearest even, saturating to 65504 (packHalf2x16 leaves rounding open)
+uint f32_to_f16(float f) {
+	uint x = floatBitsToUint(f);
+	uint sign = (x >> 16) & 0x8000u;
+	uint a = x & 0x7fffffffu;
+
+	if(a >= 0x477ff000u) return sign | 0x7bffu;
+
+	if(a < 0x38800000u) {
+		if(a <= 0x33000000u) return sign;
+		uint m = (a & 0x7fffffu) | 0x800000u;
+		uint shift = 126u - (a >> 23);
+		uint h = m >> shift;
+		uint rem = m & ((1u << shift) - 1u), half_ = 1u << (shift - 1u);
+		if(rem > half_ || (rem == half_ && (h & 1u) != 0)) h++;
+		return sign | h;
+	}
+
+	uint h = (a - 0x38000000u) >> 13;
+	uint rem = a & 0x1fffu;
+	if(rem > 0x1000u || (rem == 0x1000u && (h & 1u) != 0)) h++;
+	return sign | h;
+}
+
+uint pack_half2(vec2 v) {
+	return f32_to_f16(v.x) | (f32_to_f16(v.y) << 16);
+}
+
+vec2 unpack_half2(uint p) {
+	return unpackHalf2x16(p);
+}
+
+uint quantize_snorm16(float f) {
+	return uint(floor((f * 0.5 + 0.5) * 65534.0 + 0.5)) + 1u;
+}
+
+// Octahedral unit vector, 16 bits per axis mapped to [1, 65535]; 0 encodes "no geometry"
+uint pack_normal(vec3 n) {
+	float s = abs(n.x) + abs(n.y) + abs(n.z);
+	if(s == 0) return 0u;
+	vec2 o = n.xy / s;
+	if(n.z < 0) {
+		o = (1 - abs(o.yx)) * vec2(o.x >= 0 ? 1 : -1, o.y >= 0 ? 1 : -1);
+	}
+	return quantize_snorm16(o.x) | (quantize_snorm16(o.y) << 16);
+}
+
+vec3 unpack_normal(uint p) {
+	if(p == 0) return vec3(0);
+	vec2 o = vec2(float((p & 0xffffu) - 1u), float((p >> 16) - 1u)) * (2.0 / 65534.0) - 1;
+	vec3 n = vec3(o, 1 - abs(o.x) - abs(o.y));
+	float t = max(-n.z, 0);
+	n.x += n.x >= 0 ? -t : t;
+	n.y += n.y >= 0 ? -t : t;
+	return normalize(n);
+}
+
+// Hit distance as the top 24 bits of its float (16 bit mantissa, rounded), plus the sample's
+// sub-pixel jitter at 4 bits per axis. 0 means the ray missed.
+uint pack_depth(float t, vec2 jitter) {
+	if(!(t > 0)) return 0u;
+	uint d = max((floatBitsToUint(t) + 0x40u) >> 7, 1u);
+	uvec2 j = min(uvec2(max(jitter, vec2(0)) * 16), uvec2(15));
+	return (d << 8) | (j.y << 4) | j.x;
+}
+
+float unpack_depth(uint p, out vec2 jitter) {
+	jitter = (vec2(p & 15u, (p >> 4) & 15u) + 0.5) * (1.0 / 16.0);
+	return uintBitsToFloat((p >> 8) << 7);
+}
+
+// 8 bits per channel, rounded half up (packUnorm4x8 leaves ties open); alpha marks geometry
+uint pack_albedo(vec3 a) {
+	uvec3 q = uvec3(floor(clamp(a, vec3(0), vec3(1)) * 255 + 0.5));
+	return q.x | (q.y << 8) | (q.z << 16) | (255u << 24);
+}
+
+vec3 unpack_albedo(uint p) {
+	return vec3(p & 255u, (p >> 8) & 255u, (p >> 16) & 255u) * (1.0 / 255.0);
+}
+
+// World-space view ray through a G-buffer sample; rays maps NDC (x, y, 0, 1) to an unnormalized
+// direction, i.e. mat4(mat3(iV)) * iP
+vec3 gbuf_ray(mat4 rays, ivec2 pixel, vec2 jitter, vec2 size) {
+	vec2 ndc = (vec2(pixel) + jitter) / size * 2 - 1;
+	return normalize((rays * vec4(ndc, 0, 1)).xyz);
+}
@@ -0,0 +1,1109 @@
+
+// Bindings and path tracing routines shared by rt.rgen and restir_spatial.rgen.
+// Expects rtcommon.glsl, sobol.glsl, pack.glsl, restir.glsl and restir_gi.glsl to be included first.
+
+// Ray Data //////////////////////////////////////////
+
+layout(location = 0) rayPayloadEXT Ray_Payload payload;
+
+// Scene Data //////////////////////////////////////////
+
+layout(binding = 0) uniform UniformBufferObject {
+	mat4 V, P, iV, iP;
+	mat4 prev_V, prev_P, prev_iV, prev_iP;
+	ReSTIRConstants restir;
+} uniforms;
+
+layout(binding = 1, std430) readonly buffer SceneDescs {
+	Scene_Obj objects[];
+};
+
+layout(binding = 2, std430) readonly buffer SceneLights {
+	Scene_Light lights[];
+};
+
+layout(binding = 3, std430) readonly buffer Vertices { 
+	Vertex v[]; 
+} vertices[];
+
+layout(binding = 4, std430) readonly buffer Indices {
+	uint i[];
+} indices[];
+
+layout(binding = 5) uniform sampler2D Textures[];
+
+layout(binding = 6) uniform accelerationStructureEXT TLAS;
+
+layout(binding = 7, rgba32f) uniform image2D image;
+
+layout (binding = 8) buffer Reservoirs {
+	PackedReservoir reservoirs[];
+};
+
+layout (binding = 9) readonly buffer PrevFrameReservoirs {
+	PackedReservoir prevFrameReservoirs[];
+};
+
+// Packed G-buffer (pack.glsl): hit distance and jitter, octahedral normal, RGBA8 albedo
+layout(binding = 10, r32ui) uniform uimage2D pos_image;
+layout(binding = 11, r32ui) uniform uimage2D norm_image;
+layout(binding = 12, r32ui) uniform uimage2D alb_image;
+
+layout(binding = 13) uniform usampler2D ppos_image;
+layout(binding = 14) uniform usampler2D pnorm_image;
+layout(binding = 15) uniform usampler2D palb_image;
+
+layout(binding = 16) uniform sampler2D env_map;
+
+layout(binding = 17, std430) readonly buffer EnvDist {
+	uint env_w;
+	uint env_h;
+	float env_integral;
+	float env_pad;
+	float env_data[];
+};
+
+layout(binding = 18) uniform sampler2D blue_noise;
+
+layout(binding = 19, rgba32f) uniform image2D moments_image;
+layout(binding = 20, rgba32f) uniform image2D accum_image;
+layout(binding = 21, rgba32f) uniform readonly image2D prev_moments_image;
+layout(binding = 22, rgba32f) uniform readonly image2D prev_accum_image;
+
+layout(binding = 23) buffer GIReservoirs {
+	PackedGIReservoir gi_reservoirs[];
+};
+
+layout(binding = 24) readonly buffer PrevGIReservoirs {
+	PackedGIReservoir prev_gi_reservoirs[];
+};
+
+// Virtual textures: this frame's page table and feedback, and the layout of each texture.
+// Textures[0] and Textures[1] then hold the sRGB and linear page pools.
+layout(binding = 25, std430) readonly buffer VTTable {
+	uint vt_table[];
+};
+
+layout(binding = 26, std430) buffer VTFeedback {
+	uint vt_feedback[];
+};
+
+layout(binding = 27, std430) readonly buffer VTTextures {
+	VT_Texture vt_textures[];
+};
+
+////////////////////////////////////////////
+
+uint seed;
+uint sobol_seed, sobol_index, sobol_dim;
+vec2 gbuf_jitter;
+
+// G-buffer positions are rebuilt along each sample's camera ray, so last frame's need last
+// frame's camera
+vec3 gbuf_position(uint depth, ivec2 q, mat4 iV, mat4 iP) {
+	vec2 jitter;
+	float t = unpack_depth(depth, jitter);
+	vec3 o = (iV * vec4(0, 0, 0, 1)).xyz;
+	return o + t * gbuf_ray(mat4(mat3(iV)) * iP, q, jitter, vec2(gl_LaunchSizeEXT.xy));
+}
+
+void gbuf_store(ivec2 q, vec3 pos, vec3 norm, vec3 albedo, vec3 camera_o) {
+	uint depth = dot(norm, norm) > 0.5 ? pack_depth(distance(pos, camera_o), gbuf_jitter) : 0u;
+	imageStore(pos_image, q, uvec4(depth));
+	imageStore(norm_image, q, uvec4(pack_normal(norm)));
+	imageStore(alb_image, q, uvec4(pack_albedo(albedo)));
+}
+
+vec3 gbuf_load_pos(ivec2 q) {
+	return gbuf_position(imageLoad(pos_image, q).x, q, uniforms.iV, uniforms.iP);
+}
+vec3 gbuf_load_norm(ivec2 q) {
+	return unpack_normal(imageLoad(norm_image, q).x);
+}
+vec3 gbuf_load_albedo(ivec2 q) {
+	return unpack_albedo(imageLoad(alb_image, q).x);
+}
+
+vec3 prev_gbuf_pos(ivec2 q) {
+	return gbuf_position(texelFetch(ppos_image, q, 0).x, q, uniforms.prev_iV, uniforms.prev_iP);
+}
+vec3 prev_gbuf_norm(ivec2 q) {
+	return unpack_normal(texelFetch(pnorm_image, q, 0).x);
+}
+vec3 prev_gbuf_albedo(ivec2 q) {
+	return unpack_albedo(texelFetch(palb_image, q, 0).x);
+}
+
+// R2 rank-1 lattice point for the sample index, Cranley-Patterson rotated by the blue noise
+// mask. The lattice steps in 0.32 fixed point, so points stay exact at any sample count. Each
+// dimension pair Owen-scrambles the index with its own seed, so pairs walk the lattice in
+// different orders rather than the same sequence shifted, and reads its own channel pair at its
+// own toroidal offset so error across neighbouring pixels stays blue.
+vec2 blue_noise_2d(uint index, uint dim) {
+	const uvec2 r2 = uvec2(0xC13FA9A9u, 0x91E10DA6u);
+	uint pair = dim >> 1;
+	ivec2 shift = ivec2((pair * r2) >> 26u);
+	vec4 mask = texelFetch(blue_noise, (ivec2(gl_LaunchIDEXT.xy) + shift) & 63, 0);
+	vec2 offset = (dim & 1u) == 0 ? mask.xy : mask.zw;
+	uvec2 lattice = nested_uniform_scramble(index, sobol_hash(pair + 1u)) * r2;
+	return fract(offset + vec2(lattice >> 8u) * (1.0 / 16777216.0));
+}
+
+// Next 2D sample of the current path: blue noise or Owen-scrambled Sobol if enabled, otherwise PCG.
+// Dimensions are handed out in the order the path consumes them, starting at 0 for the camera.
+vec2 sample_2d() {
+	if(consts.use_blue_noise == 1) {
+		return blue_noise_2d(sobol_index, sobol_dim++);
+	}
+	if(consts.qmc == 1) {
+		return sobol_2d(sobol_index, sobol_dim++, sobol_seed);
+	}
+	return vec2(randf(seed), randf(seed));
+}
+
+HitInfo hit_info() {
+
+	const uint objId = objects[payload.obj_id].index;
+    const mat4 modelIT = objects[payload.obj_id].modelIT;
+    const mat4 model = objects[payload.obj_id].model;
+    const vec3 bary = payload.barycentrics;
+
+	HitInfo hit;
+	ivec3 ind = ivec3(indices[objId].i[3 * payload.prim_id + 0],
+					  indices[objId].i[3 * payload.prim_id + 1],
+					  indices[objId].i[3 * payload.prim_id + 2]);
+
+	Vertex v0 = vertices[objId].v[ind.x];
+	Vertex v1 = vertices[objId].v[ind.y];
+	Vertex v2 = vertices[objId].v[ind.z];
+
+	hit.normal = v0.norm_ty.xyz * bary.x + v1.norm_ty.xyz * bary.y + v2.norm_ty.xyz * bary.z;
+	hit.normal = normalize(vec3(modelIT * vec4(hit.normal, 0.0)));
+
+	vec3 t0 = v0.tangent.xyz * v0.tangent.w;
+	vec3 t1 = v1.tangent.xyz * v1.tangent.w;
+	vec3 t2 = v2.tangent.xyz * v2.tangent.w;
+	hit.tangent = t0 * bary.x + t1 * bary.y + t2 * bary.z;
+	hit.tangent = normalize(vec3(modelIT * vec4(hit.tangent, 0.0)));
+
+	hit.pos = v0.pos_tx.xyz * bary.x + v1.pos_tx.xyz * bary.y + v2.pos_tx.xyz * bary.z;
+	hit.pos = vec3(model * vec4(hit.pos, 1.0));
+
+	vec2 tc0 = vec2(v0.pos_tx.w, v0.norm_ty.w);
+	vec2 tc1 = vec2(v1.pos_tx.w, v1.norm_ty.w);
+	vec2 tc2 = vec2(v2.pos_tx.w, v2.norm_ty.w);
+	hit.texcoord = tc0 * bary.x + tc1 * bary.y + tc2 * bary.z;
+
+	// Per-triangle terms of the ray cone texture LOD
+	vec3 p0 = vec3(model * vec4(v0.pos_tx.xyz, 1.0));
+	vec3 p1 = vec3(model * vec4(v1.pos_tx.xyz, 1.0));
+	vec3 p2 = vec3(model * vec4(v2.pos_tx.xyz, 1.0));
+	float world_area = length(cross(p1 - p0, p2 - p0));
+	vec2 e1 = tc1 - tc0, e2 = tc2 - tc0;
+	float uv_area = abs(e1.x * e2.y - e2.x * e1.y);
+	hit.lod_bias = 0.5 * log2(max(uv_area, 1e-20) / max(world_area, 1e-20));
+
+	vec3 n0 = normalize(vec3(modelIT * vec4(v0.norm_ty.xyz, 0.0)));
+	vec3 n1 = normalize(vec3(modelIT * vec4(v1.norm_ty.xyz, 0.0)));
+	vec3 n2 = normalize(vec3(modelIT * vec4(v2.norm_ty.xyz, 0.0)));
+	hit.curvature = max(max(length(n1 - n0) / max(distance(p1, p0), EPS),
+	                        length(n2 - n1) / max(distance(p2, p1), EPS)),
+	                        length(n0 - n2) / max(distance(p0, p2), EPS));
+
+	// Until cone_hit runs, lookups read the base level
+	hit.lod = -128;
+	return hit;
+}
+
+// Ray Cones //////////////////////////////////////////
+
+// Akenine-Moller et al., "Texture Level of Detail Strategies for Real-Time Ray Tracing"
+// (Ray Tracing Gems, ch. 20). Keep in sync with Util::Ray_Cone.
+
+// A pixel's cone: zero width at the camera, spreading by the angle one pixel subtends
+RayCone camera_cone() {
+	float tan_half_fov = 1.0 / abs(uniforms.P[1][1]);
+	return RayCone(0, atan(2 * tan_half_fov / float(gl_LaunchSizeEXT.y)));
+}
+
+// Grows the cone from o to the hit and sets the hit's LOD, then widens its spread by the
+// surface curvature for the bounce leaving the hit. Curvature is unsigned, so concave surfaces
+// widen the cone too rather than focusing it.
+void cone_hit(inout RayCone cone, inout HitInfo hit, vec3 o, vec3 d) {
+	cone.width += cone.spread * distance(o, hit.pos);
+	if(consts.use_ray_cones == 1) {
+		float cos_theta = max(abs(dot(hit.normal, d)), 1e-4);
+		hit.lod = hit.lod_bias + log2(max(abs(cone.width), 1e-20) / cos_theta);
+	}
+	cone.spread += 2 * hit.curvature * abs(cone.width);
+}
+
+uvec2 vt_pages(VT_Texture tex, uint level) {
+	uvec2 size = max(uvec2(tex.w, tex.h) >> level, uvec2(1));
+	return (size + VT_PAGE - 1) / VT_PAGE;
+}
+
+// Bilinear lookup in the page covering uv at level, or in the first coarser level with that page
+// resident. Entries of the page table are the slot plus one, with the pool in the top bit.
+vec4 vt_bilinear(int idx, vec2 uv, uint level, bool record) {
+
+	VT_Texture tex = vt_textures[idx];
+	uv = fract(uv);
+
+	uint first = tex.first_page;
+	for(uint l = 0; l < level; l++) {
+		uvec2 n = vt_pages(tex, l);
+		first += n.x * n.y;
+	}
+
+	for(uint l = level; l < tex.levels; l++) {
+		uvec2 n = vt_pages(tex, l);
+		vec2 t = uv * vec2(max(uvec2(tex.w, tex.h) >> l, uvec2(1)));
+		uvec2 page = min(uvec2(t) / VT_PAGE, n - 1);
+
+		// Hashed into a small buffer; a page lost to a collision is asked for again next frame
+		if(record && l == level) {
+			uint id = uint(idx) << 20 | l << 16 | page.y << 8 | page.x;
+			vt_feedback[(id * 2654435761u + uint(consts.frame)) % VT_FEEDBACK] = id;
+		}
+
+		uint entry = vt_table[first + page.y * n.x + page.x];
+		first += n.x * n.y;
+		if(entry == 0) continue;
+
+		uint pool = entry >> 31, slot = (entry & 0x7fffffff) - 1;
+		vec2 atlas = vec2(textureSize(Textures[pool], 0));
+		uint slots_x = uint(atlas.x) / VT_SLOT;
+		vec2 origin = vec2(slot % slots_x, slot / slots_x) * VT_SLOT + VT_BORDER;
+		return textureLod(Textures[pool], (origin + t - vec2(page * VT_PAGE)) / atlas, 0.0);
+	}
+	return vec4(0.0);
+}
+
+// Trilinear lookup in a virtual texture. Levels past the last paged one, which fits in a single
+// page, clamp to it.
+vec4 vt_sample(int idx, vec2 uv, float lod) {
+	VT_Texture tex = vt_textures[idx];
+	float l = clamp(lod, 0.0, float(tex.levels - 1));
+	uint l0 = uint(l);
+	float a = l - float(l0);
+	vec4 c0 = vt_bilinear(idx, uv, l0, true);
+	if(a <= 0.0 || l0 + 1 >= tex.levels) return c0;
+	return mix(c0, vt_bilinear(idx, uv, l0 + 1, false), a);
+}
+
+vec2 texture_size(int idx) {
+	if(consts.use_virtual_textures == 1) return vec2(vt_textures[idx].w, vt_textures[idx].h);
+	return vec2(textureSize(Textures[idx], 0));
+}
+
+vec4 sample_texture(int idx, vec2 uv, float lod) {
+	if(consts.use_virtual_textures == 1) return vt_sample(idx, uv, lod);
+	return textureLod(Textures[idx], uv, lod);
+}
+
+// Trilinear lookup at the hit's LOD, scaled to the texture's size
+vec4 texture_lod(int idx, HitInfo hit) {
+	vec2 size = texture_size(idx);
+	return sample_texture(idx, hit.texcoord, hit.lod + 0.5 * log2(size.x * size.y));
+}
+
+MatInfo mat_info(HitInfo hit) {
+
+	MatInfo mat;
+	
+	int albedoIdx = objects[payload.obj_id].albedo_tex;
+	mat.albedo = objects[payload.obj_id].albedo.xyz;
+	if(albedoIdx >= 0) {
+		mat.albedo = texture_lod(albedoIdx, hit).xyz;
+	}
+
+	int emissiveIdx = objects[payload.obj_id].emissive_tex;
+	mat.emissive = objects[payload.obj_id].emissive.xyz;
+	if(emissiveIdx >= 0) {
+		mat.emissive = texture_lod(emissiveIdx, hit).xyz;
+	}
+
+	int mrIdx = objects[payload.obj_id].metal_rough_tex;
+	vec2 metal_rough = objects[payload.obj_id].metal_rough.xy;
+	if(mrIdx >= 0) {
+		metal_rough = texture_lod(mrIdx, hit).xy;
+	}
+	
+	mat.roughness = metal_rough.y;
+
+	if(consts.use_metalness == 1)
+		mat.albedo = mix(vec3(0.04), mat.albedo, metal_rough.x);
+
+	int nIdx = objects[payload.obj_id].normal_tex;
+	mat.use_tanspace = nIdx >= 0;
+	if(mat.use_tanspace) {
+		// BC5 normal maps only store x and y
+		vec2 n = texture_lod(nIdx, hit).xy * 2.0 - 1.0;
+		mat.tanspaceNormal = vec3(n, sqrt(max(1.0 - dot(n, n), 0.0)));
+	}
+	return mat;
+}
+
+ShadeInfo shade_info(TraceInfo trace, HitInfo hit, MatInfo mat) {
+
+	ShadeInfo shade;
+
+	shade.wo = trace.d;
+	if(dot(shade.wo, hit.normal) > 0) hit.normal = -hit.normal;
+
+	shade.T = hit.tangent;
+	shade.N = hit.normal;
+
+	if(mat.use_tanspace && consts.use_normal_map == 1) {
+		shade.B = cross(shade.N, shade.T);
+		shade.N = normalize(mat3(shade.T, shade.B, shade.N) * mat.tanspaceNormal);
+	}
+
+	make_tanspace(shade.N, shade.T, shade.B);
+	return shade;
+}
+
+// Environment //////////////////////////////////////////
+
+// env_data layout (see Distribution_2D::pack):
+//     marginal func (h), marginal cdf (h+1), then per row: func (w), cdf (w+1)
+
+vec2 env_dir_to_uv(vec3 d) {
+	float phi = atan(d.z, d.x);
+	if(phi < 0) phi += 2 * M_PI;
+	float theta = acos(clamp(d.y, -1, 1));
+	return vec2(phi / (2 * M_PI), theta / M_PI);
+}
+
+vec3 env_uv_to_dir(vec2 uv) {
+	float phi = uv.x * 2 * M_PI;
+	float theta = uv.y * M_PI;
+	float sinT = sin(theta);
+	return vec3(sinT * cos(phi), cos(theta), sinT * sin(phi));
+}
+
+vec3 env_radiance(vec3 d) {
+	if(consts.use_env_map == 0) return consts.env_light.xyz;
+	return consts.env_light.xyz * textureLod(env_map, env_dir_to_uv(d), 0).xyz;
+}
+
+float env_sample_1d(uint func, uint cdf, uint n, float integral, float u, out uint offset, out float pdf) {
+
+	// Largest index with cdf[i] <= u
+	uint first = 0, len = n + 1;
+	while(len > 0) {
+		uint half_len = len >> 1;
+		uint middle = first + half_len;
+		if(env_data[cdf + middle] <= u) {
+			first = middle + 1;
+			len -= half_len + 1;
+		} else {
+			len = half_len;
+		}
+	}
+	offset = clamp(first, 1u, n) - 1;
+
+	float du = u - env_data[cdf + offset];
+	float width = env_data[cdf + offset + 1] - env_data[cdf + offset];
+	if(width > 0) du /= width;
+
+	pdf = integral > 0 ? env_data[func + offset] / integral : 0;
+	return (offset + du) / n;
+}
+
+vec3 env_sample(vec2 Xi, out float pdf) {
+
+	uint y, x;
+	float pdf_v, pdf_u;
+	float v = env_sample_1d(0, env_h, env_h, env_integral, Xi.y, y, pdf_v);
+
+	uint row = 2 * env_h + 1 + y * (2 * env_w + 1);
+	float u = env_sample_1d(row, row + env_w, env_w, env_data[y], Xi.x, x, pdf_u);
+
+	float sinT = sin(v * M_PI);
+	pdf = sinT == 0 ? 0 : pdf_u * pdf_v / (2 * M_PI * M_PI * sinT);
+	return env_uv_to_dir(vec2(u, v));
+}
+
+float env_pdf(vec3 d) {
+
+	if(env_integral == 0) return 0;
+
+	vec2 uv = env_dir_to_uv(d);
+	float sinT = sin(uv.y * M_PI);
+	if(sinT == 0) return 0;
+
+	uint x = min(uint(uv.x * env_w), env_w - 1);
+	uint y = min(uint(uv.y * env_h), env_h - 1);
+	float f = env_data[2 * env_h + 1 + y * (2 * env_w + 1) + x];
+	return f / env_integral / (2 * M_PI * M_PI * sinT);
+}
+
+// Probability of picking the environment over the area lights in light_sample_dir
+float env_select_pdf() {
+	if(consts.use_env_map == 0) return 0;
+	return consts.n_lights == 0 ? 1 : 0.5;
+}
+
+// Lights //////////////////////////////////////////
+
+Scene_Light_Sample light_sample(vec3 p) {
+	
+	Scene_Light_Sample samp;
+
+	samp.l_idx = randu(seed, 0, consts.n_lights);
+	samp.o_idx = lights[samp.l_idx].index;
+	
+	uint n_tris = lights[samp.l_idx].n_triangles;
+	samp.t_idx = randu(seed, 0, n_tris);
+
+	ivec3 ind = ivec3(indices[samp.o_idx].i[3 * samp.t_idx + 0],
+					  indices[samp.o_idx].i[3 * samp.t_idx + 1],
+					  indices[samp.o_idx].i[3 * samp.t_idx + 2]);
+
+	Vertex v0 = vertices[samp.o_idx].v[ind.x];
+	Vertex v1 = vertices[samp.o_idx].v[ind.y];
+	Vertex v2 = vertices[samp.o_idx].v[ind.z];
+
+	vec3 _v0 = v0.pos_tx.xyz;
+	vec3 _v1 = v1.pos_tx.xyz;
+	vec3 _v2 = v2.pos_tx.xyz;
+	_v0 = vec3(objects[samp.o_idx].model * vec4(_v0, 1.0));
+	_v1 = vec3(objects[samp.o_idx].model * vec4(_v1, 1.0));
+	_v2 = vec3(objects[samp.o_idx].model * vec4(_v2, 1.0));
+
+	vec3 bary = triangle_sample(sample_2d());
+	vec2 texcoord = vec2(v0.pos_tx.w, v1.norm_ty.w) * bary.x + vec2(v1.pos_tx.w, v1.norm_ty.w) * bary.y + vec2(v2.pos_tx.w, v1.norm_ty.w) * bary.z;
+	
+	samp.pos = _v0 * bary.x + _v1 * bary.y + _v2 * bary.z;
+
+	int emissiveIdx = objects[samp.o_idx].emissive_tex;
+	samp.emissive = objects[samp.o_idx].emissive.xyz;
+	if(emissiveIdx >= 0) {
+		samp.emissive = sample_texture(emissiveIdx, texcoord, 0.0).xyz;
+	}
+	
+	vec3 Narea = cross(_v1 - _v0, _v2 - _v0);
+	float a = 2 / length(Narea);
+	vec3 dist = samp.pos - p;
+	vec3 N = normalize(Narea);
+	vec3 d = normalize(dist);
+	float g = dot(dist, dist) / abs(dot(N, d));
+
+	samp.normal = N;
+	samp.pdf = a * g / (n_tris * consts.n_lights);
+
+	return samp;
+}
+
+vec3 light_sample_dir(vec3 p) {
+
+	if(randf(seed) < env_select_pdf()) {
+		float pdf;
+		return env_sample(sample_2d(), pdf);
+	}
+	
+	uint l_idx = randu(seed, 0, consts.n_lights);
+	uint o_idx = lights[l_idx].index;
+	uint n_tris = lights[l_idx].n_triangles;
+	uint t_idx = randu(seed, 0, n_tris);
+
+	ivec3 ind = ivec3(indices[o_idx].i[3 * t_idx + 0],
+					  indices[o_idx].i[3 * t_idx + 1],
+					  indices[o_idx].i[3 * t_idx + 2]);
+
+	Vertex v0 = vertices[o_idx].v[ind.x];
+	Vertex v1 = vertices[o_idx].v[ind.y];
+	Vertex v2 = vertices[o_idx].v[ind.z];
+
+	vec3 bary = triangle_sample(sample_2d());
+	vec3 point = v0.pos_tx.xyz * bary.x + v1.pos_tx.xyz * bary.y + v2.pos_tx.xyz * bary.z;
+	point = vec3(objects[o_idx].model * vec4(point, 1.0));
+
+	return normalize(point - p);
+}
+
+float light_pdf(vec3 p, vec3 d) {
+
+	float p_env = env_select_pdf();
+	float env = p_env > 0 ? p_env * env_pdf(d) : 0;
+	if(consts.n_lights == 0) return env;
+
+	float oacc = 0;
+	for(uint l = 0; l < consts.n_lights; l++) {
+		
+		float tacc = 0;
+		uint o_idx = lights[l].index;
+		uint n_tris = lights[l].n_triangles;
+
+		if(!hit_bbox(p, d, lights[l].bb_min.xyz, lights[l].bb_max.xyz))
+			continue;
+
+		for(uint t = 0; t < n_tris; t++) {
+
+			ivec3 ind = ivec3(indices[o_idx].i[3 * t + 0],
+							  indices[o_idx].i[3 * t + 1],
+							  indices[o_idx].i[3 * t + 2]);
+
+			vec3 v0 = vertices[o_idx].v[ind.x].pos_tx.xyz;
+			vec3 v1 = vertices[o_idx].v[ind.y].pos_tx.xyz;
+			vec3 v2 = vertices[o_idx].v[ind.z].pos_tx.xyz;
+
+			v0 = vec3(objects[o_idx].model * vec4(v0, 1.0));
+			v1 = vec3(objects[o_idx].model * vec4(v1, 1.0));
+			v2 = vec3(objects[o_idx].model * vec4(v2, 1.0));
+
+			tacc += triangle_pdf(p, d, v0, v1, v2);
+		}
+
+		oacc += tacc / float(n_tris);
+	}
+
+	return (1 - p_env) * oacc / float(consts.n_lights) + env;
+}
+
+void trace_ray(vec3 o, vec3 d) {
+    traceRayEXT(TLAS,           // acceleration structure
+        gl_RayFlagsOpaqueEXT,   // rayFlags
+        0xFF,                   // cullMask
+        0,                      // sbtRecordOffset
+        0,                      // sbtRecordStride
+        0,                      // missIndex
+        o,                      // ray origin
+        EPS,                    // ray min range
+        d,                      // ray direction
+        LARGE_DIST,             // ray max range
+        0                       // payload (location = 0)
+    );
+}
+
+bool visibility(vec3 a, vec3 b) {
+	
+	vec3 dir = b-a;
+	float d = length(dir);
+
+	payload.hit = true;
+    traceRayEXT(TLAS,           // acceleration structure
+        gl_RayFlagsTerminateOnFirstHitEXT | gl_RayFlagsOpaqueEXT | gl_RayFlagsSkipClosestHitShaderEXT,   // rayFlags
+        0xFF,                   // cullMask
+        0,                      // sbtRecordOffset
+        0,                      // sbtRecordStride
+        0,                      // missIndex
+        a,                      // ray origin
+        EPS,                    // ray min range
+        dir / d,                // ray direction
+        d - EPS,                // ray max range
+        0                       // payload (location = 0)
+    );
+	return payload.hit;
+}
+
+vec3 direct_light(vec3 o, vec3 d, RayCone cone) {
+    trace_ray(o, d);
+	if(!payload.hit) {
+		return env_radiance(d);
+	}
+    HitInfo hit = hit_info();
+    cone_hit(cone, hit, o, d);
+    MatInfo mat = mat_info(hit);
+    return mat.emissive;
+}
+
+void integrate_mis(inout TraceInfo trace, HitInfo hit, MatInfo mat, ShadeInfo shade) {
+
+	if(any(greaterThan(mat.emissive, vec3(0)))) {
+	    trace.acc += trace.throughput * trace.mis * mat.emissive;
+		trace.depth = consts.max_depth;
+		return;
+	}
+
+	trace.o = hit.pos;
+	
+	if(mat.roughness == 0) {
+
+		trace.d = reflect(shade.wo, shade.N);
+		trace.throughput *= mat.albedo;
+		trace.mis = 1;
+
+	} else {
+		
+		vec3 wi_light = light_sample_dir(hit.pos);
+		float light_pdf_l = light_pdf(hit.pos, wi_light);
+
+		if(light_pdf_l != 0) {
+			
+            float light_pdf_m = MAT_pdf(mat, shade, wi_light);
+			vec3 light_atten = MAT_eval(mat, shade, wi_light);
+            vec3 weight = light_atten / light_pdf_l * power_heuristic(light_pdf_l, light_pdf_m);
+			
+            trace.acc += trace.throughput * weight * direct_light(hit.pos, wi_light, trace.cone);
+		}
+
+		vec3 wi_brdf;
+		if(!MAT_sample(sample_2d(), mat, shade, wi_brdf)) {
+			trace.depth = consts.max_depth;
+			return;
+		}
+
+		float brdf_pdf_m = MAT_pdf(mat, shade, wi_brdf);
+
+		if(brdf_pdf_m != 0) {
+			float brdf_pdf_l = light_pdf(hit.pos, wi_brdf);
+			vec3 brdf_atten = MAT_eval(mat, shade, wi_brdf);
+			trace.throughput *= brdf_atten / brdf_pdf_m;
+			trace.mis = power_heuristic(brdf_pdf_m, brdf_pdf_l);
+		} else {
+			trace.depth = consts.max_depth;
+			return;
+		}
+
+		trace.d = wi_brdf;
+	}
+}
+
+void integrate_mats(inout TraceInfo trace, HitInfo hit, MatInfo mat, ShadeInfo shade) {
+
+	if(any(greaterThan(mat.emissive, vec3(0)))) {
+        trace.acc += mat.emissive * trace.throughput;
+		trace.depth = consts.max_depth;
+		return;
+	}
+
+	trace.o = hit.pos;
+	
+	if(mat.roughness == 0) {
+		
+		trace.d = reflect(shade.wo, shade.N);
+		trace.throughput *= mat.albedo;
+
+	} else {
+
+		vec3 wi;
+		if(!MAT_sample(sample_2d(), mat, shade, wi)) {
+			trace.depth = consts.max_depth;
+			return;
+		}
+		
+		float pdf = MAT_pdf(mat, shade, wi);
+		vec3 atten = MAT_eval(mat, shade, wi);
+		if(pdf != 0) {
+			trace.throughput *= atten / pdf;
+		} else {
+			trace.depth = consts.max_depth;
+			return;
+		}
+	
+		trace.d = wi;
+	}
+}
+
+void integrate_direct(inout TraceInfo trace, HitInfo hit, MatInfo mat, ShadeInfo shade) {
+
+	trace.depth = consts.max_depth;
+	
+	if(any(greaterThan(mat.emissive, vec3(0)))) {
+	    trace.acc += mat.emissive;
+		return;
+	}
+
+	if(mat.roughness != 0) {
+		
+		Scene_Light_Sample light = light_sample(hit.pos);
+		vec3 wi = normalize(light.pos - hit.pos);
+		vec3 light_atten = MAT_eval(mat, shade, wi);
+
+        if(light.pdf != 0) {
+			float shadow = visibility(hit.pos, light.pos) ? 0 : 1;
+            trace.acc += light_atten / light.pdf * light.emissive * shadow;
+		}
+	}
+}
+
+Reservoir prev_res;
+
+// Whether the primary hit's direct light (and, for ReSTIR GI, its resampled indirect light) is
+// left to the spatial reuse pass
+bool restir_spatial() {
+	return consts.integrator >= 3 && uniforms.restir.spatial_samples > 0;
+}
+
+// Target function: unshadowed contribution of the reservoir's light sample to this hit
+float target_pHat(Reservoir res, HitInfo hit, MatInfo mat, ShadeInfo shade) {
+	vec3 dir = res.pos - hit.pos;
+	vec3 wi = normalize(dir);
+	vec3 light_atten = MAT_eval(mat, shade, wi);
+	float g = abs(dot(res.normal, wi)) / dot(dir, dir);
+	return luma(g * light_atten * res.emissive);
+}
+
+float update_weight(inout Reservoir res, HitInfo hit, MatInfo mat, ShadeInfo shade) {
+
+	if(res.n_seen == 0) {
+		res.w = 0;
+		return 0;
+	}
+
+	float pHat = target_pHat(res, hit, mat, shade);
+	res.w = (1 / pHat) * (res.w_sum / res.n_seen);
+	if(pHat == 0) {
+		res.w = 0;
+	}
+	return pHat;
+}
+
+// Builds this hit's reservoir from fresh candidates (plus last frame's, if first) and shades it,
+// unless deferred, in which case it is only stored for the spatial pass.
+void reservoir_sample(inout TraceInfo trace, HitInfo hit, MatInfo mat, ShadeInfo shade, bool first, bool deferred) {
+
+	Reservoir new_res = res_new();
+
+	for(int i = 0; i < uniforms.restir.new_samples; i++) {
+		
+		Scene_Light_Sample light = light_sample(hit.pos);
+		vec3 wi = normalize(light.pos - hit.pos);
+		vec3 light_atten = MAT_eval(mat, shade, wi);
+
+		vec3 contrib = light_atten * light.emissive / light.pdf;
+		res_update(seed, new_res, luma(contrib), light.pos, light.normal, light.emissive);
+	}
+
+	float new_pHat = update_weight(new_res, hit, mat, shade);
+	if(new_pHat != 0 && visibility(hit.pos, new_res.pos)) {
+		new_res.w = 0;
+	}
+
+	for(;;) {
+		if(first && consts.use_temporal == 1) {
+			vec4 prev_pos = uniforms.restir.prev_PV * vec4(hit.pos, 1.0f);
+			prev_pos.xyz /= prev_pos.w;
+			prev_pos.xy = (prev_pos.xy + 1.0f) * 0.5f;
+			
+			if(!(all(greaterThan(prev_pos.xy, vec2(0))) &&
+				 all(lessThan(prev_pos.xy, vec2(1))))) break;
+
+			vec2 ssize = vec2(gl_LaunchSizeEXT);
+			ivec2 prev_fragcoord = ivec2(prev_pos.xy * ssize);
+			vec3 old_pos = prev_gbuf_pos(prev_fragcoord);
+			vec3 old_norm = prev_gbuf_norm(prev_fragcoord);
+			vec3 old_alb = prev_gbuf_albedo(prev_fragcoord);
+
+			vec3 posdiff = old_pos - hit.pos;
+			if(dot(posdiff, posdiff) > 0.01) break;
+			vec3 albdiff = old_alb - mat.albedo;
+			if(dot(albdiff, albdiff) > 0.01) break;
+			if(dot(old_norm, shade.N) < 0.5) break;
+
+			prev_res = res_unpack(prevFrameReservoirs[prev_fragcoord.y * gl_LaunchSizeEXT.x + prev_fragcoord.x]);
+		}
+
+		Reservoir temporal_res = res_new();
+
+		res_update(seed, temporal_res, new_pHat * new_res.w * new_res.n_seen, new_res.pos, new_res.normal, new_res.emissive);
+
+		float old_pHat = update_weight(prev_res, hit, mat, shade);
+		
+		prev_res.n_seen = min(uniforms.restir.temporal_multiplier * new_res.n_seen, prev_res.n_seen);
+		res_update(seed, temporal_res, old_pHat * prev_res.w * prev_res.n_seen, prev_res.pos, prev_res.normal, prev_res.emissive);
+
+		temporal_res.n_seen = new_res.n_seen + prev_res.n_seen;
+
+		float final_pHat = update_weight(temporal_res, hit, mat, shade);
+		new_res = temporal_res;
+		break;
+	}
+	
+	if(new_res.w != 0 && !deferred) {
+		vec3 dir = new_res.pos - hit.pos;
+		vec3 wi = normalize(dir);
+		vec3 light_atten = MAT_eval(mat, shade, wi);
+		vec3 contrib = light_atten * new_res.emissive;
+		float g = abs(dot(new_res.normal, wi)) / dot(dir, dir);
+		trace.acc += new_res.w * contrib * g;
+	}
+
+	prev_res = new_res;
+}
+
+// ReSTIR GI state of the first sample's path
+GISample gi_sample;
+vec3 gi_acc;
+bool gi_active;
+MatInfo gi_mat;
+ShadeInfo gi_shade;
+float gi_pdf;
+
+void gi_begin(HitInfo hit, MatInfo mat, ShadeInfo shade, vec3 wi, float pdf, vec3 acc) {
+	gi_active = true;
+	gi_acc = acc;
+	gi_mat = mat;
+	gi_shade = shade;
+	gi_pdf = pdf;
+	gi_sample.xv = hit.pos;
+	gi_sample.nv = shade.N;
+	gi_sample.xs = hit.pos + wi * GI_DISTANT;
+	gi_sample.ns = -wi;
+	gi_sample.Lo = vec3(0);
+}
+
+// Target function: the sample's contribution to visible point x, without visibility
+float gi_target(GISample s, vec3 x, MatInfo mat, ShadeInfo shade) {
+	return luma(MAT_eval(mat, shade, normalize(s.xs - x)) * s.Lo);
+}
+
+// Last frame's pixel that saw the same surface point, if any
+bool gi_prev_pixel(vec3 pos, vec3 norm, out ivec2 q) {
+	vec4 prev = uniforms.restir.prev_PV * vec4(pos, 1.0f);
+	vec2 uv = prev.xy / prev.w * 0.5f + 0.5f;
+	q = ivec2(uv * vec2(gl_LaunchSizeEXT.xy));
+	if(prev.w <= 0 || any(lessThanEqual(uv, vec2(0))) || any(greaterThanEqual(uv, vec2(1)))) return false;
+	vec3 d = prev_gbuf_pos(q) - pos;
+	return dot(d, d) <= 0.01 && dot(prev_gbuf_norm(q), norm) >= 0.5;
+}
+
+// Resamples the first sample's indirect bounce together with last frame's reservoir and stores
+// the result for the spatial pass and the next frame. Returns its contribution, or nothing when
+// the spatial pass shades it instead.
+vec3 gi_resample() {
+
+	GIReservoir r = gi_new();
+	float pHat = gi_target(gi_sample, gi_sample.xv, gi_mat, gi_shade);
+	gi_update(seed, r, pHat / gi_pdf, gi_sample);
+
+	ivec2 q;
+	if(consts.use_temporal == 1 && consts.frame > 0 && gi_prev_pixel(gi_sample.xv, gi_sample.nv, q)) {
+		GIReservoir prev = gi_unpack(prev_gi_reservoirs[q.y * gl_LaunchSizeEXT.x + q.x]);
+		prev.n_seen = min(prev.n_seen, uniforms.restir.temporal_multiplier);
+		float J = gi_reuse_jacobian(prev.s, gi_sample.xv);
+		if(prev.n_seen > 0) {
+			float w = gi_target(prev.s, gi_sample.xv, gi_mat, gi_shade) * prev.w * prev.n_seen * J;
+			gi_combine(seed, r, w, prev);
+		}
+	}
+
+	pHat = gi_target(r.s, gi_sample.xv, gi_mat, gi_shade);
+	r.w = pHat > 0 ? r.w_sum / (pHat * r.n_seen) : 0;
+
+	// Reused samples may have become occluded since; drop them instead of carrying them on
+	bool reused = any(notEqual(r.s.xs, gi_sample.xs));
+	if(reused && r.w > 0 && visibility(gi_sample.xv, r.s.xs)) {
+		r.w = 0;
+		r.w_sum = 0;
+	}
+
+	// W is now relative to this pixel's visible point, which later reuse measures from
+	r.s.xv = gi_sample.xv;
+	r.s.nv = gi_sample.nv;
+
+	uint idx = gl_LaunchIDEXT.y * gl_LaunchSizeEXT.x + gl_LaunchIDEXT.x;
+	gi_reservoirs[idx] = gi_pack(r);
+
+	if(restir_spatial()) return vec3(0);
+	return r.w * MAT_eval(gi_mat, gi_shade, normalize(r.s.xs - r.s.xv)) * r.s.Lo;
+}
+
+void integrate_restir(inout TraceInfo trace, HitInfo hit, MatInfo mat, ShadeInfo shade, bool d_only, bool first) {
+
+	if(any(greaterThan(mat.emissive, vec3(0)))) {
+	    trace.acc += mat.emissive * trace.throughput * trace.mis;
+		trace.depth = consts.max_depth;
+		return;
+	}
+
+	trace.o = hit.pos;
+
+	if(mat.roughness == 0) {
+
+		trace.d = reflect(shade.wo, shade.N);
+		trace.throughput *= mat.albedo;
+		trace.mis = 1;
+
+	} else {
+		
+		if(trace.depth == 0) {
+			if(!restir_spatial()) {
+				reservoir_sample(trace, hit, mat, shade, first, false);
+			} else if(first) {
+				reservoir_sample(trace, hit, mat, shade, true, true);
+			}
+		}
+
+		vec3 wi_brdf;
+		if(!MAT_sample(sample_2d(), mat, shade, wi_brdf)) {
+			trace.depth = consts.max_depth;
+			return;
+		}
+
+		float brdf_pdf = MAT_pdf(mat, shade, wi_brdf);
+		if(brdf_pdf != 0) {
+			vec3 brdf_atten = MAT_eval(mat, shade, wi_brdf);
+			trace.mis = trace.depth == 0 ? 0 : 1;
+			if(first && trace.depth == 0 && consts.integrator == 5) {
+				// The rest of the path estimates the radiance coming back along wi_brdf; it is
+				// resampled by gi_resample rather than weighted here
+				gi_begin(hit, mat, shade, wi_brdf, brdf_pdf, trace.acc);
+			} else {
+				trace.throughput *= brdf_atten / brdf_pdf;
+			}
+		} else {
+			trace.depth = consts.max_depth;
+			return;
+		}
+
+		trace.d = wi_brdf;
+	}
+
+	if(d_only) {
+		trace.depth = consts.max_depth;
+	}
+}
+
+// ReSTIR DI on the primary hit, then the first sample's indirect bounce is resampled (see
+// gi_resample) while later bounces use light sampling with MIS.
+void integrate_restir_gi(inout TraceInfo trace, HitInfo hit, MatInfo mat, ShadeInfo shade, bool first) {
+
+	if(trace.depth == 0) {
+		integrate_restir(trace, hit, mat, shade, false, first);
+		return;
+	}
+	if(first && gi_active && trace.depth == 1) {
+		gi_sample.xs = hit.pos;
+		gi_sample.ns = shade.N;
+	}
+	integrate_mis(trace, hit, mat, shade);
+}
+
+void make_camera_ray(uint s, out vec3 d) {
+
+    sobol_index = uint(consts.frame * consts.samples) + s;
+    sobol_dim = 0;
+
+    vec2 jitter = sample_2d();
+    if(consts.qmc == 0 && consts.use_blue_noise == 0 && consts.frame == 0) {
+        jitter = vec2(0.5);
+    }
+    if(s == 0) gbuf_jitter = jitter;
+
+    const vec2 pixelCenter = vec2(gl_LaunchIDEXT.xy) + jitter;
+    const vec2 inUV = pixelCenter / vec2(gl_LaunchSizeEXT.xy);
+    vec4 target = uniforms.iP * vec4(inUV * 2.0 - 1.0, 0, 1);
+    vec4 direction = uniforms.iV * vec4(target.xyz, 0);
+    d = normalize(direction.xyz);
+}
+
+// Keep in sync with Util::reproject in src/util/temporal.cpp
+const float REPROJECT_NORMAL = 0.9;
+const float REPROJECT_PLANE = 0.01;
+
+// Whether last frame's G-buffer sample lies on the same surface: similar normal, and close to
+// this frame's tangent plane relative to the distance from the camera.
+bool same_surface(vec3 pos, vec3 norm, float dist, vec3 old_pos, vec3 old_norm) {
+	return dot(norm, old_norm) > REPROJECT_NORMAL && abs(dot(norm, old_pos - pos)) < REPROJECT_PLANE * dist;
+}
+
+// Bilinearly resamples last frame's accumulation where this frame's primary hit was visible,
+// dropping taps that fail the surface test. Returns the reprojected history length, or 0 if
+// the hit was disoccluded.
+float reproject(vec3 pos, vec3 norm, float dist, out vec3 color, out vec2 moments) {
+
+	color = vec3(0);
+	moments = vec2(0);
+
+	vec4 prev = uniforms.restir.prev_PV * vec4(pos, 1.0f);
+	vec2 size = vec2(gl_LaunchSizeEXT.xy);
+
+	// The G-buffer hit is at the jittered sample; shift back to where this pixel's center lands
+	vec2 coord = (prev.xy / prev.w * 0.5f + 0.5f) * size - gbuf_jitter;
+	ivec2 base = ivec2(floor(coord));
+	vec2 f = coord - vec2(base);
+
+	float w_sum = 0, n = 0;
+	for(int i = 0; i < 4; i++) {
+		ivec2 q = base + ivec2(i & 1, i >> 1);
+		if(any(lessThan(q, ivec2(0))) || any(greaterThanEqual(q, ivec2(size)))) continue;
+
+		vec3 old_pos = prev_gbuf_pos(q);
+		vec3 old_norm = prev_gbuf_norm(q);
+		if(!same_surface(pos, norm, dist, old_pos, old_norm)) continue;
+
+		float w = ((i & 1) == 1 ? f.x : 1 - f.x) * ((i >> 1) == 1 ? f.y : 1 - f.y);
+		vec3 m = imageLoad(prev_moments_image, q).xyz;
+		color += w * imageLoad(prev_accum_image, q).xyz;
+		moments += w * m.xy;
+		n += w * m.z;
+		w_sum += w;
+	}
+
+	if(w_sum < 1e-3) {
+		color = vec3(0);
+		moments = vec2(0);
+		return 0;
+	}
+	color /= w_sum;
+	moments /= w_sum;
+	return n / w_sum;
+}
+
+// Blends this frame's estimate into the pixel's history and writes the output image
+void resolve(vec3 avg, vec3 gbuf_pos, vec3 gbuf_norm, vec3 gbuf_albedo, vec3 camera_o) {
+
+	// Luminance moments of the albedo-demodulated estimate, for the denoiser's variance
+	float l = luma(avg / max(gbuf_albedo, vec3(ALBEDO_EPS)));
+	vec2 moments = vec2(l, l * l);
+
+	// History carried over from last frame: the same pixel while the camera is still, otherwise
+	// reprojected, with disoccluded pixels (and the background) starting over.
+	ivec2 pix = ivec2(gl_LaunchIDEXT.xy);
+	vec3 old_color = vec3(0);
+	vec2 old_moments = vec2(0);
+	float n = 0;
+
+	if(consts.frame > 0) {
+		if(consts.reproject == 0) {
+			vec3 m = imageLoad(prev_moments_image, pix).xyz;
+			old_color = imageLoad(prev_accum_image, pix).xyz;
+			old_moments = m.xy;
+			n = m.z;
+		} else if(dot(gbuf_norm, gbuf_norm) > 0.5) {
+			n = reproject(gbuf_pos, gbuf_norm, distance(gbuf_pos, camera_o), old_color, old_moments);
+		}
+	}
+
+	// Running mean while converging; once moving, the history is clamped so the average turns
+	// into an exponential moving average that forgets stale, resampled history.
+	n = min(n + 1, float(consts.reproject == 1 ? consts.max_history : consts.max_frame));
+	float a = 1.0f / n;
+	vec3 color = mix(old_color, avg, a);
+	moments = mix(old_moments, moments, a);
+
+	imageStore(image, pix, vec4(color, 1));
+	imageStore(accum_image, pix, vec4(color, 1));
+	imageStore(moments_image, pix, vec4(moments, n, 1));
+
+	if(consts.debug_view > 0) {
+		vec4 prev_pos = uniforms.restir.prev_PV * vec4(gbuf_pos, 1.0f);
+		prev_pos.xyz /= prev_pos.w;
+		prev_pos.xy = (prev_pos.xy + 1.0f) * 0.5f;
+		
+		if(dot(gbuf_norm, gbuf_norm) > 0.5 && 
+		   all(greaterThan(prev_pos.xy, vec2(0))) &&
+		   all(lessThan(prev_pos.xy, vec2(1)))) {
+
+			ivec2 prev_frag = ivec2(prev_pos.xy * vec2(gl_LaunchSizeEXT.xy));
+
+			vec3 old_pos = prev_gbuf_pos(prev_frag);
+			vec3 old_norm = prev_gbuf_norm(prev_frag);
+			vec3 old_alb = prev_gbuf_albedo(prev_frag);
+
+			if(consts.debug_view == 1) {
+				imageStore(image, ivec2(gl_LaunchIDEXT.xy), vec4(old_pos, 1));
+			} else if(consts.debug_view == 2) {
+				imageStore(image, ivec2(gl_LaunchIDEXT.xy), vec4(old_norm, 1));
+			} else if(consts.debug_view == 3) {
+				imageStore(image, ivec2(gl_LaunchIDEXT.xy), vec4(old_alb, 1));
+			}
+		} else {
+			imageStore(image, ivec2(gl_LaunchIDEXT.xy), vec4(0, 0, 0, 1));
+		}
+	}
+}
@@ -8,12 +8,32 @@ struct Reservoir {
 	uint n_seen;
 };
 
+// Storage form of Reservoir: octahedral light normal, half emission and a 16 bit sample count,
+// 32 bytes instead of 64. Expects pack.glsl; mirrored by Pack::Packed_Reservoir.
+struct PackedReservoir {
+	vec3 pos;
+	uint normal;
+	uint emissive_rg;
+	uint emissive_b_n;
+	float w_sum;
+	float w;
+};
+
 struct ReSTIRConstants {
     mat4 prev_PV;
 	uint new_samples;
 	uint temporal_multiplier;
+	uint spatial_samples;
+	float spatial_radius;
+	uint spatial_bias;
 };
 
+// Bias correction for spatial reuse: none and support match Reservoir_Bias::none and ::z in
+// src/lib/reservoir.h; visibility is ::z with shadowed neighbour targets
+const uint RES_BIAS_NONE = 0;
+const uint RES_BIAS_SUPPORT = 1;
+const uint RES_BIAS_VISIBILITY = 2;
+
 void res_update(inout uint seed, inout Reservoir res, float weight, vec3 pos, vec3 normal, vec3 emissive) {
 
 	res.n_seen++;
@@ -26,6 +46,19 @@ void res_update(inout uint seed, inout Reservoir res, float weight, vec3 pos, ve
 	}
 }
 
+// Merges another reservoir, whose sample has the given resampling weight here
+void res_combine(inout uint seed, inout Reservoir res, float weight, Reservoir other) {
+
+	res.n_seen += other.n_seen;
+	res.w_sum += weight;
+
+	if(randf(seed) < weight / res.w_sum) {
+		res.pos = other.pos;
+		res.normal = other.normal;
+		res.emissive = other.emissive;
+	}
+}
+
 Reservoir res_new() {
 	Reservoir result;
 	result.w_sum = 0;
@@ -34,3 +67,24 @@ Reservoir res_new() {
 	return result;
 }
 
+PackedReservoir res_pack(Reservoir res) {
+	PackedReservoir p;
+	p.pos = res.pos;
+	p.normal = pack_normal(res.normal);
+	p.emissive_rg = pack_half2(res.emissive.rg);
+	p.emissive_b_n = f32_to_f16(res.emissive.b) | (min(res.n_seen, 65535u) << 16);
+	p.w_sum = res.w_sum;
+	p.w = res.w;
+	return p;
+}
+
+Reservoir res_unpack(PackedReservoir p) {
+	Reservoir res;
+	res.pos = p.pos;
+	res.normal = unpack_normal(p.normal);
+	res.emissive = vec3(unpack_half2(p.emissive_rg), unpackHalf2x16(p.emissive_b_n).x);
+	res.w_sum = p.w_sum;
+	res.w = p.w;
+	res.n_seen = p.emissive_b_n >> 16;
+	return res;
+}
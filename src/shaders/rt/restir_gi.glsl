@@ -0,0 +1,108 @@
+
+// ReSTIR GI (Ouyang et al. 2021): reservoirs of indirect samples, i.e. the point the first bounce
+// hit and the radiance it sends back toward the visible point. Expects pack.glsl.
+// CPU counterpart: src/util/restir_gi.h.
+
+struct GISample {
+	vec3 xv, nv;	// visible point and normal the sample is currently measured at
+	vec3 xs, ns;	// sample point and normal
+	vec3 Lo;		// radiance leaving xs toward the visible point that generated it
+};
+
+struct GIReservoir {
+	GISample s;
+	float w_sum;
+	float w;
+	uint n_seen;
+};
+
+// Storage form, 48 bytes (Pack::Packed_GI_Reservoir)
+struct PackedGIReservoir {
+	vec3 xv;
+	uint nv;
+	vec3 xs;
+	uint ns;
+	uint Lo_rg;
+	uint Lo_b_n;
+	float w_sum;
+	float w;
+};
+
+// Bounces that escape to the environment become points this far along their direction
+const float GI_DISTANT = 1e5;
+// Neighbours whose sample would need more than this change of density are not reused
+const float GI_MAX_JACOBIAN = 10;
+
+GIReservoir gi_new() {
+	GIReservoir r;
+	r.s.xv = r.s.nv = r.s.xs = r.s.ns = r.s.Lo = vec3(0);
+	r.w_sum = 0;
+	r.w = 0;
+	r.n_seen = 0;
+	return r;
+}
+
+void gi_update(inout uint seed, inout GIReservoir r, float weight, GISample s) {
+
+	r.n_seen++;
+	r.w_sum += weight;
+
+	if(randf(seed) < weight / r.w_sum) {
+		r.s = s;
+	}
+}
+
+void gi_combine(inout uint seed, inout GIReservoir r, float weight, GIReservoir other) {
+
+	r.n_seen += other.n_seen;
+	r.w_sum += weight;
+
+	if(randf(seed) < weight / r.w_sum) {
+		r.s = other.s;
+	}
+}
+
+// Ratio of solid angle densities when the sample is reused at visible point x instead of s.xv
+// (eq. 11): multiplies the reused reservoir's weight.
+float gi_jacobian(GISample s, vec3 x) {
+	vec3 dq = s.xv - s.xs, dr = x - s.xs;
+	float lq = dot(dq, dq), lr = dot(dr, dr);
+	if(lq == 0 || lr == 0) return 0;
+	float cq = abs(dot(s.ns, dq)) * inversesqrt(lq);
+	float cr = abs(dot(s.ns, dr)) * inversesqrt(lr);
+	if(cq == 0) return 0;
+	return (cr / cq) * (lq / lr);
+}
+
+// Jacobian of reusing the sample at x, or 0 past the cap. Rejected reservoirs still count toward
+// n_seen: dropping them outright would pick neighbours by the samples they hold, which biases.
+float gi_reuse_jacobian(GISample s, vec3 x) {
+	float J = gi_jacobian(s, x);
+	return J <= GI_MAX_JACOBIAN ? J : 0;
+}
+
+PackedGIReservoir gi_pack(GIReservoir r) {
+	PackedGIReservoir p;
+	p.xv = r.s.xv;
+	p.nv = pack_normal(r.s.nv);
+	p.xs = r.s.xs;
+	p.ns = pack_normal(r.s.ns);
+	p.Lo_rg = pack_half2(r.s.Lo.rg);
+	p.Lo_b_n = f32_to_f16(r.s.Lo.b) | (min(r.n_seen, 65535u) << 16);
+	p.w_sum = r.w_sum;
+	p.w = r.w;
+	return p;
+}
+
+GIReservoir gi_unpack(PackedGIReservoir p) {
+	GIReservoir r;
+	r.s.xv = p.xv;
+	r.s.nv = unpack_normal(p.nv);
+	r.s.xs = p.xs;
+	r.s.ns = unpack_normal(p.ns);
+	r.s.Lo = vec3(unpack_half2(p.Lo_rg), unpackHalf2x16(p.Lo_b_n).x);
+	r.w_sum = p.w_sum;
+	r.w = p.w;
+	r.n_seen = p.Lo_b_n >> 16;
+	return r;
+}
@@ -43,6 +43,24 @@ struct Vertex {
 	vec4 tangent;
 };
 
+// Page layout of a virtual texture. Keep in sync with Util::VT_Texture in
+// src/util/virtual_texture.h
+struct VT_Texture {
+	uint w, h, levels, first_page;
+};
+
+const uint VT_PAGE = 128;
+const uint VT_BORDER = 4;
+const uint VT_SLOT = VT_PAGE + 2 * VT_BORDER;
+const uint VT_FEEDBACK = 16384;
+
+// Footprint of the pixel a path started from: width at the ray origin, and how fast it grows
+// per unit distance. Keep in sync with Util::Ray_Cone in src/util/texture_sampler.h
+struct RayCone {
+	float width;
+	float spread;
+};
+
 struct TraceInfo {
 	vec3 o;
 	vec3 d;
@@ -50,6 +68,7 @@ struct TraceInfo {
 	uint depth;
 	vec3 throughput;
 	float mis;
+	RayCone cone;
 };
 
 struct Ray_Payload {
@@ -62,6 +81,9 @@ struct Ray_Payload {
 struct HitInfo {
 	vec3 pos, normal, tangent;
 	vec2 texcoord;
+	// log2 of UV over world area of the triangle, halved, and the change of normal per unit
+	// length along its edges; lod is set by cone_hit
+	float lod_bias, curvature, lod;
 };
 
 struct MatInfo {
@@ -92,55 +114,48 @@ layout(push_constant) uniform Constants
 	int use_rr;
 	int n_lights;
 	int n_objs;
+	int use_env_map;
+	int use_blue_noise;
+	int reproject;
+	int max_history;
+	int use_ray_cones;
+	int use_virtual_textures;
 } consts;
 
 // RNG //////////////////////////////////////////
 
-uint tea(uint val0, uint val1) {
-	uint v0 = val0;
-	uint v1 = val1;
-	uint s0 = 0;
-	for(uint n = 0; n < 16; n++) {
-		s0 += 0x9e3779b9;
-		v0 += ((v1 << 4) + 0xa341316c) ^ (v1 + s0) ^ ((v1 >> 5) + 0xc8013ea4);
-		v1 += ((v0 << 4) + 0xad90777d) ^ (v0 + s0) ^ ((v0 >> 5) + 0x7e95761e);
-	}
-	return v0;
-}
+// Counter-based PCG (RXS-M-XS 32); keep in sync with src/lib/rng.h
 
-uint lcg(inout uint prev) {
-	uint LCG_A = 1664525u;
-	uint LCG_C = 1013904223u;
-	prev = (LCG_A * prev + LCG_C);
-	return prev & 0x00FFFFFF;
+uint pcg_hash(uint v) {
+	uint state = v * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
 }
 
-float randf(inout uint prev) {
-	return (float(lcg(prev)) / float(0x01000000));
+uint rng_key(uint pixel, uint frame, uint samp, uint bounce) {
+	return pcg_hash(pixel ^ pcg_hash(frame ^ pcg_hash(samp ^ pcg_hash(bounce))));
 }
 
-uint randu(inout uint prev, uint a, uint b) {
-	return lcg(prev) % (b - a) + a;
+uint pcg(inout uint state) {
+	uint old = state;
+	state = state * 747796405u + 2891336453u;
+	uint word = ((old >> ((old >> 28u) + 4u)) ^ old) * 277803737u;
+	return (word >> 22u) ^ word;
 }
 
-// Sampling //////////////////////////////////////////
-
-float radical_inverse(uint bits) {
-    bits = (bits << 16u) | (bits >> 16u);
-    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
-    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
-    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
-    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
-    return float(bits) * 2.3283064365386963e-10;
+float randf(inout uint state) {
+	return float(pcg(state) >> 8) * (1.0 / 16777216.0);
 }
 
-vec2 hammersley(uint i, uint N) {
-    return vec2(float(i)/float(N), radical_inverse(i));
+uint randu(inout uint state, uint a, uint b) {
+	return pcg(state) % (b - a) + a;
 }
 
-vec3 uniform_hemisphere(inout uint seed, vec3 x, vec3 y, vec3 z) {
-    float Xi1 = randf(seed);
-    float Xi2 = randf(seed);
+// Sampling //////////////////////////////////////////
+
+vec3 uniform_hemisphere(vec2 Xi, vec3 x, vec3 y, vec3 z) {
+    float Xi1 = Xi.x;
+    float Xi2 = Xi.y;
     float costheta = Xi1;
 	float sintheta = sqrt(1 - costheta * costheta);
     float phi = 2 * M_PI * Xi2;
@@ -150,18 +165,18 @@ vec3 uniform_hemisphere(inout uint seed, vec3 x, vec3 y, vec3 z) {
     return x * xs + y * ys + z * zs;
 }
 
-vec3 cosine_hemisphere(inout uint seed, vec3 x, vec3 y, vec3 z) {
-	float phi = randf(seed);
-	float cosT2 = randf(seed);
+vec3 cosine_hemisphere(vec2 Xi, vec3 x, vec3 y, vec3 z) {
+	float phi = Xi.x;
+	float cosT2 = Xi.y;
 	float sinT = sqrt(1.0 - cosT2);
 	vec3 direction = vec3(cos(2 * M_PI * phi) * sinT, sin(2 * M_PI * phi) * sinT, sqrt(cosT2));
 	direction = direction.x * x + direction.y * y + direction.z * z;
 	return direction;
 }
 
-vec3 cospow_hemisphere(float exponent, inout uint seed, vec3 x, vec3 y, vec3 z) {
-	float phi = 2 * M_PI * randf(seed);
-	float cosT = pow(randf(seed), 1.0 / (exponent + 1.0));
+vec3 cospow_hemisphere(float exponent, vec2 Xi, vec3 x, vec3 y, vec3 z) {
+	float phi = 2 * M_PI * Xi.x;
+	float cosT = pow(Xi.y, 1.0 / (exponent + 1.0));
 	float sinT = sqrt(1.0 - cosT*cosT);
 	vec3 direction = vec3(cos(phi) * sinT, sin(phi) * sinT, cosT);
 	direction = direction.x * x + direction.y * y + direction.z * z;
@@ -170,9 +185,9 @@ vec3 cospow_hemisphere(float exponent, inout uint seed, vec3 x, vec3 y, vec3 z)
 
 // Triangles //////////////////////////////////////////
 
-vec3 triangle_sample(inout uint seed) {
-    float u = sqrt(randf(seed));
-    float v = randf(seed);
+vec3 triangle_sample(vec2 Xi) {
+    float u = sqrt(Xi.x);
+    float v = Xi.y;
     float a = u * (1 - v);
     float b = u * v;
     return vec3(a, b, 1 - a - b);
@@ -231,6 +246,9 @@ float luma(vec3 rgb) {
 	return 0.299 * rgb.r + 0.587 * rgb.g + 0.114 * rgb.b;
 }
 
+// Smallest albedo divided out when demodulating; matches the denoiser
+const float ALBEDO_EPS = 0.01;
+
 float max4(vec3 v, float f) {
 	return max(max(v.x, v.y),max(v.z, f));
 }
@@ -269,9 +287,9 @@ vec3 bp_eval(MatInfo mat, ShadeInfo shade, vec3 wi) {
 	return mat.albedo * bp_pdf(mat, shade, wi);
 }
 
-bool bp_sample(inout uint seed, MatInfo mat, ShadeInfo shade, out vec3 wi) {
+bool bp_sample(vec2 Xi, MatInfo mat, ShadeInfo shade, out vec3 wi) {
 	float exp = 1 / mat.roughness;
-	vec3 H = cospow_hemisphere(exp, seed, shade.T, shade.B, shade.N);
+	vec3 H = cospow_hemisphere(exp, Xi, shade.T, shade.B, shade.N);
 	wi = reflect(shade.wo, H);
 	return dot(wi, shade.N) > 0;
 }
@@ -303,10 +321,10 @@ float GGX_pdf(MatInfo mat, ShadeInfo shade, vec3 wi) {
 	vec3 H = normalize(wi - shade.wo);
 	
 	float nDh = max(dot(H, shade.N), 0);
-	float oDh = max(dot(wi, H), 0);
 	float a2 = mat.roughness * mat.roughness;
 
-    return GGX_D(nDh, a2) * nDh / (4 * oDh);
+	// Visible normals: D_wo(H) / (4 oDh) = G1(wo) D(H) / (4 oDn)
+	return GGX_D(nDh, a2) / (2 * (oDn + sqrt(a2 + (1 - a2) * oDn * oDn)));
 }
 
 vec3 GGX_eval(MatInfo mat, ShadeInfo shade, vec3 wi) {
@@ -323,24 +341,34 @@ vec3 GGX_eval(MatInfo mat, ShadeInfo shade, vec3 wi) {
 	return GGX_F(mat.albedo, iDn) * GGX_D(nDh, a2) * GGX_G(oDn, iDn, a2) / (4 * oDn);
 }
 
-bool GGX_sample(inout uint seed, MatInfo mat, ShadeInfo shade, out vec3 wi) {
-	
-    float a2 = mat.roughness * mat.roughness;
+bool GGX_sample(vec2 Xi, MatInfo mat, ShadeInfo shade, out vec3 wi) {
 
-	vec2 Xi = vec2(randf(seed), randf(seed));
-	float phi = 2.0 * M_PI * Xi.x;
-    float cosTheta = sqrt((1.0 - Xi.y) / (1.0 + (a2 - 1.0) * Xi.y));
-    float sinTheta = sqrt(1.0 - cosTheta*cosTheta);
+	// Heitz 2018, "Sampling the GGX Distribution of Visible Normals"
+	float alpha = mat.roughness;
+	vec3 wo = -shade.wo;
+	vec3 Ve = vec3(dot(wo, shade.T), dot(wo, shade.B), dot(wo, shade.N));
 
-    vec3 dir;
-    dir.x = cos(phi) * sinTheta;
-    dir.y = sin(phi) * sinTheta;
-    dir.z = cosTheta;
+	// Stretch to the hemisphere configuration and build an orthonormal basis around it
+	vec3 Vh = normalize(vec3(alpha * Ve.x, alpha * Ve.y, Ve.z));
+	float lensq = Vh.x * Vh.x + Vh.y * Vh.y;
+	vec3 T1 = lensq > 0 ? vec3(-Vh.y, Vh.x, 0) * inversesqrt(lensq) : vec3(1, 0, 0);
+	vec3 T2 = cross(Vh, T1);
 
-    vec3 H = shade.T * dir.x + shade.B * dir.y + shade.N * dir.z;
+	// Sample the projected area, warped towards the visible half of the disk
+	float r = sqrt(Xi.x);
+	float phi = 2.0 * M_PI * Xi.y;
+	float t1 = r * cos(phi);
+	float t2 = r * sin(phi);
+	float s = 0.5 * (1.0 + Vh.z);
+	t2 = (1.0 - s) * sqrt(1.0 - t1 * t1) + s * t2;
+
+	vec3 Nh = t1 * T1 + t2 * T2 + sqrt(max(0.0, 1.0 - t1 * t1 - t2 * t2)) * Vh;
+	vec3 Ne = normalize(vec3(alpha * Nh.x, alpha * Nh.y, max(0.0, Nh.z)));
+
+	vec3 H = shade.T * Ne.x + shade.B * Ne.y + shade.N * Ne.z;
 	wi = reflect(shade.wo, H);
-    return dot(wi, shade.N) > 0;
-}  
+	return dot(wi, shade.N) > 0;
+}
 
 // Material //////////////////////////////////////////
 
@@ -360,10 +388,10 @@ vec3 MAT_eval(MatInfo mat, ShadeInfo shade, vec3 wi) {
 	}
 }
 
-bool MAT_sample(inout uint seed, MatInfo mat, ShadeInfo shade, out vec3 wi) {
+bool MAT_sample(vec2 Xi, MatInfo mat, ShadeInfo shade, out vec3 wi) {
 	if(consts.brdf == 0) {
-		return bp_sample(seed, mat, shade, wi);
+		return bp_sample(Xi, mat, shade, wi);
 	} else if(consts.brdf == 1) {
-		return GGX_sample(seed, mat, shade, wi);
+		return GGX_sample(Xi, mat, shade, wi);
 	}
 }
@@ -0,0 +1,61 @@
+
+// Owen-scrambled Sobol; keep in sync with src/lib/sobol.h
+
+const uint sobol_directions[64] = uint[](
+	0x80000000u, 0x40000000u, 0x20000000u, 0x10000000u, 0x08000000u, 0x04000000u, 0x02000000u, 0x01000000u,
+	0x00800000u, 0x00400000u, 0x00200000u, 0x00100000u, 0x00080000u, 0x00040000u, 0x00020000u, 0x00010000u,
+	0x00008000u, 0x00004000u, 0x00002000u, 0x00001000u, 0x00000800u, 0x00000400u, 0x00000200u, 0x00000100u,
+	0x00000080u, 0x00000040u, 0x00000020u, 0x00000010u, 0x00000008u, 0x00000004u, 0x00000002u, 0x00000001u,
+	0x80000000u, 0xc0000000u, 0xa0000000u, 0xf0000000u, 0x88000000u, 0xcc000000u, 0xaa000000u, 0xff000000u,
+	0x80800000u, 0xc0c00000u, 0xa0a00000u, 0xf0f00000u, 0x88880000u, 0xcccc0000u, 0xaaaa0000u, 0xffff0000u,
+	0x80008000u, 0xc000c000u, 0xa000a000u, 0xf000f000u, 0x88008800u, 0xcc00cc00u, 0xaa00aa00u, 0xff00ff00u,
+	0x80808080u, 0xc0c0c0c0u, 0xa0a0a0a0u, 0xf0f0f0f0u, 0x88888888u, 0xccccccccu, 0xaaaaaaaau, 0xffffffffu
+);
+
+uint sobol(uint index, uint dim) {
+	uint x = 0;
+	for(uint bit = 0; index != 0; index >>= 1, bit++) {
+		if((index & 1u) != 0) x ^= sobol_directions[dim * 32 + bit];
+	}
+	return x;
+}
+
+uint sobol_hash(uint x) {
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+uint hash_combine(uint seed, uint v) {
+	return seed ^ (v + (seed << 6) + (seed >> 2));
+}
+
+uint laine_karras_permutation(uint x, uint seed) {
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return x;
+}
+
+uint nested_uniform_scramble(uint x, uint seed) {
+	x = bitfieldReverse(x);
+	x = laine_karras_permutation(x, seed);
+	return bitfieldReverse(x);
+}
+
+float sobol_to_float(uint x) {
+	return float(x >> 8) * (1.0 / 16777216.0);
+}
+
+vec2 sobol_2d(uint index, uint dim, uint seed) {
+	uint s = hash_combine(seed, sobol_hash(dim));
+	uint i = nested_uniform_scramble(index, s);
+	uint x = nested_uniform_scramble(sobol(i, 0), hash_combine(s, 0));
+	uint y = nested_uniform_scramble(sobol(i, 1), hash_combine(s, 1));
+	return vec2(sobol_to_float(x), sobol_to_float(y));
+}
@@ -0,0 +1,611 @@
+
+#include "bc.h"
+#include "mipmap.h"
+#include "parallel.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <lib/log.h>
+#include <util/files.h>
+
+namespace Util {
+
+namespace {
+
+// Bump whenever the encoder's output changes, so stale cache entries get rebuilt
+constexpr uint32_t ENCODER_VERSION = 1;
+constexpr uint32_t CACHE_MAGIC = 0x314e4342; // "BCN1"
+
+// Endpoint refinement passes per block
+constexpr int ITERATIONS = 3;
+
+const float BC1_WEIGHTS[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+const float BC4_WEIGHTS[8] = {0.0f,        1.0f,        1.0f / 7.0f, 2.0f / 7.0f,
+                              3.0f / 7.0f, 4.0f / 7.0f, 5.0f / 7.0f, 6.0f / 7.0f};
+const int BC7_WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+/// 16 texels stored by channel, so four texels fill an SSE register
+struct Block {
+    alignas(16) float c[4][16];
+};
+
+void load_block(Image_Const_View src, unsigned int bx, unsigned int by, Block& b) {
+    for(unsigned int i = 0; i < 16; i++) {
+        unsigned int x = std::min(bx * 4 + (i & 3), src.w - 1);
+        unsigned int y = std::min(by * 4 + (i >> 2), src.h - 1);
+        const unsigned char* t = src.texel(x, y);
+        for(int c = 0; c < 4; c++) b.c[c][i] = t[c];
+    }
+}
+
+/// Index of the nearest of n palette entries for every texel, over the first channels; returns
+/// the summed squared error
+float nearest(const Block& b, const float (*pal)[4], unsigned int n, unsigned int channels,
+              uint8_t* idx) {
+    float total = 0.0f;
+#if UTIL_SSE
+    for(unsigned int g = 0; g < 16; g += 4) {
+        __m128 best = _mm_set1_ps(INFINITY), best_i = _mm_setzero_ps();
+        for(unsigned int k = 0; k < n; k++) {
+            __m128 d = _mm_setzero_ps();
+            for(unsigned int c = 0; c < channels; c++) {
+                __m128 e = _mm_sub_ps(_mm_load_ps(&b.c[c][g]), _mm_set1_ps(pal[k][c]));
+                d = _mm_add_ps(d, _mm_mul_ps(e, e));
+            }
+            best_i = select_ps(_mm_cmplt_ps(d, best), _mm_set1_ps((float)k), best_i);
+            best = _mm_min_ps(d, best);
+        }
+        alignas(16) float e[4], i[4];
+        _mm_store_ps(e, best);
+        _mm_store_ps(i, best_i);
+        for(int j = 0; j < 4; j++) {
+            total += e[j];
+            idx[g + j] = (uint8_t)i[j];
+        }
+    }
+#else
+    for(unsigned int i = 0; i < 16; i++) {
+        float best = INFINITY;
+        for(unsigned int k = 0; k < n; k++) {
+            float d = 0.0f;
+            for(unsigned int c = 0; c < channels; c++) {
+                float e = b.c[c][i] - pal[k][c];
+                d += e * e;
+            }
+            if(d < best) {
+                best = d;
+                idx[i] = (uint8_t)k;
+            }
+        }
+        total += best;
+    }
+#endif
+    return total;
+}
+
+/// Ends of the block's principal axis, found by power iteration on the covariance
+void line_endpoints(const Block& b, unsigned int channels, float* e0, float* e1) {
+
+    float mean[4] = {};
+    for(unsigned int c = 0; c < channels; c++) {
+        for(unsigned int i = 0; i < 16; i++) mean[c] += b.c[c][i];
+        mean[c] /= 16.0f;
+    }
+
+    float cov[4][4] = {};
+    for(unsigned int i = 0; i < 16; i++)
+        for(unsigned int r = 0; r < channels; r++)
+            for(unsigned int s = 0; s < channels; s++)
+                cov[r][s] += (b.c[r][i] - mean[r]) * (b.c[s][i] - mean[s]);
+
+    // Starting from the row of the widest channel avoids an initial guess orthogonal to the axis
+    unsigned int widest = 0;
+    for(unsigned int c = 1; c < channels; c++)
+        if(cov[c][c] > cov[widest][widest]) widest = c;
+
+    float axis[4] = {};
+    for(unsigned int c = 0; c < channels; c++) axis[c] = cov[widest][c];
+    for(int it = 0; it < 8; it++) {
+        float next[4] = {}, scale = 0.0f;
+        for(unsigned int r = 0; r < channels; r++) {
+            for(unsigned int s = 0; s < channels; s++) next[r] += cov[r][s] * axis[s];
+            scale = std::max(scale, std::abs(next[r]));
+        }
+        if(scale < 1e-8f) break;
+        for(unsigned int c = 0; c < channels; c++) axis[c] = next[c] / scale;
+    }
+
+    float len = 0.0f;
+    for(unsigned int c = 0; c < channels; c++) len += axis[c] * axis[c];
+    len = std::sqrt(len);
+    for(unsigned int c = 0; c < channels; c++) axis[c] = len > 1e-8f ? axis[c] / len : 0.0f;
+
+    float tmin = 0.0f, tmax = 0.0f;
+    for(unsigned int i = 0; i < 16; i++) {
+        float t = 0.0f;
+        for(unsigned int c = 0; c < channels; c++) t += (b.c[c][i] - mean[c]) * axis[c];
+        tmin = std::min(tmin, t);
+        tmax = std::max(tmax, t);
+    }
+
+    for(unsigned int c = 0; c < channels; c++) {
+        e0[c] = std::clamp(mean[c] + axis[c] * tmax, 0.0f, 255.0f);
+        e1[c] = std::clamp(mean[c] + axis[c] * tmin, 0.0f, 255.0f);
+    }
+}
+
+/// Least-squares endpoints for fixed indices, where index k sits weight[k] of the way from e0
+/// to e1. False if the indices don't pin down a line.
+bool refine(const Block& b, unsigned int channels, const uint8_t* idx, const float* weight,
+            float* e0, float* e1) {
+
+    float a = 0.0f, ab = 0.0f, bb = 0.0f, x0[4] = {}, x1[4] = {};
+    for(unsigned int i = 0; i < 16; i++) {
+        float t = weight[idx[i]], s = 1.0f - t;
+        a += s * s;
+        ab += s * t;
+        bb += t * t;
+        for(unsigned int c = 0; c < channels; c++) {
+            x0[c] += s * b.c[c][i];
+            x1[c] += t * b.c[c][i];
+        }
+    }
+
+    float det = a * bb - ab * ab;
+    if(det < 1e-6f) return false;
+
+    for(unsigned int c = 0; c < channels; c++) {
+        e0[c] = std::clamp((bb * x0[c] - ab * x1[c]) / det, 0.0f, 255.0f);
+        e1[c] = std::clamp((a * x1[c] - ab * x0[c]) / det, 0.0f, 255.0f);
+    }
+    return true;
+}
+
+/// LSB-first bit stream over one 16 byte block
+struct Bits {
+    uint64_t w[2] = {};
+    unsigned int pos = 0;
+
+    void put(uint32_t v, unsigned int n) {
+        for(unsigned int i = 0; i < n; i++, pos++)
+            if((v >> i) & 1) w[pos >> 6] |= 1ull << (pos & 63);
+    }
+    uint32_t get(unsigned int n) {
+        uint32_t v = 0;
+        for(unsigned int i = 0; i < n; i++, pos++)
+            v |= (uint32_t)((w[pos >> 6] >> (pos & 63)) & 1) << i;
+        return v;
+    }
+};
+
+uint16_t to_565(const float* c) {
+    uint32_t r = (uint32_t)std::lround(c[0] * (31.0f / 255.0f));
+    uint32_t g = (uint32_t)std::lround(c[1] * (63.0f / 255.0f));
+    uint32_t b = (uint32_t)std::lround(c[2] * (31.0f / 255.0f));
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+void from_565(uint16_t v, int* c) {
+    int r = v >> 11, g = (v >> 5) & 63, b = v & 31;
+    c[0] = (r << 3) | (r >> 2);
+    c[1] = (g << 2) | (g >> 4);
+    c[2] = (b << 3) | (b >> 2);
+}
+
+void bc1_palette(uint16_t c0, uint16_t c1, int pal[4][4]) {
+    from_565(c0, pal[0]);
+    from_565(c1, pal[1]);
+    for(int c = 0; c < 3; c++) {
+        if(c0 > c1) {
+            pal[2][c] = (2 * pal[0][c] + pal[1][c] + 1) / 3;
+            pal[3][c] = (pal[0][c] + 2 * pal[1][c] + 1) / 3;
+        } else {
+            pal[2][c] = (pal[0][c] + pal[1][c]) / 2;
+            pal[3][c] = 0;
+        }
+    }
+    for(int k = 0; k < 4; k++) pal[k][3] = 255;
+}
+
+void encode_bc1(const Block& b, unsigned char* out) {
+
+    float e0[4], e1[4];
+    line_endpoints(b, 3, e0, e1);
+    // The extremes are usually outliers, so pull the ends in a little like stb_dxt
+    for(int c = 0; c < 3; c++) {
+        float inset = (e0[c] - e1[c]) / 16.0f;
+        e0[c] -= inset;
+        e1[c] += inset;
+    }
+
+    float best = INFINITY;
+    for(int it = 0; it < ITERATIONS; it++) {
+        uint16_t c0 = to_565(e0), c1 = to_565(e1);
+        if(c0 < c1) {
+            std::swap(c0, c1);
+            std::swap_ranges(e0, e0 + 3, e1);
+        }
+
+        // Equal endpoints select three-color mode, where index 0 alone is still exact
+        int ipal[4][4];
+        float pal[4][4];
+        bc1_palette(c0, c1, ipal);
+        for(int k = 0; k < 4; k++)
+            for(int c = 0; c < 4; c++) pal[k][c] = (float)ipal[k][c];
+
+        uint8_t idx[16];
+        float err = nearest(b, pal, c0 == c1 ? 1 : 4, 3, idx);
+        if(err < best) {
+            best = err;
+            uint32_t bits = 0;
+            for(int i = 0; i < 16; i++) bits |= (uint32_t)idx[i] << (2 * i);
+            std::memcpy(out, &c0, 2);
+            std::memcpy(out + 2, &c1, 2);
+            std::memcpy(out + 4, &bits, 4);
+        }
+        if(err == 0.0f || c0 == c1 || !refine(b, 3, idx, BC1_WEIGHTS, e0, e1)) break;
+    }
+}
+
+void bc4_palette(int r0, int r1, float pal[8][4]) {
+    pal[0][0] = (float)r0;
+    pal[1][0] = (float)r1;
+    if(r0 > r1) {
+        for(int i = 2; i < 8; i++) pal[i][0] = (float)(((8 - i) * r0 + (i - 1) * r1 + 3) / 7);
+    } else {
+        for(int i = 2; i < 6; i++) pal[i][0] = (float)(((6 - i) * r0 + (i - 1) * r1 + 2) / 5);
+        pal[6][0] = 0.0f;
+        pal[7][0] = 255.0f;
+    }
+}
+
+void encode_bc4(const Block& src, unsigned int channel, unsigned char* out) {
+
+    Block b;
+    std::memcpy(b.c[0], src.c[channel], sizeof(b.c[0]));
+
+    float e0 = *std::max_element(b.c[0], b.c[0] + 16);
+    float e1 = *std::min_element(b.c[0], b.c[0] + 16);
+
+    float best = INFINITY;
+    for(int it = 0; it < ITERATIONS; it++) {
+        int r0 = (int)std::lround(e0), r1 = (int)std::lround(e1);
+        if(r0 < r1) {
+            std::swap(r0, r1);
+            std::swap(e0, e1);
+        }
+
+        float pal[8][4];
+        bc4_palette(r0, r1, pal);
+
+        uint8_t idx[16];
+        float err = nearest(b, pal, r0 == r1 ? 1 : 8, 1, idx);
+        if(err < best) {
+            best = err;
+            uint64_t bits = 0;
+            for(int i = 0; i < 16; i++) bits |= (uint64_t)idx[i] << (3 * i);
+            out[0] = (unsigned char)r0;
+            out[1] = (unsigned char)r1;
+            std::memcpy(out + 2, &bits, 6);
+        }
+        if(err == 0.0f || r0 == r1 || !refine(b, 1, idx, BC4_WEIGHTS, &e0, &e1)) break;
+    }
+}
+
+/// Best 7 bit endpoint and shared P-bit for an 8 bit color
+void quantize_p(const float* e, int* q, int& p) {
+    float best = INFINITY;
+    for(int pb = 0; pb < 2; pb++) {
+        int t[4];
+        float err = 0.0f;
+        for(int c = 0; c < 4; c++) {
+            t[c] = std::clamp((int)std::lround((e[c] - pb) * 0.5f), 0, 127);
+            float d = (float)(t[c] * 2 + pb) - e[c];
+            err += d * d;
+        }
+        if(err < best) {
+            best = err;
+            p = pb;
+            std::memcpy(q, t, sizeof(t));
+        }
+    }
+}
+
+void bc7_palette(const int* a, const int* b, float pal[16][4]) {
+    for(int k = 0; k < 16; k++)
+        for(int c = 0; c < 4; c++)
+            pal[k][c] = (float)(((64 - BC7_WEIGHTS[k]) * a[c] + BC7_WEIGHTS[k] * b[c] + 32) >> 6);
+}
+
+/// Mode 6: one subset, 7777.1 endpoints with unique P-bits and 4 bit indices
+void encode_bc7(const Block& b, unsigned char* out) {
+
+    float weights[16];
+    for(int k = 0; k < 16; k++) weights[k] = BC7_WEIGHTS[k] / 64.0f;
+
+    float e0[4], e1[4];
+    line_endpoints(b, 4, e0, e1);
+
+    float best = INFINITY;
+    for(int it = 0; it < ITERATIONS; it++) {
+        int q0[4], q1[4], p0, p1;
+        quantize_p(e0, q0, p0);
+        quantize_p(e1, q1, p1);
+
+        int a[4], c[4];
+        for(int j = 0; j < 4; j++) {
+            a[j] = q0[j] * 2 + p0;
+            c[j] = q1[j] * 2 + p1;
+        }
+        float pal[16][4];
+        bc7_palette(a, c, pal);
+
+        uint8_t idx[16];
+        float err = nearest(b, pal, 16, 4, idx);
+        if(err < best) {
+            best = err;
+
+            // The first index is stored without its top bit, so it has to be below 8
+            if(idx[0] & 8) {
+                std::swap_ranges(q0, q0 + 4, q1);
+                std::swap(p0, p1);
+                for(int i = 0; i < 16; i++) idx[i] = (uint8_t)(15 - idx[i]);
+            }
+
+            Bits bits;
+            bits.put(1 << 6, 7);
+            for(int j = 0; j < 4; j++) {
+                bits.put(q0[j], 7);
+                bits.put(q1[j], 7);
+            }
+            bits.put(p0, 1);
+            bits.put(p1, 1);
+            bits.put(idx[0], 3);
+            for(int i = 1; i < 16; i++) bits.put(idx[i], 4);
+            std::memcpy(out, bits.w, 16);
+        }
+        if(err == 0.0f || !refine(b, 4, idx, weights, e0, e1)) break;
+    }
+}
+
+void decode_bc1(const unsigned char* in, unsigned char out[16][4]) {
+    uint16_t c0, c1;
+    uint32_t bits;
+    std::memcpy(&c0, in, 2);
+    std::memcpy(&c1, in + 2, 2);
+    std::memcpy(&bits, in + 4, 4);
+    int pal[4][4];
+    bc1_palette(c0, c1, pal);
+    for(int i = 0; i < 16; i++)
+        for(int c = 0; c < 4; c++) out[i][c] = (unsigned char)pal[(bits >> (2 * i)) & 3][c];
+}
+
+void decode_bc4(const unsigned char* in, unsigned int channel, unsigned char out[16][4]) {
+    uint64_t bits = 0;
+    std::memcpy(&bits, in + 2, 6);
+    float pal[8][4];
+    bc4_palette(in[0], in[1], pal);
+    for(int i = 0; i < 16; i++) out[i][channel] = (unsigned char)pal[(bits >> (3 * i)) & 7][0];
+}
+
+/// Mode 6 only, the one encode_bc7 writes; other modes decode as black
+void decode_bc7(const unsigned char* in, unsigned char out[16][4]) {
+    Bits bits;
+    std::memcpy(bits.w, in, 16);
+    if(bits.get(7) != 1 << 6) {
+        std::memset(out, 0, 64);
+        return;
+    }
+    int q0[4], q1[4];
+    for(int j = 0; j < 4; j++) {
+        q0[j] = bits.get(7);
+        q1[j] = bits.get(7);
+    }
+    int p0 = bits.get(1), p1 = bits.get(1);
+    int a[4], c[4];
+    for(int j = 0; j < 4; j++) {
+        a[j] = q0[j] * 2 + p0;
+        c[j] = q1[j] * 2 + p1;
+    }
+    float pal[16][4];
+    bc7_palette(a, c, pal);
+    for(int i = 0; i < 16; i++) {
+        uint32_t k = bits.get(i ? 4 : 3);
+        for(int j = 0; j < 4; j++) out[i][j] = (unsigned char)pal[k][j];
+    }
+}
+
+bool read_cache(const std::string& path, BC_Texture& tex, unsigned int w, unsigned int h) {
+
+    auto file = File::read(path);
+    if(!file.has_value()) return false;
+    const std::vector<unsigned char>& data = file.value();
+
+    uint32_t header[6] = {};
+    if(data.size() < sizeof(header)) return false;
+    std::memcpy(header, data.data(), sizeof(header));
+    if(header[0] != CACHE_MAGIC || header[1] != ENCODER_VERSION ||
+       header[2] != (uint32_t)tex.format || header[4] != w || header[5] != h) {
+        warn("Ignoring stale texture cache %s", path.c_str());
+        return false;
+    }
+
+    size_t offset = sizeof(header);
+    unsigned int n = header[3];
+    tex.levels.clear();
+    for(unsigned int l = 0; l < n; l++) {
+        BC_Level level;
+        level.w = std::max(w >> l, 1u);
+        level.h = std::max(h >> l, 1u);
+        size_t size = level_bytes(level.w, level.h, tex.format);
+        if(offset + size > data.size()) {
+            warn("Ignoring truncated texture cache %s", path.c_str());
+            tex.levels.clear();
+            return false;
+        }
+        level.blocks.assign(data.begin() + offset, data.begin() + offset + size);
+        offset += size;
+        tex.levels.push_back(std::move(level));
+    }
+    return true;
+}
+
+void write_cache(const std::string& path, const BC_Texture& tex) {
+
+    const BC_Level& base = tex.levels[0];
+    uint32_t header[6] = {CACHE_MAGIC, ENCODER_VERSION, (uint32_t)tex.format,
+                          (uint32_t)tex.levels.size(), base.w, base.h};
+
+    std::vector<unsigned char> data(sizeof(header));
+    std::memcpy(data.data(), header, sizeof(header));
+    for(const BC_Level& level : tex.levels)
+        data.insert(data.end(), level.blocks.begin(), level.blocks.end());
+
+    if(!File::write(path, data.data(), data.size())) {
+        warn("Failed to write texture cache %s", path.c_str());
+    }
+}
+
+} // namespace
+
+unsigned int block_bytes(BC_Format format) {
+    return format == BC_Format::bc1 || format == BC_Format::bc4 ? 8 : 16;
+}
+
+size_t level_bytes(unsigned int w, unsigned int h, BC_Format format) {
+    return (size_t)((w + 3) / 4) * ((h + 3) / 4) * block_bytes(format);
+}
+
+const char* format_name(BC_Format format) {
+    switch(format) {
+    case BC_Format::bc1: return "BC1";
+    case BC_Format::bc4: return "BC4";
+    case BC_Format::bc5: return "BC5";
+    case BC_Format::bc7: return "BC7";
+    }
+    return "";
+}
+
+size_t BC_Texture::bytes() const {
+    size_t n = 0;
+    for(const BC_Level& level : levels) n += level.blocks.size();
+    return n;
+}
+
+BC_Level bc_compress(Image_Const_View src, BC_Format format) {
+
+    BC_Level level;
+    if(src.format != Image_Format::rgba8 && src.format != Image_Format::rgba8_srgb) {
+        warn("Cannot block-compress %s texels", format_name(src.format));
+        return level;
+    }
+
+    level.w = src.w;
+    level.h = src.h;
+    level.blocks.resize(level_bytes(src.w, src.h, format));
+    if(src.empty()) return level;
+
+    unsigned int bw = (src.w + 3) / 4, bh = (src.h + 3) / 4;
+    unsigned int size = block_bytes(format);
+
+    parallel_for(0, bh, [&](size_t by) {
+        Block b;
+        for(unsigned int bx = 0; bx < bw; bx++) {
+            load_block(src, bx, (unsigned int)by, b);
+            unsigned char* out = level.blocks.data() + (by * bw + bx) * size;
+            switch(format) {
+            case BC_Format::bc1: encode_bc1(b, out); break;
+            case BC_Format::bc4: encode_bc4(b, 0, out); break;
+            case BC_Format::bc5: {
+                encode_bc4(b, 0, out);
+                encode_bc4(b, 1, out + 8);
+            } break;
+            case BC_Format::bc7: encode_bc7(b, out); break;
+            }
+        }
+    });
+
+    return level;
+}
+
+Image bc_decompress(BC_Level_View level, BC_Format format, bool srgb) {
+
+    Image ret(level.w, level.h, srgb ? Image_Format::rgba8_srgb : Image_Format::rgba8);
+    Image_View view = ret.view();
+
+    unsigned int bw = (level.w + 3) / 4, bh = (level.h + 3) / 4;
+    unsigned int size = block_bytes(format);
+    if(level.size < (size_t)bw * bh * size) return ret;
+
+    parallel_for(0, bh, [&](size_t by) {
+        for(unsigned int bx = 0; bx < bw; bx++) {
+            const unsigned char* in = level.blocks + (by * bw + bx) * size;
+            unsigned char t[16][4] = {};
+            for(int i = 0; i < 16; i++) t[i][3] = 255;
+            switch(format) {
+            case BC_Format::bc1: decode_bc1(in, t); break;
+            case BC_Format::bc4: decode_bc4(in, 0, t); break;
+            case BC_Format::bc5: {
+                decode_bc4(in, 0, t);
+                decode_bc4(in + 8, 1, t);
+            } break;
+            case BC_Format::bc7: decode_bc7(in, t); break;
+            }
+            for(unsigned int i = 0; i < 16; i++) {
+                unsigned int x = bx * 4 + (i & 3), y = (unsigned int)by * 4 + (i >> 2);
+                if(x < level.w && y < level.h) std::memcpy(view.texel(x, y), t[i], 4);
+            }
+        }
+    });
+    return ret;
+}
+
+double psnr(Image_Const_View a, Image_Const_View b, unsigned int channels) {
+
+    double sum = 0.0;
+    for(unsigned int y = 0; y < a.h; y++) {
+        const unsigned char *ra = a.row(y), *rb = b.row(y);
+        for(unsigned int x = 0; x < a.w; x++)
+            for(unsigned int c = 0; c < channels; c++) {
+                double d = (double)ra[x * 4 + c] - rb[x * 4 + c];
+                sum += d * d;
+            }
+    }
+    double mse = sum / ((double)a.w * a.h * channels);
+    return mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : INFINITY;
+}
+
+BC_Texture bc_texture(Image_Const_View base, BC_Format format, const std::string& cache_dir) {
+
+    BC_Texture tex;
+    tex.format = format;
+    tex.srgb = base.format == Image_Format::rgba8_srgb;
+
+    std::string path;
+    if(!cache_dir.empty()) {
+        uint32_t key[5] = {ENCODER_VERSION, (uint32_t)format, (uint32_t)base.format, base.w,
+                           base.h};
+        uint64_t h = hash_texels(base, hash_bytes(key, sizeof(key)));
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bcn", (unsigned long long)h);
+        path = cache_dir + "/" + name;
+        if(read_cache(path, tex, base.w, base.h)) return tex;
+    }
+
+    tex.levels.push_back(bc_compress(base, format));
+    for(const Image& mip : build_mips(base)) tex.levels.push_back(bc_compress(mip.view(), format));
+
+    if(!path.empty()) {
+        std::error_code err;
+        std::filesystem::create_directories(cache_dir, err);
+        write_cache(path, tex);
+    }
+    return tex;
+}
+
+} // namespace Util
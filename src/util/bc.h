@@ -0,0 +1,58 @@
+
+#pragma once
+
+#include <string>
+#include <util/image.h>
+#include <vector>
+
+namespace Util {
+
+/// Block-compressed formats, 4x4 texels per block. BC1 stores RGB in 8 bytes, BC4 one channel
+/// (R) in 8, BC5 two (R, G) in 16 and BC7 RGBA in 16; the BC7 encoder only emits mode 6.
+enum class BC_Format : int { bc1, bc4, bc5, bc7 };
+
+unsigned int block_bytes(BC_Format format);
+const char* format_name(BC_Format format);
+/// Bytes of blocks covering w x h texels
+size_t level_bytes(unsigned int w, unsigned int h, BC_Format format);
+
+/// Non-owning view of a level of blocks, as held by a BC_Level or a mapped texture file
+struct BC_Level_View {
+    unsigned int w = 0, h = 0;
+    const unsigned char* blocks = nullptr;
+    size_t size = 0;
+};
+
+/// One level of blocks in row-major order; blocks past the edge repeat the last row and column
+struct BC_Level {
+    unsigned int w = 0, h = 0;
+    std::vector<unsigned char> blocks;
+
+    BC_Level_View view() const {
+        return {w, h, blocks.data(), blocks.size()};
+    }
+};
+
+/// A compressed mip chain, base first
+struct BC_Texture {
+    BC_Format format = BC_Format::bc7;
+    /// Blocks hold the texels as stored, so an sRGB source needs an sRGB block format
+    bool srgb = false;
+    std::vector<BC_Level> levels;
+
+    size_t bytes() const;
+};
+
+/// Compresses RGBA8 or RGBA8 sRGB texels, with rows of blocks split across threads
+BC_Level bc_compress(Image_Const_View src, BC_Format format);
+/// RGBA8 (sRGB if srgb) texels of a level; channels the format lacks read as (0, 0, 255)
+Image bc_decompress(BC_Level_View level, BC_Format format, bool srgb);
+
+/// Peak signal-to-noise ratio in dB over the first n channels of two RGBA8 views
+double psnr(Image_Const_View a, Image_Const_View b, unsigned int channels);
+
+/// Mips and compresses base, or reads the result back from cache_dir. Entries are keyed by a
+/// hash of the texels, size and formats; an empty cache_dir skips the cache.
+BC_Texture bc_texture(Image_Const_View base, BC_Format format, const std::string& cache_dir);
+
+} // namespace Util
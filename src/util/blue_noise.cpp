@@ -0,0 +1,186 @@
+
+#include "blue_noise.h"
+#include "files.h"
+#include "parallel.h"
+
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <lib/log.h>
+#include <lib/rng.h>
+
+namespace Util {
+
+namespace {
+
+struct Energy_Field {
+
+    Energy_Field(unsigned int w, float sigma) : w(w), lut(w * w), energy(w * w) {
+        // Toroidal distance, so the resulting mask tiles
+        for(unsigned int y = 0; y < w; y++) {
+            for(unsigned int x = 0; x < w; x++) {
+                float dx = (float)std::min(x, w - x);
+                float dy = (float)std::min(y, w - y);
+                lut[y * w + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+            }
+        }
+    }
+
+    void splat(unsigned int i, float sign) {
+        unsigned int px = i % w, py = i / w;
+        for(unsigned int y = 0; y < w; y++) {
+            unsigned int ly = ((y + w - py) % w) * w;
+            for(unsigned int x = 0; x < w; x++) {
+                energy[y * w + x] += sign * lut[ly + (x + w - px) % w];
+            }
+        }
+    }
+
+    /// Highest energy pixel where pattern == set
+    unsigned int tightest(const std::vector<bool>& pattern, bool set) const {
+        unsigned int best = 0;
+        float best_e = -INFINITY;
+        for(unsigned int i = 0; i < energy.size(); i++) {
+            if(pattern[i] == set && energy[i] > best_e) {
+                best_e = energy[i];
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    /// Lowest energy pixel where pattern == set
+    unsigned int largest_void(const std::vector<bool>& pattern, bool set) const {
+        unsigned int best = 0;
+        float best_e = INFINITY;
+        for(unsigned int i = 0; i < energy.size(); i++) {
+            if(pattern[i] == set && energy[i] < best_e) {
+                best_e = energy[i];
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    unsigned int w;
+    std::vector<float> lut, energy;
+};
+
+} // namespace
+
+std::vector<unsigned int> void_and_cluster(unsigned int w, uint32_t seed, float sigma) {
+
+    unsigned int n = w * w;
+    unsigned int n_initial = std::max(n / 10, 1u);
+
+    // Initial binary pattern: random points, relaxed until the tightest cluster
+    // and the largest void coincide.
+    std::vector<bool> initial(n, false);
+    Energy_Field field(w, sigma);
+    RNG rng(seed);
+
+    for(unsigned int placed = 0; placed < n_initial;) {
+        unsigned int i = rng.range(0, n);
+        if(initial[i]) continue;
+        initial[i] = true;
+        field.splat(i, 1.0f);
+        placed++;
+    }
+
+    for(;;) {
+        unsigned int cluster = field.tightest(initial, true);
+        initial[cluster] = false;
+        field.splat(cluster, -1.0f);
+
+        unsigned int vd = field.largest_void(initial, false);
+        initial[vd] = true;
+        field.splat(vd, 1.0f);
+
+        if(vd == cluster) break;
+    }
+
+    std::vector<unsigned int> rank(n, 0);
+
+    // Phase 1: rank the initial points by removing tightest clusters
+    {
+        std::vector<bool> pattern = initial;
+        Energy_Field e = field;
+        for(unsigned int r = n_initial; r > 0; r--) {
+            unsigned int cluster = e.tightest(pattern, true);
+            pattern[cluster] = false;
+            e.splat(cluster, -1.0f);
+            rank[cluster] = r - 1;
+        }
+    }
+
+    // Phase 2: fill the largest voids up to half coverage
+    std::vector<bool> pattern = initial;
+    unsigned int r = n_initial;
+    for(; r < n / 2; r++) {
+        unsigned int vd = field.largest_void(pattern, false);
+        pattern[vd] = true;
+        field.splat(vd, 1.0f);
+        rank[vd] = r;
+    }
+
+    // Phase 3: with the roles reversed, fill the tightest clusters of remaining zeros
+    Energy_Field zeros(w, sigma);
+    for(unsigned int i = 0; i < n; i++) {
+        if(!pattern[i]) zeros.splat(i, 1.0f);
+    }
+    for(; r < n; r++) {
+        unsigned int cluster = zeros.tightest(pattern, false);
+        pattern[cluster] = true;
+        zeros.splat(cluster, -1.0f);
+        rank[cluster] = r;
+    }
+
+    return rank;
+}
+
+std::vector<uint16_t> blue_noise(unsigned int w, const std::string& cache_dir) {
+
+    constexpr uint32_t magic = 0x314e4c42; // "BLN1"
+    constexpr unsigned int channels = 4;
+    size_t n = (size_t)w * w;
+    std::string cache = cache_dir + "/blue_noise_" + std::to_string(w) + ".bin";
+
+    if(auto file = File::read(cache); file.has_value()) {
+        const std::vector<unsigned char>& data = file.value();
+        uint32_t header[2] = {};
+        if(data.size() == sizeof(header) + n * channels * sizeof(uint16_t)) {
+            std::memcpy(header, data.data(), sizeof(header));
+            if(header[0] == magic && header[1] == w) {
+                std::vector<uint16_t> mask(n * channels);
+                std::memcpy(mask.data(), data.data() + sizeof(header),
+                            mask.size() * sizeof(uint16_t));
+                return mask;
+            }
+        }
+        warn("Ignoring stale blue noise cache %s", cache.c_str());
+    }
+
+    std::vector<uint16_t> mask(n * channels);
+    parallel_for(0, channels, [&](size_t c) {
+        std::vector<unsigned int> rank = void_and_cluster(w, RNG::pcg_hash((uint32_t)c + 1));
+        for(size_t i = 0; i < n; i++) {
+            // Rank to the center of its bucket, so the mask is uniform over [0,1)
+            mask[i * channels + c] = (uint16_t)std::lround((rank[i] + 0.5) / n * 65535.0);
+        }
+    });
+
+    std::vector<unsigned char> data(2 * sizeof(uint32_t) + mask.size() * sizeof(uint16_t));
+    uint32_t header[2] = {magic, w};
+    std::memcpy(data.data(), header, sizeof(header));
+    std::memcpy(data.data() + sizeof(header), mask.data(), mask.size() * sizeof(uint16_t));
+    std::error_code err;
+    std::filesystem::create_directories(cache_dir, err);
+    if(!File::write(cache, data.data(), data.size())) {
+        warn("Failed to write blue noise cache %s", cache.c_str());
+    }
+
+    info("Generated %ux%u blue noise mask", w, w);
+    return mask;
+}
+
+} // namespace Util
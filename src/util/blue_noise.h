@@ -0,0 +1,18 @@
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Util {
+
+/// Void-and-cluster (Ulichney 1993) dither array: w*w ranks in [0, w*w), tileable.
+/// Energy uses a toroidal Gaussian of the given sigma.
+std::vector<unsigned int> void_and_cluster(unsigned int w, uint32_t seed, float sigma = 1.5f);
+
+/// Interleaved RGBA16_UNORM mask of four independent void-and-cluster channels.
+/// Read from blue_noise_<w>.bin in cache_dir if it is there, otherwise generated and written there.
+std::vector<uint16_t> blue_noise(unsigned int w, const std::string& cache_dir);
+
+} // namespace Util
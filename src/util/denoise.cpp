@@ -0,0 +1,399 @@
+
+#include "denoise.h"
+#include "parallel.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <lib/pack.h>
+
+namespace Util {
+
+namespace {
+
+constexpr float ALBEDO_EPS = 0.01f;
+constexpr float kernel[3] = {3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+
+float luma(const float* c) {
+    return 0.299f * c[0] + 0.587f * c[1] + 0.114f * c[2];
+}
+
+bool has_geometry(const float* n) {
+    return n[0] * n[0] + n[1] * n[1] + n[2] * n[2] > 0.5f;
+}
+
+float dot3(const float* a, const float* b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+/// The input with its G-buffer decoded to RGBA32F images, positions relative to the camera like
+/// load_pos in svgf.comp, so the filter can load texels four at a time
+struct Frame {
+    unsigned int w = 0, h = 0;
+    const float* color = nullptr;
+    const float* moments = nullptr;
+    std::vector<float> pos, norm, alb;
+    int history = 1;
+};
+
+void decode_row(const SVGF_Input& in, Frame& f, unsigned int y) {
+    for(unsigned int x = 0; x < in.w; x++) {
+        size_t i = (size_t)y * in.w + x;
+        Vec2 jitter;
+        float t = Pack::unpack_depth(in.depth[i], jitter);
+        Vec3 pos = t * Pack::gbuf_ray(in.rays, x, y, jitter, in.w, in.h);
+        Vec3 norm = Pack::unpack_normal(in.norm[i]);
+        Vec3 alb = Pack::unpack_albedo(in.alb[i]);
+        for(int c = 0; c < 3; c++) {
+            f.pos[4 * i + c] = pos[c];
+            f.norm[4 * i + c] = norm[c];
+            f.alb[4 * i + c] = alb[c];
+        }
+    }
+}
+
+const float* texel(const float* img, unsigned int w, int x, int y) {
+    return img + 4 * ((size_t)y * w + x);
+}
+
+void prepare(const Frame& in, const SVGF_Params& params, int x, int y, float* dst) {
+
+    const float* color = texel(in.color, in.w, x, y);
+    const float* np = texel(in.norm.data(), in.w, x, y);
+    float* d = dst + 4 * ((size_t)y * in.w + x);
+
+    if(!has_geometry(np)) {
+        d[0] = color[0];
+        d[1] = color[1];
+        d[2] = color[2];
+        d[3] = 0.0f;
+        return;
+    }
+
+    const float* alb = texel(in.alb.data(), in.w, x, y);
+    for(int c = 0; c < 3; c++) d[c] = color[c] / std::max(alb[c], ALBEDO_EPS);
+
+    const float* m = texel(in.moments, in.w, x, y);
+    float history = m[2] > 0.0f ? m[2] : (float)in.history;
+
+    if(history >= 4.0f) {
+        d[3] = std::max(m[1] - m[0] * m[0], 0.0f) / history;
+        return;
+    }
+
+    float m1 = 0.0f, m2 = 0.0f, wsum = 0.0f;
+    for(int dy = -1; dy <= 1; dy++) {
+        for(int dx = -1; dx <= 1; dx++) {
+            int qx = x + dx, qy = y + dy;
+            if(qx < 0 || qy < 0 || qx >= (int)in.w || qy >= (int)in.h) continue;
+            const float* nq = texel(in.norm.data(), in.w, qx, qy);
+            if(!has_geometry(nq)) continue;
+
+            float w = std::pow(std::max(dot3(np, nq), 0.0f), params.phi_normal);
+            const float* cq = texel(in.color, in.w, qx, qy);
+            const float* aq = texel(in.alb.data(), in.w, qx, qy);
+            float demod[3] = {cq[0] / std::max(aq[0], ALBEDO_EPS), cq[1] / std::max(aq[1], ALBEDO_EPS),
+                              cq[2] / std::max(aq[2], ALBEDO_EPS)};
+            float l = luma(demod);
+            m1 += w * l;
+            m2 += w * l * l;
+            wsum += w;
+        }
+    }
+    m1 /= wsum;
+    m2 /= wsum;
+    d[3] = std::max(m2 - m1 * m1, 0.0f);
+}
+
+void atrous_pixel(const Frame& in, const SVGF_Params& params, int iteration, const float* src,
+                  float* dst, float* out, int x, int y) {
+
+    int w = in.w, h = in.h;
+    size_t idx = 4 * ((size_t)y * w + x);
+    const float* center = src + idx;
+    const float* np = texel(in.norm.data(), w, x, y);
+
+    if(!has_geometry(np)) {
+        std::copy(center, center + 4, dst + idx);
+        if(out) {
+            const float* color = texel(in.color, w, x, y);
+            out[idx + 0] = color[0];
+            out[idx + 1] = color[1];
+            out[idx + 2] = color[2];
+            out[idx + 3] = 1.0f;
+        }
+        return;
+    }
+
+    float variance = 0.0f;
+    for(int dy = -1; dy <= 1; dy++) {
+        for(int dx = -1; dx <= 1; dx++) {
+            int qx = std::clamp(x + dx, 0, w - 1), qy = std::clamp(y + dy, 0, h - 1);
+            int n = std::abs(dx) + std::abs(dy);
+            float k = n == 0 ? 0.25f : n == 1 ? 0.125f : 0.0625f;
+            variance += k * texel(src, w, qx, qy)[3];
+        }
+    }
+
+    const float* pp = texel(in.pos.data(), w, x, y);
+    float lp = luma(center);
+    float denom = params.phi_color * std::sqrt(std::max(variance, 0.0f)) + 1e-6f;
+    int stride = 1 << iteration;
+
+    float w0 = kernel[0] * kernel[0];
+    float sum_c[3] = {w0 * center[0], w0 * center[1], w0 * center[2]};
+    float sum_v = w0 * w0 * center[3];
+    float sum_w = w0;
+
+    for(int dy = -2; dy <= 2; dy++) {
+        for(int dx = -2; dx <= 2; dx++) {
+            if(dx == 0 && dy == 0) continue;
+
+            int qx = x + dx * stride, qy = y + dy * stride;
+            if(qx < 0 || qy < 0 || qx >= w || qy >= h) continue;
+
+            const float* nq = texel(in.norm.data(), w, qx, qy);
+            if(!has_geometry(nq)) continue;
+
+            const float* cq = texel(src, w, qx, qy);
+            const float* pq = texel(in.pos.data(), w, qx, qy);
+            float diff[3] = {pq[0] - pp[0], pq[1] - pp[1], pq[2] - pp[2]};
+
+            float w_l = std::abs(lp - luma(cq)) / denom;
+            float w_p = std::abs(dot3(np, diff)) / params.phi_pos;
+            float w_n = std::pow(std::max(dot3(np, nq), 0.0f), params.phi_normal);
+            float wt = std::exp(-w_l - w_p) * w_n * kernel[std::abs(dx)] * kernel[std::abs(dy)];
+
+            for(int c = 0; c < 3; c++) sum_c[c] += wt * cq[c];
+            sum_v += wt * wt * cq[3];
+            sum_w += wt;
+        }
+    }
+
+    float* d = dst + idx;
+    for(int c = 0; c < 3; c++) d[c] = sum_c[c] / sum_w;
+    d[3] = sum_v / (sum_w * sum_w);
+
+    if(out) {
+        const float* alb = texel(in.alb.data(), w, x, y);
+        for(int c = 0; c < 3; c++) out[idx + c] = d[c] * std::max(alb[c], ALBEDO_EPS);
+        out[idx + 3] = 1.0f;
+    }
+}
+
+#if UTIL_SSE
+
+struct Lanes {
+    __m128 x, y, z, w;
+};
+
+// Loads the texels at (qx[i], y) for each lane and transposes them into SoA form
+Lanes load4(const float* img, unsigned int w, const int* qx, int y) {
+    Lanes l;
+    l.x = _mm_loadu_ps(texel(img, w, qx[0], y));
+    l.y = _mm_loadu_ps(texel(img, w, qx[1], y));
+    l.z = _mm_loadu_ps(texel(img, w, qx[2], y));
+    l.w = _mm_loadu_ps(texel(img, w, qx[3], y));
+    _MM_TRANSPOSE4_PS(l.x, l.y, l.z, l.w);
+    return l;
+}
+
+__m128 luma4(const Lanes& c) {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(c.x, _mm_set1_ps(0.299f)), _mm_mul_ps(c.y, _mm_set1_ps(0.587f))),
+                      _mm_mul_ps(c.z, _mm_set1_ps(0.114f)));
+}
+
+__m128 dot4(const Lanes& a, const Lanes& b) {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y)), _mm_mul_ps(a.z, b.z));
+}
+
+void atrous_row_sse(const Frame& in, const SVGF_Params& params, int iteration,
+                    const float* src, float* dst, float* out, int y) {
+
+    int w = in.w, h = in.h;
+    int stride = 1 << iteration;
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 phi_n = _mm_set1_ps(params.phi_normal);
+    const __m128 inv_phi_p = _mm_set1_ps(1.0f / params.phi_pos);
+
+    for(int x = 0; x < w; x += 4) {
+
+        int lanes = std::min(4, w - x);
+        int cx[4];
+        for(int l = 0; l < 4; l++) cx[l] = std::min(x + l, w - 1);
+
+        // Blocks of sky only pass their color through, which the scalar path does without
+        // filtering all four lanes first
+        bool any = false;
+        for(int l = 0; l < lanes; l++) {
+            any = any || has_geometry(in.norm.data() + 4 * ((size_t)y * w + x + l));
+        }
+        if(!any) {
+            for(int l = 0; l < lanes; l++) {
+                atrous_pixel(in, params, iteration, src, dst, out, x + l, y);
+            }
+            continue;
+        }
+
+        Lanes center = load4(src, w, cx, y);
+        Lanes np = load4(in.norm.data(), w, cx, y);
+        Lanes pp = load4(in.pos.data(), w, cx, y);
+
+        __m128 variance = zero;
+        for(int dy = -1; dy <= 1; dy++) {
+            int qy = std::clamp(y + dy, 0, h - 1);
+            for(int dx = -1; dx <= 1; dx++) {
+                int n = std::abs(dx) + std::abs(dy);
+                float k = n == 0 ? 0.25f : n == 1 ? 0.125f : 0.0625f;
+                float a[4];
+                for(int l = 0; l < 4; l++) a[l] = texel(src, w, std::clamp(cx[l] + dx, 0, w - 1), qy)[3];
+                variance = _mm_add_ps(variance, _mm_mul_ps(_mm_set1_ps(k), _mm_loadu_ps(a)));
+            }
+        }
+
+        __m128 lp = luma4(center);
+        __m128 denom = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(params.phi_color), _mm_sqrt_ps(_mm_max_ps(variance, zero))),
+                                  _mm_set1_ps(1e-6f));
+        __m128 inv_denom = _mm_div_ps(_mm_set1_ps(1.0f), denom);
+
+        __m128 w0 = _mm_set1_ps(kernel[0] * kernel[0]);
+        __m128 sum_r = _mm_mul_ps(w0, center.x);
+        __m128 sum_g = _mm_mul_ps(w0, center.y);
+        __m128 sum_b = _mm_mul_ps(w0, center.z);
+        __m128 sum_v = _mm_mul_ps(_mm_mul_ps(w0, w0), center.w);
+        __m128 sum_w = w0;
+
+        for(int dy = -2; dy <= 2; dy++) {
+            int qy = y + dy * stride;
+            if(qy < 0 || qy >= h) continue;
+
+            for(int dx = -2; dx <= 2; dx++) {
+                if(dx == 0 && dy == 0) continue;
+
+                int qx[4];
+                float valid[4];
+                for(int l = 0; l < 4; l++) {
+                    int q = cx[l] + dx * stride;
+                    valid[l] = q >= 0 && q < w ? 1.0f : 0.0f;
+                    qx[l] = std::clamp(q, 0, w - 1);
+                }
+
+                Lanes nq = load4(in.norm.data(), w, qx, y + dy * stride);
+                Lanes cq = load4(src, w, qx, qy);
+                Lanes pq = load4(in.pos.data(), w, qx, qy);
+
+                __m128 mask = _mm_and_ps(_mm_cmpgt_ps(_mm_loadu_ps(valid), zero),
+                                         _mm_cmpgt_ps(dot4(nq, nq), half));
+
+                __m128 w_l = _mm_mul_ps(abs_ps(_mm_sub_ps(lp, luma4(cq))), inv_denom);
+
+                Lanes diff = {_mm_sub_ps(pq.x, pp.x), _mm_sub_ps(pq.y, pp.y), _mm_sub_ps(pq.z, pp.z), zero};
+                __m128 w_p = _mm_mul_ps(abs_ps(dot4(np, diff)), inv_phi_p);
+
+                // pow(d, phi_n) folded into the exponent
+                __m128 d = dot4(np, nq);
+                mask = _mm_and_ps(mask, _mm_cmpgt_ps(d, zero));
+                __m128 e = _mm_sub_ps(_mm_mul_ps(phi_n, log_ps(d)), _mm_add_ps(w_l, w_p));
+
+                __m128 wt = _mm_mul_ps(exp_ps(e), _mm_set1_ps(kernel[std::abs(dx)] * kernel[std::abs(dy)]));
+                wt = _mm_and_ps(mask, wt);
+
+                sum_r = _mm_add_ps(sum_r, _mm_mul_ps(wt, cq.x));
+                sum_g = _mm_add_ps(sum_g, _mm_mul_ps(wt, cq.y));
+                sum_b = _mm_add_ps(sum_b, _mm_mul_ps(wt, cq.z));
+                sum_v = _mm_add_ps(sum_v, _mm_mul_ps(_mm_mul_ps(wt, wt), cq.w));
+                sum_w = _mm_add_ps(sum_w, wt);
+            }
+        }
+
+        __m128 inv_w = _mm_div_ps(_mm_set1_ps(1.0f), sum_w);
+        Lanes result = {_mm_mul_ps(sum_r, inv_w), _mm_mul_ps(sum_g, inv_w), _mm_mul_ps(sum_b, inv_w),
+                        _mm_mul_ps(sum_v, _mm_mul_ps(inv_w, inv_w))};
+        _MM_TRANSPOSE4_PS(result.x, result.y, result.z, result.w);
+        __m128 texels[4] = {result.x, result.y, result.z, result.w};
+
+        for(int l = 0; l < lanes; l++) {
+            size_t idx = 4 * ((size_t)y * w + x + l);
+            const float* nc = in.norm.data() + idx;
+            if(!has_geometry(nc)) {
+                atrous_pixel(in, params, iteration, src, dst, out, x + l, y);
+                continue;
+            }
+            _mm_storeu_ps(dst + idx, texels[l]);
+            if(out) {
+                const float* alb = in.alb.data() + idx;
+                __m128 a = _mm_max_ps(_mm_setr_ps(alb[0], alb[1], alb[2], 1.0f), _mm_set1_ps(ALBEDO_EPS));
+                __m128 o = _mm_mul_ps(texels[l], a);
+                _mm_storeu_ps(out + idx, o);
+                out[idx + 3] = 1.0f;
+            }
+        }
+    }
+}
+
+#endif
+
+template<typename Row>
+void run(const SVGF_Input& packed, const SVGF_Params& params, float* out, bool threaded,
+         Row&& row) {
+
+    size_t n = (size_t)packed.w * packed.h * 4;
+    std::vector<float> ping[2] = {std::vector<float>(n), std::vector<float>(n)};
+    int n_iters = std::max(params.iterations, 1);
+
+    auto for_rows = [&](auto&& f) {
+        if(threaded) {
+            parallel_for(0, packed.h, f);
+        } else {
+            for(size_t y = 0; y < packed.h; y++) f(y);
+        }
+    };
+
+    Frame in;
+    in.w = packed.w;
+    in.h = packed.h;
+    in.color = packed.color;
+    in.moments = packed.moments;
+    in.pos.assign(n, 0.0f);
+    in.norm.assign(n, 0.0f);
+    in.alb.assign(n, 0.0f);
+    in.history = packed.history;
+    for_rows([&](size_t y) { decode_row(packed, in, (unsigned int)y); });
+
+    for_rows([&](size_t y) {
+        for(unsigned int x = 0; x < in.w; x++) prepare(in, params, x, (int)y, ping[0].data());
+    });
+
+    for(int i = 0; i < n_iters; i++) {
+        const float* src = ping[i % 2].data();
+        float* dst = ping[(i + 1) % 2].data();
+        float* o = i == n_iters - 1 ? out : nullptr;
+        for_rows([&](size_t y) { row(in, i, src, dst, o, (int)y); });
+    }
+}
+
+} // namespace
+
+void svgf_reference(const SVGF_Input& in, const SVGF_Params& params, float* out) {
+    run(in, params, out, false,
+        [&](const Frame& f, int i, const float* src, float* dst, float* o, int y) {
+            for(unsigned int x = 0; x < f.w; x++) atrous_pixel(f, params, i, src, dst, o, x, y);
+        });
+}
+
+void svgf(const SVGF_Input& in, const SVGF_Params& params, float* out) {
+#if UTIL_SSE
+    run(in, params, out, true,
+        [&](const Frame& f, int i, const float* src, float* dst, float* o, int y) {
+            atrous_row_sse(f, params, i, src, dst, o, y);
+        });
+#else
+    run(in, params, out, true,
+        [&](const Frame& f, int i, const float* src, float* dst, float* o, int y) {
+            for(unsigned int x = 0; x < f.w; x++) atrous_pixel(f, params, i, src, dst, o, x, y);
+        });
+#endif
+}
+
+} // namespace Util
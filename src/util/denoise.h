@@ -0,0 +1,39 @@
+
+#pragma once
+
+#include <cstdint>
+#include <lib/mathlib.h>
+#include <vector>
+
+namespace Util {
+
+/// CPU inputs for the SVGF filter, laid out like the RT outputs over w*h texels: RGBA32F color
+/// and moments, and the packed G-buffer of lib/pack.h (R32_UINT depth, octahedral normal and
+/// RGBA8 albedo). moments holds (mean luma, mean luma^2, history length); history is used where
+/// that is zero. rays is Pack::ray_matrix of the camera, as svgf.comp takes it.
+struct SVGF_Input {
+    unsigned int w = 0, h = 0;
+    const float* color = nullptr;
+    const float* moments = nullptr;
+    const uint32_t* depth = nullptr;
+    const uint32_t* norm = nullptr;
+    const uint32_t* alb = nullptr;
+    Mat4 rays;
+    int history = 1;
+};
+
+struct SVGF_Params {
+    int iterations = 5;
+    float phi_color = 4.0f;
+    float phi_normal = 128.0f;
+    float phi_pos = 0.5f;
+};
+
+/// Scalar mirror of shaders/svgf.comp; writes w*h RGBA32F texels to out
+void svgf_reference(const SVGF_Input& in, const SVGF_Params& params, float* out);
+
+/// Same filter, four pixels at a time with SSE and rows split across threads.
+/// Falls back to the reference when SSE2 is unavailable.
+void svgf(const SVGF_Input& in, const SVGF_Params& params, float* out);
+
+} // namespace Util
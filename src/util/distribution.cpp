@@ -0,0 +1,88 @@
+
+#include "distribution.h"
+#include "parallel.h"
+
+namespace Util {
+
+void Distribution_1D::build(const float* f, size_t n) {
+
+    func.assign(f, f + n);
+    cdf.resize(n + 1);
+
+    cdf[0] = 0.0f;
+    for(size_t i = 1; i <= n; i++) {
+        cdf[i] = cdf[i - 1] + func[i - 1] / n;
+    }
+
+    integral = cdf[n];
+    if(integral == 0.0f) {
+        for(size_t i = 1; i <= n; i++) cdf[i] = (float)i / n;
+    } else {
+        for(size_t i = 1; i <= n; i++) cdf[i] /= integral;
+    }
+}
+
+float Distribution_1D::sample(float u, float& pdf, size_t& offset) const {
+
+    // Largest index with cdf[i] <= u
+    auto it = std::upper_bound(cdf.begin(), cdf.end(), u);
+    offset = clamp<size_t>(it - cdf.begin(), 1, cdf.size() - 1) - 1;
+
+    float du = u - cdf[offset];
+    float width = cdf[offset + 1] - cdf[offset];
+    if(width > 0.0f) du /= width;
+
+    pdf = integral > 0.0f ? func[offset] / integral : 0.0f;
+    return (offset + du) / count();
+}
+
+void Distribution_2D::build(const std::vector<float>& f, unsigned int _w, unsigned int _h) {
+
+    w = _w;
+    h = _h;
+    conditional.clear();
+    conditional.resize(h);
+
+    parallel_for(0, h, [&, this](size_t y) { conditional[y].build(f.data() + y * w, w); });
+
+    std::vector<float> row_integrals(h);
+    for(unsigned int y = 0; y < h; y++) row_integrals[y] = conditional[y].integral;
+    marginal.build(row_integrals.data(), h);
+}
+
+Vec2 Distribution_2D::sample(Vec2 u, float& pdf) const {
+
+    float pdf_v, pdf_u;
+    size_t y, x;
+    float v = marginal.sample(u.y, pdf_v, y);
+    float uu = conditional[y].sample(u.x, pdf_u, x);
+
+    pdf = pdf_u * pdf_v;
+    return Vec2{uu, v};
+}
+
+float Distribution_2D::pdf(Vec2 uv) const {
+
+    if(marginal.integral == 0.0f) return 0.0f;
+
+    unsigned int x = clamp((unsigned int)(uv.x * w), 0u, w - 1);
+    unsigned int y = clamp((unsigned int)(uv.y * h), 0u, h - 1);
+    return conditional[y].func[x] / marginal.integral;
+}
+
+std::vector<float> Distribution_2D::pack() const {
+
+    std::vector<float> data;
+    data.reserve(2 * h + 1 + h * (2 * w + 1));
+
+    data.insert(data.end(), marginal.func.begin(), marginal.func.end());
+    data.insert(data.end(), marginal.cdf.begin(), marginal.cdf.end());
+
+    for(const Distribution_1D& row : conditional) {
+        data.insert(data.end(), row.func.begin(), row.func.end());
+        data.insert(data.end(), row.cdf.begin(), row.cdf.end());
+    }
+    return data;
+}
+
+} // namespace Util
@@ -0,0 +1,43 @@
+
+#pragma once
+
+#include <lib/mathlib.h>
+#include <vector>
+
+namespace Util {
+
+/// Piecewise-constant distribution over [0,1)
+struct Distribution_1D {
+
+    void build(const float* f, size_t n);
+
+    /// Continuous sample in [0,1); writes the density and the selected segment
+    float sample(float u, float& pdf, size_t& offset) const;
+
+    size_t count() const {
+        return func.size();
+    }
+
+    std::vector<float> func, cdf;
+    float integral = 0.0f;
+};
+
+/// Piecewise-constant distribution over [0,1)^2, built from marginal/conditional 1D distributions
+struct Distribution_2D {
+
+    /// f is w*h row-major; each row's conditional distribution is built in parallel
+    void build(const std::vector<float>& f, unsigned int w, unsigned int h);
+
+    Vec2 sample(Vec2 u, float& pdf) const;
+    float pdf(Vec2 uv) const;
+
+    /// Flattened for upload as a storage buffer:
+    ///     marginal func (h), marginal cdf (h+1), then per row: func (w), cdf (w+1)
+    std::vector<float> pack() const;
+
+    unsigned int w = 0, h = 0;
+    std::vector<Distribution_1D> conditional;
+    Distribution_1D marginal;
+};
+
+} // namespace Util
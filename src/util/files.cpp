@@ -1,24 +1,154 @@
 
 #include "files.h"
+#include <filesystem>
 #include <fstream>
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace File {
 
 std::optional<std::vector<unsigned char>> read(std::string path) {
 
+    // Directories open and claim to end at the largest offset
+    std::error_code err;
+    if(std::filesystem::is_directory(path, err)) {
+        return std::nullopt;
+    }
+
     std::ifstream file(path.c_str(), std::ios::ate | std::ios::binary);
     if(!file.good()) {
         return std::nullopt;
     }
 
-    unsigned int size = (unsigned int)file.tellg();
+    // tellg() is -1 when the stream can't report its position
+    std::streamoff end = file.tellg();
+    if(end < 0) {
+        return std::nullopt;
+    }
+
+    size_t size = (size_t)end;
     std::vector<unsigned char> data(size);
 
     file.seekg(0);
-    file.read((char*)data.data(), size);
-    data.resize(size);
+    file.read((char*)data.data(), (std::streamsize)size);
+    if(!file.good()) {
+        return std::nullopt;
+    }
 
     return {std::move(data)};
 }
 
+bool write(std::string path, const void* data, size_t size) {
+
+    std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+    if(!file.good()) {
+        return false;
+    }
+
+    file.write((const char*)data, size);
+    return file.good();
+}
+
+Mapping::~Mapping() {
+    close();
+}
+
+Mapping::Mapping(Mapping&& src) {
+    *this = std::move(src);
+}
+
+Mapping& Mapping::operator=(Mapping&& src) {
+    close();
+    _data = src._data;
+    _size = src._size;
+    src._data = nullptr;
+    src._size = 0;
+#ifdef _WIN32
+    file = src.file;
+    mapping = src.mapping;
+    src.file = src.mapping = nullptr;
+#endif
+    return *this;
+}
+
+#ifdef _WIN32
+
+bool Mapping::open(const std::string& path) {
+
+    close();
+
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE) {
+        file = nullptr;
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file, &size) || !size.QuadPart) {
+        close();
+        return false;
+    }
+
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(mapping) _data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(!_data) {
+        close();
+        return false;
+    }
+    _size = (size_t)size.QuadPart;
+    return true;
+}
+
+void Mapping::close() {
+    if(_data) UnmapViewOfFile(_data);
+    if(mapping) CloseHandle(mapping);
+    if(file) CloseHandle(file);
+    _data = nullptr;
+    _size = 0;
+    file = mapping = nullptr;
+}
+
+#else
+
+bool Mapping::open(const std::string& path) {
+
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+
+    struct stat st;
+    if(fstat(fd, &st) || !st.st_size) {
+        ::close(fd);
+        return false;
+    }
+
+    // The mapping keeps the file alive after the descriptor is closed
+    void* map = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(map == MAP_FAILED) return false;
+
+    _data = (const unsigned char*)map;
+    _size = (size_t)st.st_size;
+    return true;
+}
+
+void Mapping::close() {
+    if(_data) munmap((void*)_data, _size);
+    _data = nullptr;
+    _size = 0;
+}
+
+#endif
+
 } // namespace File
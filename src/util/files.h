@@ -7,4 +7,37 @@
 
 namespace File {
 std::optional<std::vector<unsigned char>> read(std::string path);
+bool write(std::string path, const void* data, size_t size);
+
+/// Read-only memory map of a whole file. Pages are read in by the OS as they are touched, so
+/// opening costs nothing up front and unused bytes are never read.
+class Mapping {
+public:
+    Mapping() = default;
+    ~Mapping();
+
+    Mapping(const Mapping&) = delete;
+    Mapping& operator=(const Mapping&) = delete;
+    Mapping(Mapping&& src);
+    Mapping& operator=(Mapping&& src);
+
+    /// False if the file cannot be opened or is empty
+    bool open(const std::string& path);
+    void close();
+
+    const unsigned char* data() const {
+        return _data;
+    }
+    size_t size() const {
+        return _size;
+    }
+
+private:
+    const unsigned char* _data = nullptr;
+    size_t _size = 0;
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#endif
+};
 }
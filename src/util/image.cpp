@@ -0,0 +1,265 @@
+
+#include "image.h"
+#include "parallel.h"
+#include "simd.h"
+#include "tonemap.h"
+
+#include <algorithm>
+#include <cstring>
+#include <lib/log.h>
+#include <lib/pack.h>
+#include <sf_libs/stb_image.h>
+#include <sf_libs/tinyexr.h>
+#include <util/files.h>
+
+namespace Util {
+
+namespace {
+
+// Texels per conversion job
+constexpr size_t BLOCK = 1 << 14;
+
+void unorm8_to_float(const unsigned char* in, float* out, size_t n) {
+    size_t i = 0;
+#if UTIL_SSE
+    const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+    const __m128i zero = _mm_setzero_si128();
+    for(; i + 16 <= n; i += 16) {
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i lo = _mm_unpacklo_epi8(b, zero), hi = _mm_unpackhi_epi8(b, zero);
+        __m128i w[4] = {_mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+                        _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero)};
+        for(int j = 0; j < 4; j++)
+            _mm_storeu_ps(out + i + j * 4, _mm_mul_ps(_mm_cvtepi32_ps(w[j]), scale));
+    }
+#endif
+    for(; i < n; i++) out[i] = in[i] * (1.0f / 255.0f);
+}
+
+void float_to_unorm8(const float* in, unsigned char* out, size_t n) {
+    size_t i = 0;
+#if UTIL_SSE
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(255.0f), half = _mm_set1_ps(0.5f);
+    for(; i + 16 <= n; i += 16) {
+        __m128i w[4];
+        for(int j = 0; j < 4; j++) {
+            // max() returns its second operand for NaN, so NaN becomes 0 like quantize_unorm8
+            __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i + j * 4), zero), one);
+            // Truncating x + 0.5 matches the floor() of the scalar path for positive x
+            w[j] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), half));
+        }
+        __m128i b = _mm_packus_epi16(_mm_packs_epi32(w[0], w[1]), _mm_packs_epi32(w[2], w[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), b);
+    }
+#endif
+    for(; i < n; i++) out[i] = static_cast<unsigned char>(Pack::quantize_unorm8(in[i]));
+}
+
+/// n linear RGBA floats to texels
+void encode(const float* in, Image_Format format, unsigned char* out, size_t n) {
+    switch(format) {
+    case Image_Format::r8:
+    case Image_Format::rg8: {
+        unsigned int c = channels(format);
+        for(size_t i = 0; i < n; i++)
+            for(unsigned int j = 0; j < c; j++)
+                out[i * c + j] = static_cast<unsigned char>(Pack::quantize_unorm8(in[i * 4 + j]));
+    } break;
+    case Image_Format::rgba8: {
+        float_to_unorm8(in, out, n * 4);
+    } break;
+    case Image_Format::rgba8_srgb: {
+        linear_to_srgb8(in, out, n * 4);
+        for(size_t i = 0; i < n; i++)
+            out[i * 4 + 3] = static_cast<unsigned char>(Pack::quantize_unorm8(in[i * 4 + 3]));
+    } break;
+    case Image_Format::rgba16f: {
+        float_to_half(in, reinterpret_cast<uint16_t*>(out), n * 4);
+    } break;
+    case Image_Format::rgba32f: {
+        std::memcpy(out, in, n * 4 * sizeof(float));
+    } break;
+    }
+}
+
+void convert_row(const unsigned char* in, Image_Format from, unsigned char* out, Image_Format to,
+                 unsigned int w, std::vector<float>& tmp) {
+
+    if(from == to) {
+        std::memcpy(out, in, (size_t)w * texel_bytes(from));
+        return;
+    }
+    // The common float pair skips the intermediate row
+    if(from == Image_Format::rgba32f && to == Image_Format::rgba16f) {
+        float_to_half(reinterpret_cast<const float*>(in), reinterpret_cast<uint16_t*>(out),
+                      (size_t)w * 4);
+        return;
+    }
+    if(from == Image_Format::rgba16f && to == Image_Format::rgba32f) {
+        half_to_float(reinterpret_cast<const uint16_t*>(in), reinterpret_cast<float*>(out),
+                      (size_t)w * 4);
+        return;
+    }
+
+    tmp.resize((size_t)w * 4);
+    decode(in, from, tmp.data(), w);
+    encode(tmp.data(), to, out, w);
+}
+
+} // namespace
+
+void decode(const unsigned char* in, Image_Format format, float* out, size_t n) {
+    switch(format) {
+    case Image_Format::r8:
+    case Image_Format::rg8: {
+        unsigned int c = channels(format);
+        for(size_t i = 0; i < n; i++) {
+            float t[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+            for(unsigned int j = 0; j < c; j++) t[j] = in[i * c + j] * (1.0f / 255.0f);
+            std::memcpy(out + i * 4, t, sizeof(t));
+        }
+    } break;
+    case Image_Format::rgba8: {
+        unorm8_to_float(in, out, n * 4);
+    } break;
+    case Image_Format::rgba8_srgb: {
+        srgb8_to_linear(in, out, n * 4);
+        for(size_t i = 0; i < n; i++) out[i * 4 + 3] = in[i * 4 + 3] * (1.0f / 255.0f);
+    } break;
+    case Image_Format::rgba16f: {
+        half_to_float(reinterpret_cast<const uint16_t*>(in), out, n * 4);
+    } break;
+    case Image_Format::rgba32f: {
+        std::memcpy(out, in, n * 4 * sizeof(float));
+    } break;
+    }
+}
+
+unsigned int texel_bytes(Image_Format format) {
+    switch(format) {
+    case Image_Format::r8: return 1;
+    case Image_Format::rg8: return 2;
+    case Image_Format::rgba8:
+    case Image_Format::rgba8_srgb: return 4;
+    case Image_Format::rgba16f: return 8;
+    case Image_Format::rgba32f: return 16;
+    }
+    return 0;
+}
+
+unsigned int channels(Image_Format format) {
+    switch(format) {
+    case Image_Format::r8: return 1;
+    case Image_Format::rg8: return 2;
+    default: return 4;
+    }
+}
+
+const char* format_name(Image_Format format) {
+    switch(format) {
+    case Image_Format::r8: return "R8";
+    case Image_Format::rg8: return "RG8";
+    case Image_Format::rgba8: return "RGBA8";
+    case Image_Format::rgba8_srgb: return "RGBA8 sRGB";
+    case Image_Format::rgba16f: return "RGBA16F";
+    case Image_Format::rgba32f: return "RGBA32F";
+    }
+    return "";
+}
+
+void convert(Image_Const_View src, Image_View dst) {
+
+    if(src.w != dst.w || src.h != dst.h) {
+        warn("Cannot convert a %ux%u image to %ux%u", src.w, src.h, dst.w, dst.h);
+        return;
+    }
+    if(src.empty()) return;
+
+    size_t rows = std::max<size_t>(BLOCK / src.w, 1);
+    parallel_for(0, (src.h + rows - 1) / rows, [&](size_t b) {
+        std::vector<float> tmp;
+        unsigned int end = (unsigned int)std::min<size_t>((b + 1) * rows, src.h);
+        for(unsigned int y = (unsigned int)(b * rows); y < end; y++)
+            convert_row(src.row(y), src.format, dst.row(y), dst.format, src.w, tmp);
+    });
+}
+
+uint64_t hash_bytes(const void* data, size_t n, uint64_t h) {
+    // 8 byte words, then the tail
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        uint64_t w;
+        std::memcpy(&w, bytes + i, 8);
+        h = (h ^ w) * 0x100000001b3ull;
+    }
+    for(; i < n; i++) h = (h ^ bytes[i]) * 0x100000001b3ull;
+    return h;
+}
+
+uint64_t hash_texels(Image_Const_View view, uint64_t h) {
+    for(unsigned int y = 0; y < view.h; y++) h = hash_bytes(view.row(y), view.row_bytes(), h);
+    return h;
+}
+
+bool same_texels(Image_Const_View a, Image_Const_View b) {
+    if(a.w != b.w || a.h != b.h || a.format != b.format) return false;
+    for(unsigned int y = 0; y < a.h; y++) {
+        if(std::memcmp(a.row(y), b.row(y), a.row_bytes())) return false;
+    }
+    return true;
+}
+
+Image::Image(Image_Const_View src) : Image(src.w, src.h, src.format) {
+    Util::convert(src, view());
+}
+
+Image Image::convert(Image_Format format) const {
+    Image ret(_w, _h, format);
+    Util::convert(view(), ret.view());
+    return ret;
+}
+
+bool Image::reload(std::string path) {
+    auto file_data = File::read(path);
+    if(!file_data.has_value()) return false;
+    return reload(file_data->data(), file_data->size(), path);
+}
+
+bool Image::reload(const unsigned char* file, size_t size, const std::string& name) {
+
+    int x = 0, y = 0;
+    float* hdr = nullptr;
+
+    const unsigned char exr_magic[] = {0x76, 0x2f, 0x31, 0x01};
+    if(size >= 4 && !std::memcmp(file, exr_magic, 4)) {
+        const char* err = nullptr;
+        if(LoadEXRFromMemory(&hdr, &x, &y, file, size, &err) != TINYEXR_SUCCESS) {
+            warn("Failed to load %s: %s", name.c_str(), err ? err : "");
+            FreeEXRErrorMessage(err);
+            return false;
+        }
+    } else if(stbi_is_hdr_from_memory(file, (int)size)) {
+        hdr = stbi_loadf_from_memory(file, (int)size, &x, &y, nullptr, STBI_rgb_alpha);
+        if(!hdr) return false;
+    }
+
+    if(hdr) {
+        reload(x, y, Image_Format::rgba32f, std::vector<unsigned char>((size_t)x * y * 16));
+        std::memcpy(_data.data(), hdr, _data.size());
+        free(hdr);
+        return true;
+    }
+
+    unsigned char* pixels = stbi_load_from_memory(file, (int)size, &x, &y, nullptr, STBI_rgb_alpha);
+    if(!pixels) return false;
+
+    reload(x, y, Image_Format::rgba8_srgb, std::vector<unsigned char>((size_t)x * y * 4));
+    std::memcpy(_data.data(), pixels, _data.size());
+    stbi_image_free(pixels);
+
+    return true;
+}
+
+} // namespace Util
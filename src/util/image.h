@@ -1,21 +1,96 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <optional>
-#include <sf_libs/stb_image.h>
-#include <cstring>
-#include <util/files.h>
+#include <string>
 #include <vector>
 
 namespace Util {
 
+/// Texel layouts an Image can hold; each maps to one VkFormat (see VK::vk_format)
+enum class Image_Format : unsigned char { r8, rg8, rgba8, rgba8_srgb, rgba16f, rgba32f };
+
+unsigned int texel_bytes(Image_Format format);
+unsigned int channels(Image_Format format);
+const char* format_name(Image_Format format);
+
+/// Non-owning w x h window into texels of one format, with rows stride bytes apart. Cropping
+/// and passing views around never copies; Image::view() and Image::const_view() make them.
+template<typename Byte> struct Image_View_Of {
+
+    Byte* data = nullptr;
+    unsigned int w = 0, h = 0;
+    size_t stride = 0;
+    Image_Format format = Image_Format::rgba8_srgb;
+
+    Byte* row(unsigned int y) const {
+        return data + y * stride;
+    }
+    Byte* texel(unsigned int x, unsigned int y) const {
+        return row(y) + (size_t)x * texel_bytes(format);
+    }
+    size_t row_bytes() const {
+        return (size_t)w * texel_bytes(format);
+    }
+    /// Bytes of texel data, not counting row padding
+    size_t bytes() const {
+        return row_bytes() * h;
+    }
+    /// Rows follow each other with no padding, so the view is one contiguous block
+    bool packed() const {
+        return stride == row_bytes();
+    }
+    bool empty() const {
+        return !data || !w || !h;
+    }
+
+    Image_View_Of crop(unsigned int x, unsigned int y, unsigned int cw, unsigned int ch) const {
+        return {texel(x, y), cw, ch, stride, format};
+    }
+
+    operator Image_View_Of<const unsigned char>() const {
+        return {data, w, h, stride, format};
+    }
+};
+
+using Image_View = Image_View_Of<unsigned char>;
+using Image_Const_View = Image_View_Of<const unsigned char>;
+
+/// Converts texels between any two formats, row by row. Unorm formats go through linear floats,
+/// rgba8_srgb through the sRGB curve (alpha stays linear); missing channels read as (0, 0, 1)
+/// like Vulkan samples them. The views must have the same size.
+void convert(Image_Const_View src, Image_View dst);
+/// n texels to linear RGBA floats, on the calling thread
+void decode(const unsigned char* texels, Image_Format format, float* out, size_t n);
+
+/// FNV-1a over n bytes, continuing from h
+uint64_t hash_bytes(const void* data, size_t n, uint64_t h = 0xcbf29ce484222325ull);
+/// Hash of the texels, skipping row padding; size and format only count through the seed
+uint64_t hash_texels(Image_Const_View view, uint64_t h = 0xcbf29ce484222325ull);
+/// Same size, format and texels
+bool same_texels(Image_Const_View a, Image_Const_View b);
+
 struct Image {
 
     explicit Image() = default;
     ~Image() = default;
 
-    explicit Image(unsigned int w, unsigned int h, std::vector<unsigned char>&& data) 
-        : _w(w), _h(h), _data(std::move(data)) {}
+    /// Packed rgba8_srgb texels, as loaded from LDR files and glTF
+    explicit Image(unsigned int w, unsigned int h, std::vector<unsigned char>&& data)
+        : _data(std::move(data)), _w(w), _h(h) {
+    }
+    explicit Image(unsigned int w, unsigned int h, Image_Format format,
+                   std::vector<unsigned char>&& data)
+        : _data(std::move(data)), _w(w), _h(h), _format(format) {
+    }
+    /// Zero-initialized
+    explicit Image(unsigned int w, unsigned int h, Image_Format format)
+        : _data((size_t)w * h * texel_bytes(format)), _w(w), _h(h), _format(format) {
+    }
+    /// Packed copy of a view
+    explicit Image(Image_Const_View src);
 
     Image(const Image& src) = delete;
     Image& operator=(const Image& src) = delete;
@@ -29,8 +104,11 @@ struct Image {
     unsigned int h() const {
         return _h;
     }
-    unsigned int bytes() const {
-        return _w * _h * 4;
+    Image_Format format() const {
+        return _format;
+    }
+    size_t bytes() const {
+        return (size_t)_w * _h * texel_bytes(_format);
     }
 
     std::pair<unsigned int, unsigned int> dim() const {
@@ -40,32 +118,32 @@ struct Image {
     const unsigned char* data() const {
         return _data.data();
     }
+    unsigned char* data() {
+        return _data.data();
+    }
 
-    bool reload(std::string path) {
-
-        auto file_data = File::read(path);
-        if(!file_data.has_value()) return false;
-
-        int x, y;
-        unsigned char* pixels =
-            stbi_load_from_memory(file_data.value().data(), (int)file_data.value().size(), &x, &y,
-                                  nullptr, STBI_rgb_alpha);
-        if(!pixels) return false;
-
-        _data.clear();
-        _data.resize(x * y * 4);
-        _w = x;
-        _h = y;
-
-        std::memcpy(_data.data(), pixels, _data.size());
-        stbi_image_free(pixels);
-
-        return true;
+    Image_View view() {
+        return {_data.data(), _w, _h, (size_t)_w * texel_bytes(_format), _format};
+    }
+    Image_Const_View view() const {
+        return {_data.data(), _w, _h, (size_t)_w * texel_bytes(_format), _format};
     }
 
+    /// Copy in another format; see Util::convert
+    Image convert(Image_Format format) const;
+
+    /// EXR and Radiance HDR files load as rgba32f, everything stb_image reads as rgba8_srgb
+    bool reload(std::string path);
+    /// Same, for file bytes already in memory; name is only used in warnings
+    bool reload(const unsigned char* file, size_t size, const std::string& name);
     void reload(unsigned int w, unsigned int h, std::vector<unsigned char>&& data) {
+        reload(w, h, Image_Format::rgba8_srgb, std::move(data));
+    }
+    void reload(unsigned int w, unsigned int h, Image_Format format,
+                std::vector<unsigned char>&& data) {
         _w = w;
         _h = h;
+        _format = format;
         _data = std::move(data);
     }
 
@@ -80,6 +158,7 @@ struct Image {
 private:
     std::vector<unsigned char> _data;
     unsigned int _w = 0, _h = 0;
+    Image_Format _format = Image_Format::rgba8_srgb;
 };
 
 } // namespace Util
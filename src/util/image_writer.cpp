@@ -0,0 +1,219 @@
+
+#include "image_writer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <lib/log.h>
+#include <lib/pack.h>
+#include <sf_libs/stb_image_write.h>
+#include <sf_libs/tinyexr.h>
+
+namespace Util {
+
+std::string Output_Settings::path(unsigned int number) const {
+
+    std::string ret = name;
+
+    size_t begin = ret.find('#');
+    if(begin != std::string::npos) {
+        size_t end = ret.find_first_not_of('#', begin);
+        if(end == std::string::npos) end = ret.size();
+
+        std::string digits = std::to_string(number);
+        if(digits.size() < end - begin) digits.insert(0, end - begin - digits.size(), '0');
+        ret.replace(begin, end - begin, digits);
+    }
+
+    return ret + (format == Output_Format::png ? ".png" : ".exr");
+}
+
+Image_Writer::Image_Writer() : thread([this]() { worker(); }) {
+}
+
+Image_Writer::~Image_Writer() {
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        stop = true;
+    }
+    cv_work.notify_one();
+    thread.join();
+}
+
+Output_Frame Image_Writer::acquire(unsigned int w, unsigned int h, bool aovs) {
+
+    Output_Frame frame;
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        if(!spare.empty()) {
+            frame = std::move(spare.back());
+            spare.pop_back();
+        }
+    }
+
+    size_t n = (size_t)w * h;
+    frame.w = w;
+    frame.h = h;
+    frame.color.resize(n * 4);
+    frame.depth.resize(aovs ? n : 0);
+    frame.normal.resize(aovs ? n : 0);
+    frame.albedo.resize(aovs ? n : 0);
+    return frame;
+}
+
+bool Image_Writer::submit(Output_Frame&& frame) {
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        if(queue.size() + busy >= max_pending) {
+            warn("Image writer is behind, dropping %s", frame.path.c_str());
+            return false;
+        }
+        queue.push_back(std::move(frame));
+    }
+    cv_work.notify_one();
+    return true;
+}
+
+void Image_Writer::flush() {
+    std::unique_lock<std::mutex> lock(mut);
+    cv_done.wait(lock, [this]() { return queue.empty() && !busy; });
+}
+
+size_t Image_Writer::pending() const {
+    std::lock_guard<std::mutex> lock(mut);
+    return queue.size() + busy;
+}
+
+void Image_Writer::worker() {
+
+    std::unique_lock<std::mutex> lock(mut);
+
+    for(;;) {
+        cv_work.wait(lock, [this]() { return stop || !queue.empty(); });
+        if(queue.empty()) return;
+
+        Output_Frame frame = std::move(queue.front());
+        queue.pop_front();
+        busy++;
+
+        lock.unlock();
+        write(frame);
+        lock.lock();
+
+        busy--;
+        // One spare per frame in flight is all acquire() can use
+        if(spare.size() < max_pending) spare.push_back(std::move(frame));
+        cv_done.notify_all();
+    }
+}
+
+static bool write_png(const Output_Frame& frame) {
+
+    size_t n = (size_t)frame.w * frame.h;
+    std::vector<unsigned char> pixels(n * 4);
+    Tonemapper(frame.settings.tonemap).run(frame.color.data(), pixels.data(), frame.w, frame.h);
+
+    if(!stbi_write_png(frame.path.c_str(), frame.w, frame.h, 4, pixels.data(), frame.w * 4)) {
+        warn("Failed to write %s", frame.path.c_str());
+        return false;
+    }
+    return true;
+}
+
+static bool write_exr(const Output_Frame& frame) {
+
+    size_t n = (size_t)frame.w * frame.h;
+    bool aovs = frame.settings.aovs && frame.depth.size() == n && frame.normal.size() == n &&
+                frame.albedo.size() == n;
+    int type = frame.settings.format == Output_Format::exr_half ? TINYEXR_PIXELTYPE_HALF
+                                                                : TINYEXR_PIXELTYPE_FLOAT;
+
+    struct Channel {
+        std::string name;
+        std::vector<float> data;
+        int type;
+        std::vector<uint16_t> half;
+    };
+    std::vector<Channel> channels;
+
+    const char* rgba[] = {"R", "G", "B", "A"};
+    for(size_t c = 0; c < 4; c++) {
+        Channel& ch = channels.emplace_back(Channel{rgba[c], std::vector<float>(n), type, {}});
+        for(size_t i = 0; i < n; i++) ch.data[i] = frame.color[i * 4 + c];
+    }
+
+    if(aovs) {
+        const char* names[] = {"albedo.R", "albedo.G", "albedo.B", "N.X", "N.Y", "N.Z"};
+        for(const char* name : names) channels.push_back({name, std::vector<float>(n), type, {}});
+        // Hit distance loses precision as half, so depth is always written as float
+        channels.push_back({"Z", std::vector<float>(n), TINYEXR_PIXELTYPE_FLOAT, {}});
+
+        for(size_t i = 0; i < n; i++) {
+            Vec2 jitter;
+            Vec3 a = Pack::unpack_albedo(frame.albedo[i]);
+            Vec3 N = frame.depth[i] ? Pack::unpack_normal(frame.normal[i]) : Vec3{};
+            for(size_t c = 0; c < 3; c++) {
+                channels[4 + c].data[i] = a[c];
+                channels[7 + c].data[i] = N[c];
+            }
+            channels[10].data[i] = Pack::unpack_depth(frame.depth[i], jitter);
+        }
+    }
+
+    // Readers expect channels sorted by name
+    std::sort(channels.begin(), channels.end(),
+              [](const Channel& l, const Channel& r) { return l.name < r.name; });
+
+    std::vector<EXRChannelInfo> infos(channels.size());
+    std::vector<int> types;
+    std::vector<unsigned char*> images;
+    for(size_t c = 0; c < channels.size(); c++) {
+        Channel& ch = channels[c];
+        std::snprintf(infos[c].name, sizeof(infos[c].name), "%s", ch.name.c_str());
+        types.push_back(ch.type);
+        // Convert here rather than one value at a time in tinyexr
+        if(ch.type == TINYEXR_PIXELTYPE_HALF) {
+            ch.half.resize(n);
+            float_to_half(ch.data.data(), ch.half.data(), n);
+            images.push_back(reinterpret_cast<unsigned char*>(ch.half.data()));
+        } else {
+            images.push_back(reinterpret_cast<unsigned char*>(ch.data.data()));
+        }
+    }
+
+    EXRHeader header;
+    InitEXRHeader(&header);
+    header.num_channels = (int)channels.size();
+    header.channels = infos.data();
+    header.pixel_types = types.data();
+    header.requested_pixel_types = types.data();
+    header.compression_type = TINYEXR_COMPRESSIONTYPE_ZIP;
+
+    EXRImage image;
+    InitEXRImage(&image);
+    image.num_channels = (int)channels.size();
+    image.images = images.data();
+    image.width = frame.w;
+    image.height = frame.h;
+
+    const char* err = nullptr;
+    if(SaveEXRImageToFile(&image, &header, frame.path.c_str(), &err) != TINYEXR_SUCCESS) {
+        warn("Failed to write %s: %s", frame.path.c_str(), err ? err : "");
+        FreeEXRErrorMessage(err);
+        return false;
+    }
+    return true;
+}
+
+bool Image_Writer::write(const Output_Frame& frame) {
+
+    if(frame.color.size() != (size_t)frame.w * frame.h * 4) {
+        warn("Output frame %s has no color data", frame.path.c_str());
+        return false;
+    }
+
+    bool ok = frame.settings.format == Output_Format::png ? write_png(frame) : write_exr(frame);
+    if(ok) info("Wrote %s", frame.path.c_str());
+    return ok;
+}
+
+} // namespace Util
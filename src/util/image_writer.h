@@ -0,0 +1,81 @@
+
+#pragma once
+
+#include <lib/mathlib.h>
+#include <util/tonemap.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Util {
+
+enum class Output_Format : int { exr_half, exr_float, png };
+
+struct Output_Settings {
+    Output_Format format = Output_Format::exr_half;
+    /// File name without extension; a run of '#' is replaced by the zero-padded frame number
+    std::string name = "out_####";
+    /// Adds the G-buffer as albedo, N and Z layers (EXR only)
+    bool aovs = true;
+    /// PNG only: the display's tonemapping, reproduced by Util::Tonemapper
+    Tonemap_Params tonemap;
+
+    /// File name for the given frame number, with the format's extension
+    std::string path(unsigned int number) const;
+};
+
+/// One image for the encoder: RGBA float radiance, plus the packed G-buffer (lib/pack.h) when
+/// AOVs are written. Every vector holds w*h texels (times four for color).
+struct Output_Frame {
+    unsigned int w = 0, h = 0;
+    std::vector<float> color;
+    std::vector<uint32_t> depth, normal, albedo;
+    std::string path;
+    Output_Settings settings;
+};
+
+/// Encodes frames to EXR (tinyexr) or PNG (stb) on a background thread, so saving never waits
+/// on the disk. Frames are handed over by move; their buffers are kept for reuse by acquire()
+/// once written.
+class Image_Writer {
+public:
+    Image_Writer();
+    ~Image_Writer();
+
+    Image_Writer(const Image_Writer&) = delete;
+    Image_Writer& operator=(const Image_Writer&) = delete;
+
+    /// Frame with buffers sized for w*h texels, recycled from a finished one when possible
+    Output_Frame acquire(unsigned int w, unsigned int h, bool aovs);
+
+    /// Queues a frame; false (and the frame is dropped) if max_pending are already waiting
+    bool submit(Output_Frame&& frame);
+
+    /// Blocks until every queued frame has been written
+    void flush();
+
+    /// Frames queued or being encoded
+    size_t pending() const;
+
+    /// Encodes on the calling thread; false on failure, which is logged
+    static bool write(const Output_Frame& frame);
+
+    static constexpr size_t max_pending = 4;
+
+private:
+    void worker();
+
+    mutable std::mutex mut;
+    std::condition_variable cv_work, cv_done;
+    std::deque<Output_Frame> queue;
+    std::vector<Output_Frame> spare;
+    size_t busy = 0;
+    bool stop = false;
+    std::thread thread;
+};
+
+} // namespace Util
@@ -0,0 +1,215 @@
+
+#include "mipmap.h"
+#include "parallel.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <lib/mathlib.h>
+
+namespace Util {
+
+namespace {
+
+// Kaiser-windowed sinc, in destination texels
+constexpr float KAISER_RADIUS = 2.0f;
+constexpr float KAISER_ALPHA = 4.0f;
+
+float bessel_i0(float x) {
+    float sum = 1.0f, term = 1.0f;
+    for(int k = 1; k < 32; k++) {
+        term *= (x * 0.5f / k) * (x * 0.5f / k);
+        sum += term;
+        if(term < sum * 1e-7f) break;
+    }
+    return sum;
+}
+
+float kaiser(float t) {
+    if(std::abs(t) >= KAISER_RADIUS) return 0.0f;
+    float x = t / KAISER_RADIUS;
+    float sinc = t == 0.0f ? 1.0f : std::sin(PI_F * t) / (PI_F * t);
+    return sinc * bessel_i0(KAISER_ALPHA * std::sqrt(1.0f - x * x)) / bessel_i0(KAISER_ALPHA);
+}
+
+/// Source texels and weights for every texel along one axis of the smaller level
+struct Taps {
+    unsigned int n = 0;
+    std::vector<unsigned int> index;
+    std::vector<float> weight;
+};
+
+Taps build_taps(unsigned int src, unsigned int dst, Mip_Filter filter) {
+
+    float s = (float)src / dst;
+    float radius = filter == Mip_Filter::box ? 0.5f * s : KAISER_RADIUS * s;
+
+    Taps taps;
+    taps.n = (unsigned int)std::ceil(2.0f * radius) + 1;
+    taps.index.resize((size_t)dst * taps.n);
+    taps.weight.resize((size_t)dst * taps.n);
+
+    for(unsigned int o = 0; o < dst; o++) {
+        float c = (o + 0.5f) * s;
+        int first = (int)std::floor(c - radius);
+        float sum = 0.0f;
+
+        for(unsigned int k = 0; k < taps.n; k++) {
+            int i = first + (int)k;
+            float w;
+            if(filter == Mip_Filter::box) {
+                w = std::max(std::min(i + 1.0f, c + radius) - std::max((float)i, c - radius), 0.0f);
+            } else {
+                w = kaiser((i + 0.5f - c) / s);
+            }
+            taps.index[o * taps.n + k] = (unsigned int)(((i % (int)src) + (int)src) % (int)src);
+            taps.weight[o * taps.n + k] = w;
+            sum += w;
+        }
+        for(unsigned int k = 0; k < taps.n; k++) taps.weight[o * taps.n + k] /= sum;
+    }
+    return taps;
+}
+
+template<typename F> void for_rows(size_t n, bool parallel, F&& f) {
+    if(parallel) {
+        parallel_for(0, n, f);
+    } else {
+        for(size_t i = 0; i < n; i++) f(i);
+    }
+}
+
+void convert_rows(Image_Const_View src, Image_View dst, bool parallel) {
+    if(parallel) {
+        convert(src, dst);
+        return;
+    }
+    // One row at a time is a single job, so convert() stays on this thread
+    for(unsigned int y = 0; y < src.h; y++)
+        convert(src.crop(0, y, src.w, 1), dst.crop(0, y, dst.w, 1));
+}
+
+/// src to the next level down, as RGBA32F clamped to [0, ceiling]. Rows of other formats are
+/// decoded as they are read, so the base level never exists as floats in full.
+Image downsample(Image_Const_View src, Mip_Filter filter, bool parallel, float ceiling) {
+
+    unsigned int w = std::max(src.w / 2, 1u), h = std::max(src.h / 2, 1u);
+    Taps tx = build_taps(src.w, w, filter), ty = build_taps(src.h, h, filter);
+
+    std::vector<float> tmp((size_t)w * src.h * 4);
+
+    for_rows(src.h, parallel, [&](size_t y) {
+        thread_local std::vector<float> decoded;
+        const float* row = reinterpret_cast<const float*>(src.row((unsigned int)y));
+        if(src.format != Image_Format::rgba32f) {
+            decoded.resize((size_t)src.w * 4);
+            Image_View dst{reinterpret_cast<unsigned char*>(decoded.data()), src.w, 1,
+                           decoded.size() * sizeof(float), Image_Format::rgba32f};
+            convert(src.crop(0, (unsigned int)y, src.w, 1), dst);
+            row = decoded.data();
+        }
+
+        float* out = tmp.data() + y * w * 4;
+        for(unsigned int x = 0; x < w; x++) {
+            const unsigned int* idx = &tx.index[(size_t)x * tx.n];
+            const float* wt = &tx.weight[(size_t)x * tx.n];
+#if UTIL_SSE
+            __m128 acc = _mm_setzero_ps();
+            for(unsigned int k = 0; k < tx.n; k++)
+                acc = _mm_add_ps(acc,
+                                 _mm_mul_ps(_mm_set1_ps(wt[k]), _mm_loadu_ps(row + idx[k] * 4)));
+            _mm_storeu_ps(out + x * 4, acc);
+#else
+            float acc[4] = {};
+            for(unsigned int k = 0; k < tx.n; k++)
+                for(int c = 0; c < 4; c++) acc[c] += wt[k] * row[idx[k] * 4 + c];
+            for(int c = 0; c < 4; c++) out[x * 4 + c] = acc[c];
+#endif
+        }
+    });
+
+    Image dst(w, h, Image_Format::rgba32f);
+    float* out = reinterpret_cast<float*>(dst.data());
+    size_t n = (size_t)w * 4;
+
+    for_rows(h, parallel, [&](size_t y) {
+        const unsigned int* idx = &ty.index[y * ty.n];
+        const float* wt = &ty.weight[y * ty.n];
+        float* row = out + y * n;
+        size_t i = 0;
+#if UTIL_SSE
+        const __m128 zero = _mm_setzero_ps(), top = _mm_set1_ps(ceiling);
+        for(; i < n; i += 4) {
+            __m128 acc = _mm_setzero_ps();
+            for(unsigned int k = 0; k < ty.n; k++)
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(wt[k]),
+                                                 _mm_loadu_ps(&tmp[idx[k] * n + i])));
+            // The Kaiser lobes ring below zero next to sharp edges, and above the brightest
+            // texel, which for half floats can overflow to infinity
+            _mm_storeu_ps(row + i, _mm_min_ps(_mm_max_ps(acc, zero), top));
+        }
+#endif
+        for(; i < n; i++) {
+            float acc = 0.0f;
+            for(unsigned int k = 0; k < ty.n; k++) acc += wt[k] * tmp[idx[k] * n + i];
+            row[i] = std::min(std::max(acc, 0.0f), ceiling);
+        }
+    });
+
+    return dst;
+}
+
+std::vector<Image> build_chain(Image_Const_View image, Mip_Filter filter, bool parallel) {
+
+    std::vector<Image> levels;
+    unsigned int n = mip_count(image.w, image.h);
+    if(n <= 1) return levels;
+
+    float ceiling = image.format == Image_Format::rgba16f ? 65504.0f
+                                                          : std::numeric_limits<float>::infinity();
+    Image linear = downsample(image, filter, parallel, ceiling);
+
+    for(unsigned int l = 1; l < n; l++) {
+        if(l > 1) linear = downsample(linear.view(), filter, parallel, ceiling);
+        if(image.format == Image_Format::rgba32f) {
+            levels.push_back(Image(linear.view()));
+        } else {
+            Image level(linear.w(), linear.h(), image.format);
+            convert_rows(linear.view(), level.view(), parallel);
+            levels.push_back(std::move(level));
+        }
+    }
+    return levels;
+}
+
+} // namespace
+
+unsigned int mip_count(unsigned int w, unsigned int h) {
+    unsigned int n = 1;
+    for(unsigned int m = std::max(w, h); m > 1; m /= 2) n++;
+    return n;
+}
+
+std::vector<Image> build_mips(Image_Const_View image, Mip_Filter filter) {
+    return build_chain(image, filter, true);
+}
+
+std::vector<std::vector<Image>> build_mips(const std::vector<Image_Const_View>& images,
+                                           Mip_Filter filter) {
+
+    std::vector<std::vector<Image>> chains(images.size());
+
+    // With fewer textures than threads, splitting rows keeps every thread busy instead
+    if(images.size() < n_threads()) {
+        for(size_t i = 0; i < images.size(); i++) chains[i] = build_chain(images[i], filter, true);
+        return chains;
+    }
+
+    parallel_for(0, images.size(), [&](size_t i) {
+        chains[i] = build_chain(images[i], filter, false);
+    });
+    return chains;
+}
+
+} // namespace Util
@@ -0,0 +1,24 @@
+
+#pragma once
+
+#include <util/image.h>
+#include <vector>
+
+namespace Util {
+
+enum class Mip_Filter : int { box, kaiser };
+
+/// Levels in a full chain down to 1x1, including the base
+unsigned int mip_count(unsigned int w, unsigned int h);
+
+/// Levels 1 and down of a full chain, each made from the one above it and stored in the base
+/// format. Texels are filtered as linear floats, so sRGB textures average the way the sampler
+/// blends them; addressing wraps like the REPEAT texture sampler. Filter ringing is clamped to
+/// the range the format can hold. Rows of each level are split across threads.
+std::vector<Image> build_mips(Image_Const_View image, Mip_Filter filter = Mip_Filter::kaiser);
+
+/// Chains for many textures at once, one texture per thread
+std::vector<std::vector<Image>> build_mips(const std::vector<Image_Const_View>& images,
+                                           Mip_Filter filter = Mip_Filter::kaiser);
+
+} // namespace Util
@@ -0,0 +1,43 @@
+
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace Util {
+
+inline unsigned int n_threads() {
+    unsigned int n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
+
+/// Calls f(i) for every i in [begin, end), split into contiguous chunks across threads
+template<typename F> void parallel_for(size_t begin, size_t end, F&& f) {
+
+    if(end <= begin) return;
+
+    size_t n = end - begin;
+    size_t n_t = std::min<size_t>(n_threads(), n);
+
+    if(n_t <= 1) {
+        for(size_t i = begin; i < end; i++) f(i);
+        return;
+    }
+
+    size_t chunk = (n + n_t - 1) / n_t;
+    std::vector<std::thread> threads;
+
+    for(size_t t = 0; t < n_t; t++) {
+        size_t b = begin + t * chunk;
+        size_t e = std::min(end, b + chunk);
+        if(b >= e) break;
+        threads.emplace_back([&f, b, e]() {
+            for(size_t i = b; i < e; i++) f(i);
+        });
+    }
+
+    for(auto& t : threads) t.join();
+}
+
+} // namespace Util
@@ -0,0 +1,461 @@
+
+#include "path_tracer.h"
+#include "parallel.h"
+
+#include <lib/ggx.h>
+#include <lib/pack.h>
+#include <lib/rng.h>
+#include <scene/scene.h>
+#include <util/camera.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace Util {
+
+static constexpr unsigned int LEAF_SIZE = 4;
+static constexpr int SAH_BINS = 12;
+static constexpr float EPS = 1e-4f;
+
+static float luma(Vec3 c) {
+    return 0.299f * c.x + 0.587f * c.y + 0.114f * c.z;
+}
+
+static float power_heuristic(float a, float b) {
+    float a2 = a * a;
+    return a2 > 0.0f ? a2 / (a2 + b * b) : 0.0f;
+}
+
+static bool hit_box(const BBox& box, Vec3 o, Vec3 inv_d, float t_max) {
+    float t0 = 0.0f, t1 = t_max;
+    for(int i = 0; i < 3; i++) {
+        float a = (box.min[i] - o[i]) * inv_d[i];
+        float b = (box.max[i] - o[i]) * inv_d[i];
+        if(a > b) std::swap(a, b);
+        t0 = std::max(t0, a);
+        t1 = std::min(t1, b);
+        if(t0 > t1) return false;
+    }
+    return true;
+}
+
+Tracer_Scene::Tracer_Scene(const Scene& scene) {
+
+    scene.for_objs([this](const Object& obj) {
+        std::vector<Vec3> pos, norm;
+        for(const VK::Mesh::Vertex& v : obj.mesh().verts()) {
+            pos.push_back(v.pos.xyz());
+            norm.push_back(v.norm.xyz());
+        }
+        Tracer_Material mat;
+        mat.albedo = obj.material.albedo;
+        mat.emissive = obj.material.emissive;
+        mat.roughness = obj.material.metal_rough.y;
+        add_mesh(pos, norm, obj.mesh().inds(), obj.pose.transform(), mat);
+    });
+
+    if(!scene.env_map().empty()) env = &scene.env_map();
+    build();
+}
+
+void Tracer_Scene::add_mesh(const std::vector<Vec3>& pos, const std::vector<Vec3>& norm,
+                            const std::vector<unsigned int>& idx, const Mat4& T,
+                            const Tracer_Material& mat) {
+
+    Mat4 N = Mat4::inverse(T).T();
+    unsigned int m = (unsigned int)materials.size();
+    materials.push_back(mat);
+
+    for(size_t i = 0; i + 2 < idx.size(); i += 3) {
+        Vec3 p[3], n[3];
+        for(int j = 0; j < 3; j++) {
+            p[j] = T * pos[idx[i + j]];
+            n[j] = idx[i + j] < norm.size() ? N.rotate(norm[idx[i + j]]).unit() : Vec3{};
+        }
+        Vec3 ng = cross(p[1] - p[0], p[2] - p[0]);
+        if(ng.norm_squared() == 0.0f) continue;
+        for(int j = 0; j < 3; j++) {
+            if(!(n[j].norm_squared() > 0.0f)) n[j] = ng.unit();
+        }
+        tris.push_back({p[0], p[1] - p[0], p[2] - p[0], n[0], n[1], n[2], m});
+    }
+}
+
+void Tracer_Scene::build() {
+
+    nodes.clear();
+    std::vector<BBox> boxes(tris.size());
+    std::vector<Vec3> centers(tris.size());
+    for(size_t i = 0; i < tris.size(); i++) {
+        const Tri& t = tris[i];
+        boxes[i].enclose(t.v0);
+        boxes[i].enclose(t.v0 + t.e1);
+        boxes[i].enclose(t.v0 + t.e2);
+        centers[i] = boxes[i].center();
+    }
+    if(!tris.empty()) build_node(0, (unsigned int)tris.size(), boxes, centers);
+
+    light_tris.clear();
+    light_weights.clear();
+    for(unsigned int i = 0; i < tris.size(); i++) {
+        float e = luma(material(i).emissive);
+        if(e <= 0.0f) continue;
+        light_tris.push_back(i);
+        light_weights.push_back(e * 0.5f * cross(tris[i].e1, tris[i].e2).norm());
+    }
+    light_total = 0.0f;
+    for(float w : light_weights) light_total += w;
+    if(!light_tris.empty()) lights.build(light_weights.data(), light_weights.size());
+}
+
+// Binned SAH; tris, boxes and centers are partitioned together
+unsigned int Tracer_Scene::build_node(unsigned int begin, unsigned int end,
+                                      std::vector<BBox>& boxes, std::vector<Vec3>& centers) {
+
+    unsigned int idx = (unsigned int)nodes.size();
+    nodes.push_back({});
+
+    BBox box, cbox;
+    for(unsigned int i = begin; i < end; i++) {
+        box.enclose(boxes[i]);
+        cbox.enclose(centers[i]);
+    }
+    nodes[idx].box = box;
+
+    unsigned int n = end - begin;
+    int best_axis = -1, best_split = 0;
+    float best_cost = (float)n;
+
+    if(n > LEAF_SIZE) {
+        for(int a = 0; a < 3; a++) {
+            float lo = cbox.min[a], extent = cbox.max[a] - lo;
+            if(extent <= 0.0f) continue;
+
+            BBox bins[SAH_BINS];
+            unsigned int counts[SAH_BINS] = {};
+            for(unsigned int i = begin; i < end; i++) {
+                int b = std::min((int)((centers[i][a] - lo) / extent * SAH_BINS), SAH_BINS - 1);
+                bins[b].enclose(boxes[i]);
+                counts[b]++;
+            }
+
+            float area = box.surface_area();
+            for(int s = 1; s < SAH_BINS; s++) {
+                BBox l, r;
+                unsigned int nl = 0, nr = 0;
+                for(int b = 0; b < s; b++) {
+                    l.enclose(bins[b]);
+                    nl += counts[b];
+                }
+                for(int b = s; b < SAH_BINS; b++) {
+                    r.enclose(bins[b]);
+                    nr += counts[b];
+                }
+                if(!nl || !nr) continue;
+                float cost = 0.125f + (l.surface_area() * nl + r.surface_area() * nr) / area;
+                if(cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = a;
+                    best_split = s;
+                }
+            }
+        }
+    }
+
+    if(best_axis < 0) {
+        nodes[idx].start = begin;
+        nodes[idx].count = n;
+        return idx;
+    }
+
+    float lo = cbox.min[best_axis], extent = cbox.max[best_axis] - lo;
+    unsigned int mid = begin;
+    for(unsigned int i = begin; i < end; i++) {
+        int b = std::min((int)((centers[i][best_axis] - lo) / extent * SAH_BINS), SAH_BINS - 1);
+        if(b < best_split) {
+            std::swap(tris[i], tris[mid]);
+            std::swap(boxes[i], boxes[mid]);
+            std::swap(centers[i], centers[mid]);
+            mid++;
+        }
+    }
+
+    build_node(begin, mid, boxes, centers);
+    unsigned int r = build_node(mid, end, boxes, centers);
+    nodes[idx].start = r;
+    return idx;
+}
+
+bool Tracer_Scene::intersect(Vec3 o, Vec3 d, Hit& hit) const {
+
+    if(nodes.empty()) return false;
+
+    Vec3 inv_d = 1.0f / d;
+    float u_hit = 0.0f, v_hit = 0.0f;
+    bool found = false;
+
+    unsigned int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+
+    while(top) {
+        unsigned int n = stack[--top];
+        const Node& node = nodes[n];
+        if(!hit_box(node.box, o, inv_d, hit.t)) continue;
+
+        if(!node.count) {
+            stack[top++] = node.start;
+            stack[top++] = n + 1;
+            continue;
+        }
+
+        // Moller-Trumbore
+        for(unsigned int i = node.start; i < node.start + node.count; i++) {
+            const Tri& t = tris[i];
+            Vec3 p = cross(d, t.e2);
+            float det = dot(t.e1, p);
+            if(det == 0.0f) continue;
+            float inv = 1.0f / det;
+            Vec3 s = o - t.v0;
+            float u = dot(s, p) * inv;
+            if(u < 0.0f || u > 1.0f) continue;
+            Vec3 q = cross(s, t.e1);
+            float v = dot(d, q) * inv;
+            if(v < 0.0f || u + v > 1.0f) continue;
+            float dist = dot(t.e2, q) * inv;
+            if(dist <= EPS || dist >= hit.t) continue;
+            hit.t = dist;
+            hit.tri = i;
+            u_hit = u;
+            v_hit = v;
+            found = true;
+        }
+    }
+
+    if(found) {
+        const Tri& t = tris[hit.tri];
+        hit.pos = o + hit.t * d;
+        hit.Ng = cross(t.e1, t.e2).unit();
+        hit.N = ((1.0f - u_hit - v_hit) * t.n0 + u_hit * t.n1 + v_hit * t.n2).unit();
+    }
+    return found;
+}
+
+bool Tracer_Scene::occluded(Vec3 a, Vec3 b) const {
+    Vec3 d = b - a;
+    float l = d.norm();
+    Hit hit;
+    hit.t = l * (1.0f - EPS);
+    return intersect(a, d / l, hit);
+}
+
+Tracer_Scene::Light_Sample Tracer_Scene::sample_light(Vec3 u) const {
+
+    Light_Sample ls;
+    if(light_tris.empty()) return ls;
+
+    float pdf;
+    size_t i;
+    lights.sample(u.x, pdf, i);
+    const Tri& t = tris[light_tris[i]];
+
+    float su = std::sqrt(u.y);
+    float b1 = 1.0f - su, b2 = u.z * su;
+    ls.pos = t.v0 + b1 * t.e1 + b2 * t.e2;
+    ls.norm = cross(t.e1, t.e2).unit();
+    ls.emissive = materials[t.mat].emissive;
+    ls.pdf = light_pdf(light_tris[i]);
+    return ls;
+}
+
+float Tracer_Scene::light_pdf(unsigned int tri) const {
+    float e = luma(material(tri).emissive);
+    return e > 0.0f && light_total > 0.0f ? e / light_total : 0.0f;
+}
+
+BBox Tracer_Scene::bounds() const {
+    return nodes.empty() ? BBox{} : nodes[0].box;
+}
+
+namespace {
+
+struct Vertex {
+    Vec3 pos, dir;
+    float pdf;
+    Vec3 throughput;
+    Vec3 radiance;
+};
+
+struct Path_State {
+    Vertex verts[64];
+    int n = 0;
+
+    // Adds a contribution, already scaled by the path throughput, to the radiance every
+    // recorded vertex receives along its sampled direction
+    void splat(Vec3 c) {
+        for(int i = 0; i < n; i++) {
+            Vec3 t = verts[i].throughput;
+            verts[i].radiance += Vec3{t.x > 0.0f ? c.x / t.x : 0.0f, t.y > 0.0f ? c.y / t.y : 0.0f,
+                                      t.z > 0.0f ? c.z / t.z : 0.0f};
+        }
+    }
+};
+
+// guide, when set, is sampled alongside the BRDF; record keeps the vertices for training
+Vec3 trace_path(const Tracer_Scene& scene, const SD_Tree* guide, bool record,
+                const Trace_Params& params, Vec3 o, Vec3 d, RNG& rng, Path_State& path) {
+
+    Vec3 L, beta{1.0f};
+    float prev_pdf = 0.0f;
+    int max_depth = std::min(params.max_depth, 64);
+
+    for(int depth = 0; depth < max_depth; depth++) {
+
+        Tracer_Scene::Hit hit;
+        if(!scene.intersect(o, d, hit)) {
+            if(scene.env) {
+                Vec3 c = beta * scene.env->radiance(d);
+                L += c;
+                path.splat(c);
+            }
+            break;
+        }
+
+        const Tracer_Material& mat = scene.material(hit.tri);
+
+        if(luma(mat.emissive) > 0.0f) {
+            float w = 1.0f;
+            if(prev_pdf > 0.0f) {
+                float cos_l = std::abs(dot(hit.Ng, d));
+                float p_light = cos_l > 0.0f ? scene.light_pdf(hit.tri) * hit.t * hit.t / cos_l : 0.0f;
+                w = power_heuristic(prev_pdf, p_light);
+            }
+            Vec3 c = beta * w * mat.emissive;
+            L += c;
+            path.splat(c);
+            break;
+        }
+
+        // Double sided: face the normals toward the incoming ray
+        Vec3 Ng = hit.Ng, N = hit.N;
+        if(dot(Ng, d) > 0.0f) Ng = -Ng;
+        if(dot(N, Ng) < 0.0f) N = -N;
+        Vec3 x = hit.pos + Ng * EPS;
+
+        if(mat.roughness == 0.0f) {
+            d = GGX_reflect(d, N);
+            beta *= mat.albedo;
+            prev_pdf = 0.0f;
+            o = x;
+            continue;
+        }
+
+        GGX_Shade shade;
+        shade.wo = d;
+        shade.N = N;
+        shade.T = (std::abs(N.x) > 0.5f ? cross(N, Vec3{0.0f, 1.0f, 0.0f}) : cross(N, Vec3{1.0f, 0.0f, 0.0f})).unit();
+        shade.B = cross(N, shade.T);
+
+        float alpha = guide ? params.bsdf_fraction : 1.0f;
+        auto mixture_pdf = [&](Vec3 wi) {
+            float p = alpha * GGX_pdf(mat.roughness, shade, wi);
+            if(guide) p += (1.0f - alpha) * guide->pdf(x, wi);
+            return p;
+        };
+
+        if(scene.has_lights()) {
+            Tracer_Scene::Light_Sample ls = scene.sample_light(Vec3{rng.unit(), rng.unit(), rng.unit()});
+            Vec3 to = ls.pos - x;
+            float l2 = to.norm_squared();
+            Vec3 wi = to / std::sqrt(l2);
+            float cos_l = std::abs(dot(ls.norm, wi));
+            Vec3 f = GGX_eval(mat.albedo, mat.roughness, shade, wi);
+            if(ls.pdf > 0.0f && cos_l > 0.0f && luma(f) > 0.0f && !scene.occluded(x, ls.pos)) {
+                float p_light = ls.pdf * l2 / cos_l;
+                Vec3 c = beta * f * ls.emissive * (power_heuristic(p_light, mixture_pdf(wi)) / p_light);
+                L += c;
+                path.splat(c);
+            }
+        }
+
+        Vec3 wi;
+        Vec2 u{rng.unit(), rng.unit()};
+        if(guide && rng.unit() >= alpha) {
+            float p;
+            wi = guide->sample(x, u, p);
+        } else if(!GGX_sample(u, mat.roughness, shade, wi)) {
+            break;
+        }
+
+        float pdf = mixture_pdf(wi);
+        Vec3 f = GGX_eval(mat.albedo, mat.roughness, shade, wi);
+        if(!(pdf > 0.0f) || luma(f) <= 0.0f) break;
+
+        beta *= f / pdf;
+        prev_pdf = pdf;
+        o = x;
+        d = wi;
+
+        if(record) path.verts[path.n++] = {x, wi, pdf, beta, Vec3{}};
+    }
+    return L;
+}
+
+} // namespace
+
+int path_trace(const Tracer_Scene& scene, const Camera& cam, const Trace_Params& params,
+               std::vector<Vec3>& out) {
+
+    const unsigned int w = params.w, h = params.h;
+    Mat4 iV = cam.get_view().inverse();
+    Mat4 rays = Pack::ray_matrix(iV, cam.get_proj().inverse());
+    Vec3 eye = cam.pos();
+
+    SD_Tree tree(scene.bounds(), params.tree);
+
+    int used = 0, iter_spp = 1, iteration = 0;
+    for(;; iteration++) {
+
+        int remaining = params.spp - used;
+        bool last = !params.guiding || remaining < 3 * iter_spp;
+        int spp = last ? remaining : iter_spp;
+        const SD_Tree* guide = params.guiding && tree.iteration() > 0 ? &tree : nullptr;
+        bool learn = !last;
+
+        out.assign((size_t)w * h, Vec3{});
+
+        parallel_for(0, h, [&](size_t y) {
+            for(unsigned int x = 0; x < w; x++) {
+
+                uint32_t pixel = (uint32_t)(y * w + x);
+                Vec3 sum;
+
+                for(int s = 0; s < spp; s++) {
+                    RNG rng(pixel, (uint32_t)iteration, (uint32_t)s, params.seed);
+                    Vec2 ndc = Vec2{(x + rng.unit()) / w, (y + rng.unit()) / h} * 2.0f - Vec2{1.0f};
+                    Vec3 d = (rays * Vec4{ndc.x, ndc.y, 0.0f, 1.0f}).xyz().unit();
+
+                    Path_State path;
+                    Vec3 L = trace_path(scene, guide, learn, params, eye, d, rng, path);
+                    if(std::isfinite(L.x) && std::isfinite(L.y) && std::isfinite(L.z)) sum += L;
+
+                    if(learn) {
+                        for(int i = 0; i < path.n; i++) {
+                            const Vertex& v = path.verts[i];
+                            tree.record(v.pos, v.dir, luma(v.radiance) / v.pdf);
+                        }
+                    }
+                }
+                out[pixel] = spp > 0 ? sum / (float)spp : Vec3{};
+            }
+        });
+
+        used += spp;
+        if(last) break;
+        tree.refine();
+        iter_spp *= 2;
+    }
+    return iteration + 1;
+}
+
+} // namespace Util
@@ -0,0 +1,111 @@
+
+#pragma once
+
+#include <lib/mathlib.h>
+#include <util/distribution.h>
+#include <util/sd_tree.h>
+#include <vector>
+
+class Scene;
+class Camera;
+class Env_Map;
+
+namespace Util {
+
+struct Tracer_Material {
+    Vec3 albedo{1.0f};
+    Vec3 emissive;
+    float roughness = 1.0f;
+};
+
+/// World-space triangles of a Scene in a BVH, for tracing on the CPU. Materials use their
+/// constant factors; textures are not sampled.
+class Tracer_Scene {
+public:
+    Tracer_Scene() = default;
+    /// Keeps a pointer to the scene's environment map, if it has one
+    explicit Tracer_Scene(const Scene& scene);
+
+    void add_mesh(const std::vector<Vec3>& pos, const std::vector<Vec3>& norm,
+                  const std::vector<unsigned int>& idx, const Mat4& T, const Tracer_Material& mat);
+    /// Builds the BVH and the light distribution; call after the last add_mesh
+    void build();
+
+    struct Hit {
+        float t = INFINITY;
+        unsigned int tri = 0;
+        Vec3 pos, Ng, N;
+    };
+    bool intersect(Vec3 o, Vec3 d, Hit& hit) const;
+    /// Whether anything lies strictly between a and b
+    bool occluded(Vec3 a, Vec3 b) const;
+
+    struct Light_Sample {
+        Vec3 pos, norm, emissive;
+        /// Area density
+        float pdf = 0.0f;
+    };
+    /// Point on an emissive triangle, picked by area times emitted luma
+    Light_Sample sample_light(Vec3 u) const;
+    /// Area density of sample_light() at a point of triangle tri
+    float light_pdf(unsigned int tri) const;
+
+    const Tracer_Material& material(unsigned int tri) const {
+        return materials[tris[tri].mat];
+    }
+    bool has_lights() const {
+        return !light_tris.empty();
+    }
+    BBox bounds() const;
+
+    const Env_Map* env = nullptr;
+
+private:
+    struct Tri {
+        Vec3 v0, e1, e2;
+        Vec3 n0, n1, n2;
+        unsigned int mat;
+    };
+    struct Node {
+        BBox box;
+        /// Leaves hold count triangles from start; inner nodes are followed by their left child
+        /// and hold the index of the right one in start
+        unsigned int start = 0, count = 0;
+    };
+
+    unsigned int build_node(unsigned int begin, unsigned int end, std::vector<BBox>& boxes,
+                            std::vector<Vec3>& centers);
+
+    std::vector<Tri> tris;
+    std::vector<Tracer_Material> materials;
+    std::vector<Node> nodes;
+    std::vector<unsigned int> light_tris;
+    std::vector<float> light_weights;
+    Distribution_1D lights;
+    float light_total = 0.0f;
+};
+
+struct Trace_Params {
+    unsigned int w = 256, h = 256;
+    /// Samples per pixel over all iterations
+    int spp = 64;
+    int max_depth = 8;
+    /// Learn an SD-tree and sample it alongside the BRDF
+    bool guiding = true;
+    /// Chance of sampling the BRDF rather than the SD-tree once it is trained
+    float bsdf_fraction = 0.5f;
+    SD_Tree_Params tree;
+    /// Mixed into every path's random stream, for independent renders of the same view
+    uint32_t seed = 0;
+};
+
+/// Multithreaded CPU path tracer: next event estimation and BRDF sampling combined with the power
+/// heuristic, like integrate_mis in raygen.glsl. With guiding, it trains an SD-tree over
+/// iterations of 1, 2, 4... spp from the radiance each completed path found, and samples it in a
+/// one-sample mixture with the BRDF. The last iteration takes what is left of the budget once the
+/// next doubling no longer fits; only its image is written, w*h RGB texels laid out like the
+/// RT target. Returns the number of iterations.
+int path_trace(const Tracer_Scene& scene, const Camera& cam, const Trace_Params& params,
+               std::vector<Vec3>& out);
+
+} // namespace Util
@@ -0,0 +1,131 @@
+
+#include "radiance_cache.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Util {
+
+// Key layout: bit 63 marks a used key, then 5 bits of level, 3 of normal direction and 18 per
+// cell coordinate. Coordinates wrap every 2^18 cells, far past any scene at the finest level.
+static constexpr uint64_t KEY_USED = uint64_t(1) << 63;
+static constexpr int COORD_BITS = 18;
+static constexpr int MAX_LEVEL = 31;
+
+static uint64_t mix64(uint64_t k) {
+    k ^= k >> 30;
+    k *= 0xbf58476d1ce4e5b9ull;
+    k ^= k >> 27;
+    k *= 0x94d049bb133111ebull;
+    k ^= k >> 31;
+    return k;
+}
+
+static uint64_t coord(float x, float size) {
+    int64_t c = (int64_t)std::floor(x / size);
+    return (uint64_t)c & ((uint64_t(1) << COORD_BITS) - 1);
+}
+
+static uint64_t normal_dir(Vec3 n) {
+    Vec3 a{std::abs(n.x), std::abs(n.y), std::abs(n.z)};
+    if(a.x >= a.y && a.x >= a.z) return n.x >= 0.0f ? 0 : 1;
+    if(a.y >= a.z) return n.y >= 0.0f ? 2 : 3;
+    return n.z >= 0.0f ? 4 : 5;
+}
+
+Radiance_Cache::Radiance_Cache(const Radiance_Cache_Params& p) : params(p) {
+    size_t cap = 1;
+    while(cap < std::max(params.capacity, size_t(1))) cap <<= 1;
+    mask = cap - 1;
+    cells = std::make_unique<Cell[]>(cap);
+}
+
+int Radiance_Cache::level(float dist) const {
+    float size = std::max(params.spread * dist, params.min_cell);
+    int l = (int)std::ceil(std::log2(size / params.min_cell));
+    return std::clamp(l, 0, MAX_LEVEL);
+}
+
+float Radiance_Cache::cell_size(float dist) const {
+    return std::ldexp(params.min_cell, level(dist));
+}
+
+uint64_t Radiance_Cache::key(Vec3 pos, Vec3 norm, float dist) const {
+    int l = level(dist);
+    float size = std::ldexp(params.min_cell, l);
+    return KEY_USED | (uint64_t)l << 58 | normal_dir(norm) << 55 |
+           coord(pos.x, size) << (2 * COORD_BITS) | coord(pos.y, size) << COORD_BITS |
+           coord(pos.z, size);
+}
+
+Radiance_Cache::Cell* Radiance_Cache::find(uint64_t key, bool claim) const {
+
+    size_t h = (size_t)mix64(key);
+
+    for(unsigned int i = 0; i <= params.max_probes; i++) {
+
+        Cell& c = cells[(h + i) & mask];
+        uint64_t k = c.key.load(std::memory_order_acquire);
+
+        if(k == key) return &c;
+        if(k != 0) continue;
+
+        // Keys are never removed, so an empty slot ends the probe sequence
+        if(!claim) return nullptr;
+        if(c.key.compare_exchange_strong(k, key, std::memory_order_acq_rel)) return &c;
+        if(k == key) return &c;
+    }
+    return nullptr;
+}
+
+bool Radiance_Cache::insert(uint64_t key, Vec3 radiance) {
+
+    Cell* c = find(key, true);
+    if(!c) {
+        n_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    if(c->n.load(std::memory_order_relaxed) >= params.max_samples) return true;
+
+    c->r.fetch_add(radiance.x, std::memory_order_relaxed);
+    c->g.fetch_add(radiance.y, std::memory_order_relaxed);
+    c->b.fetch_add(radiance.z, std::memory_order_relaxed);
+    c->n.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+bool Radiance_Cache::lookup(uint64_t key, Vec3& radiance) const {
+
+    const Cell* c = find(key, false);
+    if(!c) return false;
+
+    uint32_t n = c->n.load(std::memory_order_acquire);
+    if(n < std::max(params.min_samples, 1u)) return false;
+
+    radiance = Vec3{c->r.load(std::memory_order_relaxed), c->g.load(std::memory_order_relaxed),
+                    c->b.load(std::memory_order_relaxed)} /
+               (float)n;
+    return true;
+}
+
+void Radiance_Cache::clear() {
+    for(size_t i = 0; i <= mask; i++) {
+        cells[i].key.store(0, std::memory_order_relaxed);
+        cells[i].r.store(0.0f, std::memory_order_relaxed);
+        cells[i].g.store(0.0f, std::memory_order_relaxed);
+        cells[i].b.store(0.0f, std::memory_order_relaxed);
+        cells[i].n.store(0, std::memory_order_relaxed);
+    }
+    n_dropped.store(0, std::memory_order_relaxed);
+}
+
+size_t Radiance_Cache::occupied() const {
+    size_t n = 0;
+    for(size_t i = 0; i <= mask; i++) {
+        if(cells[i].key.load(std::memory_order_relaxed)) n++;
+    }
+    return n;
+}
+
+} // namespace Util
@@ -0,0 +1,85 @@
+
+#pragma once
+
+#include <lib/mathlib.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace Util {
+
+struct Radiance_Cache_Params {
+    /// Table slots, rounded up to a power of two
+    size_t capacity = size_t(1) << 20;
+    /// Slots tried after the hashed one before an insert gives up
+    unsigned int max_probes = 8;
+    /// Edge of the finest cells, at the camera
+    float min_cell = 0.01f;
+    /// Cell edge per unit of distance to the camera; rounded up to min_cell times a power of two
+    float spread = 0.02f;
+    /// Samples a cell needs before lookups use it
+    unsigned int min_samples = 4;
+    /// Cells stop accumulating past this many samples
+    unsigned int max_samples = 256;
+};
+
+/// World-space radiance cache: a fixed-size hash table of cells, keyed on the quantized position,
+/// the cell level and the dominant axis of the normal. Cells grow by powers of two with distance
+/// to the camera. Cells are claimed with a compare-and-swap on their key and accumulate with
+/// atomic adds, so any number of threads may insert and look up at once without locks. A lookup
+/// racing an insert may see the sum and count one sample apart.
+class Radiance_Cache {
+public:
+    explicit Radiance_Cache(const Radiance_Cache_Params& params = {});
+
+    Radiance_Cache(const Radiance_Cache&) = delete;
+    Radiance_Cache& operator=(const Radiance_Cache&) = delete;
+
+    /// Key of the cell holding pos; dist is the distance to the camera. Never zero.
+    uint64_t key(Vec3 pos, Vec3 norm, float dist) const;
+
+    /// Adds a radiance sample to the cell; false if its probe sequence is full of other cells
+    bool insert(uint64_t key, Vec3 radiance);
+    /// Mean radiance of the cell, if it has at least min_samples
+    bool lookup(uint64_t key, Vec3& radiance) const;
+
+    bool insert(Vec3 pos, Vec3 norm, float dist, Vec3 radiance) {
+        return insert(key(pos, norm, dist), radiance);
+    }
+    bool lookup(Vec3 pos, Vec3 norm, float dist, Vec3& radiance) const {
+        return lookup(key(pos, norm, dist), radiance);
+    }
+
+    /// Not thread safe
+    void clear();
+
+    /// Claimed slots, by scanning the table
+    size_t occupied() const;
+    size_t capacity() const {
+        return mask + 1;
+    }
+    /// Inserts rejected since the last clear
+    size_t dropped() const {
+        return n_dropped.load(std::memory_order_relaxed);
+    }
+
+    /// Edge length of the cells at the given distance to the camera
+    float cell_size(float dist) const;
+
+private:
+    struct Cell {
+        std::atomic<uint64_t> key{0};
+        std::atomic<float> r{0.0f}, g{0.0f}, b{0.0f};
+        std::atomic<uint32_t> n{0};
+    };
+
+    Cell* find(uint64_t key, bool claim) const;
+    int level(float dist) const;
+
+    Radiance_Cache_Params params;
+    size_t mask = 0;
+    std::unique_ptr<Cell[]> cells;
+    std::atomic<size_t> n_dropped{0};
+};
+
+} // namespace Util
@@ -0,0 +1,311 @@
+
+#include "restir_gi.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Util {
+
+namespace {
+
+// Keep in sync with restir_gi.glsl and restir_spatial.rgen
+constexpr float GI_DISTANT = 1e5f;
+constexpr float GI_MAX_JACOBIAN = 10.0f;
+constexpr int MAX_SPATIAL = 16;
+constexpr float EPS = 1e-4f;
+
+struct Hit {
+    float t = INFINITY;
+    int quad = -1;
+    Vec3 pos, norm;
+};
+
+float luma(Vec3 c) {
+    return 0.299f * c.x + 0.587f * c.y + 0.114f * c.z;
+}
+
+Hit intersect(const GI_Scene& scene, Vec3 o, Vec3 d, float t_max = INFINITY) {
+    Hit hit;
+    hit.t = t_max;
+    for(size_t i = 0; i < scene.quads.size(); i++) {
+        const GI_Scene::Quad& q = scene.quads[i];
+        Vec3 n = cross(q.u, q.v);
+        float den = dot(d, n);
+        if(den == 0.0f) continue;
+        float t = dot(q.corner - o, n) / den;
+        if(t <= EPS || t >= hit.t) continue;
+        Vec3 p = o + t * d - q.corner;
+        float a = dot(p, q.u) / q.u.norm_squared(), b = dot(p, q.v) / q.v.norm_squared();
+        if(a < 0.0f || a > 1.0f || b < 0.0f || b > 1.0f) continue;
+        hit.t = t;
+        hit.quad = static_cast<int>(i);
+        hit.pos = o + t * d;
+        hit.norm = den < 0.0f ? n.unit() : -n.unit();
+    }
+    return hit;
+}
+
+bool occluded(const GI_Scene& scene, Vec3 a, Vec3 b) {
+    Vec3 d = b - a;
+    float l = d.norm();
+    return intersect(scene, a, d / l, l - EPS).quad >= 0;
+}
+
+Vec3 emitted(const GI_Scene& scene, const Hit& hit, Vec3 d) {
+    const GI_Scene::Quad& q = scene.quads[hit.quad];
+    return dot(d, cross(q.u, q.v)) < 0.0f ? q.emissive : Vec3{};
+}
+
+Vec3 cosine_sample(Vec3 n, RNG& rng) {
+    float phi = 2.0f * PI_F * rng.unit(), r2 = rng.unit(), r = std::sqrt(r2);
+    Vec3 t = std::abs(n.x) > 0.5f ? Vec3{0.0f, 1.0f, 0.0f} : Vec3{1.0f, 0.0f, 0.0f};
+    Vec3 b1 = cross(n, t).unit(), b2 = cross(n, b1);
+    return (r * std::cos(phi) * b1 + r * std::sin(phi) * b2 + std::sqrt(1.0f - r2) * n).unit();
+}
+
+// Light sampling of every emissive quad by area; diffuse BRDF albedo / pi
+Vec3 direct(const GI_Scene& scene, const Hit& hit, RNG& rng) {
+    Vec3 L;
+    Vec3 albedo = scene.quads[hit.quad].albedo;
+    for(const GI_Scene::Quad& q : scene.quads) {
+        if(q.emissive.norm_squared() == 0.0f) continue;
+        Vec3 y = q.corner + rng.unit() * q.u + rng.unit() * q.v;
+        Vec3 n = cross(q.u, q.v);
+        float area = n.norm();
+        Vec3 d = y - hit.pos;
+        float l2 = d.norm_squared();
+        Vec3 wi = d / std::sqrt(l2);
+        float cx = dot(hit.norm, wi), cy = -dot(n / area, wi);
+        if(cx <= 0.0f || cy <= 0.0f || occluded(scene, hit.pos, y)) continue;
+        L += albedo * (1.0f / PI_F) * q.emissive * (cx * cy * area / l2);
+    }
+    return L;
+}
+
+// Radiance leaving hit, emission excluded: direct light plus max_depth more bounces. With a cache,
+// the path ends at the first vertex past hit whose cell is populated; vertices it does trace
+// feed their own estimate back into their cell.
+Vec3 outgoing(const GI_Scene& scene, const Hit& hit, int max_depth, RNG& rng,
+              Radiance_Cache* cache) {
+
+    Vec3 L = direct(scene, hit, rng);
+    if(max_depth <= 0) return L;
+
+    Vec3 d = cosine_sample(hit.norm, rng);
+    Hit next = intersect(scene, hit.pos, d);
+    if(next.quad < 0) return L;
+
+    Vec3 albedo = scene.quads[hit.quad].albedo;
+    if(!cache) return L + albedo * outgoing(scene, next, max_depth - 1, rng, nullptr);
+
+    uint64_t key = cache->key(next.pos, next.norm, (next.pos - scene.eye).norm());
+    Vec3 cached;
+    if(cache->lookup(key, cached)) return L + albedo * cached;
+
+    Vec3 Lo = outgoing(scene, next, max_depth - 1, rng, cache);
+    cache->insert(key, Lo);
+    return L + albedo * Lo;
+}
+
+float target(const GI_Sample& s, Vec3 x, Vec3 n, Vec3 albedo) {
+    Vec3 wi = (s.xs - x).unit();
+    return luma(albedo * (1.0f / PI_F) * std::max(dot(n, wi), 0.0f) * s.Lo);
+}
+
+// Jacobian of reusing s at x, or 0 past the cap. Rejected reservoirs still count toward M: dropping
+// them outright would pick which neighbours count by the samples they hold, which biases.
+float reuse_jacobian(const GI_Sample& s, Vec3 x) {
+    float J = gi_jacobian(s, x);
+    return J <= GI_MAX_JACOBIAN ? J : 0.0f;
+}
+
+Vec3 shade(const GI_Sample& s, float W, Vec3 x, Vec3 n, Vec3 albedo) {
+    Vec3 wi = (s.xs - x).unit();
+    return W * albedo * (1.0f / PI_F) * std::max(dot(n, wi), 0.0f) * s.Lo;
+}
+
+struct Pixel {
+    Hit hit;
+    Vec3 albedo;
+    Vec3 radiance;
+    Reservoir<GI_Sample> res;
+};
+
+} // namespace
+
+float gi_jacobian(const GI_Sample& s, Vec3 x) {
+    Vec3 dq = s.xv - s.xs, dr = x - s.xs;
+    float lq = dq.norm_squared(), lr = dr.norm_squared();
+    if(lq == 0.0f || lr == 0.0f) return 0.0f;
+    float cq = std::abs(dot(s.ns, dq)) / std::sqrt(lq);
+    float cr = std::abs(dot(s.ns, dr)) / std::sqrt(lr);
+    if(cq == 0.0f) return 0.0f;
+    return (cr / cq) * (lq / lr);
+}
+
+GI_Scene GI_Scene::box() {
+    GI_Scene s;
+    Vec3 white{0.75f}, red{0.65f, 0.06f, 0.05f}, green{0.12f, 0.45f, 0.15f};
+    auto quad = [&](Vec3 c, Vec3 u, Vec3 v, Vec3 albedo, Vec3 emissive = Vec3{}) {
+        s.quads.push_back({c, u, v, albedo, emissive});
+    };
+    Vec3 X{1.0f, 0.0f, 0.0f}, Y{0.0f, 1.0f, 0.0f}, Z{0.0f, 0.0f, 1.0f};
+    quad(Vec3{}, X, Z, white);                         // floor
+    quad(Vec3{0.0f, 1.0f, 0.0f}, Z, X, white);         // ceiling
+    quad(Vec3{0.0f, 0.0f, 1.0f}, X, Y, white);         // back
+    quad(Vec3{}, Y, Z, red);                           // left
+    quad(Vec3{1.0f, 0.0f, 0.0f}, Z, Y, green);         // right
+    quad(Vec3{0.2f, 0.2f, 0.3f}, 0.3f * X, 0.3f * Y, white); // block facing the camera
+    quad(Vec3{0.4f, 0.999f, 0.4f}, 0.2f * X, 0.2f * Z, Vec3{}, Vec3{40.0f}); // light, facing down
+    return s;
+}
+
+void gi_render(const GI_Scene& scene, const GI_Params& params, std::vector<Vec3>& out) {
+
+    const unsigned int w = params.w, h = params.h;
+    const size_t n = (size_t)w * h;
+    out.assign(n, Vec3{});
+
+    std::vector<Pixel> cur(n), prev(n);
+
+    Vec3 fwd = (scene.look - scene.eye).unit();
+    Vec3 right = cross(fwd, Vec3{0.0f, 1.0f, 0.0f}).unit(), up = cross(right, fwd);
+    float th = std::tan(Radians(scene.fov) * 0.5f), tw = th * w / h;
+
+    for(int frame = 0; frame < params.frames; frame++) {
+
+        // Primary hits, direct light, and either the path traced bounce or a fresh GI sample
+        // resampled with last frame's reservoir (rt.rgen, gi_resample)
+        parallel_for(0, h, [&](size_t y) {
+            for(unsigned int x = 0; x < w; x++) {
+
+                size_t i = y * w + x;
+                RNG rng((uint32_t)i, (uint32_t)frame, 0u, 0u);
+                Pixel& p = cur[i];
+                p = Pixel{};
+
+                float u = ((x + rng.unit()) / w * 2.0f - 1.0f) * tw;
+                float v = (1.0f - (y + rng.unit()) / h * 2.0f) * th;
+                Vec3 d = (fwd + u * right + v * up).unit();
+
+                p.hit = intersect(scene, scene.eye, d);
+                if(p.hit.quad < 0) continue;
+
+                p.albedo = scene.quads[p.hit.quad].albedo;
+                if(params.direct) p.radiance = emitted(scene, p.hit, d) + direct(scene, p.hit, rng);
+
+                Vec3 wi = cosine_sample(p.hit.norm, rng);
+                float pdf = std::max(dot(p.hit.norm, wi), 0.0f) / PI_F;
+
+                GI_Sample s;
+                s.xv = p.hit.pos;
+                s.nv = p.hit.norm;
+                s.xs = p.hit.pos + GI_DISTANT * wi;
+                s.ns = -wi;
+                Hit bounce = intersect(scene, p.hit.pos, wi);
+                if(bounce.quad >= 0) {
+                    s.xs = bounce.pos;
+                    s.ns = bounce.norm;
+                    s.Lo = outgoing(scene, bounce, params.max_depth - 1, rng, params.cache);
+                }
+
+                if(!params.restir) {
+                    if(pdf > 0.0f) p.radiance += shade(s, 1.0f / pdf, s.xv, s.nv, p.albedo);
+                    continue;
+                }
+
+                Reservoir<GI_Sample>& r = p.res;
+                r.update(s, pdf > 0.0f ? target(s, s.xv, s.nv, p.albedo) / pdf : 0.0f, rng);
+
+                const Pixel& q = prev[i];
+                if(params.temporal && frame > 0 && q.hit.quad >= 0 &&
+                   (q.hit.pos - p.hit.pos).norm_squared() <= 0.01f &&
+                   dot(q.hit.norm, p.hit.norm) >= 0.5f && q.res.M > 0.0f) {
+                    Reservoir<GI_Sample> old = q.res;
+                    old.M = std::min(old.M, (float)params.temporal_cap);
+                    float J = reuse_jacobian(old.y, s.xv);
+                    r.merge(old, target(old.y, s.xv, s.nv, p.albedo) * old.W * old.M * J, rng);
+                }
+
+                r.finalize(target(r.y, s.xv, s.nv, p.albedo));
+                if(r.y.xs != s.xs && r.W > 0.0f && occluded(scene, s.xv, r.y.xs)) {
+                    r.W = 0.0f;
+                    r.w_sum = 0.0f;
+                }
+                r.y.xv = s.xv;
+                r.y.nv = s.nv;
+            }
+        });
+
+        // Spatial reuse and shading (restir_spatial.rgen, gi_spatial_reuse)
+        parallel_for(0, h, [&](size_t y) {
+            for(unsigned int x = 0; x < w; x++) {
+
+                size_t i = y * w + x;
+                Pixel& p = cur[i];
+                Vec3 L = p.radiance;
+
+                if(params.restir && p.hit.quad >= 0) {
+
+                    RNG rng((uint32_t)i, (uint32_t)frame, 0u, ~0u);
+                    Vec3 xv = p.hit.pos, nv = p.hit.norm;
+                    float depth = (xv - scene.eye).norm();
+
+                    Reservoir<GI_Sample> res;
+                    res.merge(p.res, target(p.res.y, xv, nv, p.albedo) * p.res.W * p.res.M, rng);
+
+                    size_t taps[MAX_SPATIAL];
+                    int n_taps = 0;
+                    int k = std::min(params.spatial_samples, MAX_SPATIAL);
+
+                    for(int j = 0; j < k; j++) {
+                        float r = params.spatial_radius * std::sqrt(rng.unit());
+                        float phi = 2.0f * PI_F * rng.unit();
+                        int qx = (int)x + (int)std::round(r * std::cos(phi));
+                        int qy = (int)y + (int)std::round(r * std::sin(phi));
+                        if((qx == (int)x && qy == (int)y) || qx < 0 || qy < 0 || qx >= (int)w ||
+                           qy >= (int)h)
+                            continue;
+
+                        size_t qi = (size_t)qy * w + qx;
+                        const Pixel& q = cur[qi];
+                        if(q.res.M == 0.0f) continue;
+                        float q_depth = (q.res.y.xv - scene.eye).norm();
+                        if(dot(nv, q.res.y.nv) <= 0.9f || std::abs(q_depth - depth) >= 0.1f * depth)
+                            continue;
+
+                        float J = reuse_jacobian(q.res.y, xv);
+                        res.merge(q.res, target(q.res.y, xv, nv, p.albedo) * q.res.W * q.res.M * J,
+                                  rng);
+                        taps[n_taps++] = qi;
+                    }
+
+                    float p_hat = target(res.y, xv, nv, p.albedo);
+                    float Z = res.M;
+                    if(params.bias != Reservoir_Bias::none) {
+                        Z = p.res.M;
+                        for(int j = 0; j < n_taps; j++) {
+                            const Reservoir<GI_Sample>& q = cur[taps[j]].res;
+                            GI_Sample from_q = res.y;
+                            from_q.xv = q.y.xv;
+                            if(dot(res.y.xs - q.y.xv, q.y.nv) > 0.0f && luma(res.y.Lo) > 0.0f &&
+                               reuse_jacobian(from_q, xv) > 0.0f)
+                                Z += q.M;
+                        }
+                    }
+
+                    if(p_hat > 0.0f && Z > 0.0f && !occluded(scene, xv, res.y.xs)) {
+                        L += shade(res.y, res.w_sum / (p_hat * Z), xv, nv, p.albedo);
+                    }
+                }
+
+                out[i] = params.accumulate ? out[i] + (L - out[i]) * (1.0f / (frame + 1)) : L;
+            }
+        });
+
+        std::swap(cur, prev);
+    }
+}
+
+} // namespace Util
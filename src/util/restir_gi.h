@@ -0,0 +1,70 @@
+
+#pragma once
+
+#include <lib/mathlib.h>
+#include <lib/reservoir.h>
+#include <util/radiance_cache.h>
+#include <vector>
+
+namespace Util {
+
+/// ReSTIR GI sample (Ouyang et al. 2021); mirrors GISample in src/shaders/rt/restir_gi.glsl.
+/// Lo is the radiance leaving xs toward the visible point xv the sample is measured at.
+struct GI_Sample {
+    Vec3 xv, nv;
+    Vec3 xs, ns;
+    Vec3 Lo;
+};
+
+/// Ratio of solid angle densities when s is reused at visible point x instead of s.xv (gi_jacobian)
+float gi_jacobian(const GI_Sample& s, Vec3 x);
+
+/// Closed set of diffuse quads lit by emissive ones: just enough scene for the reference
+/// integrator to trace without the GPU.
+struct GI_Scene {
+    struct Quad {
+        Vec3 corner, u, v;
+        Vec3 albedo;
+        /// Emitted from the side cross(u, v) points to
+        Vec3 emissive;
+    };
+    std::vector<Quad> quads;
+
+    Vec3 eye = Vec3{0.5f, 0.5f, -1.2f};
+    Vec3 look = Vec3{0.5f, 0.5f, 0.0f};
+    float fov = 45.0f;
+
+    /// Cornell-style unit box, open toward the camera, with a small ceiling light
+    static GI_Scene box();
+};
+
+struct GI_Params {
+    unsigned int w = 128, h = 128;
+    /// Frames rendered with the camera held still
+    int frames = 16;
+    /// Off: out holds only the last frame, as seen in real time
+    bool accumulate = true;
+    /// Bounces past the first when estimating a sample's radiance
+    int max_depth = 3;
+    /// Off: plain path tracing, with the same direct light and one bounce sample per pixel
+    bool restir = true;
+    /// Off: only the indirect light at the primary hit, to compare its estimators in isolation
+    bool direct = true;
+    bool temporal = true;
+    /// Cap on the sample count carried over from last frame
+    int temporal_cap = 16;
+    int spatial_samples = 5;
+    float spatial_radius = 8.0f;
+    /// Normalization of spatial reuse; mis is treated like z
+    Reservoir_Bias bias = Reservoir_Bias::z;
+    /// Optional: paths end in the cache past the first diffuse bounce, and fill it as they go
+    Radiance_Cache* cache = nullptr;
+};
+
+/// CPU reference for the ReSTIR GI integrator (integrator 5): direct light is sampled at every
+/// vertex, and the indirect light at the primary hit is either path traced or resampled with
+/// temporal and spatial reuse the way rt.rgen and restir_spatial.rgen do. Writes the mean of all
+/// frames (or the last one, see accumulate) as w*h RGB texels.
+void gi_render(const GI_Scene& scene, const GI_Params& params, std::vector<Vec3>& out);
+
+} // namespace Util
@@ -0,0 +1,61 @@
+
+#include "ring_allocator.h"
+
+#include <cassert>
+
+namespace Util {
+
+Ring_Allocator::Ring_Allocator(size_t capacity) : _capacity(capacity) {
+}
+
+std::optional<size_t> Ring_Allocator::alloc(size_t size, size_t align) {
+
+    assert(align && !(align & (align - 1)));
+    if(!size || size > _capacity) return std::nullopt;
+    if(!_used) head = tail = 0;
+
+    // Free space is [head, capacity) and [0, tail) when the live bytes do not wrap, or just
+    // [head, tail) when they do; head == tail with bytes in use means full.
+    size_t start = (head + align - 1) & ~(align - 1);
+    bool wrapped = head < tail || (head == tail && _used);
+    size_t end = wrapped ? tail : _capacity;
+
+    size_t taken;
+    if(start <= end && size <= end - start) {
+        taken = start + size - head;
+    } else if(!wrapped && size <= tail) {
+        // The tail end is too short; skip it and start over at zero
+        start = 0;
+        taken = _capacity - head + size;
+    } else {
+        return std::nullopt;
+    }
+
+    head = start + size;
+    if(head == _capacity) head = 0;
+    _used += taken;
+    open += taken;
+    return start;
+}
+
+void Ring_Allocator::submit(uint64_t id) {
+    if(!open) return;
+    assert(batches.empty() || batches.back().id < id);
+    batches.push_back({id, head, open});
+    open = 0;
+}
+
+void Ring_Allocator::retire(uint64_t id) {
+    while(!batches.empty() && batches.front().id <= id) {
+        tail = batches.front().end;
+        _used -= batches.front().bytes;
+        batches.pop_front();
+    }
+}
+
+std::optional<uint64_t> Ring_Allocator::oldest() const {
+    if(batches.empty()) return std::nullopt;
+    return batches.front().id;
+}
+
+} // namespace Util
@@ -0,0 +1,55 @@
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+
+namespace Util {
+
+/// Offsets into a circular buffer of fixed capacity, handed out in order. Allocations made
+/// between two submit() calls form a batch, tagged with an increasing id; retire(id) frees every
+/// batch up to it once the consumer is done with them, e.g. when a GPU fence signals. Only does
+/// the bookkeeping, so the memory can be anything.
+class Ring_Allocator {
+public:
+    explicit Ring_Allocator(size_t capacity = 0);
+
+    /// Offset of size bytes aligned to align, a power of two; none if the free space cannot hold
+    /// them in one piece. Space left at the end when an allocation wraps counts as used until
+    /// its batch retires.
+    std::optional<size_t> alloc(size_t size, size_t align = 1);
+    /// Closes the open batch under id; ids must increase. Does nothing if the batch is empty.
+    void submit(uint64_t id);
+    /// Frees every submitted batch with an id up to id
+    void retire(uint64_t id);
+
+    size_t capacity() const {
+        return _capacity;
+    }
+    /// Bytes held by live batches, padding included
+    size_t used() const {
+        return _used;
+    }
+    /// Bytes allocated since the last submit
+    size_t open_bytes() const {
+        return open;
+    }
+    /// Id of the oldest submitted batch still live
+    std::optional<uint64_t> oldest() const;
+
+private:
+    struct Batch {
+        uint64_t id = 0;
+        size_t end = 0, bytes = 0;
+    };
+
+    size_t _capacity = 0;
+    /// Next free byte, and first live byte
+    size_t head = 0, tail = 0;
+    size_t _used = 0, open = 0;
+    std::deque<Batch> batches;
+};
+
+} // namespace Util
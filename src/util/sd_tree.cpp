@@ -0,0 +1,268 @@
+
+#include "sd_tree.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace Util {
+
+static constexpr float INV_4PI = 1.0f / (4.0f * PI_F);
+
+// Quadrant of p in the unit square, and p rescaled to that quadrant
+static int quadrant(Vec2& p) {
+    int i = 0;
+    p *= 2.0f;
+    if(p.x >= 1.0f) {
+        i |= 1;
+        p.x -= 1.0f;
+    }
+    if(p.y >= 1.0f) {
+        i |= 2;
+        p.y -= 1.0f;
+    }
+    return i;
+}
+
+D_Tree::D_Tree() : nodes(1) {
+}
+
+Vec2 D_Tree::dir_to_square(Vec3 dir) {
+    float x = (std::clamp(dir.z, -1.0f, 1.0f) + 1.0f) * 0.5f;
+    float phi = std::atan2(dir.y, dir.x);
+    if(phi < 0.0f) phi += 2.0f * PI_F;
+    float y = phi / (2.0f * PI_F);
+    return Vec2{std::min(x, 0.99999994f), std::min(y, 0.99999994f)};
+}
+
+Vec3 D_Tree::square_to_dir(Vec2 p) {
+    float c = 2.0f * p.x - 1.0f;
+    float s = std::sqrt(std::max(1.0f - c * c, 0.0f));
+    float phi = 2.0f * PI_F * p.y;
+    return Vec3{s * std::cos(phi), s * std::sin(phi), c};
+}
+
+float D_Tree::total() const {
+    const Node& n = nodes[0];
+    return n.sum[0] + n.sum[1] + n.sum[2] + n.sum[3];
+}
+
+void D_Tree::record(Vec3 dir, float value) {
+
+    std::atomic_ref<uint64_t>(n_samples).fetch_add(1, std::memory_order_relaxed);
+    if(!(value > 0.0f) || !std::isfinite(value)) return;
+
+    Vec2 p = dir_to_square(dir);
+    uint32_t node = 0;
+    for(;;) {
+        int i = quadrant(p);
+        std::atomic_ref<float>(nodes[node].sum[i]).fetch_add(value, std::memory_order_relaxed);
+        if(!nodes[node].child[i]) break;
+        node = nodes[node].child[i];
+    }
+}
+
+Vec3 D_Tree::sample(Vec2 u, float& pdf) const {
+
+    if(!(total() > 0.0f)) {
+        pdf = INV_4PI;
+        return square_to_dir(u);
+    }
+
+    // Hierarchical warping: pick the column with u.x, then the row with u.y, at every level
+    Vec2 origin;
+    float size = 1.0f, density = 1.0f;
+    uint32_t node = 0;
+
+    for(;;) {
+        const float* s = nodes[node].sum;
+        float all = s[0] + s[1] + s[2] + s[3];
+
+        float left = (s[0] + s[2]) / all;
+        int x = 0;
+        if(u.x < left) {
+            u.x /= left;
+        } else {
+            u.x = (u.x - left) / (1.0f - left);
+            x = 1;
+        }
+
+        float bottom = s[x] / (s[x] + s[x + 2]);
+        int y = 0;
+        if(u.y < bottom) {
+            u.y /= bottom;
+        } else {
+            u.y = (u.y - bottom) / (1.0f - bottom);
+            y = 1;
+        }
+
+        int i = x | (y << 1);
+        density *= 4.0f * s[i] / all;
+        size *= 0.5f;
+        origin += Vec2{(float)x, (float)y} * size;
+
+        if(!nodes[node].child[i]) break;
+        node = nodes[node].child[i];
+    }
+
+    Vec2 p = origin + size * Vec2{std::min(u.x, 0.99999994f), std::min(u.y, 0.99999994f)};
+    pdf = density * INV_4PI;
+    return square_to_dir(p);
+}
+
+float D_Tree::pdf(Vec3 dir) const {
+
+    if(!(total() > 0.0f)) return INV_4PI;
+
+    Vec2 p = dir_to_square(dir);
+    float density = 1.0f;
+    uint32_t node = 0;
+
+    for(;;) {
+        const float* s = nodes[node].sum;
+        float all = s[0] + s[1] + s[2] + s[3];
+        if(!(all > 0.0f)) return 0.0f;
+
+        int i = quadrant(p);
+        density *= 4.0f * s[i] / all;
+        if(!nodes[node].child[i]) break;
+        node = nodes[node].child[i];
+    }
+    return density * INV_4PI;
+}
+
+void D_Tree::refine(float rho, int max_depth) {
+
+    float limit = rho * total();
+    std::vector<Node> out(1);
+
+    struct Item {
+        uint32_t dst;
+        // Matching node of this tree; quadrants split past its leaves share their parent's energy
+        uint32_t src;
+        bool has_src;
+        float sum[4];
+        int depth;
+    };
+    std::vector<Item> stack;
+
+    if(limit > 0.0f) {
+        const Node& root = nodes[0];
+        stack.push_back({0, 0, true, {root.sum[0], root.sum[1], root.sum[2], root.sum[3]}, 1});
+    }
+
+    while(!stack.empty()) {
+
+        Item it = stack.back();
+        stack.pop_back();
+        if(it.depth >= max_depth) continue;
+
+        for(int i = 0; i < 4; i++) {
+            if(it.sum[i] <= limit) continue;
+
+            uint32_t c = (uint32_t)out.size();
+            out.push_back({});
+            out[it.dst].child[i] = c;
+
+            Item next{c, 0, false, {}, it.depth + 1};
+            if(it.has_src && nodes[it.src].child[i]) {
+                next.src = nodes[it.src].child[i];
+                next.has_src = true;
+                std::copy(nodes[next.src].sum, nodes[next.src].sum + 4, next.sum);
+            } else {
+                std::fill(next.sum, next.sum + 4, it.sum[i] * 0.25f);
+            }
+            stack.push_back(next);
+        }
+    }
+
+    nodes = std::move(out);
+    n_samples = 0;
+}
+
+SD_Tree::SD_Tree(BBox b, const SD_Tree_Params& p) : bounds(b), params(p), nodes(1) {
+    // Cube around the scene, so halving along alternating axes keeps cells near cubical
+    Vec3 e = bounds.max - bounds.min;
+    float size = std::max(std::max(e.x, e.y), std::max(e.z, 1e-3f));
+    bounds.max = bounds.min + Vec3{size};
+}
+
+uint32_t SD_Tree::leaf(Vec3 pos) const {
+
+    Vec3 p = (pos - bounds.min) / (bounds.max - bounds.min);
+    p = clamp(p, Vec3{0.0f}, Vec3{0.99999994f});
+
+    uint32_t node = 0;
+    while(nodes[node].child) {
+        int a = nodes[node].axis;
+        p[a] *= 2.0f;
+        if(p[a] < 1.0f) {
+            node = nodes[node].child;
+        } else {
+            p[a] -= 1.0f;
+            node = nodes[node].child + 1;
+        }
+    }
+    return node;
+}
+
+void SD_Tree::record(Vec3 pos, Vec3 dir, float value) {
+    nodes[leaf(pos)].building.record(dir, value);
+}
+
+Vec3 SD_Tree::sample(Vec3 pos, Vec2 u, float& pdf) const {
+    return nodes[leaf(pos)].sampling.sample(u, pdf);
+}
+
+float SD_Tree::pdf(Vec3 pos, Vec3 dir) const {
+    return nodes[leaf(pos)].sampling.pdf(dir);
+}
+
+size_t SD_Tree::n_leaves() const {
+    return std::count_if(nodes.begin(), nodes.end(), [](const S_Node& n) { return !n.child; });
+}
+
+void SD_Tree::refine() {
+
+    float threshold = params.spatial_threshold * std::sqrt(std::ldexp(1.0f, iter));
+
+    // Split leaves until each holds no more than the threshold, assuming samples split evenly
+    std::vector<std::pair<uint32_t, int>> stack;
+    stack.push_back({0, 0});
+
+    while(!stack.empty()) {
+
+        auto [node, depth] = stack.back();
+        stack.pop_back();
+
+        if(nodes[node].child) {
+            stack.push_back({nodes[node].child, depth + 1});
+            stack.push_back({nodes[node].child + 1, depth + 1});
+            continue;
+        }
+        if(depth >= params.max_s_depth || (float)nodes[node].building.n_samples <= threshold) {
+            continue;
+        }
+
+        uint32_t c = (uint32_t)nodes.size();
+        nodes.push_back(nodes[node]);
+        nodes.push_back(nodes[node]);
+        nodes[node].child = c;
+        for(uint32_t i = c; i < c + 2; i++) {
+            nodes[i].axis = (nodes[node].axis + 1) % 3;
+            nodes[i].building.n_samples /= 2;
+            stack.push_back({i, depth + 1});
+        }
+        nodes[node].sampling = D_Tree{};
+        nodes[node].building = D_Tree{};
+    }
+
+    for(S_Node& n : nodes) {
+        if(n.child) continue;
+        n.sampling = n.building;
+        n.building.refine(params.rho, params.max_d_depth);
+    }
+    iter++;
+}
+
+} // namespace Util
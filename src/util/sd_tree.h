@@ -0,0 +1,95 @@
+
+#pragma once
+
+#include <lib/mathlib.h>
+#include <cstdint>
+#include <vector>
+
+namespace Util {
+
+/// Directional quadtree over the cylindrical (equal-area) map of the sphere: x = (cos theta + 1)
+/// / 2, y = phi / 2 pi, so densities on the square are 4 pi times those in solid angle. Every node
+/// holds the energy recorded in each of its four quadrants.
+struct D_Tree {
+
+    struct Node {
+        float sum[4] = {};
+        /// Node index of each quadrant, 0 for a leaf
+        uint32_t child[4] = {};
+    };
+
+    D_Tree();
+
+    /// Adds value to the leaf holding dir and every node above it; lock-free, so any number of
+    /// threads may record at once while nothing else touches the tree
+    void record(Vec3 dir, float value);
+
+    /// Direction drawn in proportion to the recorded energy, uniform when there is none
+    Vec3 sample(Vec2 u, float& pdf) const;
+    /// Solid angle density of sample()
+    float pdf(Vec3 dir) const;
+
+    /// Restructures for the next iteration from the energy recorded here: quadrants holding more
+    /// than rho of the total are split, those below it are collapsed. Clears the recorded values.
+    void refine(float rho, int max_depth);
+
+    float total() const;
+
+    static Vec2 dir_to_square(Vec3 dir);
+    static Vec3 square_to_dir(Vec2 p);
+
+    std::vector<Node> nodes;
+    uint64_t n_samples = 0;
+};
+
+struct SD_Tree_Params {
+    /// Spatial leaves split once they take more than this times sqrt(2^iteration) samples
+    float spatial_threshold = 12000.0f;
+    /// Energy fraction above which a directional quadrant is split
+    float rho = 0.01f;
+    int max_d_depth = 20;
+    int max_s_depth = 24;
+};
+
+/// Path guiding SD-tree (Mueller et al. 2017): a binary tree halving the scene bounds along
+/// alternating axes, with two D_Trees per leaf. One is sampled from, frozen since the last
+/// iteration; the other records the current iteration's radiance.
+class SD_Tree {
+public:
+    SD_Tree() = default;
+    SD_Tree(BBox bounds, const SD_Tree_Params& params = {});
+
+    /// Splats an estimate of the radiance arriving at pos from dir, already divided by the
+    /// density dir was sampled with. Lock-free, like D_Tree::record.
+    void record(Vec3 pos, Vec3 dir, float value);
+
+    Vec3 sample(Vec3 pos, Vec2 u, float& pdf) const;
+    float pdf(Vec3 pos, Vec3 dir) const;
+
+    /// Ends an iteration: splits busy spatial leaves, then makes every leaf's recorded tree its
+    /// sampling tree and starts a refined, empty one. Not thread safe.
+    void refine();
+
+    /// Iterations refined so far; sampling trees are only trained once this is non-zero
+    int iteration() const {
+        return iter;
+    }
+    size_t n_leaves() const;
+
+private:
+    struct S_Node {
+        /// Children are child and child + 1; 0 for a leaf
+        uint32_t child = 0;
+        int axis = 0;
+        D_Tree sampling, building;
+    };
+
+    uint32_t leaf(Vec3 pos) const;
+
+    BBox bounds;
+    SD_Tree_Params params;
+    std::vector<S_Node> nodes;
+    int iter = 0;
+};
+
+} // namespace Util
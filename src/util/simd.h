@@ -0,0 +1,102 @@
+
+#pragma once
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define UTIL_SSE 1
+#include <emmintrin.h>
+#else
+#define UTIL_SSE 0
+#endif
+
+#if UTIL_SSE
+
+// SSE2 transcendentals (Cephes polynomials); relative error is around 2 ulp over the float range.
+
+namespace Util {
+
+inline __m128 exp_ps(__m128 x) {
+
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    x = _mm_min_ps(x, _mm_set1_ps(88.3762626647949f));
+    x = _mm_max_ps(x, _mm_set1_ps(-87.3365447504f));
+
+    // x = n ln2 + r, |r| <= ln2 / 2
+    __m128 fx = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)), _mm_set1_ps(0.5f));
+    __m128i n = _mm_cvttps_epi32(fx);
+    __m128 tmp = _mm_cvtepi32_ps(n);
+    // Truncation rounds towards zero, so fix up negative values to floor
+    __m128 mask = _mm_and_ps(_mm_cmpgt_ps(tmp, fx), one);
+    fx = _mm_sub_ps(tmp, mask);
+    n = _mm_cvttps_epi32(fx);
+
+    x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(0.693359375f)));
+    x = _mm_add_ps(x, _mm_mul_ps(fx, _mm_set1_ps(2.12194440e-4f)));
+
+    __m128 z = _mm_mul_ps(x, x);
+    __m128 y = _mm_set1_ps(1.9875691500e-4f);
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.3981999507e-3f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(8.3334519073e-3f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(4.1665795894e-2f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.6666665459e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(5.0000001201e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, z), _mm_add_ps(x, one));
+
+    // Scale by 2^n
+    __m128i e = _mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23);
+    return _mm_mul_ps(y, _mm_castsi128_ps(e));
+}
+
+/// Natural log for x > 0; returns a large negative value for x == 0
+inline __m128 log_ps(__m128 x) {
+
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    x = _mm_max_ps(x, _mm_castsi128_ps(_mm_set1_epi32(0x00800000))); // smallest normal
+
+    __m128i bits = _mm_castps_si128(x);
+    __m128i exp_i = _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127));
+    __m128 e = _mm_add_ps(_mm_cvtepi32_ps(exp_i), one);
+
+    // Mantissa in [0.5, 1)
+    bits = _mm_and_si128(bits, _mm_set1_epi32(~0x7f800000));
+    bits = _mm_or_si128(bits, _mm_castps_si128(_mm_set1_ps(0.5f)));
+    x = _mm_castsi128_ps(bits);
+
+    // Fold into [sqrt(1/2), sqrt(2)) - 1
+    __m128 mask = _mm_cmplt_ps(x, _mm_set1_ps(0.707106781186547524f));
+    __m128 tmp = _mm_and_ps(x, mask);
+    x = _mm_sub_ps(x, one);
+    e = _mm_sub_ps(e, _mm_and_ps(one, mask));
+    x = _mm_add_ps(x, tmp);
+
+    __m128 z = _mm_mul_ps(x, x);
+    __m128 y = _mm_set1_ps(7.0376836292e-2f);
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.1514610310e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.1676998740e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.2420140846e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.4249322787e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.6668057665e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(2.0000714765e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-2.4999993993e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(3.3333331174e-1f));
+    y = _mm_mul_ps(_mm_mul_ps(y, x), z);
+
+    y = _mm_add_ps(y, _mm_mul_ps(e, _mm_set1_ps(-2.12194440e-4f)));
+    y = _mm_sub_ps(y, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+    x = _mm_add_ps(x, y);
+    return _mm_add_ps(x, _mm_mul_ps(e, _mm_set1_ps(0.693359375f)));
+}
+
+inline __m128 abs_ps(__m128 x) {
+    return _mm_and_ps(x, _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)));
+}
+
+/// Lanes of 'a' where mask is set, otherwise lanes of 'b'
+inline __m128 select_ps(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+} // namespace Util
+
+#endif
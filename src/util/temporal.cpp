@@ -0,0 +1,121 @@
+
+#include "temporal.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <lib/pack.h>
+
+namespace Util {
+
+// Keep in sync with raygen.glsl
+static constexpr float REPROJECT_NORMAL = 0.9f;
+static constexpr float REPROJECT_PLANE = 0.01f;
+
+static Vec3 load3(const float* img, unsigned int w, int x, int y) {
+    const float* t = img + 4 * ((size_t)y * w + x);
+    return Vec3{t[0], t[1], t[2]};
+}
+
+static Vec3 load_pos(const Temporal_Frame& f, int x, int y) {
+    return Pack::unpack_position(f.depth[(size_t)y * f.w + x], x, y, f.w, f.h, f.iV, f.iP);
+}
+
+static Vec3 load_norm(const Temporal_Frame& f, int x, int y) {
+    return Pack::unpack_normal(f.norm[(size_t)y * f.w + x]);
+}
+
+static bool same_surface(Vec3 pos, Vec3 norm, float dist, Vec3 old_pos, Vec3 old_norm) {
+    return dot(norm, old_norm) > REPROJECT_NORMAL &&
+           std::abs(dot(norm, old_pos - pos)) < REPROJECT_PLANE * dist;
+}
+
+Reprojected reproject(const Temporal_Frame& prev, const Mat4& prev_PV, Vec3 pos, Vec3 norm,
+                      float dist, Vec2 jitter) {
+
+    Reprojected ret;
+
+    Vec4 p = prev_PV * Vec4(pos, 1.0f);
+    Vec2 coord{(p.x / p.w * 0.5f + 0.5f) * prev.w - jitter.x,
+               (p.y / p.w * 0.5f + 0.5f) * prev.h - jitter.y};
+
+    float bx = std::floor(coord.x), by = std::floor(coord.y);
+    float fx = coord.x - bx, fy = coord.y - by;
+
+    float w_sum = 0.0f;
+    for(int i = 0; i < 4; i++) {
+        int qx = (int)bx + (i & 1), qy = (int)by + (i >> 1);
+        if(qx < 0 || qy < 0 || qx >= (int)prev.w || qy >= (int)prev.h) continue;
+
+        Vec3 old_pos = load_pos(prev, qx, qy);
+        Vec3 old_norm = load_norm(prev, qx, qy);
+        if(!same_surface(pos, norm, dist, old_pos, old_norm)) continue;
+
+        float w = ((i & 1) ? fx : 1.0f - fx) * ((i >> 1) ? fy : 1.0f - fy);
+        Vec3 m = load3(prev.moments, prev.w, qx, qy);
+        ret.color += w * load3(prev.accum, prev.w, qx, qy);
+        ret.moments += w * Vec2{m.x, m.y};
+        ret.history += w * m.z;
+        w_sum += w;
+    }
+
+    if(w_sum < 1e-3f) return Reprojected{};
+
+    ret.color /= w_sum;
+    ret.moments /= w_sum;
+    ret.history /= w_sum;
+    return ret;
+}
+
+void temporal_accumulate(const Temporal_Frame& prev, const Temporal_Frame& cur,
+                         const Temporal_Params& params, std::vector<float>& accum,
+                         std::vector<float>& moments) {
+
+    accum.resize((size_t)cur.w * cur.h * 4);
+    moments.resize((size_t)cur.w * cur.h * 4);
+
+    float cap = (float)(params.reproject ? params.max_history : params.max_frames);
+    Vec3 camera = cur.iV[3].xyz();
+
+    parallel_for(0, cur.h, [&](size_t y) {
+        for(unsigned int x = 0; x < cur.w; x++) {
+
+            size_t idx = 4 * (y * cur.w + x);
+            Vec3 pos = load_pos(cur, x, (int)y);
+            Vec3 norm = load_norm(cur, x, (int)y);
+
+            Reprojected old;
+            if(prev.accum) {
+                if(!params.reproject) {
+                    old.color = load3(prev.accum, prev.w, x, (int)y);
+                    Vec3 m = load3(prev.moments, prev.w, x, (int)y);
+                    old.moments = Vec2{m.x, m.y};
+                    old.history = m.z;
+                } else if(dot(norm, norm) > 0.5f) {
+                    Vec2 jitter;
+                    Pack::unpack_depth(cur.depth[y * cur.w + x], jitter);
+                    old = reproject(prev, params.prev_PV, pos, norm, (pos - camera).norm(), jitter);
+                }
+            }
+
+            float n = std::min(old.history + 1.0f, cap);
+            float a = 1.0f / n;
+
+            Vec3 color = load3(cur.accum, cur.w, x, (int)y);
+            const float* m = cur.moments + idx;
+            color = old.color + (color - old.color) * a;
+            Vec2 mom = old.moments + (Vec2{m[0], m[1]} - old.moments) * a;
+
+            accum[idx + 0] = color.x;
+            accum[idx + 1] = color.y;
+            accum[idx + 2] = color.z;
+            accum[idx + 3] = 1.0f;
+            moments[idx + 0] = mom.x;
+            moments[idx + 1] = mom.y;
+            moments[idx + 2] = n;
+            moments[idx + 3] = 1.0f;
+        }
+    });
+}
+
+} // namespace Util
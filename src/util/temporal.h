@@ -0,0 +1,50 @@
+
+#pragma once
+
+#include <cstdint>
+#include <lib/mathlib.h>
+#include <vector>
+
+namespace Util {
+
+/// One frame of temporal state, laid out like the RT outputs over w*h texels: the packed
+/// G-buffer (lib/pack.h) as R32_UINT depth and octahedral normal, and RGBA32F accum and moments.
+/// accum is the accumulated radiance, moments is (mean luma, mean luma^2, history length).
+/// Positions are rebuilt along the camera rays of iV and iP, like gbuf_position in raygen.glsl.
+struct Temporal_Frame {
+    unsigned int w = 0, h = 0;
+    const uint32_t* depth = nullptr;
+    const uint32_t* norm = nullptr;
+    const float* accum = nullptr;
+    const float* moments = nullptr;
+    Mat4 iV, iP;
+};
+
+struct Temporal_Params {
+    /// Camera moved since last frame: reproject through prev_PV and clamp the history
+    bool reproject = true;
+    int max_history = 32;
+    int max_frames = 256;
+    Mat4 prev_PV;
+};
+
+struct Reprojected {
+    Vec3 color;
+    Vec2 moments;
+    /// Zero when the point was not visible last frame
+    float history = 0.0f;
+};
+
+/// Mirror of reproject() in raygen.glsl: bilinear lookup of last frame's accumulation where pos
+/// landed, skipping taps on a different surface. jitter is this pixel's sub-pixel sample offset.
+Reprojected reproject(const Temporal_Frame& prev, const Mat4& prev_PV, Vec3 pos, Vec3 norm,
+                      float dist, Vec2 jitter);
+
+/// Mirror of resolve() in raygen.glsl for a whole frame. cur holds this frame's G-buffer, whose
+/// depth also carries each pixel's jitter, its radiance estimate in accum and its (luma, luma^2)
+/// in moments. Writes w*h RGBA texels to accum and moments.
+void temporal_accumulate(const Temporal_Frame& prev, const Temporal_Frame& cur,
+                         const Temporal_Params& params, std::vector<float>& accum,
+                         std::vector<float>& moments);
+
+} // namespace Util
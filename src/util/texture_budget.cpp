@@ -0,0 +1,72 @@
+
+#include "texture_budget.h"
+
+#include <cmath>
+#include <numeric>
+#include <queue>
+#include <unordered_map>
+
+namespace Util {
+
+std::vector<unsigned int> find_duplicates(const std::vector<Image_Const_View>& images) {
+
+    std::vector<unsigned int> first(images.size());
+    std::unordered_map<uint64_t, std::vector<unsigned int>> buckets;
+
+    for(unsigned int i = 0; i < images.size(); i++) {
+        const Image_Const_View& img = images[i];
+        uint32_t key[3] = {img.w, img.h, (uint32_t)img.format};
+        std::vector<unsigned int>& bucket = buckets[hash_texels(img, hash_bytes(key, sizeof(key)))];
+
+        first[i] = i;
+        for(unsigned int j : bucket) {
+            if(same_texels(images[j], img)) {
+                first[i] = j;
+                break;
+            }
+        }
+        if(first[i] == i) bucket.push_back(i);
+    }
+    return first;
+}
+
+Budget_Fit fit_budget(const std::vector<Budget_Item>& items, size_t budget) {
+
+    Budget_Fit fit;
+    fit.first_level.resize(items.size(), 0);
+    for(const Budget_Item& item : items) {
+        const std::vector<size_t>& levels = item.level_bytes;
+        fit.full_bytes += std::accumulate(levels.begin(), levels.end(), size_t(0));
+    }
+    fit.bytes = fit.full_bytes;
+    if(!budget || fit.bytes <= budget) return fit;
+
+    // Bytes per unit of weight of the current top level of each item
+    struct Entry {
+        float cost;
+        size_t item;
+        bool operator<(const Entry& o) const {
+            return cost < o.cost;
+        }
+    };
+    auto cost = [&](size_t i) {
+        const Budget_Item& item = items[i];
+        float bytes = (float)item.level_bytes[fit.first_level[i]];
+        return item.weight > 0.0f ? bytes / item.weight : INFINITY;
+    };
+
+    std::priority_queue<Entry> heap;
+    for(size_t i = 0; i < items.size(); i++) {
+        if(items[i].level_bytes.size() > 1) heap.push({cost(i), i});
+    }
+
+    while(fit.bytes > budget && !heap.empty()) {
+        size_t i = heap.top().item;
+        heap.pop();
+        fit.bytes -= items[i].level_bytes[fit.first_level[i]++];
+        if(fit.first_level[i] + 1 < items[i].level_bytes.size()) heap.push({cost(i), i});
+    }
+    return fit;
+}
+
+} // namespace Util
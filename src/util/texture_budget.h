@@ -0,0 +1,35 @@
+
+#pragma once
+
+#include <util/image.h>
+#include <vector>
+
+namespace Util {
+
+/// For each image, the index of the first one with the same size, format and texels (its own
+/// index if there is none before it). Images are bucketed by hash, then compared in full.
+std::vector<unsigned int> find_duplicates(const std::vector<Image_Const_View>& images);
+
+/// One texture competing for the budget
+struct Budget_Item {
+    /// Size of each mip level, base first
+    std::vector<size_t> level_bytes;
+    /// How much the texture is seen, e.g. the surface area it covers. Zero keeps only the
+    /// smallest level.
+    float weight = 1.0f;
+};
+
+struct Budget_Fit {
+    /// First resident level of each item
+    std::vector<unsigned int> first_level;
+    /// Every level of every item, and the resident levels
+    size_t full_bytes = 0, bytes = 0;
+};
+
+/// Drops top levels until the rest fit in budget bytes; a budget of zero keeps everything. Each
+/// step drops the level with the most bytes per unit of weight, so the resident size of a texture
+/// ends up roughly proportional to its weight. Items always keep their smallest level, so a tiny
+/// budget can be exceeded.
+Budget_Fit fit_budget(const std::vector<Budget_Item>& items, size_t budget);
+
+} // namespace Util
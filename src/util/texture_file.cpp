@@ -0,0 +1,221 @@
+
+#include "texture_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <lib/log.h>
+
+namespace Util {
+
+namespace {
+
+constexpr unsigned char KTX2_ID[12] = {0xab, 'K', 'T', 'X', ' ', '2', '0',
+                                       0xbb, '\r', '\n', 0x1a, '\n'};
+
+uint32_t u32(const unsigned char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+uint64_t u64(const unsigned char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+uint32_t fourcc(const char* s) {
+    return u32(reinterpret_cast<const unsigned char*>(s));
+}
+
+/// Container format codes this loader accepts: DXGI_FORMAT values for DDS, VkFormat for KTX2
+struct Format_Code {
+    uint32_t code;
+    BC_Format format;
+    bool srgb;
+};
+constexpr Format_Code DXGI_FORMATS[] = {
+    {71, BC_Format::bc1, false}, {72, BC_Format::bc1, true},  {80, BC_Format::bc4, false},
+    {83, BC_Format::bc5, false}, {98, BC_Format::bc7, false}, {99, BC_Format::bc7, true},
+};
+constexpr Format_Code VK_FORMATS[] = {
+    {131, BC_Format::bc1, false}, {132, BC_Format::bc1, true},  {133, BC_Format::bc1, false},
+    {134, BC_Format::bc1, true},  {139, BC_Format::bc4, false}, {141, BC_Format::bc5, false},
+    {145, BC_Format::bc7, false}, {146, BC_Format::bc7, true},
+};
+
+template<size_t N>
+bool find_format(const Format_Code (&codes)[N], uint32_t code, BC_File& out) {
+    for(const Format_Code& c : codes) {
+        if(c.code == code) {
+            out.format = c.format;
+            out.srgb = c.srgb;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Levels in a full chain down to 1x1; headers asking for more are clamped to this
+unsigned int max_levels(unsigned int w, unsigned int h) {
+    unsigned int levels = 1;
+    while(levels < 32 && (w | h) >> levels) levels++;
+    return levels;
+}
+
+/// Levels laid out back to back from offset, as DDS stores them
+bool packed_levels(const unsigned char* data, size_t size, size_t offset, unsigned int w,
+                   unsigned int h, unsigned int levels, BC_File& out) {
+    for(unsigned int l = 0; l < levels; l++) {
+        unsigned int lw = std::max(w >> l, 1u), lh = std::max(h >> l, 1u);
+        size_t bytes = level_bytes(lw, lh, out.format);
+        if(offset + bytes > size) return false;
+        out.levels.push_back({lw, lh, data + offset, bytes});
+        offset += bytes;
+    }
+    return true;
+}
+
+bool parse_dds(const unsigned char* data, size_t size, const std::string& name, BC_File& out) {
+
+    if(size < 128 || u32(data + 4) != 124) {
+        warn("Truncated DDS file %s", name.c_str());
+        return false;
+    }
+
+    unsigned int h = u32(data + 12), w = u32(data + 16);
+    unsigned int levels = std::clamp(u32(data + 28), 1u, max_levels(w, h));
+    uint32_t caps2 = u32(data + 112);
+    uint32_t pf_flags = u32(data + 80), code = u32(data + 84);
+    size_t offset = 128;
+
+    // Cube map or volume
+    if(caps2 & 0x200 || caps2 & 0x200000) {
+        warn("DDS file %s is not a 2D texture", name.c_str());
+        return false;
+    }
+    if(!(pf_flags & 0x4)) {
+        warn("DDS file %s is not block-compressed", name.c_str());
+        return false;
+    }
+
+    bool known = true;
+    if(code == fourcc("DX10")) {
+        if(size < 148) {
+            warn("Truncated DDS file %s", name.c_str());
+            return false;
+        }
+        uint32_t dxgi = u32(data + 128), dimension = u32(data + 132);
+        uint32_t misc = u32(data + 136), array = u32(data + 140);
+        offset = 148;
+        if(dimension != 3 || misc & 0x4 || array > 1) {
+            warn("DDS file %s is not a 2D texture", name.c_str());
+            return false;
+        }
+        known = find_format(DXGI_FORMATS, dxgi, out);
+    } else if(code == fourcc("DXT1")) {
+        out.format = BC_Format::bc1;
+    } else if(code == fourcc("ATI1") || code == fourcc("BC4U")) {
+        out.format = BC_Format::bc4;
+    } else if(code == fourcc("ATI2") || code == fourcc("BC5U")) {
+        out.format = BC_Format::bc5;
+    } else {
+        known = false;
+    }
+    if(!known) {
+        warn("DDS file %s is not BC1, BC4, BC5 or BC7", name.c_str());
+        return false;
+    }
+
+    if(!w || !h || !packed_levels(data, size, offset, w, h, levels, out)) {
+        warn("Truncated DDS file %s", name.c_str());
+        out.levels.clear();
+        return false;
+    }
+    return true;
+}
+
+bool parse_ktx2(const unsigned char* data, size_t size, const std::string& name, BC_File& out) {
+
+    if(size < 80) {
+        warn("Truncated KTX2 file %s", name.c_str());
+        return false;
+    }
+
+    uint32_t format = u32(data + 12);
+    unsigned int w = u32(data + 20), h = u32(data + 24);
+    uint32_t depth = u32(data + 28), layers = u32(data + 32), faces = u32(data + 36);
+    unsigned int levels = std::clamp(u32(data + 40), 1u, max_levels(w, h));
+    uint32_t scheme = u32(data + 44);
+
+    // Basis Universal payloads come as VK_FORMAT_UNDEFINED; they and zstd/zlib levels would need
+    // a transcoder or decompressor first
+    if(format == 0 || scheme != 0) {
+        warn("KTX2 file %s is supercompressed or Basis Universal, which is not supported",
+             name.c_str());
+        return false;
+    }
+    if(depth > 1 || layers > 1 || faces != 1) {
+        warn("KTX2 file %s is not a 2D texture", name.c_str());
+        return false;
+    }
+    if(!find_format(VK_FORMATS, format, out)) {
+        warn("KTX2 file %s is not BC1, BC4, BC5 or BC7", name.c_str());
+        return false;
+    }
+    if(!w || !h || 80 + (size_t)levels * 24 > size) {
+        warn("Truncated KTX2 file %s", name.c_str());
+        return false;
+    }
+
+    for(unsigned int l = 0; l < levels; l++) {
+        const unsigned char* entry = data + 80 + (size_t)l * 24;
+        uint64_t offset = u64(entry), length = u64(entry + 8);
+        unsigned int lw = std::max(w >> l, 1u), lh = std::max(h >> l, 1u);
+        size_t bytes = level_bytes(lw, lh, out.format);
+        if(length < bytes || offset > size || bytes > size - offset) {
+            warn("Truncated KTX2 file %s", name.c_str());
+            out.levels.clear();
+            return false;
+        }
+        out.levels.push_back({lw, lh, data + offset, bytes});
+    }
+    return true;
+}
+
+bool parse(const unsigned char* data, size_t size, const std::string& name, BC_File& out) {
+    out.levels.clear();
+    if(size >= 4 && std::memcmp(data, "DDS ", 4) == 0) return parse_dds(data, size, name, out);
+    if(size >= 12 && std::memcmp(data, KTX2_ID, 12) == 0)
+        return parse_ktx2(data, size, name, out);
+    warn("%s is neither a DDS nor a KTX2 file", name.c_str());
+    return false;
+}
+
+} // namespace
+
+size_t BC_File::bytes() const {
+    size_t total = 0;
+    for(const BC_Level_View& level : levels) total += level.size;
+    return total;
+}
+
+bool is_bc_container(const unsigned char* data, size_t size) {
+    return (size >= 4 && std::memcmp(data, "DDS ", 4) == 0) ||
+           (size >= 12 && std::memcmp(data, KTX2_ID, 12) == 0);
+}
+
+bool load_bc_file(const std::string& path, BC_File& out) {
+    out.owned.clear();
+    if(!out.mapping.open(path)) {
+        warn("Failed to open texture %s", path.c_str());
+        return false;
+    }
+    return parse(out.mapping.data(), out.mapping.size(), path, out);
+}
+
+bool load_bc_file(std::vector<unsigned char>&& bytes, const std::string& name, BC_File& out) {
+    out.mapping.close();
+    out.owned = std::move(bytes);
+    return parse(out.owned.data(), out.owned.size(), name, out);
+}
+
+} // namespace Util
@@ -0,0 +1,42 @@
+
+#pragma once
+
+#include <string>
+#include <util/bc.h>
+#include <util/files.h>
+#include <vector>
+
+namespace Util {
+
+/// A block-compressed mip chain from a DDS or KTX2 container, base first. Levels point into the
+/// file's mapping, or into the bytes handed over for images embedded in a glTF binary, so no
+/// texel is decoded or copied before the upload.
+struct BC_File {
+    BC_Format format = BC_Format::bc7;
+    /// As the container declares it; legacy DDS files cannot say and read as linear
+    bool srgb = false;
+    std::vector<BC_Level_View> levels;
+
+    unsigned int w() const {
+        return levels.empty() ? 0 : levels[0].w;
+    }
+    unsigned int h() const {
+        return levels.empty() ? 0 : levels[0].h;
+    }
+    size_t bytes() const;
+
+    File::Mapping mapping;
+    std::vector<unsigned char> owned;
+};
+
+/// Whether data starts like a DDS or KTX2 file
+bool is_bc_container(const unsigned char* data, size_t size);
+
+/// Maps and parses a DDS or KTX2 file holding one 2D BC1, BC4, BC5 or BC7 image. Anything else
+/// (other formats, arrays, cube maps, Basis Universal or zstd supercompression) is refused with
+/// a warning naming the file.
+bool load_bc_file(const std::string& path, BC_File& out);
+/// Same, for file bytes already in memory
+bool load_bc_file(std::vector<unsigned char>&& bytes, const std::string& name, BC_File& out);
+
+} // namespace Util
@@ -0,0 +1,79 @@
+
+#include "texture_sampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Util {
+
+Cone_Triangle cone_triangle(const Vec3 pos[3], const Vec3 norm[3], const Vec2 uv[3]) {
+
+    Cone_Triangle tri;
+
+    float world_area = cross(pos[1] - pos[0], pos[2] - pos[0]).norm();
+    Vec2 e1 = uv[1] - uv[0], e2 = uv[2] - uv[0];
+    float uv_area = std::abs(e1.x * e2.y - e2.x * e1.y);
+    tri.lod_bias = 0.5f * std::log2(std::max(uv_area, 1e-20f) / std::max(world_area, 1e-20f));
+
+    for(int i = 0; i < 3; i++) {
+        int j = (i + 1) % 3;
+        float len = std::max((pos[j] - pos[i]).norm(), EPS_F);
+        tri.curvature = std::max(tri.curvature, (norm[j] - norm[i]).norm() / len);
+    }
+    return tri;
+}
+
+Ray_Cone Ray_Cone::camera(float fov_y, unsigned int height) {
+    Ray_Cone cone;
+    cone.spread = std::atan(2.0f * std::tan(Radians(fov_y) * 0.5f) / height);
+    return cone;
+}
+
+float Ray_Cone::hit(float t, float cos_theta, const Cone_Triangle& tri) {
+    width += spread * t;
+    float lod = tri.lod_bias +
+                std::log2(std::max(std::abs(width), 1e-20f) / std::max(std::abs(cos_theta), 1e-4f));
+    spread += 2.0f * tri.curvature * std::abs(width);
+    return lod;
+}
+
+Texture_Sampler::Texture_Sampler(std::vector<Image_Const_View> levels)
+    : _levels(std::move(levels)) {
+}
+
+float Texture_Sampler::lod(float cone_lod) const {
+    if(_levels.empty()) return 0.0f;
+    return cone_lod + 0.5f * std::log2((float)_levels[0].w * _levels[0].h);
+}
+
+Vec4 Texture_Sampler::texel(unsigned int level, int x, int y) const {
+    const Image_Const_View& v = _levels[level];
+    unsigned int tx = (unsigned int)(((x % (int)v.w) + (int)v.w) % (int)v.w);
+    unsigned int ty = (unsigned int)(((y % (int)v.h) + (int)v.h) % (int)v.h);
+    Vec4 ret;
+    decode(v.texel(tx, ty), v.format, ret.data, 1);
+    return ret;
+}
+
+Vec4 Texture_Sampler::bilinear(Vec2 uv, unsigned int level) const {
+    const Image_Const_View& v = _levels[level];
+    float x = uv.x * v.w - 0.5f, y = uv.y * v.h - 0.5f;
+    float fx = std::floor(x), fy = std::floor(y);
+    int x0 = (int)fx, y0 = (int)fy;
+    float ax = x - fx, ay = y - fy;
+    Vec4 top = lerp(texel(level, x0, y0), texel(level, x0 + 1, y0), ax);
+    Vec4 bottom = lerp(texel(level, x0, y0 + 1), texel(level, x0 + 1, y0 + 1), ax);
+    return lerp(top, bottom, ay);
+}
+
+Vec4 Texture_Sampler::sample(Vec2 uv, float lod) const {
+    if(_levels.empty()) return Vec4{};
+    float l = std::clamp(lod, 0.0f, (float)(_levels.size() - 1));
+    unsigned int l0 = (unsigned int)l;
+    unsigned int l1 = std::min(l0 + 1, (unsigned int)_levels.size() - 1);
+    float a = l - l0;
+    Vec4 c0 = bilinear(uv, l0);
+    return a > 0.0f ? lerp(c0, bilinear(uv, l1), a) : c0;
+}
+
+} // namespace Util
@@ -0,0 +1,61 @@
+
+#pragma once
+
+#include <lib/mathlib.h>
+#include <util/image.h>
+#include <vector>
+
+namespace Util {
+
+/// Per-triangle terms of the ray cone LOD, like hit_info in raygen.glsl
+struct Cone_Triangle {
+    /// Half the log2 of the triangle's UV area over its world-space area
+    float lod_bias = 0.0f;
+    /// Largest change of the vertex normals per unit length along an edge
+    float curvature = 0.0f;
+};
+
+/// World-space positions and normals and the texture coordinates of a triangle's vertices
+Cone_Triangle cone_triangle(const Vec3 pos[3], const Vec3 norm[3], const Vec2 uv[3]);
+
+/// Footprint of a pixel along a path (Akenine-Moller et al., "Texture Level of Detail Strategies
+/// for Real-Time Ray Tracing", Ray Tracing Gems ch. 20). Matches camera_cone and cone_hit in
+/// raygen.glsl.
+struct Ray_Cone {
+    float width = 0.0f, spread = 0.0f;
+
+    /// Zero width at the camera, spreading by the angle one pixel subtends; fov_y in degrees
+    static Ray_Cone camera(float fov_y, unsigned int height);
+
+    /// Grows the cone over distance t to a hit seen at cos_theta to the normal and returns the
+    /// hit's LOD, before Texture_Sampler::lod adds the texture size. The spread then widens by
+    /// the curvature for the bounce leaving the hit.
+    float hit(float t, float cos_theta, const Cone_Triangle& tri);
+};
+
+/// Trilinear lookups into a mip chain, like the texture sampler of the RT pipe: linear filtering
+/// within and between levels and REPEAT addressing. Returns linear RGBA; sRGB texels are decoded
+/// before filtering, as the GPU does.
+class Texture_Sampler {
+public:
+    Texture_Sampler() = default;
+    /// Levels base first, each half the size of the one before; the views must outlive this
+    explicit Texture_Sampler(std::vector<Image_Const_View> levels);
+
+    /// Level to sample for a Ray_Cone::hit LOD, unclamped
+    float lod(float cone_lod) const;
+
+    Vec4 sample(Vec2 uv, float lod) const;
+    Vec4 bilinear(Vec2 uv, unsigned int level) const;
+
+    unsigned int levels() const {
+        return (unsigned int)_levels.size();
+    }
+
+private:
+    Vec4 texel(unsigned int level, int x, int y) const;
+
+    std::vector<Image_Const_View> _levels;
+};
+
+} // namespace Util
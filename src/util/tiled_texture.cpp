@@ -0,0 +1,245 @@
+
+#include "tiled_texture.h"
+#include "simd.h"
+#include "tonemap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace Util {
+
+namespace {
+
+/// Offset of texel (x, y) in its tile, interleaving the bits of x and y
+struct Morton_Table {
+    unsigned char idx[64] = {};
+    constexpr Morton_Table() {
+        for(unsigned int y = 0; y < 8; y++) {
+            for(unsigned int x = 0; x < 8; x++) {
+                unsigned int m = 0;
+                for(unsigned int b = 0; b < 3; b++)
+                    m |= ((x >> b) & 1) << (2 * b) | ((y >> b) & 1) << (2 * b + 1);
+                idx[y * 8 + x] = (unsigned char)m;
+            }
+        }
+    }
+};
+constexpr Morton_Table MORTON;
+
+const float* srgb_table() {
+    static const std::vector<float> table = []() {
+        std::vector<float> t(256);
+        unsigned char bytes[256];
+        for(int i = 0; i < 256; i++) bytes[i] = (unsigned char)i;
+        srgb8_to_linear(bytes, t.data(), 256);
+        return t;
+    }();
+    return table.data();
+}
+
+#if UTIL_SSE
+__m128 floor_ps(__m128 x) {
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+}
+#endif
+
+} // namespace
+
+Tiled_Texture::Tiled_Texture(const std::vector<Image_Const_View>& levels, Texel_Layout layout)
+    : _layout(layout) {
+
+    if(levels.empty()) return;
+    _srgb = levels[0].format == Image_Format::rgba8_srgb;
+    Image_Format format = _srgb ? Image_Format::rgba8_srgb : Image_Format::rgba8;
+
+    size_t total = 0;
+    for(const Image_Const_View& view : levels) {
+        Level level;
+        level.w = view.w;
+        level.h = view.h;
+        level.tiles_x = (view.w + TILE - 1) / TILE;
+        level.offset = total;
+        if(layout == Texel_Layout::tiled) {
+            total += (size_t)level.tiles_x * ((view.h + TILE - 1) / TILE) * TILE * TILE;
+        } else {
+            total += (size_t)view.w * view.h;
+        }
+        _levels.push_back(level);
+    }
+    _texels.resize(total);
+
+    for(size_t l = 0; l < levels.size(); l++) {
+        Image converted;
+        Image_Const_View src = levels[l];
+        if(src.format != format) {
+            converted = Image(src.w, src.h, format);
+            convert(src, converted.view());
+            src = converted.view();
+        }
+        for(unsigned int y = 0; y < src.h; y++) {
+            const unsigned char* row = src.row(y);
+            for(unsigned int x = 0; x < src.w; x++)
+                std::memcpy(&_texels[index(_levels[l], x, y)], row + x * 4, 4);
+        }
+    }
+}
+
+size_t Tiled_Texture::index(const Level& level, unsigned int x, unsigned int y) const {
+    if(_layout == Texel_Layout::row_major) return level.offset + (size_t)y * level.w + x;
+    size_t tile = (size_t)(y / TILE) * level.tiles_x + x / TILE;
+    return level.offset + tile * TILE * TILE + MORTON.idx[(y % TILE) * TILE + x % TILE];
+}
+
+uint32_t Tiled_Texture::texel(unsigned int level, unsigned int x, unsigned int y) const {
+    return _texels[index(_levels[level], x, y)];
+}
+
+void Tiled_Texture::gather(const Lookup8& in, const unsigned int* level, const float* weight,
+                           Texel8& out, bool first) const {
+
+    alignas(16) float lw[8], lh[8], ax[8], ay[8];
+    alignas(16) int32_t x0[8], x1[8], y0[8], y1[8];
+    for(int i = 0; i < 8; i++) {
+        lw[i] = (float)_levels[level[i]].w;
+        lh[i] = (float)_levels[level[i]].h;
+    }
+
+    // Corner coordinates and weights. u and v wrap to [0, 1) first so the texel coordinates
+    // stay small; a lookup that is still out of range is clamped when it is read.
+#if UTIL_SSE
+    const __m128 half = _mm_set1_ps(0.5f), one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+    auto corners = [&](const float* uv, const float* size, float* a, int32_t* c0, int32_t* c1) {
+        for(int i = 0; i < 8; i += 4) {
+            __m128 t = _mm_load_ps(uv + i), n = _mm_load_ps(size + i);
+            t = _mm_sub_ps(t, floor_ps(t));
+            __m128 x = _mm_sub_ps(_mm_mul_ps(t, n), half);
+            __m128 f = floor_ps(x);
+            _mm_store_ps(a + i, _mm_sub_ps(x, f));
+            f = select_ps(_mm_cmplt_ps(f, zero), _mm_sub_ps(n, one), f);
+            __m128 g = _mm_add_ps(f, one);
+            g = select_ps(_mm_cmplt_ps(g, n), g, zero);
+            _mm_store_si128(reinterpret_cast<__m128i*>(c0 + i), _mm_cvttps_epi32(f));
+            _mm_store_si128(reinterpret_cast<__m128i*>(c1 + i), _mm_cvttps_epi32(g));
+        }
+    };
+#else
+    auto corners = [&](const float* uv, const float* size, float* a, int32_t* c0, int32_t* c1) {
+        for(int i = 0; i < 8; i++) {
+            float t = uv[i] - std::floor(uv[i]);
+            float x = t * size[i] - 0.5f, f = std::floor(x);
+            a[i] = x - f;
+            if(f < 0.0f) f = size[i] - 1.0f;
+            float g = f + 1.0f < size[i] ? f + 1.0f : 0.0f;
+            c0[i] = (int32_t)f;
+            c1[i] = (int32_t)g;
+        }
+    };
+#endif
+    corners(in.u, lw, ax, x0, x1);
+    corners(in.v, lh, ay, y0, y1);
+
+    // The gather itself is scalar; SSE2 has no gather instruction
+    alignas(16) uint32_t c[4][8];
+    for(int i = 0; i < 8; i++) {
+        const Level& l = _levels[level[i]];
+        unsigned int xa = std::min((unsigned int)x0[i], l.w - 1);
+        unsigned int xb = std::min((unsigned int)x1[i], l.w - 1);
+        unsigned int ya = std::min((unsigned int)y0[i], l.h - 1);
+        unsigned int yb = std::min((unsigned int)y1[i], l.h - 1);
+        c[0][i] = _texels[index(l, xa, ya)];
+        c[1][i] = _texels[index(l, xb, ya)];
+        c[2][i] = _texels[index(l, xa, yb)];
+        c[3][i] = _texels[index(l, xb, yb)];
+    }
+
+    // Corners to linear floats, channel by channel
+    alignas(16) float f[4][4][8];
+    const float* table = srgb_table();
+    for(int k = 0; k < 4; k++) {
+        if(_srgb) {
+            for(int i = 0; i < 8; i++) {
+                uint32_t t = c[k][i];
+                f[k][0][i] = table[t & 0xff];
+                f[k][1][i] = table[(t >> 8) & 0xff];
+                f[k][2][i] = table[(t >> 16) & 0xff];
+                f[k][3][i] = (t >> 24) * (1.0f / 255.0f);
+            }
+            continue;
+        }
+#if UTIL_SSE
+        const __m128i mask = _mm_set1_epi32(0xff);
+        const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+        for(int i = 0; i < 8; i += 4) {
+            __m128i t = _mm_load_si128(reinterpret_cast<const __m128i*>(c[k] + i));
+            for(int ch = 0; ch < 4; ch++) {
+                __m128i b = _mm_and_si128(_mm_srli_epi32(t, 8 * ch), mask);
+                _mm_store_ps(f[k][ch] + i, _mm_mul_ps(_mm_cvtepi32_ps(b), scale));
+            }
+        }
+#else
+        for(int i = 0; i < 8; i++)
+            for(int ch = 0; ch < 4; ch++)
+                f[k][ch][i] = ((c[k][i] >> (8 * ch)) & 0xff) * (1.0f / 255.0f);
+#endif
+    }
+
+    float* dst[4] = {out.r, out.g, out.b, out.a};
+#if UTIL_SSE
+    for(int i = 0; i < 8; i += 4) {
+        __m128 wx = _mm_load_ps(ax + i), wy = _mm_load_ps(ay + i), w = _mm_loadu_ps(weight + i);
+        for(int ch = 0; ch < 4; ch++) {
+            __m128 c00 = _mm_load_ps(f[0][ch] + i), c10 = _mm_load_ps(f[1][ch] + i);
+            __m128 c01 = _mm_load_ps(f[2][ch] + i), c11 = _mm_load_ps(f[3][ch] + i);
+            __m128 top = _mm_add_ps(c00, _mm_mul_ps(_mm_sub_ps(c10, c00), wx));
+            __m128 bottom = _mm_add_ps(c01, _mm_mul_ps(_mm_sub_ps(c11, c01), wx));
+            __m128 v = _mm_mul_ps(_mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), wy)), w);
+            if(!first) v = _mm_add_ps(v, _mm_load_ps(dst[ch] + i));
+            _mm_store_ps(dst[ch] + i, v);
+        }
+    }
+#else
+    for(int i = 0; i < 8; i++) {
+        for(int ch = 0; ch < 4; ch++) {
+            float top = f[0][ch][i] + (f[1][ch][i] - f[0][ch][i]) * ax[i];
+            float bottom = f[2][ch][i] + (f[3][ch][i] - f[2][ch][i]) * ax[i];
+            float v = (top + (bottom - top) * ay[i]) * weight[i];
+            dst[ch][i] = first ? v : dst[ch][i] + v;
+        }
+    }
+#endif
+}
+
+void Tiled_Texture::bilinear8(const Lookup8& in, unsigned int level, Texel8& out) const {
+    if(_levels.empty()) return;
+    unsigned int levels[8];
+    float weights[8];
+    std::fill(levels, levels + 8, std::min(level, (unsigned int)_levels.size() - 1));
+    std::fill(weights, weights + 8, 1.0f);
+    gather(in, levels, weights, out, true);
+}
+
+void Tiled_Texture::sample8(const Lookup8& in, Texel8& out) const {
+    if(_levels.empty()) return;
+
+    float last = (float)(_levels.size() - 1);
+    unsigned int l0[8], l1[8];
+    float w0[8], w1[8];
+    bool blend = false;
+
+    for(int i = 0; i < 8; i++) {
+        // NaN fails both comparisons and reads the base level
+        float l = in.lod[i] > 0.0f ? std::min(in.lod[i], last) : 0.0f;
+        l0[i] = (unsigned int)l;
+        l1[i] = std::min(l0[i] + 1, (unsigned int)last);
+        w1[i] = l - l0[i];
+        w0[i] = 1.0f - w1[i];
+        blend = blend || w1[i] > 0.0f;
+    }
+
+    gather(in, l0, w0, out, true);
+    if(blend) gather(in, l1, w1, out, false);
+}
+
+} // namespace Util
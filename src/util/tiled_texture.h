@@ -0,0 +1,83 @@
+
+#pragma once
+
+#include <cstdint>
+#include <util/image.h>
+#include <vector>
+
+namespace Util {
+
+/// Texel order within each level of a Tiled_Texture
+enum class Texel_Layout : int { row_major, tiled };
+
+/// Eight texture lookups at once, as structures of arrays
+struct Lookup8 {
+    alignas(16) float u[8], v[8], lod[8];
+};
+struct Texel8 {
+    alignas(16) float r[8], g[8], b[8], a[8];
+};
+
+/// RGBA8 mip chain laid out for incoherent lookups. Levels are split into 8x8 tiles of 256
+/// bytes, with texels in Morton order inside a tile. Each 4x4 quarter then fills one 64 byte
+/// cache line, so most bilinear footprints touch a single line instead of two rows. Row-major
+/// layout is there for comparison.
+class Tiled_Texture {
+public:
+    static constexpr unsigned int TILE = 8;
+
+    Tiled_Texture() = default;
+    /// Levels base first, each half the size of the one before. Texels are stored as RGBA8,
+    /// sRGB if the base is; other formats are converted.
+    explicit Tiled_Texture(const std::vector<Image_Const_View>& levels,
+                           Texel_Layout layout = Texel_Layout::tiled);
+
+    unsigned int levels() const {
+        return (unsigned int)_levels.size();
+    }
+    unsigned int w(unsigned int level = 0) const {
+        return _levels[level].w;
+    }
+    unsigned int h(unsigned int level = 0) const {
+        return _levels[level].h;
+    }
+    bool srgb() const {
+        return _srgb;
+    }
+    Texel_Layout layout() const {
+        return _layout;
+    }
+    size_t bytes() const {
+        return _texels.size() * sizeof(uint32_t);
+    }
+
+    /// Packed RGBA8 texel, x < w(level) and y < h(level)
+    uint32_t texel(unsigned int level, unsigned int x, unsigned int y) const;
+
+    /// Bilinear lookups in one level, with REPEAT addressing; results are linear RGBA like
+    /// Texture_Sampler::bilinear
+    void bilinear8(const Lookup8& in, unsigned int level, Texel8& out) const;
+    /// Trilinear lookups at each lane's own lod, clamped to the chain like Texture_Sampler::sample
+    void sample8(const Lookup8& in, Texel8& out) const;
+
+private:
+    struct Level {
+        unsigned int w = 0, h = 0;
+        /// Tiles per row, for the tiled layout
+        unsigned int tiles_x = 0;
+        size_t offset = 0;
+    };
+
+    size_t index(const Level& level, unsigned int x, unsigned int y) const;
+    /// Bilinear lookups with each lane in its own level, scaled by weight and added to out
+    /// unless it is the first pass
+    void gather(const Lookup8& in, const unsigned int* level, const float* weight, Texel8& out,
+                bool first) const;
+
+    std::vector<Level> _levels;
+    std::vector<uint32_t> _texels;
+    Texel_Layout _layout = Texel_Layout::tiled;
+    bool _srgb = false;
+};
+
+} // namespace Util
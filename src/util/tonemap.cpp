@@ -0,0 +1,298 @@
+
+#include "tonemap.h"
+#include "parallel.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <lib/pack.h>
+
+namespace Util {
+
+namespace {
+
+// Table entries cover curve outputs from 2^-64 to 1 with 10 mantissa bits each, plus one entry
+// for exactly 1. Anything smaller encodes like 2^-64, which rounds to 0 for any gamma below 5.
+constexpr uint32_t TABLE_MIN = 0x1f800000u;
+constexpr uint32_t TABLE_SHIFT = 13;
+constexpr size_t TABLE_SIZE = ((0x3f800000u - TABLE_MIN) >> TABLE_SHIFT) + 1;
+
+float uncharted2(float x) {
+    const float A = 0.15f, B = 0.50f, C = 0.10f, D = 0.20f, E = 0.02f, F = 0.30f;
+    return ((x * (A * x + C * B) + D * E) / (x * (A * x + B) + D * F)) - E / F;
+}
+
+const float UNCHARTED2_SCALE = 1.0f / uncharted2(11.2f);
+
+unsigned char quantize(float v) {
+    return static_cast<unsigned char>(Pack::quantize_unorm8(v));
+}
+
+std::vector<unsigned char> build_table(float inv_gamma, bool srgb) {
+    std::vector<unsigned char> table(TABLE_SIZE);
+    for(size_t i = 0; i < TABLE_SIZE; i++) {
+        float t = i + 1 == TABLE_SIZE
+                      ? 1.0f
+                      : Pack::bits_float(TABLE_MIN + ((uint32_t)i << TABLE_SHIFT) +
+                                         (1u << (TABLE_SHIFT - 1)));
+        float v = std::pow(t, inv_gamma);
+        table[i] = quantize(srgb ? linear_to_srgb(v) : v);
+    }
+    return table;
+}
+
+unsigned char lookup(const std::vector<unsigned char>& table, float t) {
+    t = std::clamp(t, 0.0f, 1.0f);
+    if(!(t >= 0.0f)) t = 0.0f;
+    uint32_t bits = std::max(Pack::float_bits(t), TABLE_MIN);
+    return table[(bits - TABLE_MIN) >> TABLE_SHIFT];
+}
+
+uint16_t to_half(float f) {
+    uint32_t a = Pack::float_bits(f) & 0x7fffffffu;
+    uint32_t sign = (Pack::float_bits(f) >> 16) & 0x8000u;
+    if(a >= 0x477ff000u) return static_cast<uint16_t>(sign | (a > 0x7f800000u ? 0x7e00u : 0x7c00u));
+    return static_cast<uint16_t>(Pack::f32_to_f16(f));
+}
+
+#if UTIL_SSE
+
+// Clamps to [0, 1], NaNs to 0, and returns the table index of each lane
+__m128i table_index(__m128 t) {
+    t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    t = _mm_max_ps(t, _mm_castsi128_ps(_mm_set1_epi32(TABLE_MIN)));
+    __m128i bits = _mm_sub_epi32(_mm_castps_si128(t), _mm_set1_epi32(TABLE_MIN));
+    return _mm_srli_epi32(bits, TABLE_SHIFT);
+}
+
+template<Tonemap_Curve curve>
+void tonemap_sse(const float* in, unsigned char* out, size_t n, float exposure,
+                 const unsigned char* table) {
+
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 exp4 = _mm_set1_ps(exposure);
+    const __m128i alpha_mask = _mm_setr_epi32(0, 0, 0, -1);
+    alignas(16) uint32_t idx[4];
+
+    for(size_t i = 0; i < n; i++) {
+
+        __m128 c = _mm_loadu_ps(in + i * 4);
+        __m128 t = c;
+
+        if constexpr(curve == Tonemap_Curve::uncharted2) {
+            const float A = 0.15f, B = 0.50f, C = 0.10f, D = 0.20f, E = 0.02f, F = 0.30f;
+            __m128 x = _mm_mul_ps(c, exp4);
+            __m128 ax = _mm_mul_ps(_mm_set1_ps(A), x);
+            __m128 num = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(ax, _mm_set1_ps(C * B))),
+                                    _mm_set1_ps(D * E));
+            __m128 den = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(ax, _mm_set1_ps(B))),
+                                    _mm_set1_ps(D * F));
+            t = _mm_sub_ps(_mm_div_ps(num, den), _mm_set1_ps(E / F));
+            t = _mm_mul_ps(t, _mm_set1_ps(UNCHARTED2_SCALE));
+        } else if constexpr(curve == Tonemap_Curve::exponential) {
+            t = _mm_sub_ps(one, exp_ps(_mm_mul_ps(_mm_sub_ps(_mm_setzero_ps(), c), exp4)));
+        }
+
+        // Alpha is quantized directly: clamped, so truncation rounds like quantize_unorm8
+        __m128 a = _mm_min_ps(_mm_max_ps(c, _mm_setzero_ps()), one);
+        __m128i q =
+            _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(a, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+        __m128i index = _mm_or_si128(_mm_and_si128(alpha_mask, q),
+                                     _mm_andnot_si128(alpha_mask, table_index(t)));
+
+        _mm_store_si128(reinterpret_cast<__m128i*>(idx), index);
+        uint32_t texel =
+            table[idx[0]] | (table[idx[1]] << 8) | (table[idx[2]] << 16) | (idx[3] << 24);
+        std::memcpy(out + i * 4, &texel, sizeof(texel));
+    }
+}
+
+// Giesen's round to nearest even conversion; only inputs that round to zero go through a
+// denormal, so flush-to-zero modes give the same result
+__m128i half4(__m128 f) {
+
+    const __m128i inf32 = _mm_set1_epi32(0x7f800000);
+    const __m128i max32 = _mm_set1_epi32((127 + 16) << 23);
+    const __m128i min_normal = _mm_set1_epi32((127 - 14) << 23);
+    const __m128i sub_magic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+    const __m128i normal_bias = _mm_set1_epi32(0xfff - ((127 - 15) << 23));
+
+    __m128 sign = _mm_and_ps(f, _mm_castsi128_ps(_mm_set1_epi32(0x80000000)));
+    __m128 absf = _mm_xor_ps(f, sign);
+    __m128i a = _mm_castps_si128(absf);
+
+    __m128i is_nan = _mm_cmpgt_epi32(a, inf32);
+    __m128i is_regular = _mm_cmpgt_epi32(max32, a);
+    __m128i special = _mm_or_si128(_mm_and_si128(is_nan, _mm_set1_epi32(0x200)),
+                                   _mm_set1_epi32(0x7c00));
+
+    // Subnormal halves: let the float adder round the mantissa into place
+    __m128i is_sub = _mm_cmpgt_epi32(min_normal, a);
+    __m128 sub1 = _mm_add_ps(absf, _mm_castsi128_ps(sub_magic));
+    __m128i sub = _mm_sub_epi32(_mm_castps_si128(sub1), sub_magic);
+
+    // Normal halves: rebias, then round half to even on bit 13
+    __m128i odd = _mm_srai_epi32(_mm_slli_epi32(a, 31 - 13), 31);
+    __m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(a, normal_bias), odd), 13);
+
+    __m128i value = _mm_or_si128(_mm_and_si128(is_sub, sub), _mm_andnot_si128(is_sub, normal));
+    value = _mm_or_si128(_mm_and_si128(is_regular, value), _mm_andnot_si128(is_regular, special));
+    return _mm_or_si128(value, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+}
+
+// Subnormal halves are converted from integers, so no float denormals are involved
+__m128 float4(__m128i h) {
+
+    __m128i em = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+    __m128i sign = _mm_slli_epi32(_mm_xor_si128(h, em), 16);
+
+    __m128i normal = _mm_add_epi32(_mm_slli_epi32(em, 13), _mm_set1_epi32(112 << 23));
+    __m128i is_special = _mm_cmpgt_epi32(em, _mm_set1_epi32(0x7bff));
+    normal = _mm_or_si128(normal, _mm_and_si128(is_special, _mm_set1_epi32(0x7f800000)));
+
+    __m128 sub = _mm_mul_ps(_mm_cvtepi32_ps(em), _mm_set1_ps(1.0f / 16777216.0f));
+    __m128 is_sub = _mm_castsi128_ps(_mm_cmplt_epi32(em, _mm_set1_epi32(0x400)));
+
+    __m128 value = select_ps(is_sub, sub, _mm_castsi128_ps(normal));
+    return _mm_or_ps(value, _mm_castsi128_ps(sign));
+}
+
+#endif
+
+} // namespace
+
+Vec3 tonemap(Vec3 color, const Tonemap_Params& params) {
+
+    Vec3 c;
+    switch(params.curve) {
+    case Tonemap_Curve::uncharted2: {
+        Vec3 x = color * params.exposure;
+        c = Vec3{uncharted2(x.x), uncharted2(x.y), uncharted2(x.z)} * UNCHARTED2_SCALE;
+    } break;
+    case Tonemap_Curve::exponential: {
+        Vec3 x = -color * params.exposure;
+        c = Vec3{1.0f - std::exp(x.x), 1.0f - std::exp(x.y), 1.0f - std::exp(x.z)};
+    } break;
+    case Tonemap_Curve::none: return color;
+    }
+
+    float g = 1.0f / params.gamma;
+    return Vec3{std::pow(c.x, g), std::pow(c.y, g), std::pow(c.z, g)};
+}
+
+float linear_to_srgb(float x) {
+    return x <= 0.0031308f ? 12.92f * x : 1.055f * std::pow(x, 1.0f / 2.4f) - 0.055f;
+}
+
+float srgb_to_linear(float x) {
+    return x <= 0.04045f ? x / 12.92f : std::pow((x + 0.055f) / 1.055f, 2.4f);
+}
+
+Tonemapper::Tonemapper(const Tonemap_Params& params) : p(params) {
+    float inv_gamma = p.curve == Tonemap_Curve::none ? 1.0f : 1.0f / p.gamma;
+    table = build_table(inv_gamma, p.srgb);
+}
+
+unsigned char Tonemapper::encode(float t) const {
+    return lookup(table, t);
+}
+
+void Tonemapper::reference(const float* in, unsigned char* out, size_t n) const {
+    for(size_t i = 0; i < n; i++) {
+        const float* c = in + i * 4;
+        Vec3 t = tonemap(Vec3{c[0], c[1], c[2]}, p);
+        for(int j = 0; j < 3; j++) {
+            float v = std::isnan(t[j]) ? 0.0f : std::clamp(t[j], 0.0f, 1.0f);
+            out[i * 4 + j] = quantize(p.srgb ? linear_to_srgb(v) : v);
+        }
+        out[i * 4 + 3] = quantize(c[3]);
+    }
+}
+
+void Tonemapper::run_block(const float* in, unsigned char* out, size_t n) const {
+#if UTIL_SSE
+    switch(p.curve) {
+    case Tonemap_Curve::uncharted2: {
+        tonemap_sse<Tonemap_Curve::uncharted2>(in, out, n, p.exposure, table.data());
+    } break;
+    case Tonemap_Curve::exponential: {
+        tonemap_sse<Tonemap_Curve::exponential>(in, out, n, p.exposure, table.data());
+    } break;
+    case Tonemap_Curve::none: {
+        tonemap_sse<Tonemap_Curve::none>(in, out, n, p.exposure, table.data());
+    } break;
+    }
+#else
+    Tonemap_Params curve = p;
+    curve.gamma = 1.0f;
+    for(size_t i = 0; i < n; i++) {
+        const float* c = in + i * 4;
+        Vec3 t = tonemap(Vec3{c[0], c[1], c[2]}, curve);
+        for(int j = 0; j < 3; j++) out[i * 4 + j] = encode(t[j]);
+        out[i * 4 + 3] = quantize(c[3]);
+    }
+#endif
+}
+
+void Tonemapper::run(const float* in, unsigned char* out, unsigned int w, unsigned int h) const {
+    // Each thread gets one contiguous band of rows
+    parallel_for(0, h, [&](size_t y) {
+        size_t begin = y * w;
+        run_block(in + begin * 4, out + begin * 4, w);
+    });
+}
+
+void linear_to_srgb8(const float* in, unsigned char* out, size_t n) {
+
+    static const std::vector<unsigned char> table = build_table(1.0f, true);
+
+    size_t i = 0;
+#if UTIL_SSE
+    alignas(16) uint32_t idx[4];
+    for(; i + 4 <= n; i += 4) {
+        _mm_store_si128(reinterpret_cast<__m128i*>(idx), table_index(_mm_loadu_ps(in + i)));
+        for(int j = 0; j < 4; j++) out[i + j] = table[idx[j]];
+    }
+#endif
+    for(; i < n; i++) out[i] = lookup(table, in[i]);
+}
+
+void srgb8_to_linear(const unsigned char* in, float* out, size_t n) {
+
+    static const std::vector<float> table = []() {
+        std::vector<float> t(256);
+        for(int i = 0; i < 256; i++) t[i] = srgb_to_linear(i / 255.0f);
+        return t;
+    }();
+
+    for(size_t i = 0; i < n; i++) out[i] = table[in[i]];
+}
+
+void float_to_half(const float* in, uint16_t* out, size_t n) {
+    size_t i = 0;
+#if UTIL_SSE
+    for(; i + 8 <= n; i += 8) {
+        __m128i lo = half4(_mm_loadu_ps(in + i));
+        __m128i hi = half4(_mm_loadu_ps(in + i + 4));
+        // Lanes hold a sign-extended 16 bit value, so the saturating pack keeps every bit
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(lo, hi));
+    }
+#endif
+    for(; i < n; i++) out[i] = to_half(in[i]);
+}
+
+void half_to_float(const uint16_t* in, float* out, size_t n) {
+    size_t i = 0;
+#if UTIL_SSE
+    for(; i + 8 <= n; i += 8) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i zero = _mm_setzero_si128();
+        _mm_storeu_ps(out + i, float4(_mm_unpacklo_epi16(h, zero)));
+        _mm_storeu_ps(out + i + 4, float4(_mm_unpackhi_epi16(h, zero)));
+    }
+#endif
+    for(; i < n; i++) out[i] = Pack::f16_to_f32(in[i]);
+}
+
+} // namespace Util
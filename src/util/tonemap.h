@@ -0,0 +1,63 @@
+
+#pragma once
+
+#include <lib/mathlib.h>
+#include <cstdint>
+#include <vector>
+
+namespace Util {
+
+/// Curves of tonemap.frag, in the order of EffectPipe::tonemap_type
+enum class Tonemap_Curve : int { uncharted2, exponential, none };
+
+struct Tonemap_Params {
+    Tonemap_Curve curve = Tonemap_Curve::exponential;
+    /// Unused by Tonemap_Curve::none, like in tonemap.frag
+    float exposure = 1.0f;
+    float gamma = 2.2f;
+    /// Encode to sRGB after the curve, as storing to the R8G8B8A8_SRGB swapchain image does
+    bool srgb = true;
+};
+
+/// Scalar mirror of tonemap.frag for one color, before clamping and sRGB encoding
+Vec3 tonemap(Vec3 color, const Tonemap_Params& params);
+
+float linear_to_srgb(float x);
+float srgb_to_linear(float x);
+
+/// Tonemaps RGBA32F texels to RGBA8 the way the tonemap pass and the swapchain do. Gamma and
+/// the sRGB encoding share one table indexed by the float bits of the clamped curve output,
+/// built once per set of parameters; alpha is quantized linearly.
+class Tonemapper {
+public:
+    explicit Tonemapper(const Tonemap_Params& params = {});
+
+    const Tonemap_Params& params() const {
+        return p;
+    }
+
+    /// n texels, with std::pow and the exact sRGB curve
+    void reference(const float* in, unsigned char* out, size_t n) const;
+    /// A packed w x h frame, with SSE and the rows split across threads; within one step of
+    /// reference()
+    void run(const float* in, unsigned char* out, unsigned int w, unsigned int h) const;
+
+private:
+    void run_block(const float* in, unsigned char* out, size_t n) const;
+    unsigned char encode(float t) const;
+
+    Tonemap_Params p;
+    std::vector<unsigned char> table;
+};
+
+/// Linear values in [0, 1] (clamped) to sRGB bytes, through a Tonemapper-style table
+void linear_to_srgb8(const float* in, unsigned char* out, size_t n);
+/// sRGB bytes to linear values, through a 256 entry table
+void srgb8_to_linear(const unsigned char* in, float* out, size_t n);
+
+/// IEEE half with round to nearest even; overflow becomes infinity and NaNs stay NaNs
+void float_to_half(const float* in, uint16_t* out, size_t n);
+/// Exact
+void half_to_float(const uint16_t* in, float* out, size_t n);
+
+} // namespace Util
@@ -0,0 +1,448 @@
+
+#include "virtual_texture.h"
+#include "mipmap.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <lib/log.h>
+
+namespace Util {
+
+namespace {
+
+constexpr uint32_t PAGE_MAGIC = 0x31505456; // "VTP1"
+// Bump whenever the cooked layout changes, so stale page files get rebuilt
+constexpr uint32_t PAGE_VERSION = 1;
+
+struct Page_Header {
+    uint32_t magic = PAGE_MAGIC;
+    uint32_t version = PAGE_VERSION;
+    uint32_t page_size = PAGE_SIZE;
+    uint32_t border = PAGE_BORDER;
+    uint32_t textures = 0;
+    uint32_t pages = 0;
+};
+
+struct Page_Entry {
+    uint32_t w, h, levels, srgb;
+};
+
+unsigned int wrap(int x, unsigned int n) {
+    int m = x % (int)n;
+    return (unsigned int)(m < 0 ? m + (int)n : m);
+}
+
+} // namespace
+
+uint32_t VT_Texture::pages() const {
+    uint32_t n = 0;
+    for(unsigned int l = 0; l < levels; l++) n += pages_x(l) * pages_y(l);
+    return n;
+}
+
+uint32_t VT_Texture::page(unsigned int level, unsigned int x, unsigned int y) const {
+    uint32_t idx = first_page;
+    for(unsigned int l = 0; l < level; l++) idx += pages_x(l) * pages_y(l);
+    return idx + y * pages_x(level) + x;
+}
+
+VT_Texture vt_texture(unsigned int w, unsigned int h, bool srgb, uint32_t first_page) {
+    VT_Texture tex;
+    tex.w = w;
+    tex.h = h;
+    tex.srgb = srgb;
+    tex.first_page = first_page;
+    tex.levels = 1;
+    while(tex.pages_x(tex.levels - 1) > 1 || tex.pages_y(tex.levels - 1) > 1) tex.levels++;
+    return tex;
+}
+
+void cut_page(Image_Const_View level, unsigned int x, unsigned int y, unsigned char* out) {
+    int x0 = (int)(x * PAGE_SIZE) - (int)PAGE_BORDER;
+    int y0 = (int)(y * PAGE_SIZE) - (int)PAGE_BORDER;
+    for(unsigned int j = 0; j < PAGE_SLOT; j++) {
+        const unsigned char* row = level.row(wrap(y0 + (int)j, level.h));
+        for(unsigned int i = 0; i < PAGE_SLOT; i++) {
+            std::memcpy(out, row + (size_t)wrap(x0 + (int)i, level.w) * 4, 4);
+            out += 4;
+        }
+    }
+}
+
+std::string cook_pages(const std::vector<Image_Const_View>& images, const std::string& cache_dir) {
+
+    Page_Header header;
+    header.textures = (uint32_t)images.size();
+    if(images.size() > 4096) {
+        warn("Cannot page %zu textures, at most 4096", images.size());
+        return {};
+    }
+
+    std::vector<VT_Texture> layout;
+    uint64_t key = hash_bytes(&header, sizeof(header));
+    for(const Image_Const_View& img : images) {
+        if(img.empty() || img.w > 32768 || img.h > 32768) {
+            warn("Cannot page a %ux%u texture", img.w, img.h);
+            return {};
+        }
+        VT_Texture tex = vt_texture(img.w, img.h, img.format == Image_Format::rgba8_srgb,
+                                    header.pages);
+        header.pages += tex.pages();
+        layout.push_back(tex);
+
+        uint32_t id[3] = {img.w, img.h, (uint32_t)img.format};
+        key = hash_texels(img, hash_bytes(id, sizeof(id), key));
+    }
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.vtp", (unsigned long long)key);
+    std::string path = cache_dir + "/" + name;
+    if(std::filesystem::exists(path)) {
+        Page_File existing;
+        if(existing.open(path)) return path;
+    }
+
+    std::error_code err;
+    std::filesystem::create_directories(cache_dir, err);
+
+    // Written under a temporary name, so an interrupted cook never leaves a truncated page file
+    std::string tmp = path + ".tmp";
+    std::ofstream out(tmp, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for(const VT_Texture& tex : layout) {
+        Page_Entry entry = {tex.w, tex.h, tex.levels, tex.srgb};
+        out.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+    }
+
+    // One texture at a time, so only a single mip chain is in memory
+    std::vector<unsigned char> page(PAGE_BYTES);
+    for(size_t i = 0; i < images.size(); i++) {
+        const VT_Texture& tex = layout[i];
+        Image_Format format = tex.srgb ? Image_Format::rgba8_srgb : Image_Format::rgba8;
+
+        Image converted;
+        Image_Const_View base = images[i];
+        if(base.format != format) {
+            converted = Image(base.w, base.h, format);
+            convert(base, converted.view());
+            base = converted.view();
+        }
+        std::vector<Image> mips = tex.levels > 1 ? build_mips(base) : std::vector<Image>{};
+
+        for(unsigned int l = 0; l < tex.levels; l++) {
+            Image_Const_View level = l ? mips[l - 1].view() : base;
+            for(unsigned int y = 0; y < tex.pages_y(l); y++) {
+                for(unsigned int x = 0; x < tex.pages_x(l); x++) {
+                    cut_page(level, x, y, page.data());
+                    out.write(reinterpret_cast<const char*>(page.data()), page.size());
+                }
+            }
+        }
+    }
+
+    out.close();
+    if(!out) {
+        warn("Failed to write page file %s", tmp.c_str());
+        std::filesystem::remove(tmp, err);
+        return {};
+    }
+    std::filesystem::rename(tmp, path, err);
+    if(err) {
+        warn("Failed to write page file %s: %s", path.c_str(), err.message().c_str());
+        return {};
+    }
+    info("Cooked %u pages of %zu textures (%zu MB)", header.pages, images.size(),
+         ((size_t)header.pages * PAGE_BYTES) >> 20);
+    return path;
+}
+
+bool Page_File::open(const std::string& file_path) {
+
+    std::lock_guard<std::mutex> lock(mut);
+    _textures.clear();
+    _pages = 0;
+    path = file_path;
+    file = std::ifstream(path, std::ios::binary);
+    if(!file) {
+        warn("Failed to open page file %s", path.c_str());
+        return false;
+    }
+
+    Page_Header header, expect;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if(!file || header.magic != expect.magic || header.version != expect.version ||
+       header.page_size != expect.page_size || header.border != expect.border) {
+        warn("Ignoring stale page file %s", path.c_str());
+        return false;
+    }
+
+    uint32_t first = 0;
+    for(uint32_t i = 0; i < header.textures; i++) {
+        Page_Entry entry;
+        file.read(reinterpret_cast<char*>(&entry), sizeof(entry));
+        if(!file) break;
+        VT_Texture tex = vt_texture(entry.w, entry.h, entry.srgb != 0, first);
+        if(tex.levels != entry.levels) break;
+        first += tex.pages();
+        _textures.push_back(tex);
+    }
+
+    data_offset = sizeof(Page_Header) + (size_t)header.textures * sizeof(Page_Entry);
+    std::error_code err;
+    size_t size = std::filesystem::file_size(path, err);
+    if(_textures.size() != header.textures || first != header.pages || err ||
+       size < data_offset + (size_t)header.pages * PAGE_BYTES) {
+        warn("Ignoring truncated page file %s", path.c_str());
+        _textures.clear();
+        return false;
+    }
+    _pages = header.pages;
+    return true;
+}
+
+unsigned int Page_File::texture_of(uint32_t page) const {
+    auto it = std::upper_bound(
+        _textures.begin(), _textures.end(), page,
+        [](uint32_t p, const VT_Texture& tex) { return p < tex.first_page; });
+    return (unsigned int)(it - _textures.begin()) - 1;
+}
+
+bool Page_File::read(uint32_t page, unsigned char* out) const {
+    if(page >= _pages) return false;
+    std::lock_guard<std::mutex> lock(mut);
+    file.clear();
+    file.seekg(data_offset + (size_t)page * PAGE_BYTES);
+    file.read(reinterpret_cast<char*>(out), PAGE_BYTES);
+    if(!file) {
+        warn("Failed to read page %u of %s", page, path.c_str());
+        return false;
+    }
+    return true;
+}
+
+Page_Cache::Page_Cache(unsigned int slots)
+    : slot_page(slots, NO_PAGE), slot_frame(slots, 0), slot_pinned(slots, false), lru_pos(slots) {
+    for(unsigned int s = 0; s < slots; s++) lru_pos[s] = lru.insert(lru.end(), s);
+}
+
+int Page_Cache::find(uint32_t page) const {
+    auto it = page_slot.find(page);
+    return it == page_slot.end() ? -1 : (int)it->second;
+}
+
+bool Page_Cache::touch(uint32_t page, uint64_t frame) {
+    auto it = page_slot.find(page);
+    if(it == page_slot.end()) return false;
+    unsigned int s = it->second;
+    slot_frame[s] = frame;
+    if(!slot_pinned[s]) lru.splice(lru.begin(), lru, lru_pos[s]);
+    return true;
+}
+
+int Page_Cache::insert(uint32_t page, uint64_t frame, bool pinned, uint32_t* evicted) {
+
+    if(evicted) *evicted = NO_PAGE;
+    if(touch(page, frame)) return find(page);
+    if(lru.empty()) return -1;
+
+    // Everything ahead of the last slot was used more recently, so if it is in use this frame,
+    // they all are
+    unsigned int s = lru.back();
+    if(slot_page[s] != NO_PAGE) {
+        if(slot_frame[s] == frame) return -1;
+        page_slot.erase(slot_page[s]);
+        if(evicted) *evicted = slot_page[s];
+    }
+
+    slot_page[s] = page;
+    slot_frame[s] = frame;
+    page_slot[page] = s;
+    if(pinned) {
+        lru.erase(lru_pos[s]);
+        slot_pinned[s] = true;
+    } else {
+        lru.splice(lru.begin(), lru, lru_pos[s]);
+    }
+    return (int)s;
+}
+
+Page_Streamer::Page_Streamer(const Page_File& file, unsigned int n) : file(file) {
+    for(unsigned int i = 0; i < std::max(n, 1u); i++) threads.emplace_back([this]() { worker(); });
+}
+
+Page_Streamer::~Page_Streamer() {
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        stop = true;
+    }
+    cv_work.notify_all();
+    for(std::thread& t : threads) t.join();
+}
+
+void Page_Streamer::request(const std::vector<uint32_t>& pages) {
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        for(uint32_t page : queue) in_flight.erase(page);
+        queue.clear();
+        for(uint32_t page : pages) {
+            if(in_flight.insert(page).second) queue.push_back(page);
+        }
+    }
+    cv_work.notify_all();
+}
+
+std::vector<Loaded_Page> Page_Streamer::poll(size_t max) {
+    std::lock_guard<std::mutex> lock(mut);
+    size_t n = std::min(max, done.size());
+    std::vector<Loaded_Page> ret(std::make_move_iterator(done.begin()),
+                                 std::make_move_iterator(done.begin() + n));
+    done.erase(done.begin(), done.begin() + n);
+    for(const Loaded_Page& page : ret) in_flight.erase(page.page);
+    return ret;
+}
+
+size_t Page_Streamer::pending() const {
+    std::lock_guard<std::mutex> lock(mut);
+    return queue.size() + busy + done.size();
+}
+
+void Page_Streamer::flush() {
+    std::unique_lock<std::mutex> lock(mut);
+    cv_done.wait(lock, [this]() { return queue.empty() && !busy; });
+}
+
+void Page_Streamer::worker() {
+
+    std::unique_lock<std::mutex> lock(mut);
+
+    for(;;) {
+        cv_work.wait(lock, [this]() { return stop || !queue.empty(); });
+        if(stop) return;
+
+        Loaded_Page loaded;
+        loaded.page = queue.front();
+        queue.pop_front();
+        busy++;
+
+        lock.unlock();
+        loaded.texels.resize(PAGE_BYTES);
+        bool ok = file.read(loaded.page, loaded.texels.data());
+        lock.lock();
+
+        busy--;
+        if(ok) {
+            done.push_back(std::move(loaded));
+        } else {
+            in_flight.erase(loaded.page);
+        }
+        cv_done.notify_all();
+    }
+}
+
+Virtual_Textures::Virtual_Textures(const std::string& path, unsigned int slots,
+                                   unsigned int threads) {
+
+    if(!file.open(path)) return;
+    cache[0] = Page_Cache(slots);
+    cache[1] = Page_Cache(slots);
+    _table.resize(file.pages(), 0);
+    streamer = std::make_unique<Page_Streamer>(file, threads);
+
+    // The last level of each texture is a single page
+    size_t failed = 0;
+    for(const VT_Texture& tex : file.textures()) {
+        Loaded_Page tail;
+        tail.page = tex.first_page + tex.pages() - 1;
+        tail.texels.resize(PAGE_BYTES);
+        if(!file.read(tail.page, tail.texels.data()) || !place(std::move(tail), true, initial)) {
+            failed++;
+        }
+    }
+    if(failed) warn("%zu textures have no resident level; raise the page cache size", failed);
+    _valid = true;
+}
+
+unsigned int Virtual_Textures::pool(uint32_t page) const {
+    return file.textures()[file.texture_of(page)].srgb ? 0 : 1;
+}
+
+bool Virtual_Textures::place(Loaded_Page&& loaded, bool pinned,
+                             std::vector<Page_Upload>& uploads) {
+
+    unsigned int p = pool(loaded.page);
+    if(cache[p].find(loaded.page) >= 0) return true;
+
+    uint32_t evicted;
+    int slot = cache[p].insert(loaded.page, frame, pinned, &evicted);
+    if(slot < 0) return false;
+    if(evicted != NO_PAGE) {
+        _table[evicted] = 0;
+        _stats.evicted++;
+    }
+    _table[loaded.page] = ((uint32_t)slot + 1) | (p ? POOL_BIT : 0);
+    uploads.push_back({p, (unsigned int)slot, std::move(loaded.texels)});
+    return true;
+}
+
+std::vector<Page_Upload> Virtual_Textures::update(const uint32_t* feedback, size_t n,
+                                                  size_t max_uploads) {
+
+    std::vector<Page_Upload> uploads = std::move(initial);
+    initial.clear();
+    if(!_valid) return uploads;
+
+    frame++;
+    size_t evicted = _stats.evicted;
+    _stats = {};
+    _stats.evicted = evicted;
+
+    // Each requested page and its coarser stand-ins down the chain. A chain stops at the first
+    // page another request already walked.
+    const std::vector<VT_Texture>& textures = file.textures();
+    std::unordered_set<uint32_t> seen;
+    std::vector<std::pair<unsigned int, uint32_t>> missing;
+
+    for(size_t i = 0; i < n; i++) {
+        if(feedback[i] == NO_PAGE) continue;
+        Page_Id id = Page_Id::unpack(feedback[i]);
+        if(id.tex >= textures.size()) continue;
+        const VT_Texture& tex = textures[id.tex];
+        if(id.level >= tex.levels || id.x >= tex.pages_x(id.level) ||
+           id.y >= tex.pages_y(id.level)) {
+            continue;
+        }
+
+        bool first = true;
+        for(unsigned int l = id.level, x = id.x, y = id.y; l < tex.levels; l++) {
+            uint32_t page = tex.page(l, x, y);
+            if(!seen.insert(page).second) break;
+            _stats.requested += first;
+            first = false;
+            if(!cache[tex.srgb ? 0 : 1].touch(page, frame)) missing.push_back({l, page});
+            if(l + 1 < tex.levels) {
+                x = std::min(x / 2, tex.pages_x(l + 1) - 1);
+                y = std::min(y / 2, tex.pages_y(l + 1) - 1);
+            }
+        }
+    }
+
+    // Coarse pages first: they cover more of the screen and refine from there
+    std::stable_sort(missing.begin(), missing.end(),
+                     [](const auto& a, const auto& b) { return a.first > b.first; });
+    std::vector<uint32_t> queue;
+    for(const auto& m : missing) queue.push_back(m.second);
+    streamer->request(queue);
+    _stats.missing = missing.size();
+
+    for(Loaded_Page& loaded : streamer->poll(max_uploads)) {
+        place(std::move(loaded), false, uploads);
+    }
+
+    _stats.uploaded = uploads.size();
+    _stats.resident = cache[0].resident() + cache[1].resident();
+    _stats.pending = streamer->pending();
+    return uploads;
+}
+
+} // namespace Util
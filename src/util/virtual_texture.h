@@ -0,0 +1,266 @@
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <util/image.h>
+#include <vector>
+
+namespace Util {
+
+/// Streaming virtual textures: every level of every texture is cut into pages, cooked into one
+/// file, and only the pages recent frames asked for are kept in a fixed number of physical slots.
+
+/// Texels per page side
+constexpr unsigned int PAGE_SIZE = 128;
+/// Texels copied in from the neighbouring pages (wrapping at the edges) on every side, so a
+/// bilinear lookup never reads outside its slot
+constexpr unsigned int PAGE_BORDER = 4;
+/// Side of a page as stored in the file and in the atlas
+constexpr unsigned int PAGE_SLOT = PAGE_SIZE + 2 * PAGE_BORDER;
+/// Bytes of one stored page, RGBA8
+constexpr size_t PAGE_BYTES = (size_t)PAGE_SLOT * PAGE_SLOT * 4;
+
+/// A page as the shader's feedback names it, packed into 32 bits: texture (12 bits), level (4),
+/// page row (8) and column (8). NO_PAGE marks an empty feedback entry.
+struct Page_Id {
+    unsigned int tex = 0, level = 0, x = 0, y = 0;
+
+    uint32_t pack() const {
+        return tex << 20 | level << 16 | y << 8 | x;
+    }
+    static Page_Id unpack(uint32_t id) {
+        return {id >> 20, (id >> 16) & 0xf, id & 0xff, (id >> 8) & 0xff};
+    }
+};
+constexpr uint32_t NO_PAGE = ~0u;
+
+/// Page layout of one texture. Levels are paged down to the first one that fits in a single
+/// page; lookups that want a coarser level clamp to that one.
+struct VT_Texture {
+    unsigned int w = 0, h = 0;
+    unsigned int levels = 0;
+    bool srgb = false;
+    /// Global index of the texture's first page; levels follow each other, rows within a level
+    uint32_t first_page = 0;
+
+    unsigned int level_w(unsigned int level) const {
+        return std::max(w >> level, 1u);
+    }
+    unsigned int level_h(unsigned int level) const {
+        return std::max(h >> level, 1u);
+    }
+    unsigned int pages_x(unsigned int level) const {
+        return (level_w(level) + PAGE_SIZE - 1) / PAGE_SIZE;
+    }
+    unsigned int pages_y(unsigned int level) const {
+        return (level_h(level) + PAGE_SIZE - 1) / PAGE_SIZE;
+    }
+    uint32_t pages() const;
+    /// Global index of page (x, y) of a level
+    uint32_t page(unsigned int level, unsigned int x, unsigned int y) const;
+};
+
+/// Layout of a texture of w x h texels whose pages start at first_page
+VT_Texture vt_texture(unsigned int w, unsigned int h, bool srgb, uint32_t first_page);
+
+/// RGBA8 texels of page (x, y) of a level, borders included, into PAGE_BYTES at out
+void cut_page(Image_Const_View level, unsigned int x, unsigned int y, unsigned char* out);
+
+/// Cuts every texture into pages and writes them to a page file in cache_dir, unless one for the
+/// same texels already exists. Texels are stored as RGBA8, sRGB for sRGB textures; other formats
+/// are converted. Page ids limit a set to 4096 textures of at most 32768 texels a side. Returns
+/// the file's path, empty on failure.
+std::string cook_pages(const std::vector<Image_Const_View>& images, const std::string& cache_dir);
+
+/// A cooked page file: a header, the layout of each texture, then fixed-size pages in global
+/// index order. Pages can be read from several threads at once.
+class Page_File {
+public:
+    Page_File() = default;
+    Page_File(const Page_File&) = delete;
+    Page_File& operator=(const Page_File&) = delete;
+
+    /// False, with a warning, if the file is missing, stale or truncated
+    bool open(const std::string& path);
+
+    const std::vector<VT_Texture>& textures() const {
+        return _textures;
+    }
+    uint32_t pages() const {
+        return _pages;
+    }
+    /// Texture owning a global page index
+    unsigned int texture_of(uint32_t page) const;
+
+    /// PAGE_BYTES of page texels into out
+    bool read(uint32_t page, unsigned char* out) const;
+
+private:
+    std::vector<VT_Texture> _textures;
+    uint32_t _pages = 0;
+    size_t data_offset = 0;
+    std::string path;
+    mutable std::mutex mut;
+    mutable std::ifstream file;
+};
+
+/// Which page each physical slot holds. Slots are handed out least recently used first; pinned
+/// pages and pages used in the current frame are never evicted.
+class Page_Cache {
+public:
+    explicit Page_Cache(unsigned int slots = 0);
+
+    Page_Cache(const Page_Cache&) = delete;
+    Page_Cache& operator=(const Page_Cache&) = delete;
+    Page_Cache(Page_Cache&&) = default;
+    Page_Cache& operator=(Page_Cache&&) = default;
+
+    unsigned int slots() const {
+        return (unsigned int)slot_page.size();
+    }
+    size_t resident() const {
+        return page_slot.size();
+    }
+
+    /// Slot holding a page, or -1
+    int find(uint32_t page) const;
+    /// Marks a resident page used in frame; false if it is not resident
+    bool touch(uint32_t page, uint64_t frame);
+    /// Slot to load a page into, marked used in frame. Evicts the least recently used page,
+    /// stored in evicted (NO_PAGE if the slot was free). -1 if every slot is pinned or in use
+    /// this frame.
+    int insert(uint32_t page, uint64_t frame, bool pinned = false, uint32_t* evicted = nullptr);
+
+private:
+    std::vector<uint32_t> slot_page;
+    std::vector<uint64_t> slot_frame;
+    std::vector<bool> slot_pinned;
+    /// Unpinned slots, most recently used first
+    std::list<unsigned int> lru;
+    std::vector<std::list<unsigned int>::iterator> lru_pos;
+    std::unordered_map<uint32_t, unsigned int> page_slot;
+};
+
+/// Texels of a page read by a Page_Streamer
+struct Loaded_Page {
+    uint32_t page = NO_PAGE;
+    std::vector<unsigned char> texels;
+};
+
+/// Reads pages from a Page_File on background threads
+class Page_Streamer {
+public:
+    explicit Page_Streamer(const Page_File& file, unsigned int threads = 2);
+    ~Page_Streamer();
+
+    Page_Streamer(const Page_Streamer&) = delete;
+    Page_Streamer& operator=(const Page_Streamer&) = delete;
+
+    /// Replaces the queue with these pages, first to be read first. Pages being read or waiting
+    /// to be polled are skipped; pages of earlier requests that were not started are dropped.
+    void request(const std::vector<uint32_t>& pages);
+    /// Up to max pages that finished loading
+    std::vector<Loaded_Page> poll(size_t max);
+    /// Pages queued, being read, or waiting to be polled
+    size_t pending() const;
+    /// Blocks until every queued page has been read
+    void flush();
+
+private:
+    void worker();
+
+    const Page_File& file;
+    mutable std::mutex mut;
+    std::condition_variable cv_work, cv_done;
+    std::deque<uint32_t> queue;
+    std::vector<Loaded_Page> done;
+    /// Queued, being read or done
+    std::unordered_set<uint32_t> in_flight;
+    size_t busy = 0;
+    bool stop = false;
+    std::vector<std::thread> threads;
+};
+
+/// Texels to copy into a slot of one of the two pools: sRGB textures page into pool 0, linear
+/// ones into pool 1
+struct Page_Upload {
+    unsigned int pool = 0, slot = 0;
+    std::vector<unsigned char> texels;
+};
+
+/// Page table, resident caches and streaming for one page file. Each frame, update() takes the
+/// pages the shader asked for and returns the pages to copy into the pools; table() then maps
+/// every page to its slot.
+class Virtual_Textures {
+public:
+    static constexpr uint32_t POOL_BIT = 1u << 31;
+
+    /// Opens a page file with slots pages per pool. The last level of every texture is read right
+    /// away and pinned, so there is always a resident level to fall back to.
+    Virtual_Textures(const std::string& path, unsigned int slots, unsigned int threads = 2);
+
+    Virtual_Textures(const Virtual_Textures&) = delete;
+    Virtual_Textures& operator=(const Virtual_Textures&) = delete;
+
+    bool valid() const {
+        return _valid;
+    }
+    const std::vector<VT_Texture>& textures() const {
+        return file.textures();
+    }
+    unsigned int slots() const {
+        return cache[0].slots();
+    }
+
+    /// One entry per page: 0 if it is not resident, else its slot plus one, with POOL_BIT set for
+    /// the linear pool
+    const std::vector<uint32_t>& table() const {
+        return _table;
+    }
+
+    /// Marks the requested pages, and the coarser pages standing in for them, used this frame and
+    /// queues the missing ones, coarsest first. Returns at most max_uploads pages that finished
+    /// loading; they are already in the table.
+    std::vector<Page_Upload> update(const uint32_t* feedback, size_t n, size_t max_uploads);
+
+    /// Blocks until every requested page has been read
+    void flush() {
+        streamer->flush();
+    }
+
+    struct Stats {
+        size_t requested = 0, missing = 0, uploaded = 0;
+        size_t resident = 0, pending = 0, evicted = 0;
+    };
+    /// Counts for the last update; evicted is the running total
+    const Stats& stats() const {
+        return _stats;
+    }
+
+private:
+    unsigned int pool(uint32_t page) const;
+    bool place(Loaded_Page&& loaded, bool pinned, std::vector<Page_Upload>& uploads);
+
+    Page_File file;
+    Page_Cache cache[2];
+    std::unique_ptr<Page_Streamer> streamer;
+    std::vector<uint32_t> _table;
+    /// Pinned pages read when the file was opened, returned by the first update
+    std::vector<Page_Upload> initial;
+    uint64_t frame = 0;
+    Stats _stats;
+    bool _valid = false;
+};
+
+} // namespace Util
@@ -0,0 +1,194 @@
+
+#include "denoise.h"
+#include <util/files.h>
+
+namespace VK {
+
+static void compute_barrier(VkCommandBuffer& cmds, VkPipelineStageFlags src, VkPipelineStageFlags dst) {
+
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(cmds, src, dst, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+DenoisePipe::~DenoisePipe() {
+    destroy();
+}
+
+DenoisePipe::DenoisePipe(VkExtent2D ext) {
+    recreate(ext);
+}
+
+void DenoisePipe::recreate(VkExtent2D _ext) {
+    ext = _ext;
+    pipe.drop();
+    create_images();
+    create_desc();
+    create_pipe();
+}
+
+void DenoisePipe::destroy() {
+    pipe.drop();
+    for(unsigned int f = 0; f < Manager::MAX_IN_FLIGHT; f++) {
+        for(unsigned int i = 0; i < 2; i++) {
+            ping[f][i].drop();
+            ping_view[f][i].drop();
+        }
+        out[f].drop();
+        out_view[f].drop();
+    }
+}
+
+void DenoisePipe::create_images() {
+
+    auto make = [this](Drop<Image>& img, Drop<ImageView>& view) {
+        img.drop();
+        view.drop();
+        img->recreate(ext.width, ext.height, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_TILING_OPTIMAL,
+                      VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                      VMA_MEMORY_USAGE_GPU_ONLY);
+        img->transition(VK_IMAGE_LAYOUT_GENERAL);
+        view->recreate(img, VK_IMAGE_ASPECT_COLOR_BIT);
+    };
+
+    for(unsigned int f = 0; f < Manager::MAX_IN_FLIGHT; f++) {
+        make(ping[f][0], ping_view[f][0]);
+        make(ping[f][1], ping_view[f][1]);
+        make(out[f], out_view[f]);
+    }
+}
+
+void DenoisePipe::denoise(VkCommandBuffer& cmds, const ImageView& color, const ImageView& moments,
+                          const ImageView& pos, const ImageView& norm, const ImageView& alb,
+                          const Mat4& rays, int history) {
+
+    // Two sets per frame: set 0 filters ping[0] -> ping[1], set 1 filters ping[1] -> ping[0].
+    // Both use this frame's own images, as the previous frame may still be filtering or
+    // presenting from its own.
+    unsigned int frame = vk().frame();
+    unsigned int base = 2 * frame;
+
+    const ImageView* inputs[] = {&color, &moments, &pos, &norm, &alb};
+
+    for(unsigned int s = 0; s < 2; s++) {
+
+        VkDescriptorImageInfo infos[8] = {};
+        for(unsigned int i = 0; i < 5; i++) infos[i].imageView = inputs[i]->view;
+        infos[5].imageView = ping_view[frame][s]->view;
+        infos[6].imageView = ping_view[frame][!s]->view;
+        infos[7].imageView = out_view[frame]->view;
+
+        VkWriteDescriptorSet writes[8] = {};
+        for(unsigned int i = 0; i < 8; i++) {
+            infos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = pipe->descriptor_sets[base + s];
+            writes[i].dstBinding = i;
+            writes[i].dstArrayElement = 0;
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            writes[i].descriptorCount = 1;
+            writes[i].pImageInfo = &infos[i];
+        }
+        vkUpdateDescriptorSets(vk().device(), 8, writes, 0, nullptr);
+    }
+
+    consts.history = history;
+    consts.phi_color = phi_color;
+    consts.phi_normal = phi_normal;
+    consts.phi_pos = phi_pos;
+    consts.rays = rays;
+
+    unsigned int gx = (ext.width + 7) / 8, gy = (ext.height + 7) / 8;
+    int n_iters = std::max(iterations, 1);
+
+    vkCmdBindPipeline(cmds, VK_PIPELINE_BIND_POINT_COMPUTE, pipe->pipe);
+
+    compute_barrier(cmds, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    // iteration -1 demodulates into ping[0]; iteration i then reads ping[i % 2]
+    for(int i = -1; i < n_iters; i++) {
+
+        unsigned int set = base + (i < 0 ? 1 : i % 2);
+        consts.iteration = i;
+        consts.last = i == n_iters - 1;
+
+        vkCmdBindDescriptorSets(cmds, VK_PIPELINE_BIND_POINT_COMPUTE, pipe->p_layout, 0, 1,
+                                &pipe->descriptor_sets[set], 0, nullptr);
+        vkCmdPushConstants(cmds, pipe->p_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(Push_Consts), &consts);
+        vkCmdDispatch(cmds, gx, gy, 1);
+
+        compute_barrier(cmds, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+                            VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR |
+                            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    }
+}
+
+void DenoisePipe::create_desc() {
+
+    VkDescriptorSetLayoutBinding bindings[8] = {};
+    for(unsigned int i = 0; i < 8; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = 8;
+    layout_info.pBindings = bindings;
+
+    VK_CHECK(vkCreateDescriptorSetLayout(vk().device(), &layout_info, nullptr, &pipe->d_layout));
+
+    unsigned int n_sets = 2 * Manager::MAX_IN_FLIGHT;
+    std::vector<VkDescriptorSetLayout> layouts(n_sets, pipe->d_layout);
+
+    VkDescriptorSetAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = vk().pool();
+    alloc_info.descriptorSetCount = n_sets;
+    alloc_info.pSetLayouts = layouts.data();
+
+    pipe->descriptor_sets.resize(n_sets);
+    VK_CHECK(vkAllocateDescriptorSets(vk().device(), &alloc_info, pipe->descriptor_sets.data()));
+}
+
+void DenoisePipe::create_pipe() {
+
+    pipe->destroy_swap();
+
+    Shader comp(File::read("shaders/svgf.comp.spv").value());
+
+    VkPushConstantRange pushes = {};
+    pushes.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushes.size = sizeof(Push_Consts);
+    pushes.offset = 0;
+
+    VkPipelineLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_info.setLayoutCount = 1;
+    layout_info.pSetLayouts = &pipe->d_layout;
+    layout_info.pushConstantRangeCount = 1;
+    layout_info.pPushConstantRanges = &pushes;
+
+    VK_CHECK(vkCreatePipelineLayout(vk().device(), &layout_info, nullptr, &pipe->p_layout));
+
+    VkComputePipelineCreateInfo pipe_info = {};
+    pipe_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipe_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipe_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipe_info.stage.module = comp.shader;
+    pipe_info.stage.pName = "main";
+    pipe_info.layout = pipe->p_layout;
+
+    VK_CHECK(vkCreateComputePipelines(vk().device(), VK_NULL_HANDLE, 1, &pipe_info, nullptr,
+                                      &pipe->pipe));
+}
+
+} // namespace VK
@@ -0,0 +1,68 @@
+
+#pragma once
+
+#include <lib/mathlib.h>
+#include "vulkan.h"
+
+namespace VK {
+
+/// SVGF-style a-trous denoiser over the accumulated RT output, guided by the RT G-buffer
+struct DenoisePipe {
+
+    DenoisePipe() = default;
+    DenoisePipe(VkExtent2D ext);
+    ~DenoisePipe();
+
+    DenoisePipe(const DenoisePipe&) = delete;
+    DenoisePipe(DenoisePipe&& src) = default;
+    DenoisePipe& operator=(const DenoisePipe&) = delete;
+    DenoisePipe& operator=(DenoisePipe&& src) = default;
+
+    void recreate(VkExtent2D ext);
+    void destroy();
+
+    /// All inputs are in the GENERAL layout: color and moments RGBA32F, pos/norm/alb the packed
+    /// RT G-buffer, whose positions are rebuilt with rays (RTPipe::gbuf_rays). The result is
+    /// left in output(), also in GENERAL. Each frame in flight filters through its own images,
+    /// so one frame's passes never overwrite what the previous frame is still reading.
+    void denoise(VkCommandBuffer& cmds, const ImageView& color, const ImageView& moments,
+                 const ImageView& pos, const ImageView& norm, const ImageView& alb,
+                 const Mat4& rays, int history);
+
+    /// The current frame's result
+    ImageView& output() {
+        return out_view[vk().frame()];
+    }
+    Image& output_image() {
+        return out[vk().frame()];
+    }
+
+    int iterations = 5;
+    float phi_color = 4.0f;
+    float phi_normal = 128.0f;
+    float phi_pos = 0.5f;
+
+private:
+    struct Push_Consts {
+        int iteration;
+        int last;
+        int history;
+        float phi_color;
+        float phi_normal;
+        float phi_pos;
+        alignas(16) Mat4 rays;
+    };
+
+    Push_Consts consts;
+    Drop<PipeData> pipe;
+
+    VkExtent2D ext = {};
+    Drop<Image> ping[Manager::MAX_IN_FLIGHT][2], out[Manager::MAX_IN_FLIGHT];
+    Drop<ImageView> ping_view[Manager::MAX_IN_FLIGHT][2], out_view[Manager::MAX_IN_FLIGHT];
+
+    void create_images();
+    void create_desc();
+    void create_pipe();
+};
+
+} // namespace VK
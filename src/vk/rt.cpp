@@ -1,6 +1,10 @@
 
 #include "rt.h"
+#include <util/bc.h>
+#include <util/blue_noise.h>
 #include <util/files.h>
+#include <util/mipmap.h>
+#include <util/texture_budget.h>
 #include <scene/scene.h>
 
 namespace VK {
@@ -16,6 +20,8 @@ RTPipe::RTPipe(const Scene& scene) {
 void RTPipe::recreate(const Scene& scene) {
     pipe.drop();
     build_textures(scene);
+    build_env(scene);
+    build_noise();
     create_desc(scene);
     build_desc(scene);
     create_pipe();
@@ -125,12 +131,27 @@ void RTPipe::update_uniforms(const Camera& cam) {
     ubo.camera.P = cam.get_proj();
     ubo.camera.iV = ubo.camera.V.inverse();
     ubo.camera.iP = ubo.camera.P.inverse();
+    ubo.prev_camera = old_cam;
     ubo.restir.new_samples = res_samples;
     ubo.restir.prev_PV = old_cam.P * old_cam.V;
     ubo.restir.temporal_multiplier = temporal_scale;
-
-    if(consts.frame >= 0 && std::memcmp(&ubo.camera, &old_cam, sizeof(CameraConstants))) {
-        reset_frame();
+    ubo.restir.spatial_samples = use_spatial ? spatial_samples : 0;
+    ubo.restir.spatial_radius = spatial_radius;
+    ubo.restir.spatial_bias = spatial_bias;
+
+    // With reprojection on, camera motion only restarts the convergence count; the shader
+    // carries each pixel's history over through prev_PV instead of discarding it. old_cam always
+    // follows the camera, since the packed G-buffer also needs it to rebuild positions.
+    consts.reproject = 0;
+    if(std::memcmp(&ubo.camera, &old_cam, sizeof(CameraConstants))) {
+        if(consts.frame >= 0) {
+            if(use_reproject) {
+                consts.reproject = 1;
+                still_frames = 0;
+            } else {
+                reset_frame();
+            }
+        }
         old_cam = ubo.camera;
     }
 
@@ -180,8 +201,14 @@ void RTPipe::resize_temporal_stuff() {
     res0.drop();
     res1.drop();
 
-    res0->recreate(sizeof(Reservoir) * prev_ext.width * prev_ext.height, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
-    res1->recreate(sizeof(Reservoir) * prev_ext.width * prev_ext.height, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    res0->recreate(sizeof(Pack::Packed_Reservoir) * prev_ext.width * prev_ext.height, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    res1->recreate(sizeof(Pack::Packed_Reservoir) * prev_ext.width * prev_ext.height, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+
+    gi_res0.drop();
+    gi_res1.drop();
+
+    gi_res0->recreate(sizeof(Pack::Packed_GI_Reservoir) * prev_ext.width * prev_ext.height, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    gi_res1->recreate(sizeof(Pack::Packed_GI_Reservoir) * prev_ext.width * prev_ext.height, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
 
     pos_image[0].drop();
     pos_image[1].drop();
@@ -190,12 +217,12 @@ void RTPipe::resize_temporal_stuff() {
     alb_image[0].drop();
     alb_image[1].drop();
 
-    pos_image[0]->recreate(prev_ext.width, prev_ext.height, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
-    pos_image[1]->recreate(prev_ext.width, prev_ext.height, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
-    norm_image[0]->recreate(prev_ext.width, prev_ext.height, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
-    norm_image[1]->recreate(prev_ext.width, prev_ext.height, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
-    alb_image[0]->recreate(prev_ext.width, prev_ext.height, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
-    alb_image[1]->recreate(prev_ext.width, prev_ext.height, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    pos_image[0]->recreate(prev_ext.width, prev_ext.height, VK_FORMAT_R32_UINT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    pos_image[1]->recreate(prev_ext.width, prev_ext.height, VK_FORMAT_R32_UINT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    norm_image[0]->recreate(prev_ext.width, prev_ext.height, VK_FORMAT_R32_UINT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    norm_image[1]->recreate(prev_ext.width, prev_ext.height, VK_FORMAT_R32_UINT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    alb_image[0]->recreate(prev_ext.width, prev_ext.height, VK_FORMAT_R32_UINT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    alb_image[1]->recreate(prev_ext.width, prev_ext.height, VK_FORMAT_R32_UINT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
 
     pos_image_view[0].drop();
     pos_image_view[1].drop();
@@ -211,17 +238,39 @@ void RTPipe::resize_temporal_stuff() {
     alb_image_view[0]->recreate(alb_image[0], VK_IMAGE_ASPECT_COLOR_BIT);
     alb_image_view[1]->recreate(alb_image[1], VK_IMAGE_ASPECT_COLOR_BIT);
 
+    // Both halves stay in GENERAL: last frame's half is read with imageLoad
+    for(unsigned int i = 0; i < 2; i++) {
+        accum_image[i].drop();
+        accum_image_view[i].drop();
+        moments_image[i].drop();
+        moments_image_view[i].drop();
+
+        accum_image[i]->recreate(prev_ext.width, prev_ext.height, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+        moments_image[i]->recreate(prev_ext.width, prev_ext.height, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+        accum_image_view[i]->recreate(accum_image[i], VK_IMAGE_ASPECT_COLOR_BIT);
+        moments_image_view[i]->recreate(moments_image[i], VK_IMAGE_ASPECT_COLOR_BIT);
+        accum_image[i]->transition(VK_IMAGE_LAYOUT_GENERAL);
+        moments_image[i]->transition(VK_IMAGE_LAYOUT_GENERAL);
+    }
+
     pos_image[0]->transition(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     norm_image[0]->transition(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     alb_image[0]->transition(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     pos_image[1]->transition(VK_IMAGE_LAYOUT_GENERAL);
     norm_image[1]->transition(VK_IMAGE_LAYOUT_GENERAL);
     alb_image[1]->transition(VK_IMAGE_LAYOUT_GENERAL);
+
+    // The first trace writes half 1, matching the layouts above
+    last_gbuf = 0;
+    reset_frame();
 }
 
 void RTPipe::bind_temporal_stuff(VkCommandBuffer cmds) {
 
-    bool even = vk().frame() % 2;
+    // Flip relative to the last trace rather than the frame index, so frames skipped once
+    // converged never leave the 'previous' half stale
+    bool even = last_gbuf == 0;
+    last_gbuf = even;
 
     VkDescriptorBufferInfo res_b = {};
     res_b.buffer = even ? res0->buf : res1->buf;
@@ -332,7 +381,46 @@ void RTPipe::bind_temporal_stuff(VkCommandBuffer cmds) {
     palb_write.descriptorCount = 1;
     palb_write.pImageInfo = &palb_info;
 
-    std::vector<VkWriteDescriptorSet> writes = {res_w, prev_res_w, pos_write, norm_write, alb_write, ppos_write, pnorm_write, palb_write};
+    // 19: moments, 20: accumulation, 21: previous moments, 22: previous accumulation
+    VkDescriptorImageInfo history_info[4] = {};
+    history_info[0].imageView = moments_image_view[even]->view;
+    history_info[1].imageView = accum_image_view[even]->view;
+    history_info[2].imageView = moments_image_view[!even]->view;
+    history_info[3].imageView = accum_image_view[!even]->view;
+
+    VkWriteDescriptorSet history_writes[4] = {};
+    for(unsigned int i = 0; i < 4; i++) {
+        history_info[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        history_writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        history_writes[i].dstSet = pipe->descriptor_sets[vk().frame()];
+        history_writes[i].dstBinding = 19 + i;
+        history_writes[i].dstArrayElement = 0;
+        history_writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        history_writes[i].descriptorCount = 1;
+        history_writes[i].pImageInfo = &history_info[i];
+    }
+
+    // 23: ReSTIR GI reservoirs, 24: last frame's
+    VkDescriptorBufferInfo gi_res_b[2] = {};
+    gi_res_b[0].buffer = even ? gi_res0->buf : gi_res1->buf;
+    gi_res_b[1].buffer = even ? gi_res1->buf : gi_res0->buf;
+
+    VkWriteDescriptorSet gi_res_writes[2] = {};
+    for(unsigned int i = 0; i < 2; i++) {
+        gi_res_b[i].offset = 0;
+        gi_res_b[i].range = VK_WHOLE_SIZE;
+        gi_res_writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        gi_res_writes[i].dstSet = pipe->descriptor_sets[vk().frame()];
+        gi_res_writes[i].dstBinding = 23 + i;
+        gi_res_writes[i].dstArrayElement = 0;
+        gi_res_writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        gi_res_writes[i].descriptorCount = 1;
+        gi_res_writes[i].pBufferInfo = &gi_res_b[i];
+    }
+
+    std::vector<VkWriteDescriptorSet> writes = {res_w, prev_res_w, pos_write, norm_write, alb_write, ppos_write, pnorm_write, palb_write,
+                                                history_writes[0], history_writes[1], history_writes[2], history_writes[3],
+                                                gi_res_writes[0], gi_res_writes[1]};
     vkUpdateDescriptorSets(vk().device(), writes.size(), writes.data(), 0, nullptr);
 
     pos_image[even]->transition(cmds, VK_IMAGE_LAYOUT_GENERAL);
@@ -350,7 +438,9 @@ bool RTPipe::trace(const Camera& cam, VkCommandBuffer& cmds, VkExtent2D ext) {
         resize_temporal_stuff();
     }
 
-    if(consts.frame >= max_frames) return false;
+    if(still_frames >= max_frames) return false;
+
+    if(vt) stream_pages(cmds);
 
     consts.clear_col = Vec4{clear, 1.0f};
     consts.env_light = Vec4{env_scale * env, 1.0f};
@@ -363,12 +453,25 @@ bool RTPipe::trace(const Camera& cam, VkCommandBuffer& cmds, VkExtent2D ext) {
     consts.use_rr = use_rr;
     consts.max_frame = max_frames;
     consts.qmc = use_qmc;
+    consts.use_blue_noise = use_blue_noise;
+    consts.use_ray_cones = use_ray_cones;
+    consts.use_virtual_textures = vt != nullptr;
     consts.use_temporal = use_temporal;
     consts.debug_view = debug_view;
+    consts.max_history = max_history;
     consts.frame++;
+    still_frames++;
 
     bind_temporal_stuff(cmds);
 
+    // Last frame's accumulation and moments stay in GENERAL, so no layout transition orders them
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmds, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
     vkCmdBindPipeline(cmds, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, pipe->pipe);
     vkCmdBindDescriptorSets(cmds, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, pipe->p_layout, 0, 1,
                             &pipe->descriptor_sets[vk().frame()], 0, nullptr);
@@ -390,16 +493,39 @@ bool RTPipe::trace(const Camera& cam, VkCommandBuffer& cmds, VkExtent2D ext) {
 
     vk().rtx.vkCmdTraceRaysKHR(cmds, &addrs[0], &addrs[1], &addrs[2], &addrs[3], ext.width,
                                ext.height, 1);
+
+    // Spatial reuse reads every pixel's reservoir and G-buffer from the pass above, then shades
+    // and accumulates. Same layout and descriptors, only the raygen record differs.
+    if(use_spatial && integrator >= 3) {
+
+        vkCmdPipelineBarrier(cmds, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+                             VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &barrier, 0,
+                             nullptr, 0, nullptr);
+
+        Stride spatial = {sbt_addr + 3u * groupSize, groupStride, groupSize};
+        vk().rtx.vkCmdTraceRaysKHR(cmds, &spatial, &addrs[1], &addrs[2], &addrs[3], ext.width,
+                                   ext.height, 1);
+    }
+
+    if(vt) {
+        VkMemoryBarrier feedback = {};
+        feedback.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        feedback.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        feedback.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(cmds, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+                             VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &feedback, 0, nullptr, 0, nullptr);
+    }
     return true;
 }
 
 void RTPipe::reset_frame() {
     consts.frame = -1;
+    still_frames = 0;
 }
 
 void RTPipe::create_sbt() {
 
-    unsigned int shader_count = 3;
+    unsigned int shader_count = 4;
     unsigned int groupHandleSize = vk().rtx.properties.shaderGroupHandleSize;
     unsigned int groupSizeAligned =
         align_up(groupHandleSize, vk().rtx.properties.shaderGroupBaseAlignment);
@@ -430,24 +556,411 @@ void RTPipe::create_sbt() {
 void RTPipe::build_textures(const Scene& scene) {
 
     const auto& images = scene.images();
+    const auto& bc_images = scene.bc_images();
     textures.clear();
     texture_views.clear();
-
-    for(const auto& image : images) {
-        auto [w,h] = image.dim();
-        
-        VK::Image img(w, h, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
-        img.write(image);
-
-        textures.push_back(std::move(img));
-        texture_views.push_back(VK::ImageView(textures.back(), VK_IMAGE_ASPECT_COLOR_BIT));
-    }
+    vt.reset();
 
     texture_sampler.drop();
     texture_sampler->recreate(VK_FILTER_LINEAR, VK_FILTER_LINEAR);
 
     gbuf_sampler.drop();
     gbuf_sampler->recreate(VK_FILTER_NEAREST, VK_FILTER_NEAREST);
+
+    // How a texture is sampled picks its block format. Normal and metal/rough maps hold linear
+    // data, whatever format the loader gave them; unreferenced textures count as color.
+    // The budget weighs each texture by the world-space area of the surfaces using it.
+    enum class Use { color, normal, data, none };
+    std::vector<Use> uses(images.size(), Use::none);
+    std::vector<float> area(images.size(), 0.0f);
+    scene.for_objs([&](const Object& obj) {
+        Mat4 model = Mat4::scale(Vec3{scene.scale}) * obj.pose.transform();
+        const auto& verts = obj.mesh().verts();
+        const auto& inds = obj.mesh().inds();
+        float a = 0.0f;
+        for(size_t i = 0; i + 2 < inds.size(); i += 3) {
+            Vec3 p0 = model * verts[inds[i]].pos.xyz(), p1 = model * verts[inds[i + 1]].pos.xyz(),
+                 p2 = model * verts[inds[i + 2]].pos.xyz();
+            a += 0.5f * cross(p1 - p0, p2 - p0).norm();
+        }
+        auto mark = [&](int tex, Use use) {
+            if(tex < 0 || tex >= (int)images.size()) return;
+            uses[tex] = std::min(uses[tex], use);
+            area[tex] += a;
+        };
+        mark(obj.material.albedo_tex, Use::color);
+        mark(obj.material.emissive_tex, Use::color);
+        mark(obj.material.normal_tex, Use::normal);
+        mark(obj.material.metal_rough_tex, Use::data);
+    });
+    for(Use& use : uses) {
+        if(use == Use::none) use = Use::color;
+    }
+
+    // Textures loaded as blocks are uploaded as they are, except for virtual textures, which page
+    // RGBA8 texels, and on devices without BC support. There their base level is decoded.
+    bool use_bc = vk().supports_bc();
+    std::vector<Util::Image> unpacked(images.size());
+    for(size_t i = 0; i < images.size(); i++) {
+        const Util::BC_File& file = bc_images[i];
+        if(file.levels.empty() || (use_bc && !use_virtual_textures)) continue;
+        unpacked[i] = Util::bc_decompress(file.levels[0], file.format, uses[i] == Use::color);
+    }
+    auto base_view = [&](size_t i) {
+        return unpacked[i].bytes() ? unpacked[i].view() : images[i].view();
+    };
+
+    if(use_virtual_textures) {
+        std::vector<Util::Image_Const_View> views(images.size());
+        for(size_t i = 0; i < images.size(); i++) {
+            views[i] = base_view(i);
+            if(uses[i] != Use::color && views[i].format == Util::Image_Format::rgba8_srgb)
+                views[i].format = Util::Image_Format::rgba8;
+        }
+        size_t hdr = std::count_if(views.begin(), views.end(), [](const auto& view) {
+            return view.format == Util::Image_Format::rgba16f ||
+                   view.format == Util::Image_Format::rgba32f;
+        });
+        if(hdr) warn("Virtual textures page RGBA8 texels; %zu HDR textures are clamped", hdr);
+        std::string path = Util::cook_pages(views, "texture_cache");
+        if(!path.empty()) {
+            unsigned int slots = (unsigned int)std::max(vt_pages, 1);
+            vt = std::make_unique<Util::Virtual_Textures>(path, slots);
+        }
+        if(vt && vt->valid()) {
+            build_virtual();
+            return;
+        }
+        warn("Virtual textures unavailable, uploading whole textures");
+        vt.reset();
+    }
+
+    // Blocks to upload for each texture, encoded here or straight from its file
+    struct BC_Source {
+        Util::BC_Format format = Util::BC_Format::bc7;
+        bool srgb = false;
+        std::vector<Util::BC_Level_View> levels;
+    };
+    std::vector<Util::Image_Const_View> bases(images.size());
+    std::vector<Util::BC_Texture> compressed(images.size());
+    std::vector<BC_Source> blocks(images.size());
+    std::vector<Util::Image_Const_View> plain;
+    std::vector<size_t> plain_idx;
+    size_t raw_bytes = 0, bc_bytes = 0, n_encoded = 0, n_loaded = 0;
+
+    for(size_t i = 0; i < images.size(); i++) {
+        const Util::BC_File& file = bc_images[i];
+        if(use_bc && !file.levels.empty()) {
+            // The use decides sRGB here too; legacy DDS files cannot say
+            bool color = file.format == Util::BC_Format::bc1 ||
+                         file.format == Util::BC_Format::bc7;
+            blocks[i] = {file.format, color && uses[i] == Use::color, file.levels};
+            n_loaded++;
+            continue;
+        }
+
+        bases[i] = base_view(i);
+        bool ldr = bases[i].format == Util::Image_Format::rgba8 ||
+                   bases[i].format == Util::Image_Format::rgba8_srgb;
+        if(ldr && uses[i] != Use::color) bases[i].format = Util::Image_Format::rgba8;
+
+        if(use_bc && ldr) {
+            Util::BC_Format fmt = uses[i] == Use::normal ? Util::BC_Format::bc5
+                                  : uses[i] == Use::data ? Util::BC_Format::bc1
+                                                         : Util::BC_Format::bc7;
+            compressed[i] = Util::bc_texture(bases[i], fmt, "texture_cache");
+            blocks[i].format = compressed[i].format;
+            blocks[i].srgb = compressed[i].srgb;
+            for(const auto& level : compressed[i].levels) blocks[i].levels.push_back(level.view());
+            raw_bytes += bases[i].bytes() * 4 / 3;
+            bc_bytes += compressed[i].bytes();
+            n_encoded++;
+        } else {
+            plain.push_back(bases[i]);
+            plain_idx.push_back(i);
+        }
+    }
+    if(bc_bytes) {
+        info("Block-compressed %zu textures: %zu MB -> %zu MB", n_encoded, raw_bytes >> 20,
+             bc_bytes >> 20);
+    }
+    if(n_loaded) info("Uploading %zu precompressed textures as stored", n_loaded);
+
+    std::vector<std::vector<Util::Image>> mips(images.size());
+    std::vector<std::vector<Util::Image>> plain_mips = Util::build_mips(plain);
+    for(size_t j = 0; j < plain.size(); j++) mips[plain_idx[j]] = std::move(plain_mips[j]);
+
+    // Levels above first[i] stay on the CPU when the textures do not fit the budget
+    std::vector<Util::Budget_Item> items(images.size());
+    for(size_t i = 0; i < images.size(); i++) {
+        items[i].weight = area[i];
+        if(blocks[i].levels.empty()) {
+            items[i].level_bytes.push_back(bases[i].bytes());
+            for(const auto& level : mips[i]) items[i].level_bytes.push_back(level.bytes());
+        } else {
+            for(const auto& level : blocks[i].levels) items[i].level_bytes.push_back(level.size);
+        }
+    }
+    Util::Budget_Fit fit = Util::fit_budget(items, (size_t)std::max(texture_budget, 0) << 20);
+    texture_bytes = fit.bytes;
+    texture_full_bytes = fit.full_bytes;
+    if(fit.bytes < fit.full_bytes) {
+        info("Texture budget: %zu MB -> %zu MB resident", fit.full_bytes >> 20, fit.bytes >> 20);
+    }
+
+    // Views keep a pointer to their image, so the vector must not grow after they are made
+    textures.reserve(images.size());
+    std::vector<VK::Image_Upload> uploads;
+
+    for(size_t i = 0; i < images.size(); i++) {
+        const BC_Source& bc = blocks[i];
+        unsigned int first = fit.first_level[i];
+
+        VkFormat format = bc.levels.empty() ? VK::vk_format(bases[i].format) : VK::vk_format(bc.format, bc.srgb);
+        unsigned int levels = (unsigned int)items[i].level_bytes.size() - first;
+        unsigned int w, h;
+        if(!bc.levels.empty()) {
+            w = bc.levels[first].w, h = bc.levels[first].h;
+        } else if(first) {
+            w = mips[i][first - 1].w(), h = mips[i][first - 1].h();
+        } else {
+            w = bases[i].w, h = bases[i].h;
+        }
+
+        VK::Image img(w, h, format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY, levels);
+        textures.push_back(std::move(img));
+
+        VK::Image_Upload& up = uploads.emplace_back();
+        up.image = &(VK::Image&)textures.back();
+        if(bc.levels.empty()) {
+            if(!first) up.levels.push_back(bases[i]);
+            for(size_t l = first ? first - 1 : 0; l < mips[i].size(); l++) {
+                up.levels.push_back(mips[i][l].view());
+            }
+        } else {
+            up.blocks.assign(bc.levels.begin() + first, bc.levels.end());
+        }
+    }
+
+    // One staging buffer and one submit for every level of every texture
+    VK::write_images(uploads);
+
+    for(auto& tex : textures) texture_views.push_back(VK::ImageView(tex, VK_IMAGE_ASPECT_COLOR_BIT));
+
+    build_virtual();
+}
+
+void RTPipe::build_virtual() {
+
+    struct VT_Desc {
+        unsigned int w, h, levels, first_page;
+    };
+
+    // Without vt the bindings still need buffers, so they get the smallest ones
+    size_t pages = vt ? vt->table().size() : 0;
+    std::vector<VT_Desc> descs;
+    if(vt) {
+        for(const Util::VT_Texture& tex : vt->textures())
+            descs.push_back({tex.w, tex.h, tex.levels, tex.first_page});
+    }
+    if(descs.empty()) descs.push_back({});
+
+    vt_descs.drop();
+    vt_descs->recreate(descs.size() * sizeof(VT_Desc),
+                       VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                       VMA_MEMORY_USAGE_GPU_ONLY);
+    vt_descs->write_staged(descs.data(), descs.size() * sizeof(VT_Desc));
+
+    std::vector<uint32_t> no_pages(vt ? VT_FEEDBACK : 1, Util::NO_PAGE);
+    vt_staged = (size_t)std::max(vt_uploads, 1);
+    vt_tables.clear();
+    vt_feedback.clear();
+    vt_staging.clear();
+    vt_tables.resize(Manager::MAX_IN_FLIGHT);
+    vt_feedback.resize(Manager::MAX_IN_FLIGHT);
+    vt_staging.resize(Manager::MAX_IN_FLIGHT);
+    for(unsigned int i = 0; i < Manager::MAX_IN_FLIGHT; i++) {
+        vt_tables[i]->recreate(std::max(pages, size_t(1)) * sizeof(uint32_t),
+                               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+        vt_feedback[i]->recreate(
+            no_pages.size() * sizeof(uint32_t),
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VMA_MEMORY_USAGE_GPU_TO_CPU);
+        vt_feedback[i]->write(no_pages.data(), no_pages.size() * sizeof(uint32_t));
+        if(vt) {
+            vt_staging[i]->recreate(vt_staged * Util::PAGE_BYTES, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                    VMA_MEMORY_USAGE_CPU_ONLY);
+        }
+    }
+    if(!vt) return;
+
+    // Two square pools of slots: sRGB for color, linear for normal and metal/rough maps
+    unsigned int side = (unsigned int)std::ceil(std::sqrt((float)vt->slots())) * Util::PAGE_SLOT;
+    for(VkFormat format : {VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_R8G8B8A8_UNORM}) {
+        VK::Image img(side, side, format, VK_IMAGE_TILING_OPTIMAL,
+                      VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                      VMA_MEMORY_USAGE_GPU_ONLY);
+        img.transition(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        textures.push_back(std::move(img));
+    }
+    for(auto& tex : textures) texture_views.push_back(VK::ImageView(tex, VK_IMAGE_ASPECT_COLOR_BIT));
+
+    texture_bytes = (size_t)side * side * 4 * 2;
+    texture_full_bytes = pages * Util::PAGE_BYTES;
+
+    // The pinned last level of every texture, so the first frame has something to fall back to
+    std::vector<Util::Page_Upload> pinned = vt->update(nullptr, 0, 0);
+    Buffer staging(std::max(pinned.size(), size_t(1)) * Util::PAGE_BYTES,
+                   VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+    VkCommandBuffer cmds = vk().begin_one_time();
+    upload_pages(cmds, pinned, staging);
+    vk().end_one_time(cmds);
+
+    info("Virtual textures: %zu pages of %zu textures, %u resident per pool", pages,
+         vt->textures().size(), vt->slots());
+}
+
+void RTPipe::upload_pages(VkCommandBuffer cmds, const std::vector<Util::Page_Upload>& pages,
+                          const Buffer& staging) {
+
+    if(pages.empty()) return;
+
+    unsigned char* data = (unsigned char*)staging.map();
+    std::vector<VkBufferImageCopy> copies[2];
+    for(size_t i = 0; i < pages.size(); i++) {
+        const Util::Page_Upload& page = pages[i];
+        std::memcpy(data + i * Util::PAGE_BYTES, page.texels.data(), Util::PAGE_BYTES);
+
+        unsigned int slots_x = textures[page.pool]->w / Util::PAGE_SLOT;
+        VkBufferImageCopy copy = {};
+        copy.bufferOffset = i * Util::PAGE_BYTES;
+        copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        copy.imageSubresource.layerCount = 1;
+        copy.imageOffset = {(int)(page.slot % slots_x * Util::PAGE_SLOT),
+                            (int)(page.slot / slots_x * Util::PAGE_SLOT), 0};
+        copy.imageExtent = {Util::PAGE_SLOT, Util::PAGE_SLOT, 1};
+        copies[page.pool].push_back(copy);
+    }
+    staging.unmap();
+
+    // The pools stay in SHADER_READ_ONLY between frames. Image::transition only waits on
+    // fragment shaders, so the barriers around the copies are spelled out for ray tracing.
+    for(unsigned int pool = 0; pool < 2; pool++) {
+        if(copies[pool].empty()) continue;
+
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = textures[pool]->img;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(cmds, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                             &barrier);
+
+        vkCmdCopyBufferToImage(cmds, staging.buf, textures[pool]->img,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               (uint32_t)copies[pool].size(), copies[pool].data());
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(cmds, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 0, nullptr, 0,
+                             nullptr, 1, &barrier);
+    }
+}
+
+void RTPipe::stream_pages(VkCommandBuffer cmds) {
+
+    unsigned int frame = vk().frame();
+
+    // This frame's buffers were last used MAX_IN_FLIGHT frames ago, and that trace has finished
+    std::vector<uint32_t> feedback(VT_FEEDBACK);
+    vt_feedback[frame]->read(feedback.data(), feedback.size() * sizeof(uint32_t));
+
+    size_t max_uploads = std::min((size_t)std::max(vt_uploads, 1), vt_staged);
+    std::vector<Util::Page_Upload> pages =
+        vt->update(feedback.data(), feedback.size(), max_uploads);
+    vt_tables[frame]->write(vt->table().data(), vt->table().size() * sizeof(uint32_t));
+    upload_pages(cmds, pages, vt_staging[frame]);
+
+    vkCmdFillBuffer(cmds, vt_feedback[frame]->buf, 0, VK_WHOLE_SIZE, Util::NO_PAGE);
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmds, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &barrier, 0, nullptr,
+                         0, nullptr);
+
+    // The accumulated frames sampled coarser levels where the new pages land. Rather than drop
+    // that history, clamp it like a moving view does (reprojecting onto the same pixels), so the
+    // pages blend in over max_history frames and the still view converges again from there.
+    if(!pages.empty() && consts.frame >= 0) {
+        if(use_reproject) {
+            consts.reproject = 1;
+            still_frames = 0;
+        } else {
+            reset_frame();
+        }
+    }
+}
+
+void RTPipe::build_env(const Scene& scene) {
+
+    const Env_Map& env_map = scene.env_map();
+
+    env_image.drop();
+    env_view.drop();
+    env_buf.drop();
+
+    consts.use_env_map = !env_map.empty();
+    if(env_map.empty()) return;
+
+    env_image->recreate(env_map.w(), env_map.h(), VK_FORMAT_R32G32B32A32_SFLOAT,
+                        VK_IMAGE_TILING_OPTIMAL,
+                        VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                        VMA_MEMORY_USAGE_GPU_ONLY);
+    env_image->write(env_map.data().data(), env_map.data().size() * sizeof(float));
+    env_view->recreate(env_image, VK_IMAGE_ASPECT_COLOR_BIT);
+
+    // Header matches EnvDist in raygen.glsl: w, h, marginal integral, padding
+    std::vector<float> dist = env_map.dist().pack();
+    struct {
+        unsigned int w, h;
+        float integral, pad;
+    } header = {env_map.w(), env_map.h(), env_map.dist().marginal.integral, 0.0f};
+
+    VkDeviceSize size = sizeof(header) + dist.size() * sizeof(float);
+    std::vector<unsigned char> data(size);
+    std::memcpy(data.data(), &header, sizeof(header));
+    std::memcpy(data.data() + sizeof(header), dist.data(), dist.size() * sizeof(float));
+
+    env_buf->recreate(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                      VMA_MEMORY_USAGE_GPU_ONLY);
+    env_buf->write_staged(data.data(), size);
+}
+
+void RTPipe::build_noise() {
+
+    // Scene independent, so only built once
+    if(noise_view->view) return;
+
+    constexpr unsigned int size = 64;
+    std::vector<uint16_t> mask = Util::blue_noise(size, "texture_cache");
+
+    noise_image->recreate(size, size, VK_FORMAT_R16G16B16A16_UNORM, VK_IMAGE_TILING_OPTIMAL,
+                          VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                          VMA_MEMORY_USAGE_GPU_ONLY);
+    noise_image->write(mask.data(), mask.size() * sizeof(uint16_t));
+    noise_view->recreate(noise_image, VK_IMAGE_ASPECT_COLOR_BIT);
 }
 
 void RTPipe::create_pipe() {
@@ -457,8 +970,9 @@ void RTPipe::create_pipe() {
     Shader chit(File::read("shaders/rt/rt.rchit.spv").value());
     Shader miss(File::read("shaders/rt/rt.rmiss.spv").value());
     Shader gen(File::read("shaders/rt/rt.rgen.spv").value());
+    Shader spatial(File::read("shaders/rt/restir_spatial.rgen.spv").value());
 
-    VkRayTracingShaderGroupCreateInfoKHR groups[3] = {};
+    VkRayTracingShaderGroupCreateInfoKHR groups[4] = {};
 
     groups[0].sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
     groups[0].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
@@ -481,7 +995,14 @@ void RTPipe::create_pipe() {
     groups[2].closestHitShader = 2;
     groups[2].generalShader = VK_SHADER_UNUSED_KHR;
 
-    VkPipelineShaderStageCreateInfo stage_info[3] = {};
+    groups[3].sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
+    groups[3].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
+    groups[3].intersectionShader = VK_SHADER_UNUSED_KHR;
+    groups[3].anyHitShader = VK_SHADER_UNUSED_KHR;
+    groups[3].closestHitShader = VK_SHADER_UNUSED_KHR;
+    groups[3].generalShader = 3;
+
+    VkPipelineShaderStageCreateInfo stage_info[4] = {};
 
     stage_info[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     stage_info[0].stage = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
@@ -498,6 +1019,11 @@ void RTPipe::create_pipe() {
     stage_info[2].module = chit.shader;
     stage_info[2].pName = "main";
 
+    stage_info[3].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stage_info[3].stage = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+    stage_info[3].module = spatial.shader;
+    stage_info[3].pName = "main";
+
     VkPushConstantRange pushes = {};
     pushes.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR |
                         VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
@@ -515,9 +1041,9 @@ void RTPipe::create_pipe() {
 
     VkRayTracingPipelineCreateInfoKHR rayPipelineInfo = {};
     rayPipelineInfo.sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR;
-    rayPipelineInfo.stageCount = 3;
+    rayPipelineInfo.stageCount = 4;
     rayPipelineInfo.pStages = stage_info;
-    rayPipelineInfo.groupCount = 3;
+    rayPipelineInfo.groupCount = 4;
     rayPipelineInfo.pGroups = groups;
     rayPipelineInfo.maxPipelineRayRecursionDepth = 1;
     rayPipelineInfo.layout = pipe->p_layout;
@@ -626,7 +1152,55 @@ void RTPipe::create_desc(const Scene& scene) {
     read_alb_bind.descriptorCount = 1;
     read_alb_bind.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
 
-    std::vector<VkDescriptorSetLayoutBinding> bindings = {ubo_bind, d_bind, l_bind, v_bind, i_bind, t_bind, a_bind, store_bind, res_bind, prev_res_bind, store_pos_bind, store_norm_bind, store_alb_bind, read_pos_bind, read_norm_bind, read_alb_bind};
+    VkDescriptorSetLayoutBinding env_bind = {};
+    env_bind.binding = 16;
+    env_bind.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    env_bind.descriptorCount = 1;
+    env_bind.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+
+    VkDescriptorSetLayoutBinding env_dist_bind = {};
+    env_dist_bind.binding = 17;
+    env_dist_bind.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    env_dist_bind.descriptorCount = 1;
+    env_dist_bind.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+
+    VkDescriptorSetLayoutBinding noise_bind = {};
+    noise_bind.binding = 18;
+    noise_bind.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    noise_bind.descriptorCount = 1;
+    noise_bind.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings = {ubo_bind, d_bind, l_bind, v_bind, i_bind, t_bind, a_bind, store_bind, res_bind, prev_res_bind, store_pos_bind, store_norm_bind, store_alb_bind, read_pos_bind, read_norm_bind, read_alb_bind, env_bind, env_dist_bind, noise_bind};
+
+    // Moments, accumulation, and last frame's moments and accumulation
+    for(unsigned int i = 0; i < 4; i++) {
+        VkDescriptorSetLayoutBinding history_bind = {};
+        history_bind.binding = 19 + i;
+        history_bind.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        history_bind.descriptorCount = 1;
+        history_bind.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+        bindings.push_back(history_bind);
+    }
+
+    // ReSTIR GI reservoirs and last frame's
+    for(unsigned int i = 0; i < 2; i++) {
+        VkDescriptorSetLayoutBinding gi_res_bind = {};
+        gi_res_bind.binding = 23 + i;
+        gi_res_bind.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        gi_res_bind.descriptorCount = 1;
+        gi_res_bind.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+        bindings.push_back(gi_res_bind);
+    }
+
+    // Virtual texture page table, feedback, and texture layouts
+    for(unsigned int i = 0; i < 3; i++) {
+        VkDescriptorSetLayoutBinding vt_bind = {};
+        vt_bind.binding = 25 + i;
+        vt_bind.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        vt_bind.descriptorCount = 1;
+        vt_bind.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+        bindings.push_back(vt_bind);
+    }
 
     VkDescriptorSetLayoutCreateInfo layout_info = {};
     layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -731,7 +1305,66 @@ void RTPipe::create_desc(const Scene& scene) {
         tbw.pImageInfo = t_imgs.data();
         tbw.descriptorCount = t_imgs.size();
 
-        std::vector<VkWriteDescriptorSet> writes = {ubw, vbw, ibw};
+        VkDescriptorImageInfo env_img = {};
+        env_img.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        env_img.imageView = env_view->view;
+        env_img.sampler = texture_sampler->sampler;
+
+        VkWriteDescriptorSet ew = {};
+        ew.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        ew.dstSet = pipe->descriptor_sets[i];
+        ew.dstBinding = 16;
+        ew.dstArrayElement = 0;
+        ew.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        ew.descriptorCount = 1;
+        ew.pImageInfo = &env_img;
+
+        VkDescriptorBufferInfo env_dist = {};
+        env_dist.buffer = env_buf->buf;
+        env_dist.range = VK_WHOLE_SIZE;
+
+        VkWriteDescriptorSet edw = {};
+        edw.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        edw.dstSet = pipe->descriptor_sets[i];
+        edw.dstBinding = 17;
+        edw.dstArrayElement = 0;
+        edw.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        edw.descriptorCount = 1;
+        edw.pBufferInfo = &env_dist;
+
+        VkDescriptorImageInfo noise_img = {};
+        noise_img.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        noise_img.imageView = noise_view->view;
+        noise_img.sampler = gbuf_sampler->sampler;
+
+        VkWriteDescriptorSet nw = {};
+        nw.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        nw.dstSet = pipe->descriptor_sets[i];
+        nw.dstBinding = 18;
+        nw.dstArrayElement = 0;
+        nw.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        nw.descriptorCount = 1;
+        nw.pImageInfo = &noise_img;
+
+        VkDescriptorBufferInfo vt_b[3] = {};
+        vt_b[0].buffer = vt_tables[i]->buf;
+        vt_b[1].buffer = vt_feedback[i]->buf;
+        vt_b[2].buffer = vt_descs->buf;
+
+        VkWriteDescriptorSet vt_writes[3] = {};
+        for(unsigned int j = 0; j < 3; j++) {
+            vt_b[j].range = VK_WHOLE_SIZE;
+            vt_writes[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            vt_writes[j].dstSet = pipe->descriptor_sets[i];
+            vt_writes[j].dstBinding = 25 + j;
+            vt_writes[j].dstArrayElement = 0;
+            vt_writes[j].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            vt_writes[j].descriptorCount = 1;
+            vt_writes[j].pBufferInfo = &vt_b[j];
+        }
+
+        std::vector<VkWriteDescriptorSet> writes = {ubw, vbw, ibw, ew, edw, nw,
+                                                    vt_writes[0], vt_writes[1], vt_writes[2]};
 
         if(tbw.descriptorCount > 0)
             writes.push_back(tbw);
@@ -2,7 +2,10 @@
 #pragma once
 
 #include <lib/mathlib.h>
+#include <lib/pack.h>
+#include <memory>
 #include <util/camera.h>
+#include <util/virtual_texture.h>
 #include <vector>
 
 #include "vulkan.h"
@@ -33,6 +36,19 @@ struct RTPipe {
 
     bool trace(const Camera& cam, VkCommandBuffer& cmds, VkExtent2D ext);
 
+    /// Frames accumulated since the camera last moved, new texture pages arrived or a reset
+    int history() const {
+        return still_frames;
+    }
+    /// Index of the G-buffer, accumulation and moments images written by the most recent trace
+    unsigned int gbuf() const {
+        return last_gbuf;
+    }
+    /// Maps NDC to view rays of the camera the last G-buffer was traced with (Pack::ray_matrix)
+    Mat4 gbuf_rays() const {
+        return Pack::ray_matrix(old_cam.iV, old_cam.iP);
+    }
+
     Drop<PipeData> pipe;
 
     int max_frames = 256;
@@ -45,25 +61,53 @@ struct RTPipe {
     bool use_rr = true;
     bool use_metalness = false;
     bool use_qmc = false;
+    bool use_blue_noise = false;
+    /// Pick texture mip levels from ray cone footprints instead of always reading the base level
+    bool use_ray_cones = true;
     bool use_temporal = true;
+    bool use_reproject = true;
     int integrator = 0;
     int temporal_scale = 16;
     int brdf = 0;
     int debug_view = 0;
     int res_samples = 4;
-
+    bool use_spatial = true;
+    int spatial_samples = 5;
+    float spatial_radius = 30.0f;
+    int spatial_bias = 1;
+    int max_history = 32;
+
+    /// Texture memory budget in MB, 0 for no limit (Util::fit_budget)
+    int texture_budget = 0;
+    /// Resident texture memory, and what every level of every texture would take
+    size_t texture_bytes = 0, texture_full_bytes = 0;
+
+    /// Stream texture pages from a cooked page file into fixed pools on demand, instead of
+    /// uploading every texture up front (Util::Virtual_Textures)
+    bool use_virtual_textures = false;
+    /// Resident pages per pool; the pools are square atlases of 136x136 texel slots
+    int vt_pages = 1024;
+    /// Pages copied to the GPU per frame at most
+    int vt_uploads = 32;
+    /// Streaming counts of the last frame, or null when virtual texturing is off
+    const Util::Virtual_Textures::Stats* vt_stats() const {
+        return vt ? &vt->stats() : nullptr;
+    }
+
+    /// Packed R32_UINT G-buffer (src/lib/pack.h): hit distance and jitter, octahedral normal and
+    /// RGBA8 albedo, ping-ponged so last frame's can be reprojected
     Drop<Image> pos_image[2], norm_image[2], alb_image[2];
     Drop<ImageView> pos_image_view[2], norm_image_view[2], alb_image_view[2];
 
+    /// Accumulated radiance, ping-ponged like the G-buffer so last frame's can be reprojected
+    Drop<Image> accum_image[2];
+    Drop<ImageView> accum_image_view[2];
+
+    /// Running mean of the demodulated luminance and its square, plus the per-pixel history length
+    Drop<Image> moments_image[2];
+    Drop<ImageView> moments_image_view[2];
+
 private:
-    struct alignas(16) Reservoir {
-        Vec4 pos;
-	    Vec4 normal;
-        Vec4 emissive;
-	    float w_sum;
-        float w;
-	    unsigned int n_seen;
-    };
     struct alignas(16) Scene_Desc {
         Mat4 model;
         Mat4 modelIT;
@@ -99,12 +143,21 @@ private:
         int use_rr;
         int n_lights;
         int n_objs;
+        int use_env_map;
+        int use_blue_noise;
+        int reproject;
+        int max_history;
+        int use_ray_cones;
+        int use_virtual_textures;
     };
     
     struct ReSTIRConstants {
         Mat4 prev_PV;
         unsigned int new_samples;
         unsigned int temporal_multiplier;
+        unsigned int spatial_samples;
+        float spatial_radius;
+        unsigned int spatial_bias;
     };
 
     struct CameraConstants {
@@ -113,6 +166,7 @@ private:
 
     struct UBO {
         CameraConstants camera;
+        CameraConstants prev_camera;
         ReSTIRConstants restir;
     };
 
@@ -121,6 +175,7 @@ private:
     Drop<Buffer> sbt;
     Drop<Buffer> desc_buf, light_buf;
     Drop<Buffer> res0, res1;
+    Drop<Buffer> gi_res0, gi_res1;
 
     Drop<Sampler> gbuf_sampler;
 
@@ -128,9 +183,27 @@ private:
     std::vector<Drop<ImageView>> texture_views;
     Drop<Sampler> texture_sampler;
 
+    Drop<Image> env_image;
+    Drop<ImageView> env_view;
+    Drop<Buffer> env_buf;
+
+    Drop<Image> noise_image;
+    Drop<ImageView> noise_view;
+
+    /// Page table and feedback per frame in flight, staging for the pages it uploads, and the
+    /// layout of each texture. Textures hold the two page pools while vt is set.
+    static constexpr unsigned int VT_FEEDBACK = 16384; // VT_FEEDBACK in rtcommon.glsl
+    std::unique_ptr<Util::Virtual_Textures> vt;
+    std::vector<Drop<Buffer>> vt_tables, vt_feedback, vt_staging;
+    Drop<Buffer> vt_descs;
+    /// Pages the staging buffers hold, vt_uploads when they were made
+    size_t vt_staged = 0;
+
     RTPipe_Constants consts;
     CameraConstants old_cam = {};
     VkExtent2D prev_ext = {};
+    unsigned int last_gbuf = 0;
+    int still_frames = 0;
 
     void create_sbt();
     void create_pipe();
@@ -139,6 +212,12 @@ private:
     void create_desc(const Scene& scene);
     void build_desc(const Scene& scene);
     void build_textures(const Scene& scene);
+    void build_virtual();
+    void upload_pages(VkCommandBuffer cmds, const std::vector<Util::Page_Upload>& pages,
+                      const Buffer& staging);
+    void stream_pages(VkCommandBuffer cmds);
+    void build_env(const Scene& scene);
+    void build_noise();
 };
 
 } // namespace VK
@@ -103,6 +103,42 @@ static bool format_has_stencil(VkFormat format) {
     return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
 }
 
+VkFormat vk_format(Util::Image_Format format) {
+    switch(format) {
+    case Util::Image_Format::r8: return VK_FORMAT_R8_UNORM;
+    case Util::Image_Format::rg8: return VK_FORMAT_R8G8_UNORM;
+    case Util::Image_Format::rgba8: return VK_FORMAT_R8G8B8A8_UNORM;
+    case Util::Image_Format::rgba8_srgb: return VK_FORMAT_R8G8B8A8_SRGB;
+    case Util::Image_Format::rgba16f: return VK_FORMAT_R16G16B16A16_SFLOAT;
+    case Util::Image_Format::rgba32f: return VK_FORMAT_R32G32B32A32_SFLOAT;
+    }
+    return VK_FORMAT_UNDEFINED;
+}
+
+VkFormat vk_format(Util::BC_Format format, bool srgb) {
+    switch(format) {
+    case Util::BC_Format::bc1:
+        return srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+    case Util::BC_Format::bc4: return VK_FORMAT_BC4_UNORM_BLOCK;
+    case Util::BC_Format::bc5: return VK_FORMAT_BC5_UNORM_BLOCK;
+    case Util::BC_Format::bc7: return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+    }
+    return VK_FORMAT_UNDEFINED;
+}
+
+bool image_format(VkFormat format, Util::Image_Format& out) {
+    switch(format) {
+    case VK_FORMAT_R8_UNORM: out = Util::Image_Format::r8; break;
+    case VK_FORMAT_R8G8_UNORM: out = Util::Image_Format::rg8; break;
+    case VK_FORMAT_R8G8B8A8_UNORM: out = Util::Image_Format::rgba8; break;
+    case VK_FORMAT_R8G8B8A8_SRGB: out = Util::Image_Format::rgba8_srgb; break;
+    case VK_FORMAT_R16G16B16A16_SFLOAT: out = Util::Image_Format::rgba16f; break;
+    case VK_FORMAT_R32G32B32A32_SFLOAT: out = Util::Image_Format::rgba32f; break;
+    default: return false;
+    }
+    return true;
+}
+
 Buffer::~Buffer() {
     destroy();
 }
@@ -140,6 +176,16 @@ void Buffer::recreate(VkDeviceSize sz, VkBufferUsageFlags busage, VmaMemoryUsage
     buf_info.usage = buf_usage;
     buf_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
+    // Staged writes come from the transfer queue; sharing the buffer with it saves an ownership
+    // transfer per write
+    const Manager::GPU& gpu = *vk().gpu.data;
+    unsigned int families[] = {(unsigned int)gpu.graphics_idx, (unsigned int)gpu.transfer_idx};
+    if(buf_usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT && families[0] != families[1]) {
+        buf_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        buf_info.queueFamilyIndexCount = 2;
+        buf_info.pQueueFamilyIndices = families;
+    }
+
     VmaAllocationCreateInfo alloc_info = {};
     alloc_info.usage = mem_usage;
 
@@ -177,11 +223,11 @@ void Buffer::copy_to(const Buffer& dst) {
     vk().end_one_time(cmds);
 }
 
-void Buffer::to_image(VkCommandBuffer& cmds, const Image& image) {
+void Buffer::to_image(VkCommandBuffer& cmds, const Image& image, unsigned int row_length) {
 
     VkBufferImageCopy region = {};
     region.bufferOffset = 0;
-    region.bufferRowLength = 0;
+    region.bufferRowLength = row_length;
     region.bufferImageHeight = 0;
     region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     region.imageSubresource.mipLevel = 0;
@@ -193,6 +239,16 @@ void Buffer::to_image(VkCommandBuffer& cmds, const Image& image) {
     vkCmdCopyBufferToImage(cmds, buf, image.img, image.layout, 1, &region);
 }
 
+void Buffer::from_image(VkCommandBuffer& cmds, const Image& image) {
+
+    VkBufferImageCopy region = {};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = {image.w, image.h, 1};
+
+    vkCmdCopyImageToBuffer(cmds, image.img, image.layout, buf, 1, &region);
+}
+
 void Buffer::write(const void* data, size_t dsize) {
 
     if(!dsize) return;
@@ -220,9 +276,14 @@ void Buffer::write_staged(const void* data, size_t dsize) {
     if(!dsize) return;
     assert(dsize <= size);
 
-    Buffer staging(dsize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
-    staging.write(data, dsize);
-    staging.copy_to(*this);
+    Uploader& up = vk().uploads();
+    Uploader::Slice slice = up.stage(dsize);
+    std::memcpy(slice.data, data, dsize);
+
+    VkBufferCopy region = {};
+    region.srcOffset = slice.offset;
+    region.size = dsize;
+    vkCmdCopyBuffer(up.cmds(), slice.buf, buf, 1, &region);
 }
 
 Image::~Image() {
@@ -246,16 +307,17 @@ void Image::destroy() {
 }
 
 Image::Image(unsigned int width, unsigned int height, VkFormat format, VkImageTiling tiling,
-             VkImageUsageFlags img_usage, VmaMemoryUsage mem_usage) {
-    recreate(width, height, format, tiling, img_usage, mem_usage);
+             VkImageUsageFlags img_usage, VmaMemoryUsage mem_usage, unsigned int mip_levels) {
+    recreate(width, height, format, tiling, img_usage, mem_usage, mip_levels);
 }
 
 void Image::recreate(unsigned int width, unsigned int height, VkFormat fmt, VkImageTiling tlg,
-                     VkImageUsageFlags iusage, VmaMemoryUsage musage) {
+                     VkImageUsageFlags iusage, VmaMemoryUsage musage, unsigned int mip_levels) {
     destroy();
 
     w = width;
     h = height;
+    mips = mip_levels;
     format = fmt;
     tiling = tlg;
     img_usage = iusage;
@@ -267,7 +329,7 @@ void Image::recreate(unsigned int width, unsigned int height, VkFormat fmt, VkIm
     img_info.extent.width = width;
     img_info.extent.height = height;
     img_info.extent.depth = 1;
-    img_info.mipLevels = 1;
+    img_info.mipLevels = mips;
     img_info.arrayLayers = 1;
     img_info.format = format;
     img_info.tiling = tiling;
@@ -285,12 +347,16 @@ void Image::recreate(unsigned int width, unsigned int height, VkFormat fmt, VkIm
 
 Util::Image Image::read() {
 
+    Util::Image_Format fmt;
+    if(!image_format(format, fmt)) die("Cannot read back image of format %d", (int)format);
+
+    Util::Image ret(w, h, fmt);
+
     VkCommandBuffer cmds = vk().begin_one_time();
 
     transition(cmds, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
 
-    assert(format == VK_FORMAT_R8G8B8A8_SRGB);
-    Buffer staging(w * h * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+    Buffer staging(ret.bytes(), VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
 
     VkExtent3D ext = {};
     ext.width = w;
@@ -306,25 +372,382 @@ Util::Image Image::read() {
 
     vk().end_one_time(cmds);
 
-    std::vector<unsigned char> data(w * h * 4);
-    staging.read(data.data(), data.size());
-
-    return Util::Image(w, h, std::move(data));
+    staging.read(ret.data(), ret.bytes());
+    return ret;
 }
 
 void Image::write(const Util::Image& data) {
+    write(data.view());
+}
 
-    VkCommandBuffer cmds = vk().begin_one_time();
+void Image::write(Util::Image_Const_View data) {
 
-    transition(cmds, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    Util::Image_Format fmt;
+    if(!image_format(format, fmt)) die("Cannot upload to image of format %d", (int)format);
+    assert(data.w == w && data.h == h);
 
-    Buffer staging(data.bytes(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
-    staging.write(data.data(), data.bytes());
-    staging.to_image(cmds, *this);
+    if(data.format != fmt) {
+        Util::Image converted(w, h, fmt);
+        Util::convert(data, converted.view());
+        write(converted.data(), converted.bytes());
+        return;
+    }
+    if(data.packed()) {
+        write(data.data, data.bytes());
+        return;
+    }
 
-    transition(cmds, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    // Strided rows go straight to the staging buffer, the copy skips the padding
+    unsigned int texel = Util::texel_bytes(fmt);
+    if(data.stride % texel) {
+        write(Util::Image(data));
+        return;
+    }
+    size_t size = data.stride * (h - 1) + data.row_bytes();
+    write_staged(data.data, size, (unsigned int)(data.stride / texel));
+}
 
-    vk().end_one_time(cmds);
+void Image::write(const void* data, size_t size) {
+    write_staged(data, size, 0);
+}
+
+void Image::write_staged(const void* data, size_t size, unsigned int row_length) {
+
+    Uploader& up = vk().uploads();
+    Uploader::Slice slice = up.stage(size);
+    std::memcpy(slice.data, data, size);
+
+    VkBufferImageCopy region = {};
+    region.bufferOffset = slice.offset;
+    region.bufferRowLength = row_length;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = {w, h, 1};
+    up.copy_to_image(*this, slice.buf, {region});
+}
+
+void write_images(const std::vector<Image_Upload>& uploads) {
+
+    // Copy offsets must be multiples of the texel size and of 4, so 16 suits every format
+    auto align = [](size_t v) { return (v + 15) & ~(size_t)15; };
+
+    Uploader& up = vk().uploads();
+    std::vector<VkBufferImageCopy> regions;
+
+    // Each image is staged in one slice, so a full ring only ever splits batches between images
+    for(const Image_Upload& upload : uploads) {
+        Image& image = *upload.image;
+        assert(upload.levels.size() + upload.blocks.size() <= image.mips);
+
+        Util::Image_Format fmt = {};
+        if(!upload.levels.empty() && !image_format(image.format, fmt))
+            die("Cannot upload to image of format %d", (int)image.format);
+
+        size_t size = 0;
+        for(const Util::BC_Level_View& level : upload.blocks) size = align(size) + level.size;
+        for(const auto& level : upload.levels)
+            size = align(size) + (size_t)level.w * level.h * Util::texel_bytes(fmt);
+        if(!size) continue;
+
+        Uploader::Slice slice = up.stage(size);
+        size_t offset = 0;
+        regions.clear();
+        auto add_region = [&](unsigned int l, unsigned int w, unsigned int h) {
+            VkBufferImageCopy region = {};
+            region.bufferOffset = slice.offset + offset;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = l;
+            region.imageSubresource.layerCount = 1;
+            region.imageExtent = {w, h, 1};
+            regions.push_back(region);
+        };
+
+        // Extents are in texels; rows of blocks are tightly packed
+        for(unsigned int l = 0; l < upload.blocks.size(); l++) {
+            const Util::BC_Level_View& level = upload.blocks[l];
+            offset = align(offset);
+            std::memcpy(slice.data + offset, level.blocks, level.size);
+            add_region(l, level.w, level.h);
+            offset += level.size;
+        }
+
+        for(unsigned int l = 0; l < upload.levels.size(); l++) {
+            const Util::Image_Const_View& level = upload.levels[l];
+            assert(level.w == std::max(image.w >> l, 1u) && level.h == std::max(image.h >> l, 1u));
+
+            // Converting straight into the mapped ring is a row memcpy when formats match
+            offset = align(offset);
+            Util::Image_View dst{slice.data + offset, level.w, level.h,
+                                 (size_t)level.w * Util::texel_bytes(fmt), fmt};
+            Util::convert(level, dst);
+            add_region(l, level.w, level.h);
+            offset += dst.bytes();
+        }
+
+        up.copy_to_image(image, slice.buf, regions);
+    }
+}
+
+Uploader::Slice Uploader::stage(size_t size, size_t align) {
+
+    Slice slice;
+    if(size > CAPACITY) {
+        Buffer& buf = open.overflow.emplace_back(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                                 VMA_MEMORY_USAGE_CPU_ONLY);
+        slice = {buf.buf, 0, static_cast<unsigned char*>(buf.map())};
+    } else {
+        retire();
+        std::optional<size_t> offset;
+        while(!(offset = ring.alloc(size, align))) {
+            // Nothing in flight means the open batch holds the rest of the ring
+            if(in_flight.empty()) flush();
+            if(std::optional<uint64_t> oldest = ring.oldest()) wait_for(copies, *oldest);
+            retire();
+        }
+        slice = {ring_buf.buf, *offset, ring_map + *offset};
+    }
+
+    open.bytes += size;
+    staged_bytes += size;
+    return slice;
+}
+
+VkCommandBuffer Uploader::cmds() {
+
+    if(open.cmds) return open.cmds;
+
+    VkCommandBufferAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandPool = vk().transfer_pool;
+    alloc_info.commandBufferCount = 1;
+    VK_CHECK(vkAllocateCommandBuffers(vk().device(), &alloc_info, &open.cmds));
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(open.cmds, &begin_info));
+
+    return open.cmds;
+}
+
+void Uploader::copy_to_image(Image& image, VkBuffer src,
+                             const std::vector<VkBufferImageCopy>& regions) {
+
+    // Image::transition assumes graphics stages, which a transfer queue does not have
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image.img;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 1};
+
+    VkCommandBuffer cmds = this->cmds();
+    vkCmdPipelineBarrier(cmds, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         0, nullptr, 0, nullptr, 1, &barrier);
+    vkCmdCopyBufferToImage(cmds, src, image.img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           (uint32_t)regions.size(), regions.data());
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    image.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    if(!dedicated()) {
+        vkCmdPipelineBarrier(cmds, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                             &barrier);
+        return;
+    }
+
+    // The transfer queue releases the image, and the graphics queue acquires it with a matching
+    // barrier once the copies are done
+    const Manager::GPU& gpu = *vk().gpu.data;
+    barrier.srcQueueFamilyIndex = gpu.transfer_idx;
+    barrier.dstQueueFamilyIndex = gpu.graphics_idx;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(cmds, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                         &barrier);
+
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    open.acquires.push_back(barrier);
+}
+
+void Uploader::flush(bool wait) {
+
+    // Staged bytes nobody recorded a copy for still need a batch to free them
+    if(!open.cmds && open.bytes) cmds();
+
+    if(open.cmds) {
+        VkDevice device = vk().device();
+        bool own_queue = dedicated();
+        open.id = next_id++;
+
+        // The batch's graphics side: the acquire submit on a queue of its own, or the copies
+        VkCommandBuffer graphics = open.cmds;
+        if(own_queue) {
+            VK_CHECK(vkEndCommandBuffer(open.cmds));
+
+            VkCommandBufferAllocateInfo alloc_info = {};
+            alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            alloc_info.commandPool = vk().command_pool;
+            alloc_info.commandBufferCount = 1;
+            VK_CHECK(vkAllocateCommandBuffers(device, &alloc_info, &open.acquire));
+
+            VkCommandBufferBeginInfo begin_info = {};
+            begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            VK_CHECK(vkBeginCommandBuffer(open.acquire, &begin_info));
+            graphics = open.acquire;
+        }
+
+        // Whatever is submitted to the graphics queue after the batch may read what it wrote.
+        // On the transfer queue's side the semaphore wait is what this barrier chains after.
+        VkMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+        vkCmdPipelineBarrier(graphics,
+                             own_queue ? VK_PIPELINE_STAGE_ALL_COMMANDS_BIT
+                                       : VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr,
+                             (uint32_t)open.acquires.size(), open.acquires.data());
+        VK_CHECK(vkEndCommandBuffer(graphics));
+
+        VkSemaphore signals[] = {copies, done};
+        uint64_t values[] = {open.id, open.id};
+        VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+        VkTimelineSemaphoreSubmitInfo timeline = {};
+        timeline.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timeline.pWaitSemaphoreValues = values;
+        timeline.pSignalSemaphoreValues = values;
+
+        VkSubmitInfo submit_info = {};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.pNext = &timeline;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &open.cmds;
+        submit_info.pSignalSemaphores = signals;
+
+        if(own_queue) {
+            timeline.signalSemaphoreValueCount = submit_info.signalSemaphoreCount = 1;
+            VK_CHECK(vkQueueSubmit(vk().gpu.transfer_queue, 1, &submit_info, VK_NULL_HANDLE));
+
+            timeline.waitSemaphoreValueCount = submit_info.waitSemaphoreCount = 1;
+            submit_info.pWaitSemaphores = &copies;
+            submit_info.pWaitDstStageMask = &wait_stage;
+            submit_info.pCommandBuffers = &open.acquire;
+            submit_info.pSignalSemaphores = &done;
+        } else {
+            timeline.signalSemaphoreValueCount = submit_info.signalSemaphoreCount = 2;
+        }
+        VK_CHECK(vkQueueSubmit(vk().gpu.graphics_queue, 1, &submit_info, VK_NULL_HANDLE));
+
+        ring.submit(open.id);
+        in_flight.push_back(std::move(open));
+        open = {};
+    }
+
+    if(wait && !in_flight.empty()) wait_for(done, in_flight.back().id);
+    retire();
+}
+
+bool Uploader::recording() const {
+    return open.cmds || open.bytes;
+}
+
+Uploader::Stats Uploader::stats() const {
+    Stats ret;
+    ret.dedicated = dedicated();
+    ret.staged = staged_bytes;
+    ret.copied = copied_bytes;
+    ret.batches = in_flight.size();
+    return ret;
+}
+
+bool Uploader::dedicated() const {
+    const Manager::GPU& gpu = *vk().gpu.data;
+    return gpu.transfer_idx != gpu.graphics_idx;
+}
+
+uint64_t Uploader::reached(VkSemaphore timeline) const {
+    uint64_t value = 0;
+    VK_CHECK(vkGetSemaphoreCounterValue(vk().device(), timeline, &value));
+    return value;
+}
+
+void Uploader::wait_for(VkSemaphore timeline, uint64_t id) const {
+    VkSemaphoreWaitInfo wait_info = {};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &timeline;
+    wait_info.pValues = &id;
+    VK_CHECK(vkWaitSemaphores(vk().device(), &wait_info, UINT64_MAX));
+}
+
+void Uploader::retire() {
+
+    VkDevice device = vk().device();
+    uint64_t copied = reached(copies), finished = reached(done);
+
+    // Staging is free once the copies are done; the command buffers once the graphics queue
+    // has waited on them too
+    ring.retire(copied);
+    for(const Batch& batch : in_flight) {
+        if(batch.id > copied) break;
+        if(batch.id <= counted_id) continue;
+        copied_bytes += batch.bytes;
+        counted_id = batch.id;
+    }
+
+    while(!in_flight.empty() && in_flight.front().id <= finished) {
+        Batch& batch = in_flight.front();
+        vkFreeCommandBuffers(device, vk().transfer_pool, 1, &batch.cmds);
+        if(batch.acquire) vkFreeCommandBuffers(device, vk().command_pool, 1, &batch.acquire);
+        for(Buffer& buf : batch.overflow) buf.unmap();
+        in_flight.pop_front();
+    }
+
+    // Progress starts over once everything staged has landed
+    if(in_flight.empty() && !recording()) staged_bytes = copied_bytes = 0;
+}
+
+void Uploader::init() {
+
+    ring_buf.recreate(CAPACITY, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+    ring_map = static_cast<unsigned char*>(ring_buf.map());
+    ring = Util::Ring_Allocator(CAPACITY);
+
+    VkSemaphoreTypeCreateInfo type_info = {};
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_info.initialValue = 0;
+
+    VkSemaphoreCreateInfo sinfo = {};
+    sinfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    sinfo.pNext = &type_info;
+    VK_CHECK(vkCreateSemaphore(vk().device(), &sinfo, nullptr, &copies));
+    VK_CHECK(vkCreateSemaphore(vk().device(), &sinfo, nullptr, &done));
+
+    if(dedicated()) info("Uploading on a dedicated transfer queue.");
+}
+
+void Uploader::destroy() {
+    flush(true);
+    vkDestroySemaphore(vk().device(), copies, nullptr);
+    vkDestroySemaphore(vk().device(), done, nullptr);
+    copies = done = VK_NULL_HANDLE;
+    if(ring_map) ring_buf.unmap();
+    ring_map = nullptr;
+    ring_buf.destroy();
 }
 
 void Image::transition(VkImageLayout new_l) {
@@ -360,7 +783,7 @@ void Image::transition(VkCommandBuffer& cmds, VkImageLayout old_l, VkImageLayout
     }
 
     barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
     barrier.subresourceRange.baseArrayLayer = 0;
     barrier.subresourceRange.layerCount = 1;
 
@@ -481,7 +904,7 @@ void ImageView::recreate(VkImage img, VkFormat format, VkImageAspectFlags asp) {
     view_info.components.a = VK_COMPONENT_SWIZZLE_A;
     view_info.subresourceRange.aspectMask = aspect;
     view_info.subresourceRange.baseMipLevel = 0;
-    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
     view_info.subresourceRange.baseArrayLayer = 0;
     view_info.subresourceRange.layerCount = 1;
 
@@ -531,7 +954,7 @@ void Sampler::recreate(VkFilter min, VkFilter mag) {
     sample_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
     sample_info.mipLodBias = 0.0f;
     sample_info.minLod = 0.0f;
-    sample_info.maxLod = 0.0f;
+    sample_info.maxLod = VK_LOD_CLAMP_NONE;
 
     VK_CHECK(vkCreateSampler(vk().device(), &sample_info, nullptr, &sampler));
 }
@@ -942,6 +1365,10 @@ bool Manager::begin_frame() {
 
     vkWaitForFences(gpu.device, 1, &frame.fence, VK_TRUE, UINT64_MAX);
 
+    // Batches submitted ahead of the frame just waited on are done, since its graphics queue
+    // waited on their copies. Uploads recorded since the last frame was submitted may write to
+    // resources about to be erased, so only those finish first.
+    uploader.flush(uploader.recording());
     do_erase();
     if(frame.buffers.size()) {
         vkFreeCommandBuffers(gpu.device, command_pool, frame.buffers.size(), frame.buffers.data());
@@ -972,6 +1399,9 @@ bool Manager::begin_frame() {
 
 void Manager::submit_frame(ImageView& out_image) {
 
+    // The frame's uploads go in one submit ahead of it
+    uploader.flush();
+
     Frame& frame = frames[current_frame];
     for(VkCommandBuffer& buf : frame.buffers) {
         VK_CHECK(vkEndCommandBuffer(buf));
@@ -1151,6 +1581,7 @@ void Manager::init(SDL_Window* sdl_window) {
     create_command_pool();
     create_descriptor_pool();
     create_frames();
+    uploader.init();
 
     create_swapchain();
 
@@ -1211,6 +1642,9 @@ void Manager::end_one_time(VkCommandBuffer cmds) {
 
 VkCommandBuffer Manager::begin_one_time() {
 
+    // One-time work may read anything uploaded so far, and runs after it on the same queue
+    uploader.flush();
+
     VkCommandBufferAllocateInfo alloc_info = {};
     alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
@@ -1239,6 +1673,7 @@ void Manager::destroy() {
 
     VK_CHECK(vkDeviceWaitIdle(gpu.device));
 
+    uploader.destroy();
     for(unsigned int i = 0; i < MAX_IN_FLIGHT; i++) {
         erase_queue[i].clear();
     }
@@ -1262,6 +1697,7 @@ void Manager::destroy() {
     frames.clear();
 
     vkDestroyCommandPool(gpu.device, command_pool, nullptr);
+    vkDestroyCommandPool(gpu.device, transfer_pool, nullptr);
     vkDestroyDescriptorPool(gpu.device, descriptor_pool, nullptr);
 
     vmaDestroyAllocator(gpu_alloc);
@@ -1275,6 +1711,7 @@ void Manager::destroy() {
     gpu_alloc = {};
     gpu = {};
     command_pool = {};
+    transfer_pool = {};
     descriptor_pool = {};
 
     info = Info();
@@ -1854,6 +2291,20 @@ void Manager::select_gpu() {
             }
         }
 
+        // A transfer-only family is usually a DMA engine that copies while the graphics queue
+        // renders; without one, uploads share the graphics queue
+        g.transfer_idx = g.graphics_idx;
+        for(unsigned int i = 0; i < g.queue_families.size(); i++) {
+            auto& family = g.queue_families[i];
+            if(!family.queueCount) continue;
+            VkQueueFlags kinds =
+                VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT;
+            if((family.queueFlags & kinds) == VK_QUEUE_TRANSFER_BIT) {
+                g.transfer_idx = i;
+                break;
+            }
+        }
+
         for(unsigned int i = 0; i < g.queue_families.size(); i++) {
             auto& family = g.queue_families[i];
             if(!family.queueCount) continue;
@@ -1901,6 +2352,15 @@ void Manager::create_logical_device_and_queues() {
         qinfo.pQueuePriorities = &priority;
         q_info.push_back(qinfo);
     }
+    if(gpu.data->transfer_idx != gpu.data->graphics_idx &&
+       gpu.data->transfer_idx != gpu.data->present_idx) {
+        VkDeviceQueueCreateInfo qinfo = {};
+        qinfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        qinfo.queueFamilyIndex = gpu.data->transfer_idx;
+        qinfo.queueCount = 1;
+        qinfo.pQueuePriorities = &priority;
+        q_info.push_back(qinfo);
+    }
 
     VkPhysicalDeviceRayQueryFeaturesKHR ray_features = {};
     ray_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR;
@@ -1922,6 +2382,7 @@ void Manager::create_logical_device_and_queues() {
     vk12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
     vk12_features.pNext = &ac_features;
     vk12_features.hostQueryReset = VK_TRUE;
+    vk12_features.timelineSemaphore = VK_TRUE;
     vk12_features.bufferDeviceAddress = VK_TRUE;
     vk12_features.runtimeDescriptorArray = VK_TRUE;
     vk12_features.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
@@ -1942,6 +2403,7 @@ void Manager::create_logical_device_and_queues() {
     features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
     features2.features.samplerAnisotropy = VK_TRUE;
     features2.features.shaderInt64 = VK_TRUE;
+    features2.features.textureCompressionBC = gpu.data->features.features.textureCompressionBC;
     features2.pNext = &clock;
 
     VkDeviceCreateInfo dev_info = {};
@@ -1959,6 +2421,7 @@ void Manager::create_logical_device_and_queues() {
 
     vkGetDeviceQueue(gpu.device, gpu.data->graphics_idx, 0, &gpu.graphics_queue);
     vkGetDeviceQueue(gpu.device, gpu.data->present_idx, 0, &gpu.present_queue);
+    vkGetDeviceQueue(gpu.device, gpu.data->transfer_idx, 0, &gpu.transfer_queue);
 }
 
 void Manager::create_frames() {
@@ -1995,6 +2458,10 @@ void Manager::create_command_pool() {
     create_info.queueFamilyIndex = gpu.data->graphics_idx;
 
     VK_CHECK(vkCreateCommandPool(gpu.device, &create_info, nullptr, &command_pool));
+
+    create_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    create_info.queueFamilyIndex = gpu.data->transfer_idx;
+    VK_CHECK(vkCreateCommandPool(gpu.device, &create_info, nullptr, &transfer_pool));
 }
 
 static VkSurfaceFormatKHR choose_format(const std::vector<VkSurfaceFormatKHR>& formats) {
@@ -2199,6 +2666,10 @@ void Manager::create_descriptor_pool() {
     VK_CHECK(vkCreateDescriptorPool(gpu.device, &pool_info, nullptr, &descriptor_pool));
 }
 
+bool Manager::supports_bc() const {
+    return gpu.data && gpu.data->features.features.textureCompressionBC;
+}
+
 VkFormat Manager::find_depth_format() {
     return choose_supported_format(
         {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
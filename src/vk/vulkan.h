@@ -2,6 +2,7 @@
 #pragma once
 
 #include <array>
+#include <deque>
 #include <functional>
 #include <mutex>
 #include <unordered_map>
@@ -10,7 +11,9 @@
 
 #include <SDL2/SDL.h>
 #include <lib/mathlib.h>
+#include <util/bc.h>
 #include <util/image.h>
+#include <util/ring_allocator.h>
 #include <vulkan/vulkan.h>
 
 #include "vk_mem_alloc.h"
@@ -59,6 +62,11 @@ struct MeshPipe;
 Manager& vk();
 std::string vk_err_str(VkResult errorCode);
 
+VkFormat vk_format(Util::Image_Format format);
+VkFormat vk_format(Util::BC_Format format, bool srgb);
+/// False for formats Util::Image cannot hold
+bool image_format(VkFormat format, Util::Image_Format& out);
+
 struct Buffer {
 
     Buffer() = default;
@@ -81,7 +89,11 @@ struct Buffer {
     void read(void* data, size_t size);
     void write_staged(const void* data, size_t dsize);
 
-    void to_image(VkCommandBuffer& cmds, const Image& image);
+    /// row_length is the buffer's row pitch in texels, 0 for tightly packed
+    void to_image(VkCommandBuffer& cmds, const Image& image, unsigned int row_length = 0);
+    /// Records a copy of the whole image, tightly packed; the image must be in GENERAL or
+    /// TRANSFER_SRC_OPTIMAL
+    void from_image(VkCommandBuffer& cmds, const Image& image);
 
     VkBuffer buf = VK_NULL_HANDLE;
 
@@ -96,7 +108,7 @@ struct Image {
 
     Image() = default;
     Image(unsigned int width, unsigned int height, VkFormat format, VkImageTiling tiling,
-          VkImageUsageFlags img_usage, VmaMemoryUsage mem_usage);
+          VkImageUsageFlags img_usage, VmaMemoryUsage mem_usage, unsigned int mip_levels = 1);
     ~Image();
 
     Image(const Image&) = delete;
@@ -105,23 +117,34 @@ struct Image {
     Image& operator=(Image&& src);
 
     void recreate(unsigned int width, unsigned int height, VkFormat format, VkImageTiling tiling,
-                  VkImageUsageFlags img_usage, VmaMemoryUsage mem_usage);
+                  VkImageUsageFlags img_usage, VmaMemoryUsage mem_usage,
+                  unsigned int mip_levels = 1);
     void destroy();
 
+    /// Transitions cover every mip level
     void transition(VkImageLayout new_l);
     void transition(VkCommandBuffer& cmds, VkImageLayout new_l);
     void transition(VkCommandBuffer& cmds, VkImageLayout old_l, VkImageLayout new_l);
 
+    /// Converts to the image's format first if needed; packed views and views whose stride is
+    /// a whole number of texels are staged as-is. The copy goes into the open upload batch.
+    void write(Util::Image_Const_View img);
     void write(const Util::Image& img);
+    void write(const void* data, size_t size);
+    /// The image's format must be one Util::Image can hold
     Util::Image read();
 
     VkImage img = VK_NULL_HANDLE;
     unsigned int w = 0;
     unsigned int h = 0;
+    unsigned int mips = 1;
     VkFormat format = {};
     VkImageLayout layout = {};
 
 private:
+    /// Records a copy of size bytes into the open upload batch; row_length as in to_image
+    void write_staged(const void* data, size_t size, unsigned int row_length);
+
     VkImageTiling tiling = {};
     VkImageUsageFlags img_usage = {};
     VmaMemoryUsage mem_usage = {};
@@ -131,6 +154,101 @@ private:
     friend struct ImageView;
 };
 
+/// Levels for write_images, base first. Texel levels are converted to the image's format if it
+/// differs; block-compressed levels are copied as-is.
+struct Image_Upload {
+    Image* image = nullptr;
+    std::vector<Util::Image_Const_View> levels;
+    std::vector<Util::BC_Level_View> blocks;
+};
+
+/// Stages every level of every upload and records their copies into the open upload batch. The
+/// images end up in SHADER_READ_ONLY_OPTIMAL.
+void write_images(const std::vector<Image_Upload>& uploads);
+
+/// Staging for every upload: a persistently mapped ring of CPU memory, and one open batch of copy
+/// commands into which Buffer::write_staged, Image::write and write_images record. The batch is
+/// submitted once per frame, or before any one-time command buffer so that work sees the data.
+/// When the GPU has a transfer-only queue family the copies run there, overlapping frames already
+/// in flight; a short graphics-queue submit then waits on them and takes ownership of the images,
+/// so everything submitted to the graphics queue afterwards sees the data. Ring space comes back
+/// when the copies finish. Copies do not wait for earlier frames, so they must only write
+/// resources no frame in flight reads, which every caller does by writing freshly created ones.
+class Uploader {
+public:
+    static constexpr size_t CAPACITY = 64ull << 20;
+
+    struct Slice {
+        VkBuffer buf = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        unsigned char* data = nullptr;
+    };
+
+    struct Stats {
+        /// Whether copies run on a transfer queue of their own
+        bool dedicated = false;
+        /// Bytes staged since uploads were last idle, and how many of them have been copied
+        size_t staged = 0, copied = 0;
+        size_t batches = 0;
+    };
+
+    /// size bytes of staging memory, aligned to align. Waits for earlier batches when the ring
+    /// is full; uploads larger than the ring get their own buffer. May submit the open batch, so
+    /// call it before cmds() for the commands that read the slice.
+    Slice stage(size_t size, size_t align = 16);
+    /// Command buffer of the open batch, begun if needed. It may belong to the transfer queue, so
+    /// only record copies into it; images go through copy_to_image.
+    VkCommandBuffer cmds();
+    /// Records regions copied from src into image, which ends up in SHADER_READ_ONLY_OPTIMAL and
+    /// owned by the graphics queue. Every level written is replaced; levels not written are
+    /// undefined afterwards.
+    void copy_to_image(Image& image, VkBuffer src, const std::vector<VkBufferImageCopy>& regions);
+    /// Submits the open batch, if any; with wait, blocks until every batch has finished
+    void flush(bool wait = false);
+    /// Whether anything was staged or recorded since the last flush
+    bool recording() const;
+
+    size_t ring_used() const {
+        return ring.used();
+    }
+    Stats stats() const;
+
+private:
+    struct Batch {
+        uint64_t id = 0;
+        /// Copies, on the transfer queue if there is one, and the graphics-queue submit that
+        /// waits on them
+        VkCommandBuffer cmds = VK_NULL_HANDLE, acquire = VK_NULL_HANDLE;
+        /// Ownership of the images written goes from the transfer to the graphics queue
+        std::vector<VkImageMemoryBarrier> acquires;
+        /// Staging for uploads that did not fit the ring
+        std::vector<Buffer> overflow;
+        size_t bytes = 0;
+    };
+
+    void init();
+    void destroy();
+    /// Frees finished batches
+    void retire();
+    bool dedicated() const;
+    /// Highest batch id the timeline has reached, and waiting for it to reach id
+    uint64_t reached(VkSemaphore timeline) const;
+    void wait_for(VkSemaphore timeline, uint64_t id) const;
+
+    Buffer ring_buf;
+    unsigned char* ring_map = nullptr;
+    Util::Ring_Allocator ring;
+    Batch open;
+    std::deque<Batch> in_flight;
+    /// Timelines counting batch ids: signaled once a batch's copies finish, and once the
+    /// graphics queue has waited on them
+    VkSemaphore copies = VK_NULL_HANDLE, done = VK_NULL_HANDLE;
+    uint64_t next_id = 1, counted_id = 0;
+    size_t staged_bytes = 0, copied_bytes = 0;
+
+    friend class Manager;
+};
+
 struct ImageView {
 
     ImageView() = default;
@@ -372,7 +490,13 @@ public:
         resize_callbacks.push_back(std::forward<F&&>(f));
     }
 
+    Uploader& uploads() {
+        return uploader;
+    }
+
     VkFormat find_depth_format();
+    /// Whether BC1-7 textures can be sampled
+    bool supports_bc() const;
 
     static constexpr unsigned int MAX_IN_FLIGHT = 2;
 
@@ -415,7 +539,8 @@ private:
         std::vector<VkExtensionProperties> exts;
         std::vector<VkQueueFamilyProperties> queue_families;
 
-        int graphics_idx = 0, present_idx = 0;
+        /// transfer_idx is a transfer-only family when there is one, else graphics_idx
+        int graphics_idx = 0, present_idx = 0, transfer_idx = 0;
         bool supports(const std::vector<const char*>& extensions);
     };
 
@@ -450,7 +575,7 @@ private:
     struct Current_GPU {
         GPU* data = nullptr;
         VkDevice device = {};
-        VkQueue graphics_queue = {}, present_queue = {};
+        VkQueue graphics_queue = {}, present_queue = {}, transfer_queue = {};
     };
 
     struct Compositor {
@@ -488,7 +613,7 @@ private:
     Swapchain swapchain;
     Compositor compositor;
 
-    VkCommandPool command_pool = {};
+    VkCommandPool command_pool = {}, transfer_pool = {};
     VkDescriptorPool descriptor_pool = {};
 
     unsigned int current_img = 0, current_frame = 0;
@@ -497,6 +622,7 @@ private:
     Current_GPU gpu;
     std::vector<GPU> gpus;
     VmaAllocator gpu_alloc;
+    Uploader uploader;
     SDL_Window* window = nullptr;
 
     void select_gpu();
@@ -532,6 +658,7 @@ private:
     friend struct Buffer;
     friend struct Image;
     friend struct ImageView;
+    friend class Uploader;
     friend struct Shader;
     friend struct Framebuffer;
     friend struct Sampler;
@@ -0,0 +1,167 @@
+
+#include "test.h"
+
+#include <algorithm>
+#include <cmath>
+#include <lib/rng.h>
+#include <lib/sobol.h>
+#include <util/blue_noise.h>
+#include <vector>
+
+using namespace Util;
+
+namespace {
+
+// The size the renderer uses
+constexpr unsigned int W = 64, N = W * W;
+
+/// Channel c of Util::blue_noise's mask, as [0,1) offsets
+std::vector<float> channel(unsigned int c) {
+    std::vector<unsigned int> rank = void_and_cluster(W, RNG::pcg_hash(c + 1));
+    std::vector<float> mask(N);
+    for(unsigned int i = 0; i < N; i++) mask[i] = (rank[i] + 0.5f) / N;
+    return mask;
+}
+
+/// Squared toroidal distance between pixels a and b
+unsigned int dist2(unsigned int a, unsigned int b) {
+    unsigned int dx = (a % W + W - b % W) % W, dy = (a / W + W - b / W) % W;
+    dx = std::min(dx, W - dx);
+    dy = std::min(dy, W - dy);
+    return dx * dx + dy * dy;
+}
+
+/// Every pixel gets a distinct rank in [0, w*w), at every size
+void is_permutation() {
+
+    for(unsigned int w : {1u, 2u, 8u, 33u, 64u}) {
+        for(uint32_t seed : {1u, 2u}) {
+            std::vector<unsigned int> rank = void_and_cluster(w, seed);
+            std::vector<bool> seen(w * w, false);
+            bool ok = rank.size() == w * w;
+            for(unsigned int r : rank) {
+                ok = ok && r < w * w && !seen[r];
+                if(r < w * w) seen[r] = true;
+            }
+            CHECK(ok);
+        }
+    }
+}
+
+/// Thresholding at any level gives evenly spread points: the k lowest (and k highest) ranked
+/// pixels sit at least half their ideal spacing sqrt(N/k) apart, where white noise puts some
+/// side by side.
+/// Adjacent pixels' ranks also differ by more than white noise's N/3 on average.
+void well_separated() {
+
+    std::vector<unsigned int> rank = void_and_cluster(W, RNG::pcg_hash(1));
+    std::vector<unsigned int> white(N);
+    for(unsigned int i = 0; i < N; i++) white[i] = i;
+    RNG rng(7);
+    for(unsigned int i = N - 1; i > 0; i--) std::swap(white[i], white[rng.range(0, i + 1)]);
+
+    auto min_dist2 = [](const std::vector<unsigned int>& r, unsigned int lo, unsigned int hi) {
+        std::vector<unsigned int> pts;
+        for(unsigned int i = 0; i < N; i++) {
+            if(r[i] >= lo && r[i] < hi) pts.push_back(i);
+        }
+        unsigned int best = ~0u;
+        for(size_t a = 0; a < pts.size(); a++) {
+            for(size_t b = a + 1; b < pts.size(); b++) best = std::min(best, dist2(pts[a], pts[b]));
+        }
+        return best;
+    };
+
+    for(unsigned int k : {N / 64, N / 16, N / 4}) {
+        float spacing2 = (float)N / k;
+        unsigned int low = min_dist2(rank, 0, k), high = min_dist2(rank, N - k, N);
+        unsigned int w = min_dist2(white, 0, k);
+        std::printf("k = %4u: min distance^2 %u / %u, white %u, ideal %.1f\n", k, low, high, w,
+                    spacing2);
+        CHECK(low >= 0.25f * spacing2);
+        CHECK(high >= 0.25f * spacing2);
+        CHECK(w <= 2);
+    }
+
+    auto neighbour_diff = [](const std::vector<unsigned int>& r) {
+        double sum = 0.0;
+        for(unsigned int i = 0; i < N; i++) {
+            unsigned int x = i % W, y = i / W;
+            unsigned int right = y * W + (x + 1) % W, down = ((y + 1) % W) * W + x;
+            sum += std::abs((double)r[i] - r[right]) + std::abs((double)r[i] - r[down]);
+        }
+        return sum / (2.0 * N * N);
+    };
+    double blue = neighbour_diff(rank), noise = neighbour_diff(white);
+    std::printf("mean neighbour rank difference / N: %.3f, white %.3f\n", blue, noise);
+    CHECK(blue > 0.4);
+    CHECK_NEAR(noise, 1.0 / 3.0, 0.02);
+}
+
+/// Integrates a Gaussian over [0,1)^2 per pixel at 1, 2 and 4 spp with raygen.glsl's blue_noise_2d
+/// (R2 lattice rotated by the mask) and with independent random points. Per pixel the error is
+/// no worse, and lower once the lattice stratifies; after a 3x3 blur, roughly what the eye or a
+/// denoiser does, blue noise's error is at most 0.6x white noise's since it sits at high
+/// frequencies. Measured: 0.57x, 0.47x and 0.24x at 1, 2 and 4 spp.
+void error_vs_white() {
+
+    std::vector<float> mx = channel(0), my = channel(1);
+    auto f = [](float x, float y) {
+        float dx = x - 0.5f, dy = y - 0.5f;
+        return std::exp(-8.0 * (dx * dx + dy * dy));
+    };
+    const double exact = 0.3926990816987241 * std::pow(std::erf(std::sqrt(2.0)), 2.0);
+
+    auto blurred_rms = [](const std::vector<double>& e) {
+        double sq = 0.0;
+        for(unsigned int i = 0; i < N; i++) {
+            unsigned int x = i % W, y = i / W;
+            double sum = 0.0;
+            for(unsigned int dy = W - 1; dy <= W + 1; dy++) {
+                for(unsigned int dx = W - 1; dx <= W + 1; dx++) {
+                    sum += e[((y + dy) % W) * W + (x + dx) % W];
+                }
+            }
+            sq += (sum / 9.0) * (sum / 9.0);
+        }
+        return std::sqrt(sq / N);
+    };
+    auto rms = [](const std::vector<double>& e) {
+        double sq = 0.0;
+        for(double v : e) sq += v * v;
+        return std::sqrt(sq / N);
+    };
+
+    std::printf("spp   blue rms  white rms   blue blur  white blur\n");
+    for(uint32_t spp : {1u, 2u, 4u}) {
+        std::vector<double> blue(N), white(N);
+        for(unsigned int i = 0; i < N; i++) {
+            double b = 0.0, w = 0.0;
+            RNG rng(i, 0, 0, 0);
+            for(uint32_t s = 0; s < spp; s++) {
+                // blue_noise_2d for dimension pair 0
+                uint32_t index = Sobol::nested_uniform_scramble(s, Sobol::hash(1));
+                float lx = (float)((index * 0xC13FA9A9u) >> 8) * (1.0f / 16777216.0f);
+                float ly = (float)((index * 0x91E10DA6u) >> 8) * (1.0f / 16777216.0f);
+                float x = mx[i] + lx, y = my[i] + ly;
+                b += f(x - std::floor(x), y - std::floor(y));
+                w += f(rng.unit(), rng.unit());
+            }
+            blue[i] = b / spp - exact;
+            white[i] = w / spp - exact;
+        }
+        double br = rms(blue), wr = rms(white), bb = blurred_rms(blue), wb = blurred_rms(white);
+        std::printf("%3u %10.4f %10.4f %11.4f %11.4f\n", spp, br, wr, bb, wb);
+        CHECK(br <= wr * (spp == 1 ? 1.05 : 0.9));
+        CHECK(bb <= wb * 0.6);
+    }
+}
+
+} // namespace
+
+int main() {
+    is_permutation();
+    well_separated();
+    error_vs_white();
+    return Test::result();
+}
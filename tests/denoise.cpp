@@ -0,0 +1,153 @@
+
+#include "test.h"
+
+#include <lib/pack.h>
+#include <lib/rng.h>
+#include <util/denoise.h>
+#include <vector>
+
+namespace {
+
+// Not a multiple of four, so the SIMD path also runs partial blocks
+const unsigned int W = 250, H = 141;
+
+/// A noisy render of a floor and a wall under sky, with its packed G-buffer
+struct Scene {
+    std::vector<float> color, moments, truth;
+    std::vector<uint32_t> depth, norm, alb;
+    Mat4 rays;
+};
+
+Scene render(int history) {
+
+    Mat4 iV = Mat4::look_at(Vec3{0.0f, 1.5f, 4.0f}, Vec3{0.0f, 1.0f, 0.0f}).inverse();
+    Mat4 iP = Mat4::project(60.0f, (float)W / H, 0.1f).inverse();
+
+    Scene s;
+    s.rays = Pack::ray_matrix(iV, iP);
+    s.color.assign(W * H * 4, 1.0f);
+    s.moments.assign(W * H * 4, 1.0f);
+    s.truth.assign(W * H * 4, 1.0f);
+    s.depth.assign(W * H, 0);
+    s.norm.assign(W * H, 0);
+    s.alb.assign(W * H, 0);
+
+    RNG rng(1);
+    Vec3 o = iV[3].xyz();
+    for(unsigned int y = 0; y < H; y++) {
+        for(unsigned int x = 0; x < W; x++) {
+            size_t i = (size_t)y * W + x;
+            Vec2 jitter{rng.unit(), rng.unit()};
+            Vec3 d = Pack::gbuf_ray(s.rays, x, y, jitter, W, H);
+
+            // Nearest of the floor y = 0 and the wall z = -2, or sky (no infinities, the
+            // tests build with -ffast-math)
+            const float miss = 1e30f;
+            float t_floor = d.y < 0.0f ? -o.y / d.y : miss;
+            float t_wall = d.z < 0.0f ? (-2.0f - o.z) / d.z : miss;
+            float t = std::min(t_floor, t_wall);
+
+            Vec3 light{0.6f, 0.7f, 0.9f}, albedo{1.0f};
+            if(t < miss) {
+                Vec3 p = o + t * d;
+                Vec3 n = t == t_floor ? Vec3{0.0f, 1.0f, 0.0f} : Vec3{0.0f, 0.0f, 1.0f};
+                bool check = ((int)std::floor(p.x * 2.0f) + (int)std::floor(p.z * 2.0f)) & 1;
+                albedo = t == t_floor ? Vec3{check ? 0.8f : 0.2f} : Vec3{0.7f, 0.4f, 0.3f};
+                light = Vec3{0.5f + 0.4f * std::sin(p.x * 3.0f) * std::cos(p.y * 2.0f)};
+                s.depth[i] = Pack::pack_depth(t, jitter);
+                s.norm[i] = Pack::pack_normal(n);
+                s.alb[i] = Pack::pack_albedo(albedo);
+                albedo = Pack::unpack_albedo(s.alb[i]);
+            }
+
+            // history samples of 2u, mean 1 and variance 1/3 each
+            float m1 = 0.0f, m2 = 0.0f;
+            Vec3 sum;
+            for(int k = 0; k < history; k++) {
+                float v = 2.0f * rng.unit();
+                float l = 0.299f * light.x * v + 0.587f * light.y * v + 0.114f * light.z * v;
+                sum += light * albedo * v;
+                m1 += l;
+                m2 += l * l;
+            }
+            for(int c = 0; c < 3; c++) {
+                s.color[4 * i + c] = sum[c] / history;
+                s.truth[4 * i + c] = light[c] * albedo[c];
+            }
+            s.moments[4 * i + 0] = m1 / history;
+            s.moments[4 * i + 1] = m2 / history;
+            s.moments[4 * i + 2] = (float)history;
+        }
+    }
+    return s;
+}
+
+/// Distance between two non-negative floats in units in the last place
+uint32_t ulps(float a, float b) {
+    uint32_t x = Pack::float_bits(a), y = Pack::float_bits(b);
+    return x > y ? x - y : y - x;
+}
+
+double rmse(const std::vector<float>& a, const std::vector<float>& b) {
+    double sum = 0.0;
+    for(size_t i = 0; i < a.size(); i++) sum += (a[i] - b[i]) * (a[i] - b[i]);
+    return std::sqrt(sum / a.size());
+}
+
+/// svgf and svgf_reference filter the same packed inputs to the same image, within a bound that
+/// grows by 10 ULPs per a-trous pass. The two can't be bit-exact: the reference mirrors
+/// svgf.comp's exp and pow, where the SIMD path has polynomial exp_ps and log_ps (about 2 ULPs
+/// each, pow folded into the exponent as phi_normal * log), divides via one reciprocal of the
+/// weight sum and sums the kernel taps in a different order. Neither uses FMA (the tests build
+/// for baseline x86-64). That bounds one pass's error at about 8 ULPs; each pass is a normalized
+/// weighted mean, so the error it inherits from the last pass carries through unamplified and
+/// the total grows linearly. Measured worst: 7, 11, 14, 22 and 22 ULPs after 1 to 5 passes.
+/// Covers the spatial variance estimate of short histories and the temporal one of long
+/// histories, and checks the filter actually denoises.
+void simd_matches_reference() {
+
+    const uint32_t ULPS_PER_PASS = 10;
+    for(int history : {1, 8}) {
+        Scene s = render(history);
+        Util::SVGF_Input in;
+        in.w = W;
+        in.h = H;
+        in.color = s.color.data();
+        in.moments = s.moments.data();
+        in.depth = s.depth.data();
+        in.norm = s.norm.data();
+        in.alb = s.alb.data();
+        in.rays = s.rays;
+        in.history = history;
+
+        std::vector<float> ref(W * H * 4), simd(W * H * 4);
+        Util::SVGF_Params params;
+        for(int passes = 1; passes <= 5; passes++) {
+            params.iterations = passes;
+            Util::svgf_reference(in, params, ref.data());
+            Util::svgf(in, params, simd.data());
+
+            uint32_t worst = 0;
+            bool finite = true;
+            for(size_t i = 0; i < ref.size(); i++) {
+                worst = std::max(worst, ulps(ref[i], simd[i]));
+                finite = finite && (Pack::float_bits(ref[i]) & 0x7f800000u) != 0x7f800000u &&
+                         ref[i] >= 0.0f;
+            }
+            std::printf("history %d, %d passes: worst %u ulps\n", history, passes, worst);
+            CHECK(finite);
+            CHECK(worst <= ULPS_PER_PASS * passes);
+        }
+
+        double before = rmse(s.color, s.truth), after = rmse(ref, s.truth);
+        std::printf("history %d: rmse %.4f -> %.4f\n", history, before, after);
+        CHECK(after < 0.5 * before);
+    }
+}
+
+} // namespace
+
+int main() {
+    simd_matches_reference();
+    return Test::result();
+}
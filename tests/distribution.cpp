@@ -0,0 +1,125 @@
+
+#include "test.h"
+
+#include <lib/rng.h>
+#include <util/distribution.h>
+
+using namespace Util;
+
+namespace {
+
+/// A 16x8 function with a large dynamic range and one empty cell
+std::vector<float> make_function(unsigned int w, unsigned int h, unsigned int empty) {
+    RNG rng(1);
+    std::vector<float> f(w * h);
+    for(float& v : f) v = 10.0f * rng.unit() * rng.unit();
+    f[empty] = 0.0f;
+    return f;
+}
+
+/// Largest relative error of the sampled histogram against f after n samples
+double histogram_error(const Distribution_2D& dist, const std::vector<float>& f, size_t n,
+                       uint32_t seed, std::vector<double>& hist) {
+
+    RNG rng(seed);
+    hist.assign(f.size(), 0.0);
+    for(size_t i = 0; i < n; i++) {
+        float pdf;
+        Vec2 uv = dist.sample(Vec2{rng.unit(), rng.unit()}, pdf);
+        unsigned int x = std::min((unsigned int)(uv.x * dist.w), dist.w - 1);
+        unsigned int y = std::min((unsigned int)(uv.y * dist.h), dist.h - 1);
+        hist[y * dist.w + x] += 1.0;
+    }
+
+    double sum = 0.0, err = 0.0;
+    for(float v : f) sum += v;
+    for(size_t i = 0; i < f.size(); i++) {
+        double expected = f[i] / sum;
+        err = std::max(err, std::abs(hist[i] / n - expected) / std::max(expected, 1e-3));
+    }
+    return err;
+}
+
+void sample_pdf_agree() {
+
+    const unsigned int w = 16, h = 8, empty = 5;
+    std::vector<float> f = make_function(w, h, empty);
+    Distribution_2D dist;
+    dist.build(f, w, h);
+
+    // The density integrates to one over the unit square
+    double integral = 0.0;
+    for(unsigned int y = 0; y < h; y++) {
+        for(unsigned int x = 0; x < w; x++) {
+            integral += dist.pdf(Vec2{(x + 0.5f) / w, (y + 0.5f) / h}) / (w * h);
+        }
+    }
+    CHECK_NEAR(integral, 1.0, 1e-4);
+
+    // Samples land in [0,1)^2 with the density pdf() reports there, and never in the empty cell
+    RNG rng(2);
+    double worst = 0.0;
+    bool in_range = true, hit_empty = false;
+    for(int i = 0; i < 100000; i++) {
+        float pdf;
+        Vec2 uv = dist.sample(Vec2{rng.unit(), rng.unit()}, pdf);
+        in_range = in_range && uv.x >= 0.0f && uv.x < 1.0f && uv.y >= 0.0f && uv.y < 1.0f;
+        worst = std::max(worst, (double)std::abs(pdf - dist.pdf(uv)) / dist.pdf(uv));
+        unsigned int x = std::min((unsigned int)(uv.x * w), w - 1);
+        unsigned int y = std::min((unsigned int)(uv.y * h), h - 1);
+        hit_empty = hit_empty || y * w + x == empty;
+    }
+    CHECK(in_range);
+    CHECK(!hit_empty);
+    CHECK_NEAR(worst, 0.0, 1e-5);
+}
+
+void histogram_converges() {
+
+    const unsigned int w = 16, h = 8;
+    std::vector<float> f = make_function(w, h, 5);
+    Distribution_2D dist;
+    dist.build(f, w, h);
+
+    // Monte Carlo error falls as 1/sqrt(n): 16x the samples should cut it about 4x
+    std::vector<double> hist;
+    double coarse = histogram_error(dist, f, 125000, 3, hist);
+    double fine = histogram_error(dist, f, 2000000, 4, hist);
+    std::printf("histogram error: %.4f at 125k samples, %.4f at 2M\n", coarse, fine);
+    CHECK(fine < 0.05);
+    CHECK(fine < coarse * 0.5);
+    CHECK(hist[5] == 0.0);
+}
+
+void degenerate_inputs() {
+
+    // An all-zero function samples uniformly and reports a zero density
+    std::vector<float> zero(4 * 4, 0.0f);
+    Distribution_2D dist;
+    dist.build(zero, 4, 4);
+    float pdf = 1.0f;
+    Vec2 uv = dist.sample(Vec2{0.3f, 0.7f}, pdf);
+    CHECK(pdf == 0.0f);
+    CHECK(dist.pdf(uv) == 0.0f);
+    CHECK_NEAR(uv.x, 0.3, 1e-6);
+    CHECK_NEAR(uv.y, 0.7, 1e-6);
+
+    // A 1D sample inverts the CDF: u at a segment boundary maps to that boundary
+    float f[] = {1.0f, 3.0f};
+    Distribution_1D line;
+    line.build(f, 2);
+    size_t offset;
+    float x = line.sample(0.25f, pdf, offset);
+    CHECK(offset == 1);
+    CHECK_NEAR(x, 0.5, 1e-6);
+    CHECK_NEAR(pdf, 1.5, 1e-6);
+}
+
+} // namespace
+
+int main() {
+    sample_pdf_agree();
+    histogram_converges();
+    degenerate_inputs();
+    return Test::result();
+}
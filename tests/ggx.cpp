@@ -0,0 +1,119 @@
+
+#include "test.h"
+
+#include <lib/ggx.h>
+#include <lib/rng.h>
+#include <vector>
+
+namespace {
+
+const int THETA_BINS = 16, PHI_BINS = 32;
+
+GGX_Shade shade(float cos_theta) {
+    float sin_theta = std::sqrt(1.0f - cos_theta * cos_theta);
+    return {-Vec3{sin_theta, 0.0f, cos_theta}, Vec3{1.0f, 0.0f, 0.0f}, Vec3{0.0f, 1.0f, 0.0f},
+            Vec3{0.0f, 0.0f, 1.0f}};
+}
+
+Vec3 direction(float cos_theta, float phi) {
+    float sin_theta = std::sqrt(1.0f - cos_theta * cos_theta);
+    return Vec3{sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta};
+}
+
+/// Probability of each (cos theta, phi) bin, integrating GGX_pdf with a midpoint rule
+std::vector<double> integrate_pdf(float roughness, const GGX_Shade& sh) {
+    const int sub = 16;
+    std::vector<double> bins(THETA_BINS * PHI_BINS, 0.0);
+    double area = (1.0 / THETA_BINS) * (2.0 * PI_F / PHI_BINS) / (sub * sub);
+    for(int t = 0; t < THETA_BINS; t++) {
+        for(int p = 0; p < PHI_BINS; p++) {
+            double sum = 0.0;
+            for(int i = 0; i < sub; i++) {
+                for(int j = 0; j < sub; j++) {
+                    float c = (t + (i + 0.5f) / sub) / THETA_BINS;
+                    float phi = (p + (j + 0.5f) / sub) / PHI_BINS * 2.0f * PI_F;
+                    sum += GGX_pdf(roughness, sh, direction(c, phi));
+                }
+            }
+            bins[t * PHI_BINS + p] = sum * area;
+        }
+    }
+    return bins;
+}
+
+/// GGX_sample draws directions with the density GGX_pdf reports: its histogram over the
+/// hemisphere matches the pdf integrated over each bin, and the pdf's mass equals the fraction
+/// of samples that come out above the surface
+void histogram_matches_pdf() {
+
+    const int n = 500000;
+    for(float roughness : {0.1f, 0.3f, 0.7f}) {
+        for(float cos_theta : {0.9f, 0.5f, 0.1f}) {
+
+            GGX_Shade sh = shade(cos_theta);
+            std::vector<double> expected = integrate_pdf(roughness, sh);
+            std::vector<double> hist(expected.size(), 0.0);
+
+            RNG rng(7);
+            int valid = 0;
+            for(int i = 0; i < n; i++) {
+                Vec3 wi;
+                if(!GGX_sample(Vec2{rng.unit(), rng.unit()}, roughness, sh, wi)) continue;
+                valid++;
+                float phi = std::atan2(wi.y, wi.x);
+                if(phi < 0.0f) phi += 2.0f * PI_F;
+                int t = std::min((int)(wi.z * THETA_BINS), THETA_BINS - 1);
+                int p = std::min((int)(phi / (2.0f * PI_F) * PHI_BINS), PHI_BINS - 1);
+                hist[t * PHI_BINS + p] += 1.0 / n;
+            }
+
+            // Each bin within four standard deviations of its binomial count, plus the
+            // quadrature error of sharp lobes
+            double mass = 0.0, worst = 0.0;
+            for(size_t b = 0; b < hist.size(); b++) {
+                double sigma = std::sqrt(expected[b] * (1.0 - expected[b]) / n);
+                worst = std::max(worst, std::abs(hist[b] - expected[b]) / (4.0 * sigma + 5e-4));
+                mass += expected[b];
+            }
+            std::printf("roughness %.1f, cos %.1f: pdf mass %.4f, valid %.4f, worst bin %.2f\n",
+                        roughness, cos_theta, mass, (double)valid / n, worst);
+            CHECK(worst <= 1.0);
+            CHECK_NEAR(mass, (double)valid / n, 0.002);
+        }
+    }
+}
+
+/// eval / pdf of a sample is the GGX estimate of directional albedo; with a white F0 it stays
+/// at or below one and matches the same integral done by uniform hemisphere sampling
+void albedo_consistent() {
+
+    for(float roughness : {0.2f, 0.6f}) {
+        GGX_Shade sh = shade(0.7f);
+        RNG rng(3);
+        const int n = 400000;
+        double importance = 0.0, uniform = 0.0;
+        for(int i = 0; i < n; i++) {
+            Vec3 wi;
+            if(GGX_sample(Vec2{rng.unit(), rng.unit()}, roughness, sh, wi)) {
+                float pdf = GGX_pdf(roughness, sh, wi);
+                if(pdf > 0.0f) importance += GGX_eval(Vec3{1.0f}, roughness, sh, wi).x / pdf;
+            }
+            Vec3 d = direction(rng.unit(), 2.0f * PI_F * rng.unit());
+            uniform += GGX_eval(Vec3{1.0f}, roughness, sh, d).x * 2.0f * PI_F;
+        }
+        importance /= n;
+        uniform /= n;
+        std::printf("roughness %.1f: albedo %.4f sampled, %.4f uniform\n", roughness,
+                    importance, uniform);
+        CHECK(importance <= 1.0);
+        CHECK_NEAR(importance, uniform, 0.02);
+    }
+}
+
+} // namespace
+
+int main() {
+    histogram_matches_pdf();
+    albedo_consistent();
+    return Test::result();
+}
@@ -0,0 +1,178 @@
+
+#include "test.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <lib/pack.h>
+#include <util/image.h>
+#include <vector>
+
+using namespace Util;
+
+namespace {
+
+const Image_Format formats[] = {Image_Format::rgba8, Image_Format::rgba8_srgb,
+                                Image_Format::rgba16f, Image_Format::rgba32f};
+
+/// Linear RGBA floats of every texel
+std::vector<float> linear(const Image& img) {
+    std::vector<float> ret((size_t)img.w() * img.h() * 4);
+    decode(img.data(), img.format(), ret.data(), (size_t)img.w() * img.h());
+    return ret;
+}
+
+/// 64 x 4 texels of format that cover every 8-bit code in each channel, or for the float
+/// formats, 0, 1 and values spread over [0, 1] down to 1e-4
+Image source(Image_Format format) {
+    const unsigned int w = 64, h = 4;
+    std::vector<float> v((size_t)w * h * 4);
+    for(size_t i = 0; i < v.size(); i++) {
+        unsigned int code = (unsigned int)((i / 4 + 64 * (i % 4)) % 256);
+        v[i] = code / 255.0f;
+        if(texel_bytes(format) > 4 && code && code < 255) v[i] = std::pow(10.0f, -4.0f * v[i]);
+    }
+    Image f(w, h, Image_Format::rgba32f);
+    std::memcpy(f.data(), v.data(), v.size() * sizeof(float));
+    return f.convert(format);
+}
+
+/// Converting to any format and back is exact where the middle format holds every value of the
+/// first (any format through rgba32f, the 8-bit ones through rgba16f). Otherwise each linear
+/// value moves by at most the middle format's rounding: through the 8-bit formats, half of
+/// rgba8's step plus half of rgba8_srgb's step near 1, 1.7 / 255 in all, so within 2 / 255; and
+/// 2^-11 relative through rgba16f.
+void round_trips() {
+
+    for(Image_Format a : formats) {
+        Image src = source(a);
+        std::vector<float> before = linear(src);
+
+        for(Image_Format b : formats) {
+            Image back = src.convert(b).convert(a);
+            std::vector<float> after = linear(back);
+
+            bool exact = a == b || b == Image_Format::rgba32f ||
+                         (b == Image_Format::rgba16f && texel_bytes(a) == 4);
+            double worst = 0.0;
+            for(size_t i = 0; i < before.size(); i++) {
+                double err = std::abs((double)after[i] - before[i]);
+                if(b == Image_Format::rgba16f) err /= std::max(std::abs(before[i]), 1e-30f);
+                worst = std::max(worst, err);
+            }
+
+            bool ok = exact ? same_texels(src.view(), back.view())
+                            : worst <= (b == Image_Format::rgba16f ? 1.0 / 2048.0 : 2.0 / 255.0);
+            if(!ok) std::printf("    %s -> %s: worst %g\n", format_name(a), format_name(b), worst);
+            CHECK(ok);
+        }
+    }
+}
+
+/// Crops keep the parent's stride: converting from a crop of one image into a crop of another
+/// reads and writes only the cropped texels, and a packed copy of a crop hashes the same
+void sub_views() {
+
+    Image src(13, 9, Image_Format::rgba8);
+    for(size_t i = 0; i < src.bytes(); i++) src.data()[i] = (unsigned char)(i * 7 + 3);
+
+    Image_Const_View crop = src.view().crop(3, 2, 7, 5);
+    CHECK(crop.stride == 13 * 4 && crop.row_bytes() == 7 * 4 && crop.bytes() == 7 * 5 * 4);
+    CHECK(!crop.packed() && src.view().packed());
+    CHECK(crop.texel(0, 0) == src.data() + (2 * 13 + 3) * 4);
+    CHECK(crop.crop(1, 1, 2, 2).texel(0, 0) == src.view().texel(4, 3));
+
+    // Sentinel everywhere, so writes outside the crop show up
+    Image dst(11, 8, Image_Format::rgba32f);
+    std::vector<float> fill((size_t)11 * 8 * 4, -7.0f);
+    std::memcpy(dst.data(), fill.data(), dst.bytes());
+    Image_View window = dst.view().crop(2, 1, 7, 5);
+    convert(crop, window);
+
+    bool inside = true, outside = true;
+    for(unsigned int y = 0; y < 8; y++) {
+        for(unsigned int x = 0; x < 11; x++) {
+            const float* t = reinterpret_cast<const float*>(dst.view().texel(x, y));
+            bool in = x >= 2 && x < 9 && y >= 1 && y < 6;
+            for(int c = 0; c < 4; c++) {
+                if(in) {
+                    float expected = crop.texel(x - 2, y - 1)[c] / 255.0f;
+                    inside = inside && t[c] == expected;
+                } else {
+                    outside = outside && t[c] == -7.0f;
+                }
+            }
+        }
+    }
+    CHECK(inside);
+    CHECK(outside);
+
+    Image packed(crop);
+    CHECK(packed.w() == 7 && packed.h() == 5 && packed.view().packed());
+    CHECK(same_texels(packed.view(), crop));
+    CHECK(hash_texels(packed.view()) == hash_texels(crop));
+    CHECK(hash_texels(packed.view()) != hash_texels(src.view().crop(3, 2, 7, 4)));
+
+    // Mismatched sizes are refused and leave the destination alone
+    convert(crop, dst.view().crop(0, 0, 6, 5));
+    CHECK(reinterpret_cast<const float*>(dst.data())[0] == -7.0f);
+}
+
+/// Values at and past the ends of the range: the unorm formats clamp (> 1 to 255, negative and
+/// NaN to 0), rgba16f keeps values over 1 and negative ones to within its rounding, overflows to
+/// infinity past 65504 and keeps NaN a NaN. Each row is five texels, so the SIMD blocks and the
+/// scalar tail both see every value.
+void edge_values() {
+
+    const float nan = Pack::bits_float(0x7fc00000u);
+    const float values[] = {0.0f, 1.0f, 2.0f, 1e30f, -1.0f, nan, 0.5f / 255.0f, 65504.0f, 1e5f};
+    const int n_values = sizeof(values) / sizeof(values[0]);
+    const unsigned int w = 5;
+
+    for(int v = 0; v < n_values; v++) {
+        Image f(w, 1, Image_Format::rgba32f);
+        std::vector<float> row(w * 4, values[v]);
+        std::memcpy(f.data(), row.data(), f.bytes());
+        float x = values[v];
+        bool is_nan = v == 5;
+
+        int unorm = is_nan || x <= 0.0f ? 0 : x >= 1.0f ? 255 : (int)(x * 255.0f + 0.5f);
+        for(Image_Format to : {Image_Format::r8, Image_Format::rg8, Image_Format::rgba8,
+                               Image_Format::rgba8_srgb}) {
+            Image q = f.convert(to);
+            bool ok = true;
+            for(size_t i = 0; i < q.bytes(); i++) {
+                // sRGB color only agrees with linear at the ends; alpha stays linear
+                bool srgb = to == Image_Format::rgba8_srgb && i % 4 != 3;
+                if(!srgb || unorm == 0 || unorm == 255) ok = ok && q.data()[i] == unorm;
+            }
+            if(!ok) std::printf("    %g to %s: got %d\n", x, format_name(to), q.data()[0]);
+            CHECK(ok);
+        }
+
+        Image h = f.convert(Image_Format::rgba16f);
+        std::vector<float> back = linear(h);
+        bool ok = true;
+        for(float b : back) {
+            uint32_t bits = Pack::float_bits(b);
+            if(is_nan) {
+                ok = ok && (bits & 0x7f800000u) == 0x7f800000u && (bits & 0x7fffffu);
+            } else if(x > 65520.0f) {
+                ok = ok && bits == 0x7f800000u;
+            } else {
+                ok = ok && std::abs(b - x) <= std::abs(x) / 2048.0f;
+            }
+        }
+        if(!ok) std::printf("    %g to RGBA16F: got %g\n", x, back[0]);
+        CHECK(ok);
+    }
+}
+
+} // namespace
+
+int main() {
+    round_trips();
+    sub_views();
+    edge_values();
+    return Test::result();
+}
@@ -0,0 +1,168 @@
+
+#include "test.h"
+
+#include <cstring>
+#include <lib/pack.h>
+#include <lib/rng.h>
+
+using namespace Pack;
+
+namespace {
+
+/// Every finite half converts to float exactly and back to the same bits
+void half_round_trip() {
+    uint32_t bad = 0;
+    for(uint32_t h = 0; h < 65536; h++) {
+        if(((h >> 10) & 0x1fu) == 0x1fu) continue;
+        float f = f16_to_f32(h);
+        double mag = (h & 0x3ffu) + (((h >> 10) & 0x1fu) ? 1024.0 : 0.0);
+        double exact = std::ldexp(mag, std::max((int)((h >> 10) & 0x1fu), 1) - 25);
+        if(h & 0x8000u) exact = -exact;
+        if((double)f != exact || f32_to_f16(f) != h) bad++;
+    }
+    CHECK(bad == 0);
+}
+
+/// f32_to_f16 rounds to nearest even: the float halfway between two adjacent halves goes to the
+/// even one and its neighbours on either side go to the closer one, across subnormals and every
+/// exponent. Values past the largest half, and infinity, saturate.
+void half_rounding() {
+    uint32_t bad = 0;
+    for(uint32_t h = 0; h < 0x7bffu; h++) {
+        float lo = f16_to_f32(h), hi = f16_to_f32(h + 1);
+        float mid = lo + (hi - lo) * 0.5f;
+        uint32_t even = (h & 1u) ? h + 1 : h;
+        uint32_t mid_bits = float_bits(mid);
+        for(uint32_t sign : {0u, 0x8000u}) {
+            float s = sign ? -1.0f : 1.0f;
+            bad += f32_to_f16(s * mid) != (sign | even);
+            bad += f32_to_f16(s * bits_float(mid_bits - 1)) != (sign | h);
+            bad += f32_to_f16(s * bits_float(mid_bits + 1)) != (sign | (h + 1));
+        }
+    }
+    CHECK(bad == 0);
+
+    CHECK(f32_to_f16(65519.0f) == 0x7bffu);
+    CHECK(f32_to_f16(65520.0f) == 0x7bffu);
+    CHECK(f32_to_f16(-1e30f) == 0xfbffu);
+    CHECK(f32_to_f16(bits_float(0x7f800000u)) == 0x7bffu);
+    CHECK(f32_to_f16(std::ldexp(1.0f, -25)) == 0u);
+    CHECK(f32_to_f16(std::ldexp(1.5f, -25)) == 1u);
+    CHECK(f32_to_f16(-0.0f) == 0x8000u);
+}
+
+/// Depth codes and albedo codes decode and re-encode to the same bits; depth keeps 16 mantissa
+/// bits of the distance and the jitter to 1/16 pixel
+void depth_albedo_round_trip() {
+    RNG rng(3);
+    uint32_t bad = 0;
+    double rel = 0.0, jit = 0.0;
+    for(int i = 0; i < 1000000; i++) {
+        float t = std::exp(rng.unit() * 16.0f - 6.0f);
+        Vec2 j{rng.unit(), rng.unit()};
+        uint32_t p = pack_depth(t, j);
+        Vec2 jj;
+        float tt = unpack_depth(p, jj);
+        rel = std::max(rel, (double)std::abs(tt - t) / t);
+        jit = std::max(jit, (double)std::max(std::abs(jj.x - j.x), std::abs(jj.y - j.y)));
+        bad += pack_depth(tt, jj) != p;
+    }
+    CHECK(bad == 0);
+    CHECK(rel <= std::ldexp(1.0, -17));
+    CHECK(jit <= 1.0 / 32.0);
+    CHECK(pack_depth(0.0f, Vec2{0.5f}) == 0u);
+
+    uint32_t abad = 0;
+    for(uint32_t i = 0; i < (1u << 24); i++) {
+        uint32_t p = i | (255u << 24);
+        abad += pack_albedo(unpack_albedo(p)) != p;
+    }
+    CHECK(abad == 0);
+}
+
+double angle(Vec3 a, Vec3 b) {
+    return std::asin(std::min(cross(a, b).norm(), 1.0f)) * 180.0 / PI_F;
+}
+
+/// Octahedral normals stay within 0.004 degrees, and re-encoding a decoded normal gives a code
+/// for the same direction (on the fold both mirrored codes do); zero means "no geometry"
+void normal_round_trip() {
+    RNG rng(7);
+    double worst = 0.0, repack = 0.0;
+    uint32_t zero = 0;
+    for(int i = 0; i < 1000000; i++) {
+        Vec3 n{rng.unit() * 2.0f - 1.0f, rng.unit() * 2.0f - 1.0f, rng.unit() * 2.0f - 1.0f};
+        if(n.norm() < 1e-3f) continue;
+        n = n.unit();
+        uint32_t p = pack_normal(n);
+        Vec3 d = unpack_normal(p);
+        worst = std::max(worst, angle(n, d));
+        repack = std::max(repack, angle(d, unpack_normal(pack_normal(d))));
+        zero += p == 0;
+    }
+    std::printf("normal: worst error %.5f degrees, re-encoded %.2g degrees\n", worst, repack);
+    CHECK(worst < 0.004);
+    CHECK(repack < 1e-4);
+    CHECK(zero == 0);
+    CHECK(pack_normal(Vec3{}) == 0u);
+    CHECK(unpack_normal(0u) == Vec3{});
+}
+
+/// Positions rebuilt along the camera ray land within the jitter quantization of the hit, and
+/// far closer to the surface's plane
+void position_reconstruction() {
+    Mat4 V = Mat4::look_at(Vec3{3.0f, 2.0f, 5.0f}, Vec3{0.0f});
+    Mat4 P = Mat4::project(90.0f, 16.0f / 9.0f, 0.1f);
+    Mat4 iV = V.inverse(), iP = P.inverse();
+    const unsigned int w = 1920, h = 1080;
+
+    RNG rng(11);
+    double worst = 0.0, plane = 0.0;
+    for(int i = 0; i < 200000; i++) {
+        unsigned int x = (unsigned int)(rng.unit() * w), y = (unsigned int)(rng.unit() * h);
+        Vec2 j{rng.unit(), rng.unit()};
+        Vec3 d = gbuf_ray(ray_matrix(iV, iP), x, y, j, w, h);
+        float t = 1.0f + rng.unit() * 50.0f;
+        Vec3 pos = iV[3].xyz() + t * d;
+        Vec3 r = unpack_position(pack_depth(t, j), x, y, w, h, iV, iP);
+        worst = std::max(worst, (double)(r - pos).norm() / t);
+        plane = std::max(plane, (double)std::abs(dot(d, r - pos)) / t);
+    }
+    std::printf("position: worst error / distance %.3g, along the ray %.3g\n", worst, plane);
+    CHECK(worst < 1e-4);
+    CHECK(plane < 1e-5);
+}
+
+/// Reservoirs survive packing: counts and emission saturate, and a packed reservoir re-packs
+/// to the same bytes
+void reservoir_round_trip() {
+    Light_Reservoir r;
+    r.pos = Vec3{1.0f, 2.0f, 3.0f};
+    r.normal = Vec3{0.0f, -1.0f, 0.0f};
+    r.emissive = Vec3{10.3f, 5.1f, 70000.0f};
+    r.w_sum = 3.0f;
+    r.w = 0.5f;
+    r.n_seen = 100000;
+
+    Packed_Reservoir p = pack_reservoir(r);
+    Light_Reservoir u = unpack_reservoir(p);
+    CHECK(u.n_seen == 65535u);
+    CHECK(u.emissive.z == 65504.0f);
+    CHECK_NEAR(u.emissive.x, 10.3f, 0.01f);
+    CHECK(u.pos == r.pos && u.w_sum == r.w_sum && u.w == r.w);
+
+    Packed_Reservoir q = pack_reservoir(u);
+    CHECK(std::memcmp(&p, &q, sizeof(p)) == 0);
+}
+
+} // namespace
+
+int main() {
+    half_round_trip();
+    half_rounding();
+    depth_albedo_round_trip();
+    normal_round_trip();
+    position_reconstruction();
+    reservoir_round_trip();
+    return Test::result();
+}
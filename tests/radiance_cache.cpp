@@ -0,0 +1,100 @@
+
+#include "test.h"
+
+#include <set>
+#include <thread>
+#include <util/radiance_cache.h>
+#include <vector>
+
+using namespace Util;
+
+namespace {
+
+/// Equal up to rounding of the final division, which -ffast-math may turn into a reciprocal
+bool same(Vec3 a, Vec3 b) {
+    return (a - b).norm() <= 1e-6f * b.norm();
+}
+
+/// 200 distinct cells into 64 slots: inserts that find room keep their own value and are found
+/// again, the rest are counted as dropped and never alias another cell's value
+void collisions() {
+
+    Radiance_Cache_Params params;
+    params.capacity = 64;
+    params.min_samples = 1;
+    Radiance_Cache cache(params);
+
+    std::vector<uint64_t> keys;
+    for(int i = 0; i < 200; i++) {
+        keys.push_back(cache.key(Vec3{i * 0.5f, 0.0f, 0.0f}, Vec3{0.0f, 1.0f, 0.0f}, 1.0f));
+    }
+    CHECK(std::set<uint64_t>(keys.begin(), keys.end()).size() == keys.size());
+
+    std::vector<bool> stored(keys.size());
+    size_t n_stored = 0;
+    for(size_t i = 0; i < keys.size(); i++) {
+        stored[i] = cache.insert(keys[i], Vec3{(float)i});
+        n_stored += stored[i];
+    }
+
+    bool consistent = true;
+    for(size_t i = 0; i < keys.size(); i++) {
+        Vec3 v;
+        bool found = cache.lookup(keys[i], v);
+        consistent = consistent && found == stored[i] && (!found || same(v, Vec3{(float)i}));
+    }
+    std::printf("%zu of %zu cells stored, %zu dropped\n", n_stored, keys.size(), cache.dropped());
+    CHECK(consistent);
+    CHECK(n_stored == cache.occupied());
+    CHECK(cache.occupied() <= cache.capacity());
+    CHECK(cache.dropped() == keys.size() - n_stored);
+
+    // Clearing frees every slot
+    cache.clear();
+    Vec3 v;
+    CHECK(cache.occupied() == 0 && cache.dropped() == 0 && !cache.lookup(keys[0], v));
+}
+
+/// Eight threads insert into the same 1000 cells at once, thread t always adding t + 1; every
+/// cell is claimed exactly once and ends with the mean 4.5 (its sums are exact in float), so no
+/// add was lost or torn
+void concurrent_mean() {
+
+    Radiance_Cache_Params params;
+    params.capacity = 4096;
+    params.min_samples = 1;
+    params.max_samples = 1u << 30;
+    Radiance_Cache cache(params);
+
+    const int threads = 8, cells = 1000, rounds = 2000;
+    auto pos = [](int k) { return Vec3{k * 0.05f, 0.0f, 0.0f}; };
+
+    std::vector<std::thread> pool;
+    for(int t = 0; t < threads; t++) {
+        pool.emplace_back([&, t] {
+            for(int r = 0; r < rounds; r++) {
+                for(int k = 0; k < cells; k++) {
+                    cache.insert(pos(k), Vec3{0.0f, 1.0f, 0.0f}, 1.0f, Vec3{(float)(t + 1)});
+                }
+            }
+        });
+    }
+    for(std::thread& t : pool) t.join();
+
+    int wrong = 0;
+    for(int k = 0; k < cells; k++) {
+        Vec3 v;
+        if(!cache.lookup(pos(k), Vec3{0.0f, 1.0f, 0.0f}, 1.0f, v) || !same(v, Vec3{4.5f})) wrong++;
+    }
+    CHECK(cache.occupied() == (size_t)cells);
+    CHECK(cache.dropped() == 0);
+    CHECK(wrong == 0);
+}
+
+} // namespace
+
+int main() {
+    collisions();
+    concurrent_mean();
+    return Test::result();
+}
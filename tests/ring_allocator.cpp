@@ -0,0 +1,160 @@
+
+#include "test.h"
+
+#include <deque>
+#include <lib/rng.h>
+#include <util/ring_allocator.h>
+#include <vector>
+
+using namespace Util;
+
+namespace {
+
+/// Allocations pad up to their alignment, wrap to zero when the end of the ring is too short
+/// (the skipped bytes stay used until their batch retires), and are refused while the live
+/// bytes leave no piece big enough
+void wrap_and_padding() {
+
+    Ring_Allocator ring(100);
+    CHECK(ring.alloc(3) == 0u);
+    CHECK(ring.alloc(8, 16) == 16u && ring.used() == 24);
+    ring.submit(1);
+
+    CHECK(ring.alloc(36) == 24u);
+    ring.submit(2);
+    CHECK(ring.alloc(30) == 60u && ring.used() == 90);
+    ring.submit(3);
+    CHECK(!ring.alloc(20));
+
+    // Batch 1 frees [0, 24); 10 bytes at the end are skipped
+    ring.retire(1);
+    CHECK(ring.oldest() == 2u && ring.used() == 66);
+    CHECK(ring.alloc(20) == 0u && ring.used() == 96);
+    CHECK(!ring.alloc(8));
+    ring.submit(4);
+
+    // The skipped end belongs to batch 4, the one that wrapped, so it outlives batch 3
+    ring.retire(3);
+    CHECK(ring.oldest() == 4u && ring.used() == 30);
+    CHECK(ring.alloc(70) == 20u && ring.used() == 100);
+    CHECK(!ring.alloc(1));
+    ring.submit(5);
+    ring.retire(4);
+    CHECK(ring.used() == 70 && ring.alloc(20) == 0u);
+}
+
+/// A ring filled to its last byte refuses everything, frees in submission order, and takes a
+/// full-capacity allocation once drained
+void full_ring() {
+
+    Ring_Allocator ring(4096);
+    for(uint64_t id = 1; id <= 4; id++) {
+        CHECK(ring.alloc(1024, 256) == (id - 1) * 1024);
+        ring.submit(id);
+    }
+    CHECK(ring.used() == 4096 && !ring.alloc(1));
+
+    ring.retire(1);
+    CHECK(ring.alloc(1024) == 0u && !ring.alloc(1));
+    ring.submit(5);
+    // Submitting nothing makes no batch
+    ring.submit(6);
+    ring.retire(4);
+    CHECK(ring.oldest() == 5u && ring.used() == 1024);
+    ring.retire(6);
+    CHECK(!ring.oldest() && ring.used() == 0);
+    CHECK(ring.alloc(4096) == 0u);
+    CHECK(!ring.alloc(4097));
+}
+
+/// Random allocations, submits and retires against a byte map of which batch owns what: every
+/// offset is aligned and in bounds, no live byte is handed out twice, retire frees exactly the
+/// batches up to its id, and an idle ring can always take its whole capacity
+void randomized() {
+
+    RNG rng(7);
+    size_t allocs = 0, refused = 0;
+    bool aligned = true, disjoint = true, ordered = true, accounted = true, idle_full = true;
+
+    for(size_t capacity : {64u, 1000u, 4096u, 1u << 16}) {
+
+        struct Batch {
+            uint64_t id = 0;
+            std::vector<std::pair<size_t, size_t>> spans;
+        };
+        Ring_Allocator ring(capacity);
+        std::vector<bool> live_byte(capacity, false);
+        std::deque<Batch> live;
+        Batch open;
+        uint64_t id = 0;
+        size_t live_bytes = 0;
+
+        auto release = [&](const Batch& b) {
+            for(auto [at, size] : b.spans) {
+                for(size_t i = at; i < at + size; i++) live_byte[i] = false;
+                live_bytes -= size;
+            }
+        };
+
+        for(int step = 0; step < 100000; step++) {
+            uint32_t op = rng.range(0, 10);
+            if(op < 6) {
+                size_t size = rng.range(1, (uint32_t)(capacity / 3 + 2));
+                size_t align = (size_t)1 << rng.range(0, 5);
+                std::optional<size_t> at = ring.alloc(size, align);
+                if(!at) {
+                    refused++;
+                    continue;
+                }
+                allocs++;
+                aligned = aligned && *at % align == 0 && *at + size <= capacity;
+                if(*at + size > capacity) continue;
+                for(size_t i = *at; i < *at + size; i++) {
+                    disjoint = disjoint && !live_byte[i];
+                    live_byte[i] = true;
+                }
+                open.spans.push_back({*at, size});
+                live_bytes += size;
+            } else if(op < 8) {
+                ring.submit(++id);
+                if(!open.spans.empty()) {
+                    open.id = id;
+                    live.push_back(open);
+                }
+                open = {};
+            } else if(!live.empty()) {
+                uint64_t upto = live[rng.range(0, (uint32_t)live.size())].id;
+                ring.retire(upto);
+                while(!live.empty() && live.front().id <= upto) {
+                    release(live.front());
+                    live.pop_front();
+                }
+                ordered = ordered && (live.empty() ? !ring.oldest() : ring.oldest() == live[0].id);
+            }
+
+            accounted = accounted && ring.used() >= live_bytes && ring.used() <= capacity;
+            if(live.empty() && open.spans.empty()) accounted = accounted && ring.used() == 0;
+        }
+
+        ring.submit(++id);
+        ring.retire(id);
+        idle_full = idle_full && ring.used() == 0 && ring.alloc(capacity) == 0u;
+    }
+
+    std::printf("%zu allocations, %zu refused\n", allocs, refused);
+    CHECK(aligned);
+    CHECK(disjoint);
+    CHECK(ordered);
+    CHECK(accounted);
+    CHECK(idle_full);
+    CHECK(refused > 0 && allocs > refused);
+}
+
+} // namespace
+
+int main() {
+    wrap_and_padding();
+    full_ring();
+    randomized();
+    return Test::result();
+}
@@ -0,0 +1,147 @@
+
+#include "test.h"
+
+#include <cstring>
+#include <lib/rng.h>
+#include <thread>
+#include <unordered_set>
+#include <util/restir_gi.h>
+#include <vector>
+
+namespace {
+
+const uint32_t PIXELS = 64 * 64, FRAMES = 4, SAMPLES = 4, BOUNCES = 4, DRAWS = 8;
+
+/// FNV-1a over every draw of one (pixel, frame, sample, bounce) stream
+uint64_t hash_stream(uint32_t pixel, uint32_t frame, uint32_t sample, uint32_t bounce) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    RNG rng(pixel, frame, sample, bounce);
+    for(uint32_t i = 0; i < DRAWS; i++) {
+        float u = rng.unit();
+        uint32_t bits;
+        std::memcpy(&bits, &u, 4);
+        h = (h ^ bits) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+size_t index(uint32_t pixel, uint32_t frame, uint32_t sample, uint32_t bounce) {
+    return ((pixel * FRAMES + frame) * SAMPLES + sample) * BOUNCES + bounce;
+}
+
+/// Hashes every stream of a 64x64 image, one thread per frame
+std::vector<uint64_t> streams() {
+    std::vector<uint64_t> out(PIXELS * FRAMES * SAMPLES * BOUNCES);
+    std::vector<std::thread> threads;
+    for(uint32_t f = 0; f < FRAMES; f++) {
+        threads.emplace_back([&, f] {
+            for(uint32_t p = 0; p < PIXELS; p++) {
+                for(uint32_t s = 0; s < SAMPLES; s++) {
+                    for(uint32_t b = 0; b < BOUNCES; b++)
+                        out[index(p, f, s, b)] = hash_stream(p, f, s, b);
+                }
+            }
+        });
+    }
+    for(std::thread& t : threads) t.join();
+    return out;
+}
+
+/// Renders the CPU ReSTIR GI box, path traced or resampled; every pixel draws from streams keyed
+/// on its pixel and frame, on whichever thread its row lands
+std::vector<Vec3> render(bool restir) {
+    Util::GI_Params params;
+    params.w = 64;
+    params.h = 48;
+    params.frames = 4;
+    params.restir = restir;
+    std::vector<Vec3> out;
+    Util::gi_render(Util::GI_Scene::box(), params, out);
+    return out;
+}
+
+/// Two renders of the same frames come out the same bit for bit
+void reproducible() {
+    for(bool restir : {false, true}) {
+        std::vector<Vec3> a = render(restir), b = render(restir);
+        CHECK(a.size() == b.size() && !std::memcmp(a.data(), b.data(), a.size() * sizeof(Vec3)));
+        double sum = 0.0;
+        for(Vec3 c : a) sum += c.x + c.y + c.z;
+        CHECK(sum > 0.0);
+    }
+}
+
+/// Keys and draws match rtcommon.glsl: these values come from compiling its pcg_hash, rng_key,
+/// pcg and randf as C with uint = uint32_t, so any drift on either side shows up here
+void matches_glsl() {
+    struct Known {
+        uint32_t pixel, frame, sample, bounce, key, draws[4];
+        float unit;
+    };
+    const Known known[] = {
+        {0u, 0u, 0u, 0u, 0x8d324821u, {0x69fe209au, 0x36dff3b3u, 0xfdbc901au, 0x3ed4ba33u},
+         0.896690011f},
+        {1u, 2u, 3u, 4u, 0xfdbf7848u, {0xa70037bbu, 0xfb72e9d6u, 0x441d4006u, 0x79e49652u},
+         0.153095245f},
+        {2073599u, 255u, 7u, 3u, 0x223454cbu, {0x4266ecd1u, 0x478e0084u, 0x0c8607afu, 0xd7d019bau},
+         0.432512045f},
+        {12345u, 0u, 0u, ~0u, 0x03a6cdd9u, {0xb03246a4u, 0x2dee0953u, 0xdcaee440u, 0xa8b55781u},
+         0.623997867f},
+    };
+    CHECK(RNG::pcg_hash(0u) == 129708002u);
+    for(const Known& k : known) {
+        RNG rng(k.pixel, k.frame, k.sample, k.bounce);
+        CHECK(rng.state == k.key);
+        for(uint32_t d : k.draws) CHECK(rng.next() == d);
+        CHECK(rng.unit() == k.unit);
+    }
+}
+
+/// Changing any one coordinate gives a different stream
+void streams_distinct() {
+    std::vector<uint64_t> a = streams();
+    std::unordered_set<uint64_t> unique(a.begin(), a.end());
+    std::printf("%zu streams, %zu distinct\n", a.size(), unique.size());
+    CHECK(unique.size() == a.size());
+
+    // The keys themselves are 32 bits, so a few collide by chance among 256k; far fewer than
+    // a bad mix would give
+    std::unordered_set<uint32_t> keys;
+    for(uint32_t p = 0; p < PIXELS; p++) {
+        for(uint32_t f = 0; f < FRAMES; f++) {
+            for(uint32_t s = 0; s < SAMPLES; s++) {
+                for(uint32_t b = 0; b < BOUNCES; b++) keys.insert(RNG::key(p, f, s, b));
+            }
+        }
+    }
+    CHECK(a.size() - keys.size() < 64);
+}
+
+/// unit() is uniform on [0,1)
+void uniform() {
+    RNG rng(5, 1, 0, 2);
+    const int n = 1 << 20, bins = 64;
+    std::vector<int> hist(bins, 0);
+    bool in_range = true;
+    for(int i = 0; i < n; i++) {
+        float u = rng.unit();
+        in_range = in_range && u >= 0.0f && u < 1.0f;
+        hist[(int)(u * bins)]++;
+    }
+    double chi2 = 0.0, expected = (double)n / bins;
+    for(int h : hist) chi2 += (h - expected) * (h - expected) / expected;
+    std::printf("chi-squared over %d bins: %.1f\n", bins, chi2);
+    CHECK(in_range);
+    // 63 degrees of freedom: p = 0.001 at 103
+    CHECK(chi2 < 103.0);
+}
+
+} // namespace
+
+int main() {
+    reproducible();
+    matches_glsl();
+    streams_distinct();
+    uniform();
+    return Test::result();
+}
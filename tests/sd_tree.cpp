@@ -0,0 +1,123 @@
+
+#include "test.h"
+
+#include <lib/rng.h>
+#include <util/sd_tree.h>
+
+using namespace Util;
+
+namespace {
+
+/// Radiance with a sharp lobe around peak over a dim constant, so refined trees get deep
+float radiance(Vec3 dir, Vec3 peak) {
+    return std::pow(std::max(dot(dir, peak), 0.0f), 50.0f) + 0.01f;
+}
+
+/// Integral of f over the sphere, by a 1024^2 midpoint rule on the equal-area square
+template<typename F> double integrate(F&& f) {
+    const int n = 1024;
+    double sum = 0.0;
+    for(int y = 0; y < n; y++) {
+        for(int x = 0; x < n; x++) {
+            Vec2 p{(x + 0.5f) / n, (y + 0.5f) / n};
+            sum += f(D_Tree::square_to_dir(p));
+        }
+    }
+    return sum * 4.0 * PI_F / ((double)n * n);
+}
+
+/// Checks that pdf integrates to one, that the density sample() reports is the one pdf() gives
+/// for the same direction, and that sampling follows it: the mean of g / pdf estimates the
+/// integral of g over the pdf's support within four standard errors. Quadrants nothing was
+/// recorded in have zero density, which the path tracer covers with BRDF samples.
+template<typename Sample, typename Pdf>
+void check_sampling(Sample&& sample, Pdf&& pdf, Vec3 peak, RNG& rng) {
+
+    auto g = [&](Vec3 d) { return std::max(dot(d, peak), 0.0f); };
+    double mass = integrate(pdf);
+    double exact = integrate([&](Vec3 d) { return pdf(d) > 0.0f ? g(d) : 0.0f; });
+
+    const int n = 400000;
+    int mismatched = 0;
+    double sum = 0.0, sq = 0.0;
+    for(int i = 0; i < n; i++) {
+        float p;
+        Vec3 d = sample(Vec2{rng.unit(), rng.unit()}, p);
+        if(std::abs(p - pdf(d)) > 1e-3f * p) mismatched++;
+        double e = g(d) / p;
+        sum += e;
+        sq += e * e;
+    }
+    double mean = sum / n, error = std::sqrt((sq / n - mean * mean) / n);
+    std::printf("  pdf integrates to %.5f, E[g/p] %.4f +- %.4f (exact %.4f), %d mismatches\n",
+                mass, mean, error, exact, mismatched);
+    CHECK_NEAR(mass, 1.0, 2e-3);
+    // Directions that land exactly on a quadrant edge may round into the neighbour
+    CHECK(mismatched <= n / 100000);
+    CHECK(std::abs(mean - exact) < 4.0 * error);
+}
+
+/// A D-tree trained over several iterations stays a normalized density, however deep it gets,
+/// and samples where its pdf says it does
+void d_tree() {
+
+    RNG rng(7);
+    Vec3 peak = Vec3{0.3f, 0.5f, 0.8f}.unit();
+    D_Tree building;
+
+    for(int iter = 0; iter < 4; iter++) {
+        for(int i = 0; i < 200000; i++) {
+            Vec3 d = D_Tree::square_to_dir(Vec2{rng.unit(), rng.unit()});
+            building.record(d, radiance(d, peak) * 4.0f * PI_F);
+        }
+        D_Tree tree = building;
+        building.refine(0.01f, 20);
+
+        std::printf("iteration %d, %zu nodes\n", iter, tree.nodes.size());
+        check_sampling([&](Vec2 u, float& p) { return tree.sample(u, p); },
+                       [&](Vec3 d) { return tree.pdf(d); }, peak, rng);
+    }
+
+    // Refining clears the energy but keeps the structure it learned
+    CHECK(building.total() == 0.0f);
+    CHECK(building.nodes.size() > 1);
+}
+
+/// The same through an SD-tree: spatial leaves split once they see enough samples, and the
+/// sampling tree of every leaf passes the same checks
+void sd_tree() {
+
+    BBox bounds;
+    bounds.enclose(Vec3{0.0f});
+    bounds.enclose(Vec3{1.0f});
+    SD_Tree tree(bounds);
+
+    RNG rng(11);
+    for(int iter = 0; iter < 3; iter++) {
+        for(int i = 0; i < 100000; i++) {
+            Vec3 pos{rng.unit(), rng.unit(), rng.unit()};
+            // The lobe turns with position, so leaves learn different distributions
+            Vec3 peak = Vec3{pos.x - 0.5f, 1.0f, pos.z - 0.5f}.unit();
+            Vec3 d = D_Tree::square_to_dir(Vec2{rng.unit(), rng.unit()});
+            tree.record(pos, d, radiance(d, peak) * 4.0f * PI_F);
+        }
+        tree.refine();
+    }
+    std::printf("%zu spatial leaves after %d iterations\n", tree.n_leaves(), tree.iteration());
+    CHECK(tree.n_leaves() > 1);
+
+    for(Vec3 pos : {Vec3{0.1f, 0.2f, 0.1f}, Vec3{0.5f}, Vec3{0.9f, 0.7f, 0.8f}}) {
+        Vec3 peak = Vec3{pos.x - 0.5f, 1.0f, pos.z - 0.5f}.unit();
+        std::printf("at (%.1f, %.1f, %.1f)\n", pos.x, pos.y, pos.z);
+        check_sampling([&](Vec2 u, float& p) { return tree.sample(pos, u, p); },
+                       [&](Vec3 d) { return tree.pdf(pos, d); }, peak, rng);
+    }
+}
+
+} // namespace
+
+int main() {
+    d_tree();
+    sd_tree();
+    return Test::result();
+}
@@ -0,0 +1,206 @@
+
+#include "test.h"
+
+#include <functional>
+#include <lib/pack.h>
+#include <lib/rng.h>
+#include <util/temporal.h>
+#include <vector>
+
+namespace {
+
+const unsigned int W = 160, H = 120;
+enum Surface : int { QUAD = 1, BACKGROUND = 2 };
+
+/// Radiance that only depends on the point seen, so a correct reprojection finds it again
+float radiance(Vec3 p, int surface) {
+    return surface == QUAD ? 0.7f + 0.1f * p.x : 0.3f + 0.05f * p.x + 0.05f * p.y;
+}
+
+/// One traced frame: the packed G-buffer and the surface behind each pixel. A unit quad at
+/// z = -5 in front of a wall at z = -10, seen from a camera looking down -z.
+struct Frame {
+    Mat4 iV, iP, PV;
+    std::vector<uint32_t> depth, norm;
+    std::vector<int> surface;
+    std::vector<Vec3> pos;
+};
+
+Frame trace(Vec3 camera, uint32_t frame) {
+
+    Frame f;
+    Mat4 V = Mat4::look_at(camera, camera + Vec3{0.0f, 0.0f, -1.0f});
+    Mat4 P = Mat4::project(60.0f, (float)W / H, 0.1f);
+    f.iV = V.inverse();
+    f.iP = P.inverse();
+    f.PV = P * V;
+    f.depth.resize(W * H);
+    f.norm.resize(W * H);
+    f.surface.resize(W * H);
+    f.pos.resize(W * H);
+
+    Mat4 rays = Pack::ray_matrix(f.iV, f.iP);
+    for(unsigned int y = 0; y < H; y++) {
+        for(unsigned int x = 0; x < W; x++) {
+            size_t i = (size_t)y * W + x;
+            RNG rng((uint32_t)i, frame, 0, 0);
+            Vec2 jitter{rng.unit(), rng.unit()};
+            Vec3 d = Pack::gbuf_ray(rays, x, y, jitter, W, H);
+
+            float t = (-5.0f - camera.z) / d.z;
+            Vec3 p = camera + t * d;
+            f.surface[i] = QUAD;
+            if(std::abs(p.x) >= 1.0f || std::abs(p.y) >= 1.0f) {
+                t = (-10.0f - camera.z) / d.z;
+                f.surface[i] = BACKGROUND;
+            }
+            f.depth[i] = Pack::pack_depth(t, jitter);
+            f.norm[i] = Pack::pack_normal(Vec3{0.0f, 0.0f, 1.0f});
+            f.pos[i] = Pack::unpack_position(f.depth[i], x, y, W, H, f.iV, f.iP);
+        }
+    }
+    return f;
+}
+
+Util::Temporal_Frame view(const Frame& f, const std::vector<float>& accum,
+                          const std::vector<float>& moments) {
+    Util::Temporal_Frame t;
+    t.w = W;
+    t.h = H;
+    t.depth = f.depth.data();
+    t.norm = f.norm.data();
+    t.accum = accum.data();
+    t.moments = moments.data();
+    t.iV = f.iV;
+    t.iP = f.iP;
+    return t;
+}
+
+/// Fills the RGBA images of an estimate: color c(i) in every channel, its luma moments and
+/// the given history length
+void fill(std::vector<float>& accum, std::vector<float>& moments, float history,
+          const std::function<float(size_t)>& c) {
+    accum.assign(W * H * 4, 1.0f);
+    moments.assign(W * H * 4, 1.0f);
+    for(size_t i = 0; i < W * H; i++) {
+        float v = c(i);
+        for(int k = 0; k < 3; k++) accum[4 * i + k] = v;
+        moments[4 * i + 0] = v;
+        moments[4 * i + 1] = v * v;
+        moments[4 * i + 2] = history;
+    }
+}
+
+/// Whether the last frame's pixels around where pos lands all saw the given surface
+bool landed_on(const Frame& prev, Vec3 pos, int surface) {
+    Vec4 p = prev.PV * Vec4(pos, 1.0f);
+    float x = (p.x / p.w * 0.5f + 0.5f) * W, y = (p.y / p.w * 0.5f + 0.5f) * H;
+    int bx = (int)std::floor(x), by = (int)std::floor(y);
+    for(int qy = by - 1; qy <= by + 2; qy++) {
+        for(int qx = bx - 1; qx <= bx + 2; qx++) {
+            if(qx < 0 || qy < 0 || qx >= (int)W || qy >= (int)H) return false;
+            if(prev.surface[(size_t)qy * W + qx] != surface) return false;
+        }
+    }
+    return true;
+}
+
+/// With the camera still, every pixel keeps a running mean of its estimates, up to max_frames
+void static_running_mean() {
+
+    Frame f = trace(Vec3{0.0f}, 0);
+    Util::Temporal_Params params;
+    params.reproject = false;
+    params.max_frames = 6;
+
+    std::vector<float> accum, moments, cur_accum, cur_moments;
+    fill(accum, moments, 1.0f, [](size_t) { return 0.0f; });
+
+    // Estimates 1, 2, ..., 8: the mean of the first n is (n + 1) / 2 until the history caps,
+    // after which each new frame gets weight 1 / 6
+    float expected = 0.0f;
+    bool ok = true;
+    for(int frame = 1; frame <= 8; frame++) {
+        fill(cur_accum, cur_moments, 0.0f, [&](size_t) { return (float)frame; });
+        std::vector<float> out_accum, out_moments;
+        Util::Temporal_Frame prev = view(f, accum, moments), cur = view(f, cur_accum, cur_moments);
+        if(frame == 1) prev.accum = nullptr;
+        Util::temporal_accumulate(prev, cur, params, out_accum, out_moments);
+
+        float n = (float)std::min(frame, params.max_frames);
+        expected += (frame - expected) / n;
+        for(size_t i = 0; i < W * H; i++) {
+            ok = ok && std::abs(out_accum[4 * i] - expected) < 1e-5f;
+            ok = ok && out_moments[4 * i + 2] == n;
+        }
+        accum = out_accum;
+        moments = out_moments;
+    }
+    CHECK(ok);
+}
+
+/// Moving the camera sideways by a known amount: pixels that saw the same surface last frame
+/// find their own radiance again and extend their history, while background the quad hid
+/// last frame starts over from this frame's estimate alone.
+void camera_move_and_disocclusion() {
+
+    Frame prev = trace(Vec3{0.0f}, 0);
+    Frame cur = trace(Vec3{0.8f, 0.2f, 0.0f}, 1);
+
+    std::vector<float> prev_accum, prev_moments, cur_accum, cur_moments;
+    fill(prev_accum, prev_moments, 10.0f,
+         [&](size_t i) { return radiance(prev.pos[i], prev.surface[i]); });
+    fill(cur_accum, cur_moments, 0.0f, [](size_t) { return 0.25f; });
+
+    Util::Temporal_Params params;
+    params.prev_PV = prev.PV;
+    std::vector<float> accum, moments;
+    Util::temporal_accumulate(view(prev, prev_accum, prev_moments),
+                              view(cur, cur_accum, cur_moments), params, accum, moments);
+
+    // Last frame's samples sat at their own jitter, which bilinear weights do not see, so the
+    // reprojected radiance is off by up to the change across about a pixel
+    double step = 0.0;
+    for(size_t i = 0; i + W < W * H; i++) {
+        for(size_t j : {i + 1, i + W}) {
+            if(j == i + 1 && j % W == 0) continue;
+            if(cur.surface[i] != cur.surface[j]) continue;
+            float a = radiance(cur.pos[i], cur.surface[i]);
+            float b = radiance(cur.pos[j], cur.surface[j]);
+            step = std::max(step, (double)std::abs(a - b));
+        }
+    }
+
+    int kept = 0, disoccluded = 0;
+    double worst_kept = 0.0, worst_history = 0.0;
+    bool restarted = true;
+    for(size_t i = 0; i < W * H; i++) {
+        int s = cur.surface[i];
+        if(landed_on(prev, cur.pos[i], s)) {
+            // History 10 plus this frame, blending in 0.25 with weight 1 / 11
+            float old = radiance(cur.pos[i], s);
+            float expected = old + (0.25f - old) / 11.0f;
+            worst_kept = std::max(worst_kept, (double)std::abs(accum[4 * i] - expected));
+            worst_history = std::max(worst_history, (double)std::abs(moments[4 * i + 2] - 11.0f));
+            kept++;
+        } else if(s == BACKGROUND && landed_on(prev, cur.pos[i], QUAD)) {
+            restarted = restarted && accum[4 * i] == 0.25f && moments[4 * i + 2] == 1.0f;
+            disoccluded++;
+        }
+    }
+    std::printf("%d pixels reprojected (worst error %.2e, pixel step %.2e), %d disoccluded\n",
+                kept, worst_kept, step, disoccluded);
+    CHECK(kept > (int)(W * H / 2));
+    CHECK(disoccluded > 100);
+    CHECK(worst_kept < step);
+    CHECK(worst_history < 1e-4);
+    CHECK(restarted);
+}
+
+} // namespace
+
+int main() {
+    static_running_mean();
+    camera_move_and_disocclusion();
+    return Test::result();
+}
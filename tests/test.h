@@ -0,0 +1,38 @@
+
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+
+// Checks for the CPU tests. A failed check prints where and why and the test carries on, so one
+// run reports every failure; main returns Test::result() for ctest.
+
+namespace Test {
+
+inline int failures = 0;
+
+inline bool report(bool ok, const char* file, int line, const char* what) {
+    if(!ok) {
+        std::printf("%s:%d: check failed: %s\n", file, line, what);
+        failures++;
+    }
+    return ok;
+}
+
+inline int result() {
+    if(failures) std::printf("%d check(s) failed\n", failures);
+    return failures ? 1 : 0;
+}
+
+} // namespace Test
+
+/// Expression must be true
+#define CHECK(...) Test::report(!!(__VA_ARGS__), __FILE__, __LINE__, #__VA_ARGS__)
+
+/// |a - b| <= tol; prints both values on failure
+#define CHECK_NEAR(a, b, tol)                                                                      \
+    [&](double _a, double _b) {                                                                    \
+        bool ok = std::abs(_a - _b) <= (double)(tol);                                              \
+        if(!ok) std::printf("    %s = %g, %s = %g\n", #a, _a, #b, _b);                             \
+        return Test::report(ok, __FILE__, __LINE__, #a " ~ " #b " within " #tol);                  \
+    }((a), (b))
@@ -0,0 +1,127 @@
+
+#include "test.h"
+
+#include <cstring>
+#include <util/texture_budget.h>
+#include <vector>
+
+using namespace Util;
+
+namespace {
+
+/// Views of a few small images: the same texels padded and packed, a changed texel, and the
+/// same bytes under another size or format are told apart
+void duplicates() {
+
+    Image a(4, 4, Image_Format::rgba8), padded(6, 5, Image_Format::rgba8);
+    for(size_t i = 0; i < a.bytes(); i++) a.view().data[i] = (unsigned char)(i * 7);
+    Image_View inner = padded.view().crop(1, 1, 4, 4);
+    for(unsigned int y = 0; y < 4; y++) std::memcpy(inner.row(y), a.view().row(y), 16);
+
+    Image copy(a.view()), changed(a.view());
+    changed.view().data[37] ^= 1u;
+    Image wide(8, 2, Image_Format::rgba8), red(16, 4, Image_Format::r8);
+    std::memcpy(wide.view().data, a.data(), a.bytes());
+    std::memcpy(red.view().data, a.data(), a.bytes());
+
+    std::vector<Image_Const_View> views = {a.view(),    changed.view(), inner,
+                                           wide.view(), red.view(),     copy.view()};
+    std::vector<unsigned int> first = find_duplicates(views);
+    CHECK(!inner.packed());
+    CHECK(first == std::vector<unsigned int>{0, 1, 0, 3, 4, 0});
+}
+
+/// Texels whose hashes collide are still compared in full. Hashing runs over 8 byte words as
+/// h = (h ^ w) * prime, so a second word can be chosen that brings any first word back to the
+/// same hash.
+void hash_collision() {
+
+    Image a(4, 1, Image_Format::rgba8), b(4, 1, Image_Format::rgba8);
+    uint64_t wa[2] = {0x0123456789abcdefull, 0x1122334455667788ull}, wb[2];
+    const uint64_t prime = 0x100000001b3ull;
+
+    uint32_t key[3] = {4, 1, (uint32_t)Image_Format::rgba8};
+    uint64_t seed = hash_bytes(key, sizeof(key));
+    wb[0] = wa[0] ^ 0xff00ull;
+    wb[1] = ((seed ^ wa[0]) * prime) ^ ((seed ^ wb[0]) * prime) ^ wa[1];
+    std::memcpy(a.view().data, wa, 16);
+    std::memcpy(b.view().data, wb, 16);
+
+    CHECK(hash_texels(a.view(), seed) == hash_texels(b.view(), seed));
+    CHECK(!same_texels(a.view(), b.view()));
+    Image c(b.view());
+    std::vector<unsigned int> first = find_duplicates({a.view(), b.view(), c.view()});
+    CHECK(first == std::vector<unsigned int>{0, 1, 1});
+}
+
+/// A chain of levels from size down to one texel, four times smaller each
+Budget_Item chain(size_t size, float weight) {
+    Budget_Item item;
+    for(size_t s = size; s >= 1; s /= 4) item.level_bytes.push_back(s);
+    item.weight = weight;
+    return item;
+}
+
+size_t resident(const Budget_Item& item, unsigned int first) {
+    size_t sum = 0;
+    for(size_t l = first; l < item.level_bytes.size(); l++) sum += item.level_bytes[l];
+    return sum;
+}
+
+/// Fits report their sizes honestly, stay under the budget, and keep resident sizes in
+/// proportion to weight: every item that lost levels ends up within one level step (a factor
+/// of four) of the same bytes per unit of weight
+void budget() {
+
+    std::vector<Budget_Item> items;
+    for(float weight : {1.0f, 16.0f, 3.0f, 0.5f, 40.0f, 7.0f}) {
+        items.push_back(chain(4u << 20, weight));
+    }
+    items.push_back(chain(1u << 20, 2.0f));
+    items.push_back(chain(64u << 10, 0.0f));
+
+    Budget_Fit all = fit_budget(items, 0);
+    size_t full = 0;
+    for(size_t i = 0; i < items.size(); i++) full += resident(items[i], 0);
+    CHECK(all.full_bytes == full && all.bytes == full);
+    CHECK(fit_budget(items, full).bytes == full);
+
+    for(size_t budget : {(size_t)24 << 20, (size_t)6 << 20, (size_t)1 << 20, (size_t)100 << 10}) {
+        Budget_Fit fit = fit_budget(items, budget);
+        size_t sum = 0;
+        double lo = 1e30, hi = 0.0;
+        for(size_t i = 0; i < items.size(); i++) {
+            size_t bytes = resident(items[i], fit.first_level[i]);
+            sum += bytes;
+            if(items[i].weight == 0.0f) {
+                CHECK(fit.first_level[i] + 1 == items[i].level_bytes.size());
+            } else if(fit.first_level[i] > 0) {
+                double per_weight = (double)bytes / items[i].weight;
+                lo = std::min(lo, per_weight);
+                hi = std::max(hi, per_weight);
+            }
+        }
+        std::printf("budget %zu KB: %zu KB resident, bytes per weight %.0f to %.0f\n",
+                    budget >> 10, fit.bytes >> 10, lo, hi);
+        CHECK(fit.bytes == sum && fit.full_bytes == full);
+        CHECK(fit.bytes <= budget);
+        CHECK(hi <= 4.0 * lo);
+    }
+
+    // Too small for even the last levels: everything keeps its smallest level anyway
+    Budget_Fit tiny = fit_budget(items, 4);
+    bool smallest = true;
+    for(size_t i = 0; i < items.size(); i++) {
+        smallest = smallest && tiny.first_level[i] + 1 == items[i].level_bytes.size();
+    }
+    CHECK(smallest && tiny.bytes == items.size());
+}
+
+} // namespace
+
+int main() {
+    duplicates();
+    hash_collision();
+    budget();
+    return Test::result();
+}
@@ -0,0 +1,90 @@
+
+#include "test.h"
+
+#include <util/mipmap.h>
+#include <util/texture_sampler.h>
+#include <vector>
+
+using namespace Util;
+
+namespace {
+
+const unsigned int SIZE = 1024, HEIGHT = 1080;
+
+/// A unit square mapped to the whole texture, facing +z
+Cone_Triangle plane(float bend = 0.0f) {
+    Vec3 pos[3] = {Vec3{0.0f}, Vec3{1.0f, 0.0f, 0.0f}, Vec3{0.0f, 1.0f, 0.0f}};
+    Vec3 n{0.0f, 0.0f, 1.0f};
+    Vec3 norm[3] = {n, Vec3{bend, 0.0f, 1.0f}.unit(), n};
+    Vec2 uv[3] = {Vec2{0.0f}, Vec2{1.0f, 0.0f}, Vec2{0.0f, 1.0f}};
+    return cone_triangle(pos, norm, uv);
+}
+
+/// A 1024^2 texture tiled once per unit, seen head on through a 90 degree, 1080 pixel tall
+/// camera: a pixel covers 2 d / 1080 units at distance d, so 2048 d / 1080 texels, and the LOD
+/// is the log2 of that. Seen at 60 degrees the footprint doubles, one level more.
+void lod_matches_footprint() {
+
+    Image base(SIZE, SIZE, Image_Format::rgba8);
+    Texture_Sampler sampler({base.view()});
+    for(float d : {1.0f, 10.0f, 100.0f}) {
+        float expected = std::log2(SIZE * 2.0f * d / HEIGHT);
+        Ray_Cone head_on = Ray_Cone::camera(90.0f, HEIGHT), slanted = head_on;
+        float lod = sampler.lod(head_on.hit(d, 1.0f, plane()));
+        float lod_60 = sampler.lod(slanted.hit(d, 0.5f, plane()));
+        std::printf("distance %5.1f: lod %.4f, expected %.4f\n", d, lod, expected);
+        CHECK_NEAR(lod, expected, 1e-3);
+        CHECK_NEAR(lod_60, expected + 1.0f, 1e-3);
+    }
+
+    // Bouncing off a curved surface widens the cone, flat surfaces leave it be
+    Ray_Cone flat = Ray_Cone::camera(90.0f, HEIGHT), curved = flat;
+    float spread = flat.spread;
+    flat.hit(10.0f, 1.0f, plane());
+    curved.hit(10.0f, 1.0f, plane(1.0f));
+    CHECK(flat.spread == spread);
+    CHECK(curved.spread > 10.0f * spread);
+}
+
+/// Trilinear filtering: whole LODs are bilinear lookups into one level, fractional ones blend
+/// the two around them, and coordinates wrap around
+void trilinear() {
+
+    Image base(SIZE, SIZE, Image_Format::rgba8);
+    Image_View v = base.view();
+    for(unsigned int y = 0; y < SIZE; y++) {
+        for(unsigned int x = 0; x < SIZE; x++) {
+            unsigned char* t = v.texel(x, y);
+            t[0] = (unsigned char)(x ^ y);
+            t[1] = (unsigned char)((x / 8 + y / 8) % 2 * 255);
+            t[2] = (unsigned char)(y / 4);
+            t[3] = 255;
+        }
+    }
+    std::vector<Image> mips = build_mips(base.view());
+    std::vector<Image_Const_View> levels = {base.view()};
+    for(const Image& m : mips) levels.push_back(m.view());
+    Texture_Sampler sampler(levels);
+    CHECK(sampler.levels() == 11);
+
+    Vec2 uv{0.3137f, 0.7071f};
+    Vec4 l2 = sampler.bilinear(uv, 2), l3 = sampler.bilinear(uv, 3);
+    Vec4 whole = sampler.sample(uv, 2.0f), half = sampler.sample(uv, 2.5f);
+    Vec4 wrapped = sampler.bilinear(uv + Vec2{1.0f, -1.0f}, 0), own = sampler.bilinear(uv, 0);
+    for(int c = 0; c < 4; c++) {
+        CHECK_NEAR(whole[c], l2[c], 1e-6);
+        CHECK_NEAR(half[c], 0.5f * (l2[c] + l3[c]), 1e-5);
+        CHECK_NEAR(wrapped[c], own[c], 1e-4);
+    }
+    // Past the last level the 1x1 mip is the mean
+    Vec4 last = sampler.sample(uv, 20.0f), top = sampler.bilinear(Vec2{0.0f}, 10);
+    CHECK_NEAR(last.y, top.y, 1e-6);
+}
+
+} // namespace
+
+int main() {
+    lod_matches_footprint();
+    trilinear();
+    return Test::result();
+}
@@ -0,0 +1,100 @@
+
+#include "test.h"
+
+#include <algorithm>
+#include <util/tonemap.h>
+#include <vector>
+
+using namespace Util;
+
+namespace {
+
+// tonemap.frag, transcribed line by line in double precision
+double Uncharted2Tonemap(double color) {
+    double A = 0.15, B = 0.50, C = 0.10, D = 0.20, E = 0.02, F = 0.30;
+    return ((color * (A * color + C * B) + D * E) / (color * (A * color + B) + D * F)) - E / F;
+}
+double tonemapUT(double color, double exposure, double gamma) {
+    double outcol = Uncharted2Tonemap(color * exposure);
+    outcol = outcol * (1.0 / Uncharted2Tonemap(11.2));
+    return std::pow(outcol, 1.0 / gamma);
+}
+double tonemapExp(double color, double exposure, double gamma) {
+    double c = 1.0 - std::exp(-color * exposure);
+    return std::pow(c, 1.0 / gamma);
+}
+
+/// What the swapchain stores for one channel: the shader's output clamped, sRGB encoded by an
+/// R8G8B8A8_SRGB target (or not), and rounded to the nearest byte
+int frag(double color, const Tonemap_Params& p) {
+    double v = color;
+    if(p.curve == Tonemap_Curve::uncharted2) v = tonemapUT(color, p.exposure, p.gamma);
+    if(p.curve == Tonemap_Curve::exponential) v = tonemapExp(color, p.exposure, p.gamma);
+    v = std::clamp(v, 0.0, 1.0);
+    if(p.srgb) v = v <= 0.0031308 ? 12.92 * v : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055;
+    return (int)std::floor(v * 255.0 + 0.5);
+}
+
+/// Channel values of zero and from 1e-14 to 1e3, dense enough that every curve reaches each of
+/// the 256 output codes, in RGBA texels with an alpha ramp
+std::vector<float> sweep() {
+    std::vector<float> texels;
+    const int n = 1 << 18;
+    for(int i = 0; i < n; i++) {
+        float v = i ? (float)std::pow(10.0, -14.0 + 17.0 * i / (n - 1)) : 0.0f;
+        texels.insert(texels.end(), {v, v * 0.5f, v * 2.0f, (float)i / (n - 1)});
+    }
+    return texels;
+}
+
+/// Tonemapper::run (SSE curve and the gamma + sRGB table) stays within one step of tonemap.frag
+/// across both curves, several exposures and gammas, with and without the sRGB store. The sweep
+/// makes the shader produce every one of the 256 output codes, so the whole range is compared.
+void matches_frag() {
+
+    std::vector<float> in = sweep();
+    size_t n = in.size() / 4;
+    std::vector<unsigned char> out(in.size());
+
+    for(Tonemap_Curve curve : {Tonemap_Curve::uncharted2, Tonemap_Curve::exponential}) {
+        for(float exposure : {0.25f, 1.0f, 8.0f}) {
+            for(float gamma : {1.0f, 2.2f}) {
+                for(bool srgb : {true, false}) {
+                    Tonemap_Params p;
+                    p.curve = curve;
+                    p.exposure = exposure;
+                    p.gamma = gamma;
+                    p.srgb = srgb;
+                    Tonemapper(p).run(in.data(), out.data(), (unsigned int)(n / 512), 512);
+
+                    int worst = 0;
+                    std::vector<bool> hit(256, false);
+                    for(size_t i = 0; i < n; i++) {
+                        for(int c = 0; c < 3; c++) {
+                            int expected = frag(in[i * 4 + c], p);
+                            worst = std::max(worst, std::abs(out[i * 4 + c] - expected));
+                            hit[expected] = true;
+                        }
+                        int alpha = (int)std::floor(in[i * 4 + 3] * 255.0 + 0.5);
+                        worst = std::max(worst, std::abs(out[i * 4 + 3] - alpha));
+                    }
+                    bool every = std::all_of(hit.begin(), hit.end(), [](bool b) { return b; });
+                    if(worst > 1 || !every) {
+                        std::printf("curve %d exposure %g gamma %g srgb %d: max step %d%s\n",
+                                    (int)curve, exposure, gamma, srgb, worst,
+                                    every ? "" : ", some codes never reached");
+                    }
+                    CHECK(worst <= 1);
+                    CHECK(every);
+                }
+            }
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    matches_frag();
+    return Test::result();
+}
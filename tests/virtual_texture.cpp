@@ -0,0 +1,217 @@
+
+#include "test.h"
+
+#include <cstring>
+#include <filesystem>
+#include <util/mipmap.h>
+#include <util/virtual_texture.h>
+#include <vector>
+
+using namespace Util;
+
+namespace {
+
+/// Page_Cache hands out free slots, then evicts least recently used first, never a page used in
+/// the current frame or a pinned one
+void lru() {
+
+    Page_Cache cache(3);
+    uint32_t evicted = 0;
+    CHECK(cache.insert(10, 1, false, &evicted) >= 0 && evicted == NO_PAGE);
+    CHECK(cache.insert(11, 1) >= 0 && cache.insert(12, 1) >= 0);
+    CHECK(cache.insert(13, 1) == -1);
+
+    // 10 was touched last, so 11 is the oldest
+    CHECK(cache.touch(10, 2) && !cache.touch(13, 2));
+    int slot11 = cache.find(11);
+    CHECK(cache.insert(13, 2, false, &evicted) == slot11 && evicted == 11);
+    CHECK(cache.find(11) == -1 && cache.find(13) == slot11);
+
+    // Pinned pages stay however old they get
+    CHECK(cache.insert(20, 3, true, &evicted) >= 0 && evicted == 12);
+    CHECK(cache.insert(21, 4, false, &evicted) >= 0 && evicted == 10);
+    CHECK(cache.insert(22, 5, false, &evicted) >= 0 && evicted == 13);
+    CHECK(cache.insert(23, 6, false, &evicted) >= 0 && evicted == 21);
+    CHECK(cache.find(20) >= 0 && cache.resident() == 3);
+
+    // Every slot pinned or used this frame
+    CHECK(cache.touch(23, 7) && cache.insert(24, 7, true) >= 0);
+    CHECK(cache.insert(25, 7) == -1);
+}
+
+/// An opaque texel that tells its texture and position apart from the others
+uint32_t texel(unsigned int tex, unsigned int x, unsigned int y) {
+    return ((tex * 0x9e3779b9u) ^ (x * 0x85ebca6bu) ^ (y * 0xc2b2ae35u)) | 0xff000000u;
+}
+
+Image texture(unsigned int tex, unsigned int w, unsigned int h, Image_Format format) {
+    Image img(w, h, format);
+    Image_View v = img.view();
+    for(unsigned int y = 0; y < h; y++) {
+        for(unsigned int x = 0; x < w; x++) {
+            uint32_t t = texel(tex, x, y);
+            std::memcpy(v.texel(x, y), &t, 4);
+        }
+    }
+    return img;
+}
+
+/// Every page carries PAGE_BORDER texels of its neighbours on each side, wrapping around the
+/// level's edges like REPEAT addressing, including pages the level only partly covers
+void borders() {
+
+    Image img = texture(0, 300, 200, Image_Format::rgba8);
+    Image_Const_View level = img.view();
+    std::vector<unsigned char> page(PAGE_BYTES);
+    size_t bad = 0;
+    for(unsigned int py = 0; py < 2; py++) {
+        for(unsigned int px = 0; px < 3; px++) {
+            cut_page(level, px, py, page.data());
+            for(unsigned int j = 0; j < PAGE_SLOT; j++) {
+                for(unsigned int i = 0; i < PAGE_SLOT; i++) {
+                    int x = (int)(px * PAGE_SIZE + i) - (int)PAGE_BORDER;
+                    int y = (int)(py * PAGE_SIZE + j) - (int)PAGE_BORDER;
+                    unsigned int sx = (unsigned int)((x + 300) % 300);
+                    unsigned int sy = (unsigned int)((y + 200) % 200);
+                    bad += std::memcmp(&page[((size_t)j * PAGE_SLOT + i) * 4],
+                                       level.texel(sx, sy), 4) != 0;
+                }
+            }
+        }
+    }
+    CHECK(bad == 0);
+}
+
+/// A cooked set of textures: one sRGB and two linear, so both pools are used
+struct Cooked {
+    std::vector<Image> images;
+    std::string path;
+};
+
+Cooked cook() {
+    Cooked c;
+    c.images.push_back(texture(0, 700, 300, Image_Format::rgba8_srgb));
+    c.images.push_back(texture(1, 512, 512, Image_Format::rgba8));
+    c.images.push_back(texture(2, 200, 1000, Image_Format::rgba8));
+    std::vector<Image_Const_View> views;
+    for(const Image& img : c.images) views.push_back(img.view());
+    std::string dir = (std::filesystem::temp_directory_path() / "gpurt-test-vt").string();
+    c.path = cook_pages(views, dir);
+    return c;
+}
+
+/// Cooked pages hold the texels cut from each level of the texture's mip chain
+void cooked_pages(const Cooked& c) {
+
+    Page_File file;
+    CHECK(file.open(c.path));
+    CHECK(file.textures().size() == c.images.size());
+    std::vector<unsigned char> page(PAGE_BYTES), expected(PAGE_BYTES);
+    size_t bad = 0;
+    for(unsigned int t = 0; t < c.images.size(); t++) {
+        const VT_Texture& tex = file.textures()[t];
+        std::vector<Image> mips = build_mips(c.images[t].view());
+        for(unsigned int l = 0; l < tex.levels; l++) {
+            Image_Const_View level = l ? mips[l - 1].view() : c.images[t].view();
+            for(unsigned int y = 0; y < tex.pages_y(l); y++) {
+                for(unsigned int x = 0; x < tex.pages_x(l); x++) {
+                    uint32_t id = tex.page(l, x, y);
+                    cut_page(level, x, y, expected.data());
+                    bad += !file.read(id, page.data()) || file.texture_of(id) != t;
+                    bad += std::memcmp(page.data(), expected.data(), PAGE_BYTES) != 0;
+                }
+            }
+        }
+        CHECK(tex.pages_x(tex.levels - 1) == 1 && tex.pages_y(tex.levels - 1) == 1);
+    }
+    CHECK(bad == 0);
+}
+
+/// Streams a camera sweeping over the textures through a small cache. After every update the
+/// table maps no two pages to the same slot, every mapped slot holds that page's texels as the
+/// uploads left them, pages asked for this frame stay resident, and the pinned last levels are
+/// never evicted.
+void streaming(const Cooked& c) {
+
+    const unsigned int SLOTS = 12;
+    Page_File file;
+    file.open(c.path);
+    Virtual_Textures vt(c.path, SLOTS);
+    CHECK(vt.valid());
+
+    const std::vector<VT_Texture>& textures = vt.textures();
+    std::vector<unsigned char> pools[2] = {std::vector<unsigned char>(SLOTS * PAGE_BYTES),
+                                           std::vector<unsigned char>(SLOTS * PAGE_BYTES)};
+    std::vector<unsigned char> page(PAGE_BYTES);
+    bool mapped_once = true, contents = true, kept = true, pinned = true;
+    size_t uploads = 0;
+
+    for(unsigned int frame = 0; frame < 60; frame++) {
+
+        // A window of 2x2 pages in one texture at a time, moving one page every few frames
+        unsigned int t = (frame / 20) % textures.size();
+        const VT_Texture& tex = textures[t];
+        unsigned int level = frame % 2;
+        std::vector<uint32_t> feedback(64, NO_PAGE), asked;
+        for(unsigned int k = 0; k < 4; k++) {
+            unsigned int x = (frame / 3 + k % 2) % tex.pages_x(level);
+            unsigned int y = (k / 2) % tex.pages_y(level);
+            feedback[k * 7] = Page_Id{t, level, x, y}.pack();
+            asked.push_back(tex.page(level, x, y));
+        }
+
+        std::vector<uint32_t> before = vt.table();
+        vt.flush();
+        std::vector<Page_Upload> ups = vt.update(feedback.data(), feedback.size(), 64);
+        for(const Page_Upload& up : ups) {
+            std::memcpy(&pools[up.pool][up.slot * PAGE_BYTES], up.texels.data(), PAGE_BYTES);
+        }
+        uploads += ups.size();
+
+        const std::vector<uint32_t>& table = vt.table();
+        std::vector<int> users[2] = {std::vector<int>(SLOTS, 0), std::vector<int>(SLOTS, 0)};
+        for(uint32_t id = 0; id < table.size(); id++) {
+            if(!table[id]) continue;
+            unsigned int pool = table[id] & Virtual_Textures::POOL_BIT ? 1 : 0;
+            unsigned int slot = (table[id] & ~Virtual_Textures::POOL_BIT) - 1;
+            mapped_once = mapped_once && slot < SLOTS && users[pool][slot]++ == 0;
+            if(slot >= SLOTS) continue;
+            file.read(id, page.data());
+            contents = contents && pool == (textures[file.texture_of(id)].srgb ? 0u : 1u) &&
+                       !std::memcmp(&pools[pool][slot * PAGE_BYTES], page.data(), PAGE_BYTES);
+        }
+        for(uint32_t id : asked) kept = kept && (!before[id] || table[id] == before[id]);
+        for(const VT_Texture& tx : textures) {
+            pinned = pinned && table[tx.first_page + tx.pages() - 1] != 0;
+        }
+    }
+
+    // Every page of the last window made it in once the streamer caught up
+    vt.flush();
+    std::vector<uint32_t> none(1, NO_PAGE);
+    vt.update(none.data(), none.size(), 64);
+    const VT_Texture& last = textures[2];
+    bool resident = vt.table()[last.page(1, 19 % last.pages_x(1), 0)] != 0;
+
+    std::printf("%zu uploads, %zu evicted\n", uploads, vt.stats().evicted);
+    CHECK(mapped_once);
+    CHECK(contents);
+    CHECK(kept);
+    CHECK(pinned);
+    CHECK(resident);
+    CHECK(vt.stats().evicted > 0);
+}
+
+} // namespace
+
+int main() {
+    lru();
+    borders();
+    Cooked c = cook();
+    CHECK(!c.path.empty());
+    if(!c.path.empty()) {
+        cooked_pages(c);
+        streaming(c);
+    }
+    return Test::result();
+}